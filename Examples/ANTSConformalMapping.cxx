@@ -24,6 +24,8 @@
 
 namespace ants
 {
+namespace
+{
 template <class TFilter>
 class CommandIterationUpdate : public itk::Command
 {
@@ -60,8 +62,9 @@ public:
              << ")" << std::endl;
   }
 };
+} // namespace
 
-void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
+static void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
 {
   typedef itk::ants::CommandLineParser::OptionType OptionType;
 
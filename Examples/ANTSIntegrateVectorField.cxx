@@ -24,7 +24,7 @@
 namespace ants
 {
 template <class TField, class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 GetVectorComponent(typename TField::Pointer field, unsigned int index)
 {
   // Initialize the Moving to the displacement field
@@ -44,7 +44,7 @@ GetVectorComponent(typename TField::Pointer field, unsigned int index)
 }
 
 template <class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 SmoothImage(typename TImage::Pointer image, float sig)
 {
 // find min value
@@ -71,7 +71,7 @@ SmoothImage(typename TImage::Pointer image, float sig)
 }
 
 template <class TImage>
-void
+static void
 SmoothDeformation(typename TImage::Pointer vectorimage, float sig)
 {
   typedef itk::Vector<float, 3> VectorType;
@@ -23,8 +23,8 @@
 namespace ants
 {
 template <class TransformType>
-void WriteAffineTransformFile(typename TransformType::Pointer & transform,
-                              const std::string & filename)
+static void WriteAffineTransformFile(typename TransformType::Pointer & transform,
+                                     const std::string & filename)
 {
   itk::TransformFileWriter::Pointer transform_writer;
 
@@ -67,7 +67,7 @@ inline void PostConversionInAffine(const typename RunningAffineTransformType::Po
 }
 
 template <class TransformA>
-void DumpTransformForANTS3D(const typename TransformA::Pointer & transform, const std::string & ANTS_prefix)
+static void DumpTransformForANTS3D(const typename TransformA::Pointer & transform, const std::string & ANTS_prefix)
 {
   const int ImageDimension = 3;
 
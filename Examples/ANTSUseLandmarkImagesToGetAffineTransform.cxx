@@ -20,8 +20,8 @@ namespace ants
 // //////////////////////////////////////////////////////////////////////
 // Stripped from ANTS_affine_registration2.h
 template <class TransformType>
-void WriteAffineTransformFile(typename TransformType::Pointer & transform,
-                              const std::string & filename)
+static void WriteAffineTransformFile(typename TransformType::Pointer & transform,
+                                     const std::string & filename)
 {
   itk::TransformFileWriter::Pointer transform_writer;
 
@@ -67,7 +67,7 @@ inline void PostConversionInAffine(RunningAffineTransformPointerType& transform_
 }
 
 template <class TransformA, unsigned int ImageDimension>
-void DumpTransformForANTS3D(typename TransformA::Pointer & transform, const std::string & ANTS_prefix)
+static void DumpTransformForANTS3D(typename TransformA::Pointer & transform, const std::string & ANTS_prefix)
 {
   // ANTS transform file type
   typedef itk::AffineTransform<double, ImageDimension> AffineTransformType;
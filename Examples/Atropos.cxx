@@ -30,6 +30,8 @@
 
 namespace ants
 {
+namespace
+{
 template <class TFilter>
 class CommandIterationUpdate : public itk::Command
 {
@@ -77,6 +79,7 @@ public:
              << annealingTemperature << ")" << std::endl;
   }
 };
+} // namespace
 
 template <unsigned int ImageDimension>
 int AtroposSegmentation( itk::ants::CommandLineParser *parser )
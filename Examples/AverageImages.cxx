@@ -31,16 +31,339 @@
 #include "itkOptimalSharpeningImageFilter.h"
 #include "itkLaplacianSharpeningImageFilter.h"
 #include "itkResampleImageFilter.h"
+#include "itkMultiThreader.h"
+#include "antsAllocImage.h"
+#include "antsImageSetSlab.h"
+#include "antsParallelizeRange.h"
 #include <algorithm>
 
 namespace ants
 {
+/** Read an input image and bring it onto the grid of the average.  Images
+ *  whose header already matches the average (known from the header pass) are
+ *  used as read; only the others go through the identity resampler. */
+template <class TImage>
+typename TImage::Pointer ReadAverageImagesInput( const std::string & filename, const TImage * average,
+                                                 bool matchesAverage )
+{
+  typedef itk::ImageFileReader<TImage> ImageFileReader;
+  typename ImageFileReader::Pointer rdr = ImageFileReader::New();
+  rdr->SetFileName( filename.c_str() );
+  rdr->Update();
+  if( matchesAverage )
+    {
+    return rdr->GetOutput();
+    }
+  typedef itk::ResampleImageFilter<TImage, TImage, float> ResamplerType;
+  typename ResamplerType::Pointer resampler = ResamplerType::New();
+  // default to identity resampler->SetTransform( transform );
+  // default to linearinterp resampler->SetInterpolator( interpolator );
+  resampler->SetInput( rdr->GetOutput() );
+  resampler->SetOutputParametersFromImage( average );
+  resampler->Update();
+  return resampler->GetOutput();
+}
+
+/** The slab of an input image that already lies on the grid of the
+ *  average, streamed through the reader's requested region. */
+template <class TImage>
+typename TImage::Pointer ReadAverageImagesSlab( const std::string & filename,
+                                                const typename TImage::RegionType & slab )
+{
+  typedef itk::ImageFileReader<TImage> ImageFileReader;
+  typename ImageFileReader::Pointer rdr = ImageFileReader::New();
+  rdr->SetFileName( filename.c_str() );
+  rdr->UpdateOutputInformation();
+  rdr->GetOutput()->SetRequestedRegion( slab );
+  rdr->Update();
+  return rdr->GetOutput();
+}
+
+template <class TImage>
+struct AverageImagesPrefetchStruct
+{
+  std::string              FileName;
+  const TImage *           Average;
+  bool                     MatchesAverage;
+  typename TImage::Pointer Image;
+  std::string              Error;
+};
+
+template <class TImage>
+ITK_THREAD_RETURN_TYPE AverageImagesPrefetchCallback( void *arg )
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+  AverageImagesPrefetchStruct<TImage> * str =
+    static_cast<AverageImagesPrefetchStruct<TImage> *>( static_cast<ThreadInfoType *>( arg )->UserData );
+  try
+    {
+    str->Image = ReadAverageImagesInput<TImage>( str->FileName, str->Average, str->MatchesAverage );
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    str->Image = ITK_NULLPTR;
+    str->Error = e.what();
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** Calls visitor( image, j ) for every input in order, on the grid of the
+ *  average.  Image j + 1 is read on a background thread while the visitor
+ *  works on image j. */
+template <class TImage, class TVisitor>
+bool VisitAverageImagesInputs( const std::vector<std::string> & filenames, const TImage * average,
+                               const std::vector<bool> & matchesAverage, TVisitor & visitor )
+{
+  itk::MultiThreader::Pointer         prefetcher = itk::MultiThreader::New();
+  AverageImagesPrefetchStruct<TImage> slots[2];
+
+  for( unsigned int j = 0; j < filenames.size(); j++ )
+    {
+    std::cout << " reading " << filenames[j] << std::endl;
+    AverageImagesPrefetchStruct<TImage> & current = slots[j % 2];
+    if( j == 0 )
+      {
+      current.Image = ReadAverageImagesInput<TImage>( filenames[j], average, matchesAverage[j] );
+      }
+    if( current.Image.IsNull() )
+      {
+      std::cerr << "ERROR:  could not read " << filenames[j] << " " << current.Error << std::endl;
+      return false;
+      }
+
+    int prefetchThread = -1;
+    if( j + 1 < filenames.size() )
+      {
+      AverageImagesPrefetchStruct<TImage> & next = slots[( j + 1 ) % 2];
+      next.FileName = filenames[j + 1];
+      next.Average = average;
+      next.MatchesAverage = matchesAverage[j + 1];
+      next.Image = ITK_NULLPTR;
+      next.Error.clear();
+      prefetchThread = prefetcher->SpawnThread( AverageImagesPrefetchCallback<TImage>, &next );
+      }
+    visitor( current.Image.GetPointer(), j );
+    current.Image = ITK_NULLPTR;
+    if( prefetchThread >= 0 )
+      {
+      prefetcher->TerminateThread( prefetchThread );
+      }
+    }
+  return true;
+}
+
+/** Mean of an image, reduced in double precision over threads. */
+class AverageImagesMeanFunctor
+{
+public:
+  AverageImagesMeanFunctor( const float * buffer, itk::ThreadIdType nthreads ) :
+    m_Buffer( buffer ), m_PartialSums( nthreads, 0.0 )
+  {
+  }
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    double sum = 0;
+    for( itk::SizeValueType i = begin; i < end; i++ )
+      {
+      sum += this->m_Buffer[i];
+      }
+    this->m_PartialSums[threadId] = sum;
+  }
+
+  double GetSum() const
+  {
+    double sum = 0;
+    for( unsigned int i = 0; i < this->m_PartialSums.size(); i++ )
+      {
+      sum += this->m_PartialSums[i];
+      }
+    return sum;
+  }
+
+private:
+  const float *       m_Buffer;
+  std::vector<double> m_PartialSums;
+};
+
+template <class TImage>
+float ComputeAverageImagesInputMean( const TImage * image )
+{
+  const itk::SizeValueType nvoxels = image->GetBufferedRegion().GetNumberOfPixels();
+  const itk::ThreadIdType  nthreads = GetNumberOfThreadsForRange( nvoxels );
+  AverageImagesMeanFunctor meanFunctor( image->GetBufferPointer(), nthreads );
+
+  ParallelizeRange( 0, nvoxels, meanFunctor, nthreads );
+  float meanval = 0;
+  if( nvoxels > 0 )
+    {
+    meanval = static_cast<float>( meanFunctor.GetSum() / (double)nvoxels );
+    }
+  if( meanval <= 0 )
+    {
+    meanval = (1);
+    }
+  return meanval;
+}
+
+/** average += ( image / meanval ) / numberofimages with Kahan-compensated
+ *  float sums, so that the rounding error does not grow with the number of
+ *  images. */
+class AverageImagesKahanFunctor
+{
+public:
+  AverageImagesKahanFunctor( float * sum, float * compensation ) :
+    m_Input( ITK_NULLPTR ), m_Sum( sum ), m_Compensation( compensation ), m_MeanValue( 1 ), m_NumberOfImages( 1 )
+  {
+  }
+
+  void SetInput( const float * input, float meanval, float numberofimages )
+  {
+    this->m_Input = input;
+    this->m_MeanValue = meanval;
+    this->m_NumberOfImages = numberofimages;
+  }
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    for( itk::SizeValueType i = begin; i < end; i++ )
+      {
+      const float val = ( this->m_Input[i] / this->m_MeanValue ) / this->m_NumberOfImages;
+      const float y = val - this->m_Compensation[i];
+      const float t = this->m_Sum[i] + y;
+      this->m_Compensation[i] = ( t - this->m_Sum[i] ) - y;
+      this->m_Sum[i] = t;
+      }
+  }
+
+private:
+  const float * m_Input;
+  float *       m_Sum;
+  float *       m_Compensation;
+  float         m_MeanValue;
+  float         m_NumberOfImages;
+};
+
+template <class TImage>
+class AverageImagesMeanVisitor
+{
+public:
+  AverageImagesMeanVisitor( TImage * average, bool normalize, float numberofimages ) :
+    m_Compensation( average->GetBufferedRegion().GetNumberOfPixels(), 0.0f ),
+    m_Accumulator( average->GetBufferPointer(), &m_Compensation[0] ),
+    m_NumberOfVoxels( average->GetBufferedRegion().GetNumberOfPixels() ),
+    m_Normalize( normalize ), m_NumberOfImages( numberofimages )
+  {
+  }
+
+  void operator()( const TImage * image, unsigned int )
+  {
+    float meanval = 1;
+    if( this->m_Normalize )
+      {
+      meanval = ComputeAverageImagesInputMean<TImage>( image );
+      }
+    this->m_Accumulator.SetInput( image->GetBufferPointer(), meanval, this->m_NumberOfImages );
+    ParallelizeRange( 0, this->m_NumberOfVoxels, this->m_Accumulator );
+  }
+
+private:
+  std::vector<float>        m_Compensation;
+  AverageImagesKahanFunctor m_Accumulator;
+  itk::SizeValueType        m_NumberOfVoxels;
+  bool                      m_Normalize;
+  float                     m_NumberOfImages;
+};
+
+template <class TImage>
+class AverageImagesInputMeanVisitor
+{
+public:
+  AverageImagesInputMeanVisitor( std::vector<float> & means ) : m_Means( means )
+  {
+  }
+
+  void operator()( const TImage * image, unsigned int j )
+  {
+    this->m_Means[j] = ComputeAverageImagesInputMean<TImage>( image );
+  }
+
+private:
+  std::vector<float> & m_Means;
+};
+
+/** Voxelwise median or interquartile mean of the (voxel-major) values of a
+ *  slab, with one scratch vector per thread. */
+template <class TImage>
+class AverageImagesRobustFunctor
+{
+public:
+  AverageImagesRobustFunctor( bool median, unsigned long nimages, itk::ThreadIdType nthreads ) :
+    m_Median( median ), m_NumberOfImages( nimages ), m_Values( nthreads, std::vector<float>( nimages ) ),
+    m_Data( ITK_NULLPTR ), m_Average( ITK_NULLPTR )
+  {
+  }
+
+  void SetSlab( const typename TImage::RegionType & slab, const std::vector<float> * data, TImage * average )
+  {
+    this->m_Slab = slab;
+    this->m_Data = data;
+    this->m_Average = average;
+  }
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    std::vector<float> & values = this->m_Values[threadId];
+    const unsigned long  n = this->m_NumberOfImages;
+    const unsigned long  mid = n / 2;
+    for( itk::SizeValueType v = begin; v < end; v++ )
+      {
+      const float * in = &( *this->m_Data )[v * n];
+      std::copy( in, in + n, values.begin() );
+
+      float stat = 0;
+      if( this->m_Median )
+        {
+        std::nth_element( values.begin(), values.begin() + mid, values.end() );
+        stat = values[mid];
+        if( n % 2 == 0 )
+          {
+          stat = ( stat + *std::max_element( values.begin(), values.begin() + mid ) ) / 2;
+          }
+        }
+      else
+        {
+        // drop the lowest and the highest quarter of the values
+        const unsigned long lo = n / 4;
+        const unsigned long hi = n - n / 4;
+        std::nth_element( values.begin(), values.begin() + lo, values.end() );
+        std::nth_element( values.begin() + lo, values.begin() + hi - 1, values.end() );
+        double total = 0;
+        for( unsigned long i = lo; i < hi; i++ )
+          {
+          total += values[i];
+          }
+        stat = static_cast<float>( total / (double)( hi - lo ) );
+        }
+      this->m_Average->SetPixel( GetImageSetSlabIndex( this->m_Slab, v ), stat );
+      }
+  }
+
+private:
+  bool                             m_Median;
+  unsigned long                    m_NumberOfImages;
+  std::vector<std::vector<float> > m_Values;
+  typename TImage::RegionType      m_Slab;
+  const std::vector<float> *       m_Data;
+  TImage *                         m_Average;
+};
+
 template <unsigned int ImageDimension, unsigned int NVectorComponents>
 int AverageImages1(unsigned int argc, char *argv[])
 {
   typedef float                                        PixelType;
   typedef itk::Image<PixelType, ImageDimension>        ImageType;
-  typedef itk::ImageRegionIteratorWithIndex<ImageType> Iterator;
+  typedef itk::ImageRegionConstIterator<ImageType>     ConstIterator;
   typedef itk::ImageFileReader<ImageType>              ImageFileReader;
   typedef itk::ImageFileWriter<ImageType>              writertype;
 
@@ -54,31 +377,49 @@ int AverageImages1(unsigned int argc, char *argv[])
     }
     {
     const std::string temp(argv[3]);
-    if( !( ( temp == "0" ) || ( temp == "1" )  ) )
+    if( !( ( temp == "0" ) || ( temp == "1" ) || ( temp == "2" ) || ( temp == "3" ) || ( temp == "4" ) ||
+           ( temp == "5" ) ) )
       {
-      std::cerr << "ERROR:  Normalize option must be 0 or 1, " << temp << "given" << std::endl;
+      std::cerr << "ERROR:  Normalize option must be 0 to 5, " << temp << "given" << std::endl;
       return EXIT_FAILURE;
       }
     }
 
-  const bool  normalizei = atoi(argv[3]);
-  const float numberofimages = (float)argc - 4.;
+  // bit 0: normalize, bit 1: median, bit 2: interquartile mean
+  const unsigned int option = atoi(argv[3]);
+  const bool         normalizei = option & 1;
+  const bool         median = option & 2;
+  const bool         trimmedmean = option & 4;
+  const float        numberofimages = (float)argc - 4.;
 
+  std::vector<std::string> filenames;
+  for( unsigned int j = 4; j < argc; j++ )
+    {
+    filenames.push_back( std::string(argv[j]) );
+    }
+
+  // a single pass over the headers picks the image that defines the output
+  // space and records which inputs already live on its grid
+  std::vector<typename ImageType::Pointer> headers( filenames.size() );
   typename ImageType::SizeType maxSize;
   maxSize.Fill( 0 );
   unsigned int bigimage = 0;
-  for( unsigned int j = 4; j < argc; j++ )
+  unsigned int vectorlength = 1;
+  for( unsigned int j = 0; j < filenames.size(); j++ )
     {
-    // Get the image dimension
-    const std::string fn = std::string(argv[j]);
-    typename itk::ImageIOBase::Pointer imageIO =
-      itk::ImageIOFactory::CreateImageIO(fn.c_str(), itk::ImageIOFactory::ReadMode);
-    imageIO->SetFileName(fn.c_str() );
-    imageIO->ReadImageInformation();
+    typename ImageFileReader::Pointer reader = ImageFileReader::New();
+    reader->SetFileName( filenames[j].c_str() );
+    reader->UpdateOutputInformation();
+    headers[j] = ImageType::New();
+    headers[j]->CopyInformation( reader->GetOutput() );
+    if( j == 0 )
+      {
+      vectorlength = reader->GetImageIO()->GetNumberOfComponents();
+      }
 
     for( unsigned int i = 0; i < ImageType::ImageDimension; i++ )
       {
-      itk::SizeValueType currentDimensionSize = imageIO->GetDimensions( i );
+      itk::SizeValueType currentDimensionSize = headers[j]->GetLargestPossibleRegion().GetSize()[i];
 
       if( currentDimensionSize > maxSize[i] )
         {
@@ -87,63 +428,110 @@ int AverageImages1(unsigned int argc, char *argv[])
         }
       }
     }
-  std::cout << " bigimage " << bigimage << " maxSize " << maxSize << std::endl;
+  std::cout << " bigimage " << bigimage + 4 << " maxSize " << maxSize << std::endl;
 
-  typename ImageFileReader::Pointer reader = ImageFileReader::New();
-  reader->SetFileName(argv[bigimage]);
-  reader->Update();
-  typename ImageType::Pointer averageimage = reader->GetOutput();
   std::cout << " Setting physcal space of output average image based on largest image " << std::endl;
-  unsigned int vectorlength = reader->GetImageIO()->GetNumberOfComponents();
+  typename ImageType::Pointer averageimage = AllocImage<ImageType>( headers[bigimage]->GetLargestPossibleRegion(),
+                                                                    headers[bigimage]->GetSpacing(),
+                                                                    headers[bigimage]->GetOrigin(),
+                                                                    headers[bigimage]->GetDirection(), 0 );
+  std::vector<bool>           matchesAverage( filenames.size() );
+  for( unsigned int j = 0; j < filenames.size(); j++ )
+    {
+    matchesAverage[j] =
+      headers[j]->GetLargestPossibleRegion() == averageimage->GetLargestPossibleRegion() &&
+      headers[j]->GetSpacing() == averageimage->GetSpacing() &&
+      headers[j]->GetOrigin() == averageimage->GetOrigin() &&
+      headers[j]->GetDirection() == averageimage->GetDirection();
+    }
   std::cout << " Averaging " << numberofimages << " images with dim = " << ImageDimension << " vector components "
            << vectorlength << std::endl;
-  PixelType meanval = 0;
-  averageimage->FillBuffer(meanval);  // Reset all images to a mean of zero on the accumulator buffer.
-  for( unsigned int j = 4; j < argc; j++ )
+
+  if( !median && !trimmedmean )
     {
-    std::cout << " reading " << std::string(argv[j]) << std::endl;
-    typename ImageFileReader::Pointer rdr = ImageFileReader::New();
-    rdr->SetFileName(argv[j]);
-    rdr->Update();
-    typedef itk::ResampleImageFilter<ImageType, ImageType, float> ResamplerType;
-    typename ResamplerType::Pointer resampler = ResamplerType::New();
-    // default to identity resampler->SetTransform( transform );
-    // default to linearinterp resampler->SetInterpolator( interpolator );
-    resampler->SetInput( rdr->GetOutput() );
-    resampler->SetOutputParametersFromImage( averageimage );
-    resampler->Update();
-
-    typename ImageType::Pointer image2 = resampler->GetOutput();
-    Iterator      vfIter2( image2,  image2->GetLargestPossibleRegion() );
-    unsigned long ct = 0;
+    AverageImagesMeanVisitor<ImageType> visitor( averageimage, normalizei, numberofimages );
+    if( !VisitAverageImagesInputs<ImageType>( filenames, averageimage, matchesAverage, visitor ) )
+      {
+      return EXIT_FAILURE;
+      }
+    }
+  else
+    {
+    // the robust statistics need all values of a voxel at once, so the
+    // inputs are streamed in slabs of the output grid
+    std::vector<float> means( filenames.size(), 1.0f );
     if( normalizei )
       {
-      meanval = 0;
-      for(  vfIter2.GoToBegin(); !vfIter2.IsAtEnd(); ++vfIter2 )
+      AverageImagesInputMeanVisitor<ImageType> visitor( means );
+      if( !VisitAverageImagesInputs<ImageType>( filenames, averageimage, matchesAverage, visitor ) )
         {
-        const PixelType & localp = image2->GetPixel( vfIter2.GetIndex() );
-        meanval = meanval + localp;
-        ct++;
+        return EXIT_FAILURE;
         }
-      if( ct > 0 )
+      }
+
+    // inputs off the grid of the average are resampled once and kept; the
+    // others are streamed, or read whole once if they cannot be streamed
+    const unsigned long                      nimages = filenames.size();
+    std::vector<typename ImageType::Pointer> resampled( nimages );
+    std::vector<std::string>                 streamed;
+    for( unsigned long j = 0; j < nimages; j++ )
+      {
+      if( matchesAverage[j] )
+        {
+        streamed.push_back( filenames[j] );
+        continue;
+        }
+      try
         {
-        meanval = meanval / (float)ct;
+        resampled[j] = ReadAverageImagesInput<ImageType>( filenames[j], averageimage, false );
         }
-      if( meanval <= 0 )
+      catch( itk::ExceptionObject & e )
         {
-        meanval = (1);
+        std::cerr << "ERROR:  could not read " << filenames[j] << " " << e.what() << std::endl;
+        return EXIT_FAILURE;
         }
       }
-    for(  vfIter2.GoToBegin(); !vfIter2.IsAtEnd(); ++vfIter2 )
+
+    const typename ImageType::RegionType fullRegion = averageimage->GetLargestPossibleRegion();
+    const unsigned int                   slabAxis = ImageDimension - 1;
+    const unsigned long                  nslices = fullRegion.GetSize()[slabAxis];
+    const unsigned long                  slabThickness =
+      ImageSetCanStreamRead( streamed ) ? GetImageSetSlabThickness( fullRegion, nimages ) : nslices;
+    const itk::ThreadIdType              nthreads =
+      GetNumberOfThreadsForRange( fullRegion.GetNumberOfPixels() / nslices * slabThickness );
+
+    AverageImagesRobustFunctor<ImageType> functor( median, nimages, nthreads );
+    std::vector<float>                    data;
+    for( unsigned long first = 0; first < nslices; first += slabThickness )
       {
-      PixelType val = vfIter2.Get();
-      if( normalizei )
+      const typename ImageType::RegionType slab = GetImageSetSlab( fullRegion, first, slabThickness );
+      std::cout << " % " << (float) first / (float) nslices << std::endl;
+      data.resize( slab.GetNumberOfPixels() * nimages );
+      for( unsigned long j = 0; j < nimages; j++ )
         {
-        val /= meanval;
+        typename ImageType::Pointer image = resampled[j];
+        if( matchesAverage[j] )
+          {
+          try
+            {
+            image = ReadAverageImagesSlab<ImageType>( filenames[j], slab );
+            }
+          catch( itk::ExceptionObject & e )
+            {
+            std::cerr << "ERROR:  could not read " << filenames[j] << " " << e.what() << std::endl;
+            return EXIT_FAILURE;
+            }
+          }
+        ConstIterator It( image, slab );
+        float *       out = &data[j];
+        for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+          {
+          *out = It.Get() / means[j];
+          out += nimages;
+          }
         }
-      val = val / (float)numberofimages;
-      const PixelType & oldval = averageimage->GetPixel(vfIter2.GetIndex() );
-      averageimage->SetPixel(vfIter2.GetIndex(), val + oldval );
+      functor.SetSlab( slab, &data, averageimage );
+      ParallelizeRange( 0, slab.GetNumberOfPixels(), functor, nthreads );
       }
     }
 
@@ -313,6 +701,10 @@ private:
       <<
       " Normalize: 0 (false) or 1 (true); if true, the 2nd image is divided by its mean. This will select the largest image to average into.\n"
       << std::endl;
+    std::cout
+      <<
+      " For scalar images, add 2 to Normalize for the voxelwise median or 4 for the interquartile (25% trimmed) mean, e.g. 3 is the median of the normalized images. These robust modes stream the images in slabs.\n"
+      << std::endl;
     std::cout << " Example Usage:\n" << std::endl;
     std::cout << argv[0] << " 3 average.nii.gz  1  *.nii.gz \n" << std::endl;
     std::cout << " \n" << std::endl;
@@ -48,7 +48,7 @@ float random_range(float lowest_number, float highest_number)
   return lowest_number + (float)(range * (float)rand() / (float)(RAND_MAX) );
 }
 
-float ComputeGenus(vtkPolyData* pd1)
+static float ComputeGenus(vtkPolyData* pd1)
 {
   vtkExtractEdges* edgeex = vtkExtractEdges::New();
 
@@ -67,7 +67,7 @@ float ComputeGenus(vtkPolyData* pd1)
   return g;
 }
 
-float vtkComputeTopology(vtkPolyData* pd)
+static float vtkComputeTopology(vtkPolyData* pd)
 {
   vtkPolyDataConnectivityFilter* con = vtkPolyDataConnectivityFilter::New();
 
@@ -79,7 +79,7 @@ float vtkComputeTopology(vtkPolyData* pd)
 }
 
 template <class TImage>
-float GetImageTopology(typename TImage::Pointer image)
+static float GetImageTopology(typename TImage::Pointer image)
 {
   typedef TImage      ImageType;
   double aaParm = 0.024;
@@ -123,7 +123,7 @@ NormalizeImage(typename TImage::Pointer image)
 }
 
 template <class TImage>
-typename TImage::Pointer SmoothImage( typename TImage::Pointer image, float sig )
+static typename TImage::Pointer SmoothImage( typename TImage::Pointer image, float sig )
 {
   typedef TImage ImageType;
   enum { ImageDimension = ImageType::ImageDimension };
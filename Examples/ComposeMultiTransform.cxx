@@ -190,8 +190,8 @@ void ComposeMultiTransform(char *output_image_filename,
 }
 
 template <int ImageDimension>
-void ComposeMultiAffine(char *output_affine_txt,
-                        char *reference_affine_txt, TRAN_OPT_QUEUE & opt_queue)
+static void ComposeMultiAffine(char *output_affine_txt,
+                               char *reference_affine_txt, TRAN_OPT_QUEUE & opt_queue)
 {
   typedef itk::Image<float, ImageDimension>      ImageType;
   typedef itk::Vector<float, ImageDimension>     VectorType;
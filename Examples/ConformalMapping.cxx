@@ -233,7 +233,7 @@ void MapToSphere(typename TImage::Pointer image, int fixdir, float e)
 }
 
 template <class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 SmoothImage( typename TImage::Pointer input, double var)
 {
   typedef TImage                        ImageType;
@@ -258,7 +258,7 @@ SmoothImage( typename TImage::Pointer input, double var)
   return caster1->GetOutput();
 }
 
-float ComputeGenus(vtkPolyData* pd1)
+static float ComputeGenus(vtkPolyData* pd1)
 {
   vtkExtractEdges* edgeex = vtkExtractEdges::New();
 
@@ -278,7 +278,7 @@ float ComputeGenus(vtkPolyData* pd1)
   return g;
 }
 
-float vtkComputeTopology(vtkPolyData* pd)
+static float vtkComputeTopology(vtkPolyData* pd)
 {
   // Marching cubes
 //    std::cout << " Marching Cubes ";
@@ -433,7 +433,7 @@ void GetMeshAndCurvature(typename TImage::Pointer image, float e, const char* fi
 }
 
 template <class TImage>
-float GetImageTopology(typename TImage::Pointer image, float e, const char* filename)
+static float GetImageTopology(typename TImage::Pointer image, float e, const char* filename)
 {
   typedef TImage      ImageType;
   typedef vtkPolyData MeshType;
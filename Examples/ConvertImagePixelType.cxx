@@ -28,7 +28,7 @@
 namespace ants
 {
 template <unsigned int ImageDimension, class TPIXELTYPE>
-int ConvertType(int argc, char *argv[], double MINVAL, double MAXVAL)
+static int ConvertType(int argc, char *argv[], double MINVAL, double MAXVAL)
 {
   typedef  TPIXELTYPE                                outPixelType;
   typedef  float                                     floatPixelType;
@@ -27,7 +27,7 @@
 namespace ants
 {
 template <unsigned int ImageDimension>
-int ConvertType(int argc, char *argv[])
+static int ConvertType(int argc, char *argv[])
 {
   typedef  unsigned char                             outPixelType;
   typedef  float                                     floatPixelType;
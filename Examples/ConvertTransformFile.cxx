@@ -43,7 +43,7 @@ using namespace std;
 /*
  *
  */
-bool FileExists(string strFilename)
+static bool FileExists(string strFilename)
 {
   struct stat stFileInfo;
   bool        blnReturn;
@@ -21,7 +21,7 @@
 
 namespace ants
 {
-int CreateMosaic( itk::ants::CommandLineParser *parser )
+static int CreateMosaic( itk::ants::CommandLineParser *parser )
 {
   const unsigned int ImageDimension = 3;
 
@@ -987,7 +987,7 @@ int CreateMosaic( itk::ants::CommandLineParser *parser )
   return EXIT_SUCCESS;
 }
 
-void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
+static void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
 {
   typedef itk::ants::CommandLineParser::OptionType OptionType;
 
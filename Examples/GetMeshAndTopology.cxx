@@ -223,7 +223,7 @@ void Display(vtkUnstructuredGrid* vtkgrid, std::string offscreen, bool secondwin
     }
 }
 
-float ComputeGenus(vtkPolyData* pd1)
+static float ComputeGenus(vtkPolyData* pd1)
 {
   vtkExtractEdges* edgeex = vtkExtractEdges::New();
 
@@ -244,7 +244,7 @@ float ComputeGenus(vtkPolyData* pd1)
 }
 
 
-float vtkComputeTopology(vtkPolyData* pd)
+static float vtkComputeTopology(vtkPolyData* pd)
 {
   // Marching cubes
 //    std::cout << " Marching Cubes ";
@@ -449,7 +449,7 @@ void GetValueMesh(typename TImage::Pointer image, typename TImage::Pointer image
 }
 
 template <class TImage>
-float GetImageTopology(typename TImage::Pointer image)
+static float GetImageTopology(typename TImage::Pointer image)
 {
   typedef TImage      ImageType;
 
@@ -107,7 +107,6 @@
 #include "itkSliceTimingCorrectionImageFilter.h"
 #include "itkSphereSpatialFunction.h"
 #include "itkSplitAlternatingTimeSeriesImageFilter.h"
-#include "itkSTAPLEImageFilter.h"
 #include "itkSubtractImageFilter.h"
 #include "itkSumProjectionImageFilter.h"
 #include "itkTDistribution.h"
@@ -133,6 +132,11 @@
 #include "ReadWriteData.h"
 #include "TensorFunctions.h"
 #include "antsMatrixUtilities.h"
+#include "antsSubjectVoxelMatrix.h"
+#include "antsLabelStatistics.h"
+#include "antsTimeSeriesKernels.h"
+#include "antsImageSetSlab.h"
+#include "antsLabelFusion.h"
 #include "antsFastMarchingImageFilter.h"
 #include "itkFastMarchingImageFilterBase.h"
 #include "itkFastMarchingThresholdStoppingCriterion.h"
@@ -140,9 +144,9 @@
 namespace ants
 {
 template <class T>
-bool from_string(T& t,
-                 const std::string& s,
-                 std::ios_base & (*f)(std::ios_base &) )
+static bool from_string(T& t,
+                        const std::string& s,
+                        std::ios_base & (*f)(std::ios_base &) )
 {
   std::istringstream iss(s);
 
@@ -158,7 +162,7 @@ bool from_string(T& t,
 }
 
 template <class T>
-std::string ants_to_string(T t)
+static std::string ants_to_string(T t)
 {
   std::stringstream istream;
 
@@ -166,7 +170,7 @@ std::string ants_to_string(T t)
   return istream.str();
 }
 
-std::string ANTSOptionName(const char *str)
+static std::string ANTSOptionName(const char *str)
 {
   std::string            filename = str;
   std::string::size_type pos = filename.rfind( "=" );
@@ -175,7 +179,7 @@ std::string ANTSOptionName(const char *str)
   return name;
 }
 
-std::string ANTSOptionValue(const char *str)
+static std::string ANTSOptionValue(const char *str)
 {
   std::string            filename = str;
   std::string::size_type pos = filename.rfind( "=" );
@@ -184,7 +188,7 @@ std::string ANTSOptionValue(const char *str)
   return value;
 }
 
-std::string ANTSGetFilePrefix(const char *str)
+static std::string ANTSGetFilePrefix(const char *str)
 {
   const std::string      filename = str;
   std::string::size_type pos = filename.rfind( "." );
@@ -1047,7 +1051,7 @@ int TruncateImageIntensity( unsigned int argc, char *argv[] )
 }
 
 template <unsigned int ImageDimension>
-int TileImages(unsigned int argc, char *argv[])
+static int TileImages(unsigned int argc, char *argv[])
 {
   typedef float                                                           PixelType;
   typedef itk::Image<PixelType, ImageDimension>                           ImageType;
@@ -1406,6 +1410,38 @@ int ConvertVectorToImage(unsigned int argc, char *argv[])
   std::string vecfn = std::string(argv[argct]); argct++;
   typename ImageType::Pointer mask = ITK_NULLPTR;
   ReadImage<ImageType>(mask, maskfn.c_str() );
+
+  if( itk::ants::SubjectVoxelMatrix::IsSubjectVoxelMatrixFileName( vecfn ) )
+    {
+    // read one subject row straight out of the mapped matrix
+    unsigned long subject = 0;
+    if( argc > argct )
+      {
+      subject = atoi( argv[argct] ); argct++;
+      }
+    itk::ants::SubjectVoxelMatrix::Pointer store = itk::ants::SubjectVoxelMatrix::New();
+    if( !store->Open( vecfn ) || subject >= store->GetNumberOfSubjects() )
+      {
+      std::cout << " cannot read subject " << subject << " from " << vecfn << std::endl;
+      return EXIT_FAILURE;
+      }
+    if( !itk::ants::SubjectVoxelMatrixMatchesMask<ImageType>( store, mask ) )
+      {
+      std::cout << " the voxels of " << vecfn << " do not match the mask " << maskfn << std::endl;
+      return EXIT_FAILURE;
+      }
+    typename ImageType::Pointer outimage = AllocImage<ImageType>( mask, 0 );
+    const itk::ants::SubjectVoxelMatrix::ValueType * row = store->GetSubjectRow( subject );
+    const itk::uint64_t *                          offsets = store->GetVoxelOffsets();
+    PixelType *                                    buffer = outimage->GetBufferPointer();
+    for( unsigned long v = 0; v < store->GetNumberOfVoxels(); v++ )
+      {
+      buffer[offsets[v]] = row[v];
+      }
+    WriteImage<ImageType>(outimage, outname.c_str() );
+    return 0;
+    }
+
   typename MatrixImageType::Pointer vecimg = ITK_NULLPTR;
   ReadImage<MatrixImageType>(vecimg, vecfn.c_str() );
   unsigned long voxct = 0, mct = 0;
@@ -2956,7 +2992,6 @@ int TimeSeriesRegionCorr(int argc, char *argv[])
   typedef itk::MinimumMaximumImageCalculator<LabelImageType> LabelCalculatorType;
   typedef itk::ants::antsSCCANObject<InputImageType, double> SCCANType;
 
-  typedef typename SCCANType::MatrixType MatrixType;
   typedef typename SCCANType::VectorType VectorType;
 
   if( argc < 6 )
@@ -3002,79 +3037,26 @@ int TimeSeriesRegionCorr(int argc, char *argv[])
   connmat->Allocate();
   connmat->FillBuffer(-1);
 
-  MatrixType timeSig( nLabels, nTimes, 0.0 );
-  for( unsigned int i = 0; i < nLabels; i++ )
-    {
-    typename LabelImageType::IndexType idx;
-    idx[1] = 0;
-    for( unsigned int v = 0; v < nVoxels; v++ )
-      {
-      idx[0] = v;
-      if( labels->GetPixel(idx) == (i + 1) )
-        {
-        labelCounts[i]++;
+  // one pass over the voxels for all region means, then the correlations
+  // of all region pairs as one product of the normalized time courses
+  std::vector<double> timeSig;
+  std::vector<double> counts;
+  ::ants::ComputeRegionTimeSeriesMeans( time->GetBufferPointer(), labels->GetBufferPointer(), nVoxels, nTimes,
+                                        nLabels, timeSig, counts );
 
-        typename InputImageType::IndexType timeIdx;
-        timeIdx[1] = v;
-        for( unsigned int t = 0; t < nTimes; t++ )
-          {
-          timeIdx[0] = t;
-          timeSig(i, t) += time->GetPixel(timeIdx);
-          }
-        }
-      }
-    }
+  std::vector<unsigned char> useRegion( nLabels, 0 );
   for( unsigned int i = 0; i < nLabels; i++ )
     {
-    for( unsigned int j = 0; j < nTimes; j++ )
-      {
-      timeSig(i, j) /= labelCounts[i];
-      }
+    labelCounts[i] = counts[i];
+    useRegion[i] = ( labelCounts[i] > minRegionSize );
     }
-  for( unsigned int i = 0; i < nLabels; i++ )
-    {
-    for( unsigned int j = (i + 1); j < nLabels; j++ )
-      {
-
-      if( (labelCounts[i] > minRegionSize) && (labelCounts[j] > minRegionSize ) )
-        {
-        VectorType p = timeSig.get_row(i);
-        VectorType q = timeSig.get_row(j);
-
-        double corr = 0.0;
-        double xysum = 0;
-        for( unsigned int z = 0; z < p.size(); z++ )
-          {
-          xysum += (p[z] * q[z]);
-          }
-
-        double frac = 1.0 / (double)p.size();
-        double xsum = p.sum();
-        double ysum = q.sum();
-        double xsqr = p.squared_magnitude();
-        double ysqr = q.squared_magnitude();
-        double numer = xysum - frac * xsum * ysum;
-        double denom = sqrt( ( xsqr - frac * xsum * xsum) * ( ysqr - frac * ysum * ysum) );
-        if( denom > 0 )
-          {
-          corr = numer / denom;
-          }
-        if( !vnl_math_isfinite( corr ) )
-          {
-          corr = 0.0;
-          }
+  std::vector<double> corrs( nLabels * nLabels, -1 );
+  ::ants::ComputeRowCorrelations( timeSig, nLabels, nTimes, useRegion, corrs );
 
-        typename InputImageType::IndexType connIdx;
-        connIdx[0] = i;
-        connIdx[1] = j;
-        connmat->SetPixel( connIdx, corr );
-        connIdx[0] = j;
-        connIdx[1] = i;
-        connmat->SetPixel( connIdx, corr );
-
-        }
-
-      }
+  PixelType *connBuffer = connmat->GetBufferPointer();
+  for( unsigned int i = 0; i < nLabels * nLabels; i++ )
+    {
+    connBuffer[i] = corrs[i];
     }
 
   WriteImage<InputImageType>(connmat, outname.c_str() );
@@ -3260,9 +3242,6 @@ int ComputeTimeSeriesLeverage(int argc, char *argv[])
     }
   typedef float                                        PixelType;
   typedef itk::Image<PixelType, ImageDimension>        ImageType;
-  typedef itk::Image<PixelType, ImageDimension - 1>    OutImageType;
-  typedef typename OutImageType::IndexType             OutIndexType;
-  typedef typename ImageType::IndexType                IndexType;
 
   typedef double                                            Scalar;
   typedef itk::ants::antsMatrixUtilities<ImageType, Scalar> matrixOpType;
@@ -3283,60 +3262,29 @@ int ComputeTimeSeriesLeverage(int argc, char *argv[])
     return 1;
     }
   unsigned int timedims = image1->GetLargestPossibleRegion().GetSize()[ImageDimension - 1];
-
-  typedef itk::ExtractImageFilter<ImageType, OutImageType> ExtractFilterType;
-  typedef itk::ImageRegionIteratorWithIndex<OutImageType>  SliceIt;
-
-  typename ImageType::RegionType extractRegion = image1->GetLargestPossibleRegion();
-  extractRegion.SetSize(ImageDimension - 1, 0);
-  unsigned int sub_vol = 0;
-  extractRegion.SetIndex(ImageDimension - 1, sub_vol );
-  typename ExtractFilterType::Pointer extractFilter = ExtractFilterType::New();
-  extractFilter->SetInput( image1 );
-  //    extractFilter->SetDirectionCollapseToIdentity();
-  extractFilter->SetDirectionCollapseToSubmatrix();
-  extractFilter->SetExtractionRegion( extractRegion );
-  extractFilter->Update();
-  typename OutImageType::Pointer outimage = extractFilter->GetOutput();
-  outimage->FillBuffer(0);
-
-  typedef itk::ImageRegionIteratorWithIndex<OutImageType> SliceIt;
+  if( timedims == 0 )
+    {
+    return 1;
+    }
 
   // step 1.  compute , for each image in the time series, the effect on the average.
   // step 2.  the effect is defined as the influence of that point on the average or, more simply, the distance of that
   // image from the average ....
+  //
+  // this is a simple approach --- just the difference from the mean.  both
+  // steps stream whole volumes of the time-major buffer in parallel.
   typedef vnl_vector<Scalar> timeVectorType;
-  timeVectorType mSample(timedims, 0);
   timeVectorType mLeverage(timedims, 0);
   timeVectorType kDistance(timedims, 0);
-  SliceIt        vfIter2( outimage, outimage->GetLargestPossibleRegion() );
-  for(  vfIter2.GoToBegin(); !vfIter2.IsAtEnd(); ++vfIter2 )
+
+  const unsigned long nvoxels = image1->GetLargestPossibleRegion().GetNumberOfPixels() / timedims;
+  std::vector<double> voxelMeans;
+  std::vector<double> leverage;
+  ::ants::ComputeTimeSeriesMoments( image1->GetBufferPointer(), nvoxels, timedims, voxelMeans );
+  ::ants::ComputeTimeSeriesLeverage( image1->GetBufferPointer(), nvoxels, timedims, voxelMeans, leverage );
+  for( unsigned int t = 0; t < timedims; t++ )
     {
-    OutIndexType ind = vfIter2.GetIndex();
-    IndexType    tind;
-    // first collect all samples for that location
-    for( unsigned int i = 0; i < ImageDimension - 1; i++ )
-      {
-      tind[i] = ind[i];
-      }
-    double all_mean = 0;
-    for( unsigned int t = 0; t < timedims; t++ )
-      {
-      tind[ImageDimension - 1] = t;
-      Scalar pix = image1->GetPixel(tind);
-      mSample(t) = pix;
-      all_mean += pix;
-      }
-    // compute mean time series value at this voxel
-    all_mean /= (double)timedims;
-    // second compute the leverage for each time point and add that to the total leverage
-    //
-    // this is a simple approach --- just the difference from the mean.
-    //
-    for( unsigned int t = 0; t < timedims; t++ )
-      {
-      mLeverage(t) += fabs(all_mean - mSample(t) ) / (Scalar)timedims;
-      }
+    mLeverage(t) = leverage[t];
     }
 
   // now use k neighbors to get a distance
@@ -3995,7 +3943,6 @@ int CompCorrAuto(int argc, char *argv[])
   typedef itk::Image<PixelType, ImageDimension>        ImageType;
   typedef itk::Image<PixelType, ImageDimension - 1>    OutImageType;
   typedef typename OutImageType::IndexType             OutIndexType;
-  typedef typename ImageType::IndexType                IndexType;
 
   typedef double                                            Scalar;
   typedef itk::ants::antsMatrixUtilities<ImageType, Scalar> matrixOpType;
@@ -4084,42 +4031,30 @@ int CompCorrAuto(int argc, char *argv[])
   // step 3.  compute the correlation of the reference region with every voxel in the roi.
   typedef vnl_matrix<Scalar> timeMatrixType;
   typedef vnl_vector<Scalar> timeVectorType;
-  timeMatrixType mSample(timedims, ct_vox, 0);
-  unsigned long  nuis_vox = 0;
-  timeVectorType sample(timedims, 0);
-  //  FIRST -- get high variance (in time) voxels
+  //  FIRST -- get high variance (in time) voxels, streaming the time-major
+  //  buffer in parallel rather than gathering one voxel at a time
+  const unsigned long nvoxels = label_image->GetLargestPossibleRegion().GetNumberOfPixels();
+  if( image1->GetLargestPossibleRegion().GetNumberOfPixels() != nvoxels * timedims )
+    {
+    std::cout << " the label image does not match the spatial size of the time series " << std::endl;
+    return 1;
+    }
+  const PixelType *   labelBuffer = label_image->GetBufferPointer();
+  PixelType *         varBuffer = var_image->GetBufferPointer();
+  std::vector<double> voxelMeans;
+  std::vector<double> voxelDeviations;
+  ::ants::ComputeTimeSeriesMoments( image1->GetBufferPointer(), nvoxels, timedims, voxelMeans, &voxelDeviations );
   float maxvar = 0;
-  for(  vfIter2.GoToBegin(); !vfIter2.IsAtEnd(); ++vfIter2 )
+  for( unsigned long v = 0; v < nvoxels; v++ )
     {
-    OutIndexType ind = vfIter2.GetIndex();
-    if( vfIter2.Get() > 0 )      // in-brain
+    if( labelBuffer[v] > 0 )      // in-brain
       {
-      IndexType tind;
-      for( unsigned int i = 0; i < ImageDimension - 1; i++ )
-        {
-        tind[i] = ind[i];
-        }
-      float total = 0;
-      for( unsigned int t = 0; t < timedims; t++ )
-        {
-        tind[ImageDimension - 1] = t;
-        Scalar pix = image1->GetPixel(tind);
-        sample(t) = pix;
-        total += pix;
-        }
-      float mean = total / (float)timedims;
-      float var = 0;
-      for( unsigned int t = 0; t < timedims; t++ )
-        {
-        var += ( (sample(t) - mean) * (sample(t) - mean) );
-        }
-      var /= (float)(timedims);
-      var = sqrt(var);
+      const float var = voxelDeviations[v];
       if( var > maxvar )
         {
         maxvar = var;
         }
-      var_image->SetPixel(ind, var);
+      varBuffer[v] = var;
       }
     }
   // std::cout << " got var " << std::endl;
@@ -4157,50 +4092,32 @@ int CompCorrAuto(int argc, char *argv[])
     }
 
   // std::cout << " maxvar " << maxvar << " varval_csf " << varval_csf << std::endl;
-  ct_nuis = 0;
-  for(  vfIter2.GoToBegin(); !vfIter2.IsAtEnd(); ++vfIter2 )
+  std::vector<unsigned long> nuisVoxels;
+  std::vector<unsigned long> brainVoxels;
+  for( unsigned long v = 0; v < nvoxels; v++ )
     {
-    OutIndexType ind = vfIter2.GetIndex();
-    if( var_image->GetPixel(ind) > varval_csf  )      // nuisance
+    if( varBuffer[v] > varval_csf  )      // nuisance
       {
-      ct_nuis++;
+      nuisVoxels.push_back( v );
+      }
+    if( labelBuffer[v] > 0  )      // in brain
+      {
+      brainVoxels.push_back( v );
       }
     }
+  ct_nuis = nuisVoxels.size();
   timeMatrixType mNuisance(timedims, ct_nuis, 0);
-  nuis_vox = 0;
-  unsigned long brain_vox = 0;
-  for(  vfIter2.GoToBegin(); !vfIter2.IsAtEnd(); ++vfIter2 )
+  timeMatrixType mSample(timedims, brainVoxels.size(), 0);
+  for( unsigned int t = 0; t < timedims; t++ )
     {
-    OutIndexType ind = vfIter2.GetIndex();
-    if( var_image->GetPixel(ind) > varval_csf  )      // nuisance
+    const PixelType *volume = image1->GetBufferPointer() + t * nvoxels;
+    for( unsigned long k = 0; k < nuisVoxels.size(); k++ )
       {
-      IndexType tind;
-      for( unsigned int i = 0; i < ImageDimension - 1; i++ )
-        {
-        tind[i] = ind[i];
-        }
-      for( unsigned int t = 0; t < timedims; t++ )
-        {
-        tind[ImageDimension - 1] = t;
-        Scalar pix = image1->GetPixel(tind);
-        mNuisance(t, nuis_vox) = pix;
-        }
-      nuis_vox++;
+      mNuisance(t, k) = volume[nuisVoxels[k]];
       }
-    if( vfIter2.Get() > 0  )      // in brain
+    for( unsigned long k = 0; k < brainVoxels.size(); k++ )
       {
-      IndexType tind;
-      for( unsigned int i = 0; i < ImageDimension - 1; i++ )
-        {
-        tind[i] = ind[i];
-        }
-      for( unsigned int t = 0; t < timedims; t++ )
-        {
-        tind[ImageDimension - 1] = t;
-        Scalar pix = image1->GetPixel(tind);
-        mSample(t, brain_vox) = pix;
-        }
-      brain_vox++;
+      mSample(t, k) = volume[brainVoxels[k]];
       }
     }
   // factor out the nuisance variables by OLS
@@ -4243,27 +4160,15 @@ int CompCorrAuto(int argc, char *argv[])
     }
 
   timeMatrixType RRt = matrixOps->ProjectionMatrix(reducedNuisance);
-  mSample = matrixOps->NormalizeMatrix(mSample);
+  matrixOps->NormalizeMatrixInPlace( mSample );
   mSample = mSample - RRt * mSample;
-  brain_vox = 0;
-  for(  vfIter2.GoToBegin(); !vfIter2.IsAtEnd(); ++vfIter2 )
+  // correct the original image
+  for( unsigned int t = 0; t < timedims; t++ )
     {
-    OutIndexType ind = vfIter2.GetIndex();
-    if( vfIter2.Get() > 0 )
+    PixelType *volume = image1->GetBufferPointer() + t * nvoxels;
+    for( unsigned long k = 0; k < brainVoxels.size(); k++ )
       {
-      timeVectorType samp = mSample.get_column(brain_vox);
-// correct the original image
-      IndexType tind;
-      for( unsigned int i = 0; i < ImageDimension - 1; i++ )
-        {
-        tind[i] = ind[i];
-        }
-      for( unsigned int t = 0; t < timedims; t++ )
-        {
-        tind[ImageDimension - 1] = t;
-        image1->SetPixel(tind, samp[t]);
-        }
-      brain_vox++;
+      volume[brainVoxels[k]] = mSample(t, k);
       }
     }
   kname = tempname + std::string("_corrected") + extension;
@@ -4581,9 +4486,9 @@ int ThreeTissueConfounds(int argc, char *argv[])
   return 0;
 
   timeMatrixType RRt = matrixOps->ProjectionMatrix(reducedNuisance);
-  mReference = matrixOps->NormalizeMatrix(mReference);
+  matrixOps->NormalizeMatrixInPlace( mReference );
   mReference = mReference - RRt * mReference;
-  mSample = matrixOps->NormalizeMatrix(mSample);
+  matrixOps->NormalizeMatrixInPlace( mSample );
   mSample = mSample - RRt * mSample;
   // reduce your reference region to the first & second eigenvector
   timeVectorType vReference = matrixOps->GetCovMatEigenvector(mReference, 0);
@@ -4882,7 +4787,7 @@ int MakeImage(int argc, char *argv[])
 }
 
 template <class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 LabelSurface(typename TImage::Pointer input, typename TImage::Pointer input2  )
 {
   typedef TImage ImageType;
@@ -5685,6 +5590,139 @@ int SmoothTensorImage(int argc, char *argv[])
 
 }
 
+/**
+ * The eigenvalue and eigenvector maps of TensorFunctions.  Each thread runs
+ * its share of the tensor buffer through VisitTensorEigenSystems, so the
+ * tensors are decomposed in blocks by the batched closed-form solver, and
+ * writes the map straight into the output buffer at the same offset.
+ */
+template <class TTensorImage, class TImage, class TColorImage, class TVectorImage>
+class TensorMapFunctor
+{
+public:
+  typedef typename TTensorImage::PixelType TensorType;
+  typedef typename TImage::PixelType       PixelType;
+  typedef typename TColorImage::PixelType  RGBType;
+  typedef typename TVectorImage::PixelType VectorType;
+
+  enum MapType { FA, RadialDiffusion, Eigenvalue, AxialDiffusion, FANumerator, FADenominator,
+                 Color, ToVector, ToVectorComponent };
+
+  MapType              m_Map;
+  unsigned int         m_WhichVector;
+  const TTensorImage * m_Tensors;
+  const TImage *       m_Mask;
+  PixelType *          m_Scalars;
+  RGBType *            m_Colors;
+  VectorType *         m_Vectors;
+
+  /** Returns false for the operations that are not eigen maps. */
+  bool SetOperation( const std::string & operation )
+  {
+    const char *   names[] = { "TensorFA", "TensorRadialDiffusion", "TensorEigenvalue", "TensorAxialDiffusion",
+                               "TensorFANumerator", "TensorFADenominator", "TensorColor", "TensorToVector",
+                               "TensorToVectorComponent" };
+    const MapType  maps[] = { FA, RadialDiffusion, Eigenvalue, AxialDiffusion, FANumerator, FADenominator,
+                              Color, ToVector, ToVectorComponent };
+    for( unsigned int n = 0; n < sizeof( maps ) / sizeof( maps[0] ); n++ )
+      {
+      if( operation == names[n] )
+        {
+        this->m_Map = maps[n];
+        return true;
+        }
+      }
+    return false;
+  }
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    const bool computeEigenVectors = this->m_Map == Color || this->m_Map == ToVector
+      || ( this->m_Map == ToVectorComponent && this->m_WhichVector <= 2 );
+
+    VisitTensorEigenSystems<TensorType>( this->m_Tensors->GetBufferPointer(), begin, end,
+                                         computeEigenVectors, *this );
+  }
+
+  void operator()( itk::SizeValueType offset, const TensorType & dtv, const double D[3], const double V[3][3] )
+  {
+    float result = 0;
+
+    switch( this->m_Map )
+      {
+      case FA:
+        {
+        if( IsRealTensor<TensorType>( dtv ) )
+          {
+          result = GetTensorFA<TensorType>( dtv, D );
+          }
+        this->m_Scalars[offset] = result;
+        return;
+        }
+      case RadialDiffusion:
+        {
+        result = GetTensorADC<TensorType>( dtv, 2, D );
+        break;
+        }
+      case Eigenvalue:
+        {
+        result = GetTensorADC<TensorType>( dtv, 3 + this->m_WhichVector, D );
+        break;
+        }
+      case AxialDiffusion:
+        {
+        result = GetTensorADC<TensorType>( dtv, 5, D );
+        break;
+        }
+      case FANumerator:
+        {
+        result = GetTensorFANumerator<TensorType>( dtv, D );
+        break;
+        }
+      case FADenominator:
+        {
+        result = GetTensorFADenominator<TensorType>( dtv, D );
+        break;
+        }
+      case Color:
+        {
+        if( this->m_Mask && !( this->m_Mask->GetPixel( this->m_Tensors->ComputeIndex( offset ) ) > 0 ) )
+          {
+          this->m_Colors[offset].Fill( 0 );
+          }
+        else
+          {
+          this->m_Colors[offset] = GetTensorRGB<TensorType>( dtv, D, V );
+          }
+        return;
+        }
+      case ToVector:
+        {
+        this->m_Vectors[offset] = GetTensorPrincipalEigenvector<TensorType>( dtv, this->m_WhichVector, V );
+        return;
+        }
+      case ToVectorComponent:
+        {
+        if( this->m_WhichVector <= 2 )
+          {
+          VectorType vv = GetTensorPrincipalEigenvector<TensorType>( dtv, 2, V );
+          this->m_Scalars[offset] = vv[this->m_WhichVector];
+          }
+        else if( this->m_WhichVector > 2 && this->m_WhichVector < 9 )
+          {
+          this->m_Scalars[offset] = dtv[this->m_WhichVector];
+          }
+        return;
+        }
+      }
+    if( vnl_math_isnan( result ) )
+      {
+      result = 0;
+      }
+    this->m_Scalars[offset] = result;
+  }
+};
+
 template <unsigned int ImageDimension>
 int TensorFunctions(int argc, char *argv[])
 {
@@ -6000,212 +6038,138 @@ int TensorFunctions(int argc, char *argv[])
     }
 
 
-  RGBType rgbZero;
+  typedef TensorMapFunctor<TensorImageType, ImageType, ColorImageType, VectorImageType> TensorMapFunctorType;
 
-  rgbZero[0] = 0;
-  rgbZero[1] = 0;
-  rgbZero[2] = 0;
-
-  Iterator tIter(timage, timage->GetLargestPossibleRegion() );
-  for(  tIter.GoToBegin(); !tIter.IsAtEnd(); ++tIter )
+  TensorMapFunctorType tensorMap;
+  if( tensorMap.SetOperation( operation ) )
+    {
+    tensorMap.m_WhichVector = whichvec;
+    tensorMap.m_Tensors = timage;
+    tensorMap.m_Mask = mimage;
+    tensorMap.m_Scalars = vimage.IsNotNull() ? vimage->GetBufferPointer() : ITK_NULLPTR;
+    tensorMap.m_Colors = cimage.IsNotNull() ? cimage->GetBufferPointer() : ITK_NULLPTR;
+    tensorMap.m_Vectors = vecimage.IsNotNull() ? vecimage->GetBufferPointer() : ITK_NULLPTR;
+    ants::ParallelizeRange( 0, timage->GetLargestPossibleRegion().GetNumberOfPixels(), tensorMap );
+    }
+  else
     {
-    IndexType ind = tIter.GetIndex();
-    float     result = 0;
+    // decide the operation once, not per voxel
+    const bool meanDiffusion = ( operation == "TensorMeanDiffusion" );
+    const bool maskTensors = ( operation == "TensorMask" );
+    const bool toPhysicalSpace = ( operation == "TensorToPhysicalSpace" );
+    const bool toLocalSpace = ( operation == "TensorToLocalSpace" );
+    const bool validTensor = ( operation == "ValidTensor" );
 
-    if( strcmp(operation.c_str(), "TensorFA") == 0 )
-      {
-      result = 0.0;
-      if( IsRealTensor<TensorType>( tIter.Value() ) )
-        {
-        result = GetTensorFA<TensorType>(tIter.Value() );
-        }
-      vimage->SetPixel(ind, result);
-      }
-    else if( strcmp(operation.c_str(), "TensorMeanDiffusion") == 0 )
-      {
-      result = GetTensorADC<TensorType>(tIter.Value(), 0);
-      if( vnl_math_isnan(result) )
-        {
-        result = 0;
-        }
-      vimage->SetPixel(ind, result);
-      }
-    else if( strcmp(operation.c_str(), "TensorRadialDiffusion") == 0 )
-      {
-      result = GetTensorADC<TensorType>(tIter.Value(), 2);
-      if( vnl_math_isnan(result) )
-        {
-        result = 0;
-        }
-      vimage->SetPixel(ind, result);
-      }
-    else if( strcmp(operation.c_str(), "TensorEigenvalue") == 0 )
-      {
-      result = GetTensorADC<TensorType>(tIter.Value(), 3 + whichvec);
-      if( vnl_math_isnan(result) )
-        {
-        result = 0;
-        }
-      vimage->SetPixel(ind, result);
-      }
-    else if( strcmp(operation.c_str(), "TensorAxialDiffusion") == 0 )
-      {
-      result = GetTensorADC<TensorType>(tIter.Value(), 5);
-      if( vnl_math_isnan(result) )
-        {
-        result = 0;
-        }
-      vimage->SetPixel(ind, result);
-      }
-    else if( strcmp(operation.c_str(), "TensorFANumerator") == 0 )
-      {
-      result = GetTensorFANumerator<TensorType>(tIter.Value() );
-      if( vnl_math_isnan(result) )
-        {
-        result = 0;
-        }
-      vimage->SetPixel(ind, result);
-      }
-    else if( strcmp(operation.c_str(), "TensorFADenominator") == 0 )
+    Iterator tIter(timage, timage->GetLargestPossibleRegion() );
+    for(  tIter.GoToBegin(); !tIter.IsAtEnd(); ++tIter )
       {
-      result = GetTensorFADenominator<TensorType>(tIter.Value() );
-      if( vnl_math_isnan(result) )
+      IndexType ind = tIter.GetIndex();
+      float     result = 0;
+
+      if( meanDiffusion )
         {
-        result = 0;
+        result = GetTensorADC<TensorType>(tIter.Value(), 0);
+        if( vnl_math_isnan(result) )
+          {
+          result = 0;
+          }
+        vimage->SetPixel(ind, result);
         }
-      vimage->SetPixel(ind, result);
-      }
-    else if( strcmp(operation.c_str(), "TensorColor") == 0 )
-      {
-      if( argc > 5 )
+      else if( maskTensors )
         {
-        if( mimage->GetPixel( tIter.GetIndex() ) > 0 )
+        float maskVal = mimage->GetPixel(ind);
+
+        if( maskVal > 0.0 )
           {
-          cimage->SetPixel(ind, GetTensorRGB<TensorType>(tIter.Value() ) );
+          toimage->SetPixel( ind, tIter.Value() );
           }
         else
           {
-          cimage->SetPixel(ind, rgbZero);
+          toimage->SetPixel( ind, backgroundTensor );
           }
-        }
-      else
-        {
-        RGBType rgb = GetTensorRGB<TensorType>(tIter.Value() );
-        cimage->SetPixel(ind, rgb);
-        }
-      }
-    else if( strcmp(operation.c_str(), "TensorMask") == 0 )
-      {
-      float maskVal = mimage->GetPixel(ind);
 
-      if( maskVal > 0.0 )
-        {
-        toimage->SetPixel( ind, tIter.Value() );
         }
-      else
+      else if( toPhysicalSpace )
         {
-        toimage->SetPixel( ind, backgroundTensor );
-        }
+        typename TensorType::EigenValuesArrayType eigenValues;
+        typename TensorType::EigenVectorsMatrixType eigenVectors;
+        typename TensorType::EigenVectorsMatrixType eigenVectorsPhysical;
+        typename TensorType::EigenVectorsMatrixType eigenValuesMatrix;
+        eigenValuesMatrix.Fill( 0.0 );
+        ComputeTensorEigenAnalysis<TensorType>( tIter.Value(), eigenValues, eigenVectors );
+        for( unsigned int i = 0; i < 3; i++ )
+          {
+          eigenValuesMatrix(i, i) = fabs( eigenValues[i] );
 
-      }
-    else if( strcmp(operation.c_str(), "TensorToVector") == 0 )
-      {
-      VectorType vv = GetTensorPrincipalEigenvector<TensorType>(tIter.Value(), whichvec);
-      vecimage->SetPixel(ind, vv);
-      }
+          itk::Vector<float, 3> ev;
+          for( unsigned int j = 0; j < 3; j++ )
+            {
+            ev[j] = eigenVectors(j, i);
+            }
 
-    else if( strcmp(operation.c_str(), "TensorToVectorComponent") == 0 )
-      {
-      if( whichvec <= 2 )
-        {
-        VectorType vv = GetTensorPrincipalEigenvector<TensorType>(tIter.Value(), 2);
-        vimage->SetPixel(ind, vv[whichvec]);
-        }
-      else if( whichvec > 2 && whichvec < 9 )
-        {
-        vimage->SetPixel(ind, tIter.Value()[whichvec]);
-        }
-      }
-    else if( strcmp(operation.c_str(), "TensorToPhysicalSpace") == 0 )
-      {
-      typename TensorType::EigenValuesArrayType eigenValues;
-      typename TensorType::EigenVectorsMatrixType eigenVectors;
-      typename TensorType::EigenVectorsMatrixType eigenVectorsPhysical;
-      typename TensorType::EigenVectorsMatrixType eigenValuesMatrix;
-      eigenValuesMatrix.Fill( 0.0 );
-      tIter.Value().ComputeEigenAnalysis( eigenValues, eigenVectors );
-      for( unsigned int i = 0; i < 3; i++ )
-        {
-        eigenValuesMatrix(i, i) = fabs( eigenValues[i] );
+          itk::Vector<float, 3> evp;
+          timage->TransformLocalVectorToPhysicalVector( ev, evp );
 
-        itk::Vector<float, 3> ev;
-        for( unsigned int j = 0; j < 3; j++ )
-          {
-          ev[j] = eigenVectors(j, i);
+          itk::Vector<float, 3> evl;
+          timage->TransformPhysicalVectorToLocalVector( evp, evl );
+          for( unsigned int j = 0; j < 3; j++ )
+            {
+            eigenVectorsPhysical(j, i) = evp[j];
+            }
           }
 
-        itk::Vector<float, 3> evp;
-        timage->TransformLocalVectorToPhysicalVector( ev, evp );
+        typename TensorType::MatrixType::InternalMatrixType phyTensor
+          = eigenVectorsPhysical.GetTranspose() * eigenValuesMatrix.GetVnlMatrix() * eigenVectorsPhysical.GetVnlMatrix();
 
-        itk::Vector<float, 3> evl;
-        timage->TransformPhysicalVectorToLocalVector( evp, evl );
-        for( unsigned int j = 0; j < 3; j++ )
-          {
-          eigenVectorsPhysical(j, i) = evp[j];
-          }
+        TensorType oTensor = Matrix2Vector<TensorType, TensorType::MatrixType::InternalMatrixType>( phyTensor );
+        toimage->SetPixel( tIter.GetIndex(), oTensor );
         }
-
-      typename TensorType::MatrixType::InternalMatrixType phyTensor
-        = eigenVectorsPhysical.GetTranspose() * eigenValuesMatrix.GetVnlMatrix() * eigenVectorsPhysical.GetVnlMatrix();
-
-      TensorType oTensor = Matrix2Vector<TensorType, TensorType::MatrixType::InternalMatrixType>( phyTensor );
-      toimage->SetPixel( tIter.GetIndex(), oTensor );
-      }
-    else if( strcmp(operation.c_str(), "TensorToLocalSpace") == 0 )
-      {
-      typename TensorType::EigenValuesArrayType eigenValues;
-      typename TensorType::EigenVectorsMatrixType eigenVectors;
-      typename TensorType::EigenVectorsMatrixType eigenValuesMatrix;
-      eigenValuesMatrix.Fill( 0.0 );
-      tIter.Value().ComputeEigenAnalysis( eigenValues, eigenVectors );
-      for( unsigned int i = 0; i < 3; i++ )
+      else if( toLocalSpace )
         {
-        eigenValuesMatrix(i, i) = fabs( eigenValues[i] );
-
-        itk::Vector<float, 3> ev;
-        for( unsigned int j = 0; j < 3; j++ )
+        typename TensorType::EigenValuesArrayType eigenValues;
+        typename TensorType::EigenVectorsMatrixType eigenVectors;
+        typename TensorType::EigenVectorsMatrixType eigenValuesMatrix;
+        eigenValuesMatrix.Fill( 0.0 );
+        ComputeTensorEigenAnalysis<TensorType>( tIter.Value(), eigenValues, eigenVectors );
+        for( unsigned int i = 0; i < 3; i++ )
           {
-          ev[j] = eigenVectors(j, i);
-          }
+          eigenValuesMatrix(i, i) = fabs( eigenValues[i] );
 
-        itk::Vector<float, 3> evp;
-        timage->TransformPhysicalVectorToLocalVector( ev, evp );
-        for( unsigned int j = 0; j < 3; j++ )
-          {
-          eigenVectors(j, i) = evp[j];
+          itk::Vector<float, 3> ev;
+          for( unsigned int j = 0; j < 3; j++ )
+            {
+            ev[j] = eigenVectors(j, i);
+            }
+
+          itk::Vector<float, 3> evp;
+          timage->TransformPhysicalVectorToLocalVector( ev, evp );
+          for( unsigned int j = 0; j < 3; j++ )
+            {
+            eigenVectors(j, i) = evp[j];
+            }
           }
-        }
 
-      typename TensorType::MatrixType::InternalMatrixType lclTensor
-        = eigenVectors.GetTranspose() * eigenValuesMatrix.GetVnlMatrix() * eigenVectors.GetVnlMatrix();
+        typename TensorType::MatrixType::InternalMatrixType lclTensor
+          = eigenVectors.GetTranspose() * eigenValuesMatrix.GetVnlMatrix() * eigenVectors.GetVnlMatrix();
 
-      TensorType oTensor = Matrix2Vector<TensorType, TensorType::MatrixType::InternalMatrixType>( lclTensor );
-      toimage->SetPixel( tIter.GetIndex(), oTensor );
-      }
-    else if( strcmp(operation.c_str(), "ValidTensor") == 0 )
-      {
-      typename TensorType::EigenValuesArrayType eigenValues;
-      typename TensorType::EigenVectorsMatrixType eigenVectors;
-      typename TensorType::EigenVectorsMatrixType eigenValuesMatrix;
-      eigenValuesMatrix.Fill( 0.0 );
-      tIter.Value().ComputeEigenAnalysis( eigenValues, eigenVectors );
-      // NOT USED bool hasNeg = false;
+        TensorType oTensor = Matrix2Vector<TensorType, TensorType::MatrixType::InternalMatrixType>( lclTensor );
+        toimage->SetPixel( tIter.GetIndex(), oTensor );
+        }
+      else if( validTensor )
+        {
+        typename TensorType::EigenValuesArrayType eigenValues;
+        typename TensorType::EigenVectorsMatrixType eigenVectors;
+        typename TensorType::EigenVectorsMatrixType eigenValuesMatrix;
+        eigenValuesMatrix.Fill( 0.0 );
+        ComputeTensorEigenAnalysis<TensorType>( tIter.Value(), eigenValues, eigenVectors );
+        // NOT USED bool hasNeg = false;
 
-      typename TensorType::MatrixType::InternalMatrixType lclTensor
-        = eigenVectors.GetTranspose() * eigenValuesMatrix.GetVnlMatrix() * eigenVectors.GetVnlMatrix();
+        typename TensorType::MatrixType::InternalMatrixType lclTensor
+          = eigenVectors.GetTranspose() * eigenValuesMatrix.GetVnlMatrix() * eigenVectors.GetVnlMatrix();
 
-      TensorType oTensor = Matrix2Vector<TensorType, TensorType::MatrixType::InternalMatrixType>( lclTensor );
-      toimage->SetPixel( tIter.GetIndex(), oTensor );
+        TensorType oTensor = Matrix2Vector<TensorType, TensorType::MatrixType::InternalMatrixType>( lclTensor );
+        toimage->SetPixel( tIter.GetIndex(), oTensor );
+        }
       }
     }
   if( strcmp(operation.c_str(), "TensorColor") == 0 )
@@ -6235,6 +6199,221 @@ int TensorFunctions(int argc, char *argv[])
   return 0;
 }
 
+/**
+ * FA, MD, AD, RD, RGB and the principal eigenvector from a single
+ * decomposition of each tensor, for TensorMaps.  Outputs left null are not
+ * computed.  Voxels outside the optional mask are zero in every map.
+ */
+template <class TTensorImage, class TImage, class TColorImage, class TVectorImage>
+class TensorMultiMapFunctor
+{
+public:
+  typedef typename TTensorImage::PixelType TensorType;
+  typedef typename TImage::PixelType       PixelType;
+  typedef typename TColorImage::PixelType  RGBType;
+  typedef typename TVectorImage::PixelType VectorType;
+
+  const TTensorImage * m_Tensors;
+  const TImage *       m_Mask;
+  PixelType *          m_FA;
+  PixelType *          m_MeanDiffusion;
+  PixelType *          m_AxialDiffusion;
+  PixelType *          m_RadialDiffusion;
+  RGBType *            m_Colors;
+  VectorType *         m_PrincipalEigenvectors;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    VisitTensorEigenSystems<TensorType>( this->m_Tensors->GetBufferPointer(), begin, end,
+                                         this->m_Colors || this->m_PrincipalEigenvectors, *this );
+  }
+
+  void operator()( itk::SizeValueType offset, const TensorType & dtv, const double D[3], const double V[3][3] )
+  {
+    if( this->m_Mask && !( this->m_Mask->GetPixel( this->m_Tensors->ComputeIndex( offset ) ) > 0 ) )
+      {
+      this->SetBackground( offset );
+      return;
+      }
+    if( this->m_FA )
+      {
+      this->m_FA[offset] = IsRealTensor<TensorType>( dtv ) ? GetTensorFA<TensorType>( dtv, D ) : 0;
+      }
+    if( this->m_MeanDiffusion )
+      {
+      this->m_MeanDiffusion[offset] = NanToZero( GetTensorADC<TensorType>( dtv, 0 ) );
+      }
+    if( this->m_AxialDiffusion )
+      {
+      this->m_AxialDiffusion[offset] = NanToZero( GetTensorADC<TensorType>( dtv, 5, D ) );
+      }
+    if( this->m_RadialDiffusion )
+      {
+      this->m_RadialDiffusion[offset] = NanToZero( GetTensorADC<TensorType>( dtv, 2, D ) );
+      }
+    if( this->m_Colors )
+      {
+      this->m_Colors[offset] = GetTensorRGB<TensorType>( dtv, D, V );
+      }
+    if( this->m_PrincipalEigenvectors )
+      {
+      this->m_PrincipalEigenvectors[offset] = GetTensorPrincipalEigenvector<TensorType>( dtv, 2, V );
+      }
+  }
+
+private:
+  static PixelType NanToZero( float value )
+  {
+    return vnl_math_isnan( value ) ? 0 : value;
+  }
+
+  void SetBackground( itk::SizeValueType offset )
+  {
+    PixelType * scalars[4] = { this->m_FA, this->m_MeanDiffusion, this->m_AxialDiffusion, this->m_RadialDiffusion };
+
+    for( unsigned int n = 0; n < 4; n++ )
+      {
+      if( scalars[n] )
+        {
+        scalars[n][offset] = 0;
+        }
+      }
+    if( this->m_Colors )
+      {
+      this->m_Colors[offset].Fill( 0 );
+      }
+    if( this->m_PrincipalEigenvectors )
+      {
+      this->m_PrincipalEigenvectors[offset].Fill( 0 );
+      }
+  }
+};
+
+template <unsigned int ImageDimension>
+int TensorMaps(int argc, char *argv[])
+{
+  typedef float                                              PixelType;
+  typedef itk::SymmetricSecondRankTensor<float, 3>           TensorType;
+  typedef typename itk::RGBPixel<unsigned char>              RGBType;
+  typedef itk::Image<TensorType, ImageDimension>             TensorImageType;
+  typedef itk::Image<PixelType, ImageDimension>              ImageType;
+  typedef itk::Image<RGBType, ImageDimension>                ColorImageType;
+  typedef itk::ImageFileWriter<ColorImageType>               ColorWriterType;
+  typedef itk::Vector<float, ImageDimension>                 VectorType;
+  typedef itk::Image<VectorType, ImageDimension>             VectorImageType;
+
+  if( argc < 5 )
+    {
+    std::cout << "Usage: ImageMath 3 outprefix.ext TensorMaps DTImage.ext {maps=FA,MD,AD,RD,RGB,V} {mask.ext}"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  int               argct = 2;
+  const std::string outname = std::string(argv[argct]);
+  argct += 2;
+  const std::string fn1 = std::string(argv[argct]);   argct++;
+  std::string       maps = "FA,MD,AD,RD,RGB,V";
+  if( argc > argct )
+    {
+    maps = std::string(argv[argct]);   argct++;
+    }
+  std::string maskfn = "";
+  if( argc > argct )
+    {
+    maskfn = std::string(argv[argct]);   argct++;
+    }
+
+  const char * names[] = { "FA", "MD", "AD", "RD", "RGB", "V" };
+  bool         wanted[6] = { false, false, false, false, false, false };
+  std::istringstream mapstream( maps );
+  std::string        map;
+  while( std::getline( mapstream, map, ',' ) )
+    {
+    unsigned int n = 0;
+    while( n < 6 && map != names[n] )
+      {
+      n++;
+      }
+    if( n == 6 )
+      {
+      std::cout << "Unrecognized tensor map " << map << ".  Choose from FA, MD, AD, RD, RGB and V." << std::endl;
+      return EXIT_FAILURE;
+      }
+    wanted[n] = true;
+    }
+
+  std::string::size_type idx;
+  idx = outname.find_first_of('.');
+  std::string tempname = outname.substr(0, idx);
+  std::string extension = outname.substr(idx, outname.length() );
+
+  typename TensorImageType::Pointer timage = ITK_NULLPTR;
+  ReadTensorImage<TensorImageType>(timage, fn1.c_str(), false);
+
+  typename ImageType::Pointer mimage = ITK_NULLPTR;
+  if( maskfn.length() > 0 )
+    {
+    ReadImage<ImageType>(mimage, maskfn.c_str() );
+    }
+
+  typename ImageType::Pointer       scalarImages[4];
+  typename ColorImageType::Pointer  cimage = ITK_NULLPTR;
+  typename VectorImageType::Pointer vecimage = ITK_NULLPTR;
+  for( unsigned int n = 0; n < 4; n++ )
+    {
+    if( wanted[n] )
+      {
+      scalarImages[n] = AllocImage<ImageType>(timage);
+      }
+    }
+  if( wanted[4] )
+    {
+    cimage = AllocImage<ColorImageType>(timage);
+    }
+  if( wanted[5] )
+    {
+    VectorType zero;  zero.Fill(0);
+    vecimage = AllocImage<VectorImageType>(timage, zero);
+    }
+
+  // every voxel is decomposed once, whatever the number of maps
+  TensorMultiMapFunctor<TensorImageType, ImageType, ColorImageType, VectorImageType> functor;
+  functor.m_Tensors = timage;
+  functor.m_Mask = mimage;
+  functor.m_FA = wanted[0] ? scalarImages[0]->GetBufferPointer() : ITK_NULLPTR;
+  functor.m_MeanDiffusion = wanted[1] ? scalarImages[1]->GetBufferPointer() : ITK_NULLPTR;
+  functor.m_AxialDiffusion = wanted[2] ? scalarImages[2]->GetBufferPointer() : ITK_NULLPTR;
+  functor.m_RadialDiffusion = wanted[3] ? scalarImages[3]->GetBufferPointer() : ITK_NULLPTR;
+  functor.m_Colors = wanted[4] ? cimage->GetBufferPointer() : ITK_NULLPTR;
+  functor.m_PrincipalEigenvectors = wanted[5] ? vecimage->GetBufferPointer() : ITK_NULLPTR;
+  ants::ParallelizeRange( 0, timage->GetLargestPossibleRegion().GetNumberOfPixels(), functor );
+
+  for( unsigned int n = 0; n < 4; n++ )
+    {
+    if( wanted[n] )
+      {
+      std::string kname = tempname + std::string( names[n] ) + extension;
+      WriteImage<ImageType>(scalarImages[n], kname.c_str() );
+      }
+    }
+  if( wanted[4] )
+    {
+    std::string kname = tempname + std::string( names[4] ) + extension;
+    typename ColorWriterType::Pointer cwrite = ColorWriterType::New();
+    cwrite->SetInput(cimage);
+    cwrite->SetFileName(kname.c_str() );
+    cwrite->Update();
+    }
+  if( wanted[5] )
+    {
+    std::string kname = tempname + std::string( names[5] ) + extension;
+    WriteImage<VectorImageType>(vecimage, kname.c_str() );
+    }
+
+  return 0;
+}
+
 template <unsigned int ImageDimension>
 int CompareHeadersAndImages(int argc, char *argv[])
 {
@@ -7588,7 +7767,7 @@ itkMRIBiasFieldCorrectionFilter(typename TImage::Pointer image,
 // }
 
 template <unsigned int ImageDimension>
-int SmoothImage(int argc, char *argv[])
+static int SmoothImage(int argc, char *argv[])
 {
   typedef float                                                           PixelType;
   typedef itk::Image<PixelType, ImageDimension>                           ImageType;
@@ -7784,6 +7963,10 @@ int PropagateLabelsThroughMask(int argc, char *argv[])
   typedef  itk::FMarchingImageFilter<ImageType, ImageType> FastMarchingFilterType;
   typedef  typename FastMarchingFilterType::LabelImageType LabelImageType;
   typename FastMarchingFilterType::Pointer  fastMarching;
+  // Every label is marched on its own.  A combined front that stops where
+  // another label arrives first does not give the same arrival times: the
+  // upwind update of a voxel uses the label's times at all of its
+  // neighbours, including those another label wins.
   for( unsigned int lab = 1; lab <= (unsigned int)maxlabel; lab++ )
     {
 
@@ -8508,7 +8691,7 @@ int NormalizeImage(int argc, char *argv[])
 }
 
 template <unsigned int ImageDimension>
-int PrintHeader(int argc, char *argv[])
+static int PrintHeader(int argc, char *argv[])
 {
   typedef  float                                     inPixelType;
   typedef itk::Image<inPixelType, ImageDimension>    ImageType;
@@ -10108,7 +10291,6 @@ int LabelStats(      int argc, char *argv[])
 {
   typedef float                                                           PixelType;
   typedef itk::Image<PixelType, ImageDimension>                           ImageType;
-  typedef itk::ImageRegionIteratorWithIndex<ImageType>                    Iterator;
 
   int               argct = 2;
   const std::string outname = std::string(argv[argct]);
@@ -10129,23 +10311,17 @@ int LabelStats(      int argc, char *argv[])
     ReadImage<ImageType>(valimage, fn2.c_str() );
     }
 
-  typedef float                  PixelType;
-  typedef std::vector<PixelType> LabelSetType;
-  LabelSetType myLabelSet;
-/** count the labels in the image */
-  Iterator It( image, image->GetLargestPossibleRegion() );
-  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+  /** gather all labels in one pass */
+  typedef LabelStatisticsCalculator<ImageType> LabelStatisticsCalculatorType;
+  typedef typename LabelStatisticsCalculatorType::StatisticsMapType LabelStatisticsMapType;
+  LabelStatisticsCalculatorType labelStatistics;
+  labelStatistics.SetLabelImage( image );
+  if( valimage )
     {
-    PixelType label = It.Get();
-    if( fabs(label) > 0 )
-      {
-      if( find( myLabelSet.begin(), myLabelSet.end(), label )
-          == myLabelSet.end() )
-        {
-        myLabelSet.push_back( label );
-        }
-      }
+    labelStatistics.SetValueImage( valimage );
     }
+  labelStatistics.Compute();
+  const LabelStatisticsMapType & labelStatisticsMap = labelStatistics.GetStatistics();
 
   // compute the voxel volume
   typename ImageType::SpacingType spacing = image->GetSpacing();
@@ -10159,16 +10335,9 @@ int LabelStats(      int argc, char *argv[])
   logfile.open(outname.c_str() );
   logfile << "x,y,z,t,label,mass,volume,count" << std::endl;
 
-  std::sort(myLabelSet.begin(), myLabelSet.end() );
-  typename LabelSetType::const_iterator it;
-  unsigned long labelcount = 0;
-  for( it = myLabelSet.begin(); it != myLabelSet.end(); ++it )
-    {
-    labelcount++;
-    }
-
-  float        temp = sqrt( (float)labelcount);
-  unsigned int squareimagesize = (unsigned int)(temp + 1);
+  unsigned long labelcount = labelStatisticsMap.size();
+  float         temp = sqrt( (float)labelcount);
+  unsigned int  squareimagesize = (unsigned int)(temp + 1);
 
   typedef itk::Image<float, 2> TwoDImageType;
   typename TwoDImageType::RegionType newregion;
@@ -10179,51 +10348,14 @@ int LabelStats(      int argc, char *argv[])
     AllocImage<TwoDImageType>(newregion, 0);
 
   labelcount = 0;
-  for( it = myLabelSet.begin(); it != myLabelSet.end(); ++it )
+  typename LabelStatisticsMapType::const_iterator it;
+  for( it = labelStatisticsMap.begin(); it != labelStatisticsMap.end(); ++it )
     {
-    float currentlabel = *it;
-    float totalvolume = 0;
-    float totalmass = 0;
-    float totalct = 0;
-    typename ImageType::PointType myCenterOfMass;
-    myCenterOfMass.Fill(0);
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      PixelType label = It.Get();
-      if(  label == currentlabel  )
-        {
-        totalvolume += volumeelement;
-        totalct += 1;
-        if( valimage )
-          {
-          totalmass += valimage->GetPixel( It.GetIndex() );
-          }
-
-        // compute center of mass
-        typename ImageType::PointType point;
-        image->TransformIndexToPhysicalPoint( It.GetIndex(), point );
-        for( unsigned int i = 0; i < spacing.Size(); i++ )
-          {
-          myCenterOfMass[i] += point[i];
-          }
-        }
-      }
-    for( unsigned int i = 0; i < spacing.Size(); i++ )
-      {
-      myCenterOfMass[i] /= (float)totalct;
-      }
-
-    if( !valimage )
-      {
-//      // std::cout << " Volume Of Label " << *it << " is " << totalvolume <<   "  Avg-Location " << myCenterOfMass
-          //      << std::endl;
-      }
-    else // if ( totalvolume > 500 &&  totalmass/totalct > 1/500 )  {
-      {
-//      // std::cout << " Volume Of Label " << *it << " is " << totalvolume <<   "  Avg-Location " << myCenterOfMass
-//                << " mass is " << totalmass << " average-val is " << totalmass / totalct << std::endl;
-//      //      // std::cout << *it << "  " <<  totalvolume <<  " & " <<  totalmass/totalct   << " \ " << std::endl;
-      }
+    float currentlabel = it->first;
+    float totalct = it->second.Count;
+    float totalvolume = totalct * volumeelement;
+    float totalmass = it->second.Sum;
+    typename ImageType::PointType myCenterOfMass = labelStatistics.GetCentroid( it->second );
 
 // square image
     squareimage->GetBufferPointer()[labelcount] = totalmass / totalct;
@@ -10293,37 +10425,23 @@ int LabelThickness(      int argc, char *argv[])
   // typename TImage::Pointer  Morphological( typename TImage::Pointer input, float rad, unsigned int option,
   //                                       float dilateval)
   eimage = ants::Morphological<ImageType>(image, 1, 4, 1);
-  typedef float                  PixelType;
-  typedef std::vector<PixelType> LabelSetType;
-  LabelSetType myLabelSet;
-  /** count the labels in the image */
+  /** gather the label volumes in one pass */
+  typedef LabelStatisticsCalculator<ImageType> LabelStatisticsCalculatorType;
+  typedef typename LabelStatisticsCalculatorType::StatisticsMapType LabelStatisticsMapType;
+  LabelStatisticsCalculatorType labelStatistics;
+  labelStatistics.SetLabelImage( image );
+  labelStatistics.Compute();
+  const LabelStatisticsMapType & labelStatisticsMap = labelStatistics.GetStatistics();
+  typename LabelStatisticsMapType::const_iterator it;
   unsigned long maxlab = 0;
-  Iterator      iIt( image, image->GetLargestPossibleRegion() );
-  for( iIt.GoToBegin(); !iIt.IsAtEnd(); ++iIt )
+  for( it = labelStatisticsMap.begin(); it != labelStatisticsMap.end(); ++it )
     {
-    PixelType label = iIt.Get();
-    if( fabs(label) > 0 )
+    if( it->first > maxlab )
       {
-      if( find( myLabelSet.begin(), myLabelSet.end(), label )
-          == myLabelSet.end() )
-        {
-        myLabelSet.push_back( label );
-        }
-      if( label > maxlab )
-        {
-        maxlab = (unsigned long)label;
-        }
+      maxlab = (unsigned long)it->first;
       }
     }
 
-  std::sort(myLabelSet.begin(), myLabelSet.end() );
-  typename LabelSetType::const_iterator it;
-  unsigned long labelcount = 0;
-  for( it = myLabelSet.begin(); it != myLabelSet.end(); ++it )
-    {
-    labelcount++;
-    }
-
   typename ImageType::SpacingType spacing = image->GetSpacing();
   float volumeelement = 1.0;
   for( unsigned int i = 0;  i < spacing.Size(); i++ )
@@ -10334,6 +10452,13 @@ int LabelThickness(      int argc, char *argv[])
 
   vnl_vector<double> surface(maxlab + 1, 0);
   vnl_vector<double> volume(maxlab + 1, 0);
+  for( it = labelStatisticsMap.begin(); it != labelStatisticsMap.end(); ++it )
+    {
+    if( it->first > 0 )
+      {
+      volume[(unsigned long) it->first] += it->second.Count;
+      }
+    }
 
   typedef itk::NeighborhoodIterator<ImageType> iteratorType;
   typename iteratorType::RadiusType rad;
@@ -10341,14 +10466,10 @@ int LabelThickness(      int argc, char *argv[])
   iteratorType GHood(rad, image, image->GetLargestPossibleRegion() );
   float        Gsz = (float)GHood.Size();
   // iterate over the label image and index into the stat image
+  Iterator iIt( image, image->GetLargestPossibleRegion() );
   for( iIt.GoToBegin(); !iIt.IsAtEnd(); ++iIt )
     {
-    PixelType label = iIt.Get();
-    if(  label > 0 )
-      {
-      volume[(unsigned long) label] = volume[(unsigned long) label] + 1;
-      }
-    label = label - eimage->GetPixel( iIt.GetIndex() );
+    PixelType label = iIt.Get() - eimage->GetPixel( iIt.GetIndex() );
     if(  label > 0 )
       {
       GHood.SetLocation( iIt.GetIndex() );
@@ -10483,7 +10604,6 @@ int ROIStatistics(      int argc, char *argv[])
 {
   typedef float                                                           PixelType;
   typedef itk::Image<PixelType, ImageDimension>                           ImageType;
-  typedef itk::ImageRegionIteratorWithIndex<ImageType>                    Iterator;
 
   //  if(grade_list.find("Tim") == grade_list.end()) {  // std::cout<<"Tim is not in the map!"<<endl; }
   // mymap.find('a')->second
@@ -10497,7 +10617,6 @@ int ROIStatistics(      int argc, char *argv[])
     throw std::exception();
     }
   const std::string outname = std::string(argv[argct]);
-  typedef vnl_matrix<double> MatrixType;
   argct += 2;
   std::string fn0 = std::string(argv[argct]);   argct++;
   // std::cout << "  fn0 " << fn0 << std::endl;
@@ -10547,126 +10666,59 @@ int ROIStatistics(      int argc, char *argv[])
     ReadImage<ImageType>(valimage5, fn5.c_str() );
     }
 
-  typedef float                  PixelType;
-  typedef std::vector<PixelType> LabelSetType;
-  LabelSetType myLabelSet;
-/** count the labels in the image */
-  unsigned long maxlab = 0;
-  Iterator      It( image, image->GetLargestPossibleRegion() );
-  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+  /** one pass over the label image gathers the cluster sizes, masses and
+   *  centres of mass of all labels; the value image is sampled with linear
+   *  interpolation when it is not on the label grid */
+  typedef LabelStatisticsCalculator<ImageType> LabelStatisticsCalculatorType;
+  typedef typename LabelStatisticsCalculatorType::StatisticsMapType LabelStatisticsMapType;
+  LabelStatisticsCalculatorType labelStatistics;
+  labelStatistics.SetLabelImage( image );
+  if( valimage )
     {
-    PixelType label = It.Get();
-    if( fabs(label) > 0 )
-      {
-      if( find( myLabelSet.begin(), myLabelSet.end(), label )
-          == myLabelSet.end() )
-        {
-        myLabelSet.push_back( label );
-        }
-      if( label > maxlab )
-        {
-        maxlab = (unsigned long)label;
-        }
-      }
+    labelStatistics.SetValueImage( valimage );
     }
-  // define the output matrix
-  // for a csv file of  n_regions for rows
-  // with columns of   Volume,CenterOfMassX,CenterOfMassY,CenterOfMassZ,CenterOfMassTime,
-  MatrixType mCSVMatrix(maxlab, ImageDimension + 1, 0);
-
-  //  maxlab=32; // for cortical analysis
-  // compute the voxel volume
-  typename ImageType::SpacingType spacing = image->GetSpacing();
-  float volumeelement = 1.0;
-  for( unsigned int i = 0;  i < spacing.Size(); i++ )
+  else
     {
-    volumeelement *= spacing[i];
+    labelStatistics.SetValueImage( image );
     }
+  labelStatistics.SetIgnoreZeroValues( true );
+  labelStatistics.Compute();
+  const LabelStatisticsMapType & labelStatisticsMap = labelStatistics.GetStatistics();
 
-  vnl_vector<double> pvals(maxlab + 1, 1.0);
-  vnl_vector<double> pvals3(maxlab + 1, 1.0);
-  vnl_vector<double> pvals4(maxlab + 1, 1.0);
-  vnl_vector<double> pvals5(maxlab + 1, 1.0);
-  vnl_vector<double> clusters(maxlab + 1, 0.0);
-  vnl_vector<double> masses(maxlab + 1, 0.0);
-  //  typename ImageType::PointType mycomlist[33];
-  std::ofstream logfile;
-  logfile.open(outname.c_str() );
-
-  std::sort(myLabelSet.begin(), myLabelSet.end() );
-  typename LabelSetType::const_iterator it;
-  unsigned long labelcount = 0;
-  for( it = myLabelSet.begin(); it != myLabelSet.end(); ++it )
+  unsigned long maxlab = 0;
+  typename LabelStatisticsMapType::const_iterator it;
+  for( it = labelStatisticsMap.begin(); it != labelStatisticsMap.end(); ++it )
     {
-    labelcount++;
+    if( it->first > maxlab )
+      {
+      maxlab = (unsigned long)it->first;
+      }
     }
 
-  typedef itk::LinearInterpolateImageFunction<ImageType, float> ScalarInterpolatorType;
-  typename ScalarInterpolatorType::Pointer interp =  ScalarInterpolatorType::New();
-  if( valimage )
-    {
-    interp->SetInputImage(valimage);
-    }
-  else
-    {
-    interp->SetInputImage(image);
-    }
-  // iterate over the label image and index into the stat image
-  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+  vnl_vector<double> clusters(maxlab + 1, 0.0);
+  vnl_vector<double> masses(maxlab + 1, 0.0);
+  for( it = labelStatisticsMap.begin(); it != labelStatisticsMap.end(); ++it )
     {
-    PixelType label = It.Get();
-    typename ImageType::PointType point;
-    image->TransformIndexToPhysicalPoint(It.GetIndex(), point);
-    float vv = interp->Evaluate( point );
-    //    float vv = valimage->GetPixel(It.GetIndex());
-    if(  label > 0  && fabs(vv) > 1.e-9 )
+    if( it->first > 0 )
       {
-      clusters[(unsigned long) label] = clusters[(unsigned long) label] + 1;
-      masses[(unsigned long) label] = masses[(unsigned long) label] + vv;
+      clusters[(unsigned long) it->first] += it->second.ValueCount;
+      masses[(unsigned long) it->first] += it->second.Sum;
       }
     }
+
+  std::ofstream logfile;
+  logfile.open(outname.c_str() );
   logfile << "ROIName,ROINumber,ClusterSize,Mass,Mean,comX,comY,comZ,comT" << std::endl;
-  //  for( it = myLabelSet.begin(); it != myLabelSet.end(); ++it )
   for( unsigned int mylabel = 1; mylabel < maxlab + 1; mylabel++ )
     {
     unsigned int roi = mylabel - 1;
-    /* first count which roi it is by iterating through the label sets
-     it = myLabelSet.begin();
-    while (  (*it) != mylabel && it != myLabelSet.end() )
-  {
-    // std::cout << " it " << *it << " roi " << roi << " mylabel " << mylabel << std::endl;
-    roi++;
-    ++it;
-    }*/
 
     typename ImageType::PointType myCenterOfMass;
     myCenterOfMass.Fill(0);
-    unsigned long totalct = 0;
-    if( clusters[mylabel] > 0 )
+    it = labelStatisticsMap.find( static_cast<PixelType>( mylabel ) );
+    if( clusters[mylabel] > 0 && it != labelStatisticsMap.end() )
       {
-      for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-        {
-        PixelType label = It.Get();
-        if(  label == mylabel )
-          {
-          totalct += 1;
-          // compute center of mass
-          typename ImageType::PointType point;
-          image->TransformIndexToPhysicalPoint(It.GetIndex(), point);
-          for( unsigned int i = 0; i < spacing.Size(); i++ )
-            {
-            myCenterOfMass[i] += point[i];
-            }
-          }
-        }
-      } // if clusters big enough
-    if( totalct == 0 )
-      {
-      totalct = 1;
-      }
-    for( unsigned int i = 0; i < spacing.Size(); i++ )
-      {
-      myCenterOfMass[i] /= (float)totalct;
+      myCenterOfMass = labelStatistics.GetCentroid( it->second );
       }
     double comy = 0, comz = 0, comt = 0;
     double comx = myCenterOfMass[0];
@@ -10696,135 +10748,6 @@ int ROIStatistics(      int argc, char *argv[])
   logfile.close();
 
   return 0;
-
-  float        temp = sqrt( (float)labelcount);
-  unsigned int squareimagesize = (unsigned int)(temp + 1);
-
-  typedef itk::Image<float, 2> TwoDImageType;
-  typename TwoDImageType::RegionType newregion;
-  typename TwoDImageType::SizeType size;
-  size[0] = size[1] = squareimagesize;
-  newregion.SetSize(size);
-  typename TwoDImageType::Pointer squareimage =
-    AllocImage<TwoDImageType>(newregion, 0);
-
-  labelcount = 0;
-  typename ImageType::PointType myCenterOfMass;
-  myCenterOfMass.Fill(0);
-  //  for (unsigned int i=0; i<=maxlab; i++) mycomlist[i]=myCenterOfMass;
-  for( it = myLabelSet.begin(); it != myLabelSet.end(); ++it )
-    {
-    float currentlabel = *it;
-    float totalvolume = 0;
-    float totalmass = 0;
-    float totalct = 0;
-    float maxoneminuspval = 0.0;
-    float maxoneminuspval3 = 0.0;
-    float maxoneminuspval4 = 0.0;
-    float maxoneminuspval5 = 0.0;
-    myCenterOfMass.Fill(0);
-    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
-      {
-      PixelType label = It.Get();
-      if(  label == currentlabel  )
-        {
-        totalvolume += volumeelement;
-        totalct += 1;
-        float vv = valimage->GetPixel(It.GetIndex() );
-        if( valimage )
-          {
-          totalmass += vv;
-          }
-        if(  vv > maxoneminuspval )
-          {
-          maxoneminuspval = vv;
-          }
-        if( valimage3 )
-          {
-          vv = valimage3->GetPixel(It.GetIndex() );
-          if(  fabs(vv) > fabs(maxoneminuspval3) )
-            {
-            maxoneminuspval3 = vv;
-            }
-          }
-        if( valimage4 )
-          {
-          vv = valimage4->GetPixel(It.GetIndex() );
-          if(  vv > maxoneminuspval4 )
-            {
-            maxoneminuspval4 = vv;
-            }
-          }
-        if( valimage5 )
-          {
-          vv = valimage5->GetPixel(It.GetIndex() );
-          if(  vv > maxoneminuspval5 )
-            {
-            maxoneminuspval5 = vv;
-            }
-          }
-
-        // compute center of mass
-        typename ImageType::PointType point;
-        image->TransformIndexToPhysicalPoint(It.GetIndex(), point);
-        for( unsigned int i = 0; i < spacing.Size(); i++ )
-          {
-          myCenterOfMass[i] += point[i];
-          }
-        }
-      }
-    if( totalct == 0 )
-      {
-      totalct = 1;
-      }
-    for( unsigned int i = 0; i < spacing.Size(); i++ )
-      {
-      myCenterOfMass[i] /= (float)totalct;
-      }
-
-    clusters[(unsigned long)*it] = totalvolume;
-    masses[(unsigned long)*it] = totalmass / totalct;
-    pvals[(unsigned long)*it] = 1.0 - maxoneminuspval;
-    pvals3[(unsigned long)*it] = maxoneminuspval3;
-    pvals4[(unsigned long)*it] = 1.0 - maxoneminuspval4;
-    pvals5[(unsigned long)*it] = 1.0 - maxoneminuspval5;
-    // mycomlist[(unsigned long)*it]=myCenterOfMass;
-// square image
-    squareimage->GetBufferPointer()[labelcount] = totalmass / totalct;
-    labelcount++;
-    }
-  for( unsigned int roi = 1; roi <= maxlab; roi++ )
-    {
-    logfile << roimap.find(roi)->second << ",";
-    }
-  for( unsigned int roi = maxlab + 1; roi <= maxlab * 2; roi++ )
-    {
-    if( roi < maxlab * 2 )
-      {
-      logfile << roimap.find(roi - maxlab)->second + std::string("mass") << ",";
-      }
-    else
-      {
-      logfile << roimap.find(roi - maxlab)->second + std::string("mass") << std::endl;
-      }
-    }
-  for( unsigned int roi = 1; roi <= maxlab; roi++ )
-    {
-    logfile << clusters[roi] << ",";
-    }
-  for( unsigned int roi = maxlab + 1; roi <= maxlab * 2; roi++ )
-    {
-    if( roi < maxlab * 2 )
-      {
-      logfile << masses[roi - maxlab] << ",";
-      }
-    else
-      {
-      logfile << masses[roi - maxlab] << std::endl;
-      }
-    }
-  logfile.close();
-  return 0;
 }
 
 template <unsigned int ImageDimension>
@@ -10977,7 +10900,25 @@ int ConvertImageSetToMatrix(unsigned int argc, char *argv[])
   unsigned long xsize = xx1;
   unsigned long ysize = yy1;
 
-  if( strcmp(ext.c_str(), ".csv") == 0 )
+  if( itk::ants::SubjectVoxelMatrix::IsSubjectVoxelMatrixFileName( outname ) )
+    {
+    // the binary store is always subject-major, i.e. rowcoloption 0
+    if( rowcoloption != 0 )
+      {
+      std::cout << " an .antsmat output holds one subject per row; use rowcoloption 0 " << std::endl;
+      return EXIT_FAILURE;
+      }
+    std::vector<std::string> filenames;
+    for( unsigned int j = argct; j < argc; j++ )
+      {
+      filenames.push_back( std::string( argv[j] ) );
+      }
+    if( !itk::ants::ConvertImageListToSubjectVoxelMatrix<ImageType>( filenames, mask, outname ) )
+      {
+      return EXIT_FAILURE;
+      }
+    }
+  else if( strcmp(ext.c_str(), ".csv") == 0 )
     {
     typedef itk::Array2D<double> MatrixType;
     std::vector<std::string> ColumnHeaders;
@@ -11512,13 +11453,48 @@ int CorrelationUpdate(      int argc, char *argv[])
   return 0;
 }
 
+/** Pack the label images in filenames voxel-major for AtlasLabelStack,
+ *  reading them with ReadImage so that in-memory images passed as pointers
+ *  work too.  The first image is returned in reference. */
+template <class TImage>
+bool ReadAtlasLabels( const std::vector<std::string> & filenames, std::vector<typename TImage::PixelType> & data,
+                      typename TImage::Pointer & reference )
+{
+  const unsigned long nImages = filenames.size();
+
+  for( unsigned long i = 0; i < nImages; i++ )
+    {
+    typename TImage::Pointer image = ITK_NULLPTR;
+    if( !ReadImage<TImage>( image, filenames[i].c_str() ) )
+      {
+      return false;
+      }
+    if( i == 0 )
+      {
+      reference = image;
+      data.resize( image->GetLargestPossibleRegion().GetNumberOfPixels() * nImages );
+      }
+    else if( image->GetLargestPossibleRegion().GetSize() != reference->GetLargestPossibleRegion().GetSize() )
+      {
+      std::cout << filenames[i] << " does not match the size of " << filenames[0] << std::endl;
+      return false;
+      }
+    const typename TImage::PixelType *buffer = image->GetBufferPointer();
+    const unsigned long               nvoxels = image->GetLargestPossibleRegion().GetNumberOfPixels();
+    for( unsigned long v = 0; v < nvoxels; v++ )
+      {
+      data[v * nImages + i] = buffer[v];
+      }
+    }
+  return nImages > 0;
+}
+
 template <unsigned int ImageDimension>
 int MajorityVoting( int argc, char *argv[] )
 {
-  typedef int                                           PixelType;
-  typedef itk::Image<PixelType, ImageDimension>         ImageType;
-  typedef itk::MinimumMaximumImageCalculator<ImageType> CalculatorType;
-  typedef itk::ImageRegionIteratorWithIndex<ImageType>  IteratorType;
+  typedef int                                   PixelType;
+  typedef itk::Image<PixelType, ImageDimension> ImageType;
+  typedef itk::ImageFileReader<ImageType>       ReaderType;
 
   if( argc < 5 )
     {
@@ -11528,54 +11504,58 @@ int MajorityVoting( int argc, char *argv[] )
 
   std::string outputName = std::string( argv[2] );
 
-  // Read input segmentations
-  const unsigned long                               nImages = argc - 4;
-  typename std::vector<typename ImageType::Pointer> images(argc - 4);
+  std::vector<std::string> filenames;
+  bool                     inMemory = false;
   for( int i = 4; i < argc; i++ )
     {
-    ReadImage<ImageType>( images[i - 4], argv[i] );
+    filenames.push_back( std::string( argv[i] ) );
+    inMemory = inMemory || ( filenames.back().substr( 0, 2 ) == std::string( "0x" ) );
     }
 
-  // Find maximum label
-  int maxLabel = 0;
-  for( unsigned int i = 0; i < nImages; i++ )
+  AtlasLabelStack<PixelType> stack;
+  std::vector<PixelType>     data;
+  std::vector<PixelType>     votes;
+  if( inMemory )
     {
-    typename CalculatorType::Pointer calc = CalculatorType::New();
-    calc->SetImage( images[i] );
-    calc->ComputeMaximum();
-    if( calc->GetMaximum() > maxLabel )
+    typename ImageType::Pointer reference = ITK_NULLPTR;
+    if( !ReadAtlasLabels<ImageType>( filenames, data, reference ) )
       {
-      maxLabel = calc->GetMaximum();
+      return 1;
       }
+    typename ImageType::Pointer output = AllocImage<ImageType>( reference, 0 );
+    stack.SetLabels( data, filenames.size() );
+    stack.MajorityVote( votes );
+    std::copy( votes.begin(), votes.end(), output->GetBufferPointer() );
+    WriteImage<ImageType>( output, outputName.c_str() );
+    return 0;
     }
-  unsigned long nLabels = maxLabel + 1; // account for label=0
-
-  typename ImageType::Pointer output =
-    AllocImage<ImageType>(images[0], 0);
 
-  IteratorType              it( output, output->GetLargestPossibleRegion() );
-  itk::Array<unsigned long> votes;
-  votes.SetSize( nLabels );
+  // the output takes its geometry from the first segmentation; the
+  // segmentations are only ever read and voted on one slab at a time, so
+  // memory stays bounded however many atlases there are
+  typename ReaderType::Pointer inforeader = ReaderType::New();
+  inforeader->SetFileName( filenames[0].c_str() );
+  inforeader->UpdateOutputInformation();
+  const typename ImageType::RegionType fullRegion = inforeader->GetOutput()->GetLargestPossibleRegion();
+  typename ImageType::Pointer output = AllocImage<ImageType>( fullRegion,
+                                                              inforeader->GetOutput()->GetSpacing(),
+                                                              inforeader->GetOutput()->GetOrigin(),
+                                                              inforeader->GetOutput()->GetDirection(), 0 );
 
-  while( !it.IsAtEnd() )
+  const unsigned long nslices = fullRegion.GetSize()[ImageDimension - 1];
+  const unsigned long sliceVoxels = fullRegion.GetNumberOfPixels() / nslices;
+  const unsigned long slabThickness =
+    ImageSetCanStreamRead( filenames ) ? GetImageSetSlabThickness( fullRegion, filenames.size() ) : nslices;
+  for( unsigned long first = 0; first < nslices; first += slabThickness )
     {
-    votes.Fill(0);
-    unsigned long maxVotes = 0;
-    unsigned long votedLabel = 0;
-    for( unsigned long i = 0; i < nImages; i++ )
+    const typename ImageType::RegionType slab = GetImageSetSlab( fullRegion, first, slabThickness );
+    if( !ReadImageSetSlab<ImageType>( filenames, slab, fullRegion, data ) )
       {
-      unsigned long label = images[i]->GetPixel( it.GetIndex() );
-      votes.SetElement(label, votes.GetElement(label) + 1 );
-
-      if( votes.GetElement(label) > maxVotes )
-        {
-        maxVotes = votes.GetElement(label);
-        votedLabel = label;
-        }
+      return 1;
       }
-
-    it.Set( votedLabel );
-    ++it;
+    stack.SetLabels( data, filenames.size() );
+    stack.MajorityVote( votes );
+    std::copy( votes.begin(), votes.end(), output->GetBufferPointer() + first * sliceVoxels );
     }
 
   WriteImage<ImageType>( output, outputName.c_str() );
@@ -11650,45 +11630,38 @@ int STAPLE( int argc, char *argv[] )
   typedef itk::Image<PixelType, ImageDimension> ImageType;
   typedef itk::Image<float, ImageDimension>     OutputImageType;
 
-  typedef itk::MinimumMaximumImageCalculator<ImageType>      CalculatorType;
-  typedef itk::STAPLEImageFilter<ImageType, OutputImageType> StapleFilterType;
-
   if( argc < 5 )
     {
     // std::cout << " Not enough inputs " << std::endl;
     return 1;
     }
 
-  std::string outputName = std::string( argv[2] );
-  typename StapleFilterType::Pointer stapler = StapleFilterType::New();
+  std::string            outputName = std::string( argv[2] );
   std::string::size_type idx;
   idx = outputName.find_first_of('.');
   std::string tempname = outputName.substr(0, idx);
   std::string extension = outputName.substr(idx, outputName.length() );
   float       confidence = atof( argv[4] ); // = 0.5
 
-  // stapler->SetForegroundValue( foreground );
-  stapler->SetConfidenceWeight( confidence );
-
   // Read input segmentations
-  typename ImageType::Pointer              nullimage( ITK_NULLPTR );
-  std::vector<typename ImageType::Pointer> images(argc - 5, nullimage );
-  typename CalculatorType::Pointer calc = CalculatorType::New();
-  int maxLabel = 0;
+  std::vector<std::string> filenames;
   for( int i = 5; i < argc; i++ )
     {
-    images[i - 5] = ImageType::New();
-    ReadImage<ImageType>( images[i - 5], argv[i] );
-    stapler->SetInput( i - 5, images[i - 5] );
-    // std::cout << "Input image " << i - 5 << " " << argv[i] << std::endl;
-
-    calc->SetImage( images[i - 5] );
-    calc->ComputeMaximum();
-    if( calc->GetMaximum() > maxLabel )
-      {
-      maxLabel = calc->GetMaximum();
-      }
+    filenames.push_back( std::string( argv[i] ) );
+    }
+  typename ImageType::Pointer reference = ITK_NULLPTR;
+  std::vector<PixelType>      data;
+  if( !ReadAtlasLabels<ImageType>( filenames, data, reference ) )
+    {
+    return 1;
     }
+  AtlasLabelStack<PixelType> stack;
+  stack.SetLabels( data, filenames.size() );
+  std::vector<PixelType>().swap( data );
+
+  typename OutputImageType::Pointer output = AllocImage<OutputImageType>( reference, 0 );
+  const int                         maxLabel = stack.GetLabels().back();
+  std::vector<float>                probability;
 
   // std::cout << "Examining " << maxLabel << " labels" << std::endl;
   for( int label = 1; label <= maxLabel; label++ )
@@ -11696,10 +11669,19 @@ int STAPLE( int argc, char *argv[] )
     char num[5];
     sprintf( num, "%04d", label );
 
+    typename AtlasLabelStack<PixelType>::LabelIdType labelId;
+    if( stack.GetLabelId( label, labelId ) )
+      {
+      stack.STAPLE( labelId, confidence, probability );
+      std::copy( probability.begin(), probability.end(), output->GetBufferPointer() );
+      }
+    else
+      {
+      output->FillBuffer( 0 );
+      }
+
     std::string oname = tempname + num + extension;
-    stapler->SetForegroundValue( label );
-    stapler->Update();
-    WriteImage<OutputImageType>( stapler->GetOutput(), oname.c_str() );
+    WriteImage<OutputImageType>( output, oname.c_str() );
     }
 
   return 0;
@@ -11788,13 +11770,10 @@ int AverageLabels( int argc, char *argv[] )
 template <unsigned int ImageDimension>
 int CorrelationVoting( int argc, char *argv[] )
 {
-  typedef float                                              PixelType;
-  typedef int                                                LabelType;
-  typedef itk::Image<PixelType, ImageDimension>              ImageType;
-  typedef itk::Image<LabelType, ImageDimension>              LabelImageType;
-  typedef itk::MinimumMaximumImageCalculator<LabelImageType> CalculatorType;
-  typedef itk::ImageRegionIteratorWithIndex<LabelImageType>  IteratorType;
-  typedef itk::NeighborhoodIterator<ImageType>               NeighborhoodIteratorType;
+  typedef float                                 PixelType;
+  typedef int                                   LabelType;
+  typedef itk::Image<PixelType, ImageDimension> ImageType;
+  typedef itk::Image<LabelType, ImageDimension> LabelImageType;
 
   if( argc < 6 )
     {
@@ -11816,138 +11795,51 @@ int CorrelationVoting( int argc, char *argv[] )
   typename ImageType::Pointer target;
   ReadImage<ImageType>( target, argv[4] );
 
-  typename std::vector<typename ImageType::Pointer>      images(nImages);
-  typename std::vector<typename LabelImageType::Pointer> labels(nImages);
-  for( int i = 5; i < (5 + nImages); i++ )
-    {
-    ReadImage<ImageType>( images[i - 5], argv[i] );
-    }
+  std::vector<std::string> labelnames;
   for( int i = 5 + nImages; i < (5 + 2 * nImages); i++ )
     {
-    ReadImage<LabelImageType>( labels[i - 5 - nImages], argv[i] );
+    labelnames.push_back( std::string( argv[i] ) );
     }
-
-  // Find maximum label
-  int maxLabel = 0;
-  for( int i = 0; i < nImages; i++ )
+  typename LabelImageType::Pointer reference = ITK_NULLPTR;
+  std::vector<LabelType>           data;
+  if( !ReadAtlasLabels<LabelImageType>( labelnames, data, reference ) )
     {
-    typename CalculatorType::Pointer calc = CalculatorType::New();
-    calc->SetImage( labels[i] );
-    calc->ComputeMaximum();
-    if( calc->GetMaximum() > maxLabel )
-      {
-      maxLabel = calc->GetMaximum();
-      }
+    return 1;
     }
-  unsigned long nLabels = maxLabel + 1; // account for label=0
-
-  typename LabelImageType::Pointer output =
-    AllocImage<LabelImageType>(images[0], 0);
+  AtlasLabelStack<LabelType> stack;
+  stack.SetLabels( data, nImages );
+  std::vector<LabelType>().swap( data );
 
-  IteratorType      it( output, output->GetLargestPossibleRegion() );
-  itk::Array<float> votes;
-  votes.SetSize( nLabels );
-
-  typename NeighborhoodIteratorType::RadiusType rad;
-  for( unsigned int j = 0; j < ImageDimension; j++ )
+  // local correlation of each atlas image with the target, weights[ i * nvoxels + v ],
+  // from box sums; each intensity image is only held while its weights are computed
+  const unsigned long nvoxels = stack.GetNumberOfVoxels();
+  if( target->GetLargestPossibleRegion().GetNumberOfPixels() != nvoxels )
     {
-    rad[j] = radius;
+    std::cout << " the target does not match the size of the label images " << std::endl;
+    return 1;
     }
-  NeighborhoodIteratorType metricIt(rad, target, target->GetLargestPossibleRegion() );
-
-  while( !it.IsAtEnd() )
+  LocalCorrelationCalculator<ImageType> correlation;
+  correlation.SetRadius( radius );
+  correlation.SetTarget( target );
+  std::vector<float> weights( nvoxels * nImages );
+  for( int i = 0; i < nImages; i++ )
     {
-    votes.Fill(0);
-    float maxVotes = 0;
-    int   votedLabel = 0;
-    for( int i = 0; i < nImages; i++ )
-      {
-      int label = labels[i]->GetPixel( it.GetIndex() );
-      votes.SetElement(label, votes.GetElement(label) + 1 );
-
-      if( votes.GetElement(label) > maxVotes )
-        {
-        maxVotes = votes.GetElement(label);
-        votedLabel = label;
-        }
-      }
-
-    // If all agree, assign label immediately
-    if( maxVotes == nImages )
+    typename ImageType::Pointer image;
+    ReadImage<ImageType>( image, argv[5 + i] );
+    if( image->GetLargestPossibleRegion().GetNumberOfPixels() != nvoxels )
       {
-      it.Set( votedLabel );
+      std::cout << argv[5 + i] << " does not match the size of the target " << std::endl;
+      return 1;
       }
-    else
-      {
-      votes.Fill( 0.0 );
-      maxVotes = 0.0;
-      votedLabel = 0;
-
-      itk::VariableLengthVector<float> weights( nImages );
-      for( int i = 0; i < nImages; i++ )
-        {
-        metricIt.SetLocation( it.GetIndex() );
-        float targetMean = 0.0;
-        float targetVar = 0.0;
-        float imageMean = 0.0;
-        float imageVar = 0.0;
-        float k = 0;
-        float product = 0.0;
-        for( unsigned int j = 0; j < metricIt.Size(); j++ )
-          {
-          typename NeighborhoodIteratorType::OffsetType internal;
-          typename NeighborhoodIteratorType::OffsetType offset;
-          if( metricIt.IndexInBounds( j, internal, offset ) )
-            {
-            k++;
-            typename ImageType::IndexType idx = metricIt.GetIndex( j );
-            if( k == 1 )
-              {
-              targetMean = target->GetPixel( idx );
-              imageMean = images[i]->GetPixel( idx );
-              targetVar = 0.0;
-              imageVar = 0.0;
-              }
-            else
-              {
-              float oldMean = targetMean;
-              float value = target->GetPixel( idx );
-              targetMean = targetMean + (value - targetMean) / k;
-              targetVar = targetVar + (value - oldMean) * ( value - targetMean );
-
-              oldMean = imageMean;
-              float iValue = images[i]->GetPixel( idx );
-              imageMean = imageMean + ( iValue - imageMean ) / k;
-              imageVar = imageVar + ( iValue - oldMean) * ( iValue - imageMean );
-
-              product += value * iValue;
-              }
-            } // metricIt.IndexInBounds()
-          }   // j >= metricIt.Size()
-
-        targetVar /= (k - 1);
-        imageVar /= (k - 1);
-        float pearson =
-          ( product - k * targetMean * imageMean ) / ( (k - 1) * std::sqrt(targetVar) * std::sqrt(imageVar) );
-        weights.SetElement( i, std::fabs(pearson) );
-        } // i >= nImages
-      for( int i = 0; i < nImages; i++ )
-        {
-        int label = labels[i]->GetPixel( it.GetIndex() );
-        votes.SetElement(label, votes.GetElement(label) + weights.GetElement(i) );
-
-        if( votes.GetElement(label) > maxVotes )
-          {
-          maxVotes = votes.GetElement(label);
-          votedLabel = label;
-          }
-        }
+    correlation.ComputeWeights( image, &weights[i * nvoxels] );
+    }
 
-      it.Set(votedLabel);
-      } // else find weighted vote winner
-
-    ++it;
-    } // iterate over output image
+  // If all agree, the label is assigned immediately; otherwise the label
+  // with the largest sum of correlation weights wins
+  typename LabelImageType::Pointer output = AllocImage<LabelImageType>( reference, 0 );
+  std::vector<LabelType>           votes;
+  stack.WeightedVote( &weights[0], votes );
+  std::copy( votes.begin(), votes.end(), output->GetBufferPointer() );
 
   WriteImage<LabelImageType>( output, outputName.c_str() );
   return 0;
@@ -12309,11 +12201,11 @@ int MinMaxMean( int argc, char *argv[] )
 }
 
 template <unsigned int ImageDimension, class TRealType, class TImageType, class TGImageType, class TInterp>
-TRealType PatchCorrelation(  itk::NeighborhoodIterator<TImageType> GHood,  itk::NeighborhoodIterator<TImageType> GHood2,
-                             std::vector<unsigned int> activeindex, std::vector<TRealType> weight,
-                             typename TGImageType::Pointer gimage,
-                             typename TGImageType::Pointer gimage2,
-                             TInterp interp2 )
+static TRealType PatchCorrelation(  itk::NeighborhoodIterator<TImageType> GHood,  itk::NeighborhoodIterator<TImageType> GHood2,
+                                    std::vector<unsigned int> activeindex, std::vector<TRealType> weight,
+                                    typename TGImageType::Pointer gimage,
+                                    typename TGImageType::Pointer gimage2,
+                                    TInterp interp2 )
 {
   typedef TRealType                                      RealType;
   typedef typename TImageType::PointType                 PointType;
@@ -13891,6 +13783,10 @@ ImageMathHelper3DOnly(int argc, char **argv)
     TensorFunctions<DIM>(argc, argv);
     return EXIT_SUCCESS;
     }
+  if( operation == "TensorMaps" )
+    {
+    return TensorMaps<DIM>(argc, argv);
+    }
   if( operation == "TensorMeanDiffusion" )
     {
     TensorFunctions<DIM>(argc, argv);
@@ -14843,6 +14739,9 @@ private:
     std::cout << "    Usage        : TensorToVectorComponent DTImage.ext WhichVec" << std::endl;
     std::cout << "  TensorMask     : Mask a tensor image, sets background tensors to zero or to isotropic tensors with specified mean diffusivity " << std::endl;
     std::cout << "    Usage        : TensorMask DTImage.ext mask.ext [ backgroundMD = 0 ] " << std::endl;
+    std::cout << "  TensorMaps     : Writes any of FA, MD, AD, RD, RGB and V (principal eigenvector) in one pass, "
+              << "as outprefixFA.ext etc. Voxels outside the optional mask are zero" << std::endl;
+    std::cout << "    Usage        : TensorMaps DTImage.ext [ maps = FA,MD,AD,RD,RGB,V ] [ mask.ext ] " << std::endl;
     std::cout << "  FuseNImagesIntoNDVectorField     : Create ND field from N input scalar images" << std::endl;
     std::cout << "    Usage        : FuseNImagesIntoNDVectorField imagex imagey imagez" << std::endl;
 
@@ -14897,6 +14796,8 @@ private:
       << std::endl;
     std::cout << "      Usage        : ConvertImageSetToMatrix rowcoloption Mask.nii *images.nii" << std::endl;
     std::cout << " ConvertImageSetToMatrix output can be an image type or csv file type." << std::endl;
+    std::cout << " An .antsmat output is a memory-mapped binary subject x voxel matrix, built in parallel,"
+              << " that sccan reads directly; it requires rowcoloption 0." << std::endl;
 
     std::cout << "\n  RandomlySampleImageSetToCSV: N random samples are selected from each image in a list "
               << std::endl;
@@ -14933,6 +14834,7 @@ private:
       "\n  ConvertVectorToImage    : The vector contains image content extracted from a mask. Here the vector is returned to its spatial origins as image content "
       << std::endl;
     std::cout << "      Usage        : ConvertVectorToImage Mask.nii vector.nii" << std::endl;
+    std::cout << "      Usage        : ConvertVectorToImage Mask.nii matrix.antsmat {subject-row=0}" << std::endl;
 
     std::cout << "\n  CorrelationUpdate    : In voxels, compute update that makes Image2 more like Image1."
               << std::endl;
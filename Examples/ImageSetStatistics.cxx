@@ -20,6 +20,8 @@
 #include <ctime>
 #include <iostream>
 #include "ReadWriteData.h"
+#include "antsImageSetSlab.h"
+#include "antsParallelizeRange.h"
 
 #include "itkMersenneTwisterRandomVariateGenerator.h"
 #include "itkHistogramMatchingImageFilter.h"
@@ -42,7 +44,7 @@
 namespace ants
 {
 template <class TImageType>
-void ReadImage(itk::SmartPointer<TImageType> & target, const char *file, bool copy)
+static void ReadImage(itk::SmartPointer<TImageType> & target, const char *file, bool copy)
 {
   //  std::cout << " reading b " << std::string(file) << std::endl;
   typedef itk::ImageFileReader<TImageType> readertype;
@@ -118,7 +120,7 @@ double TProb(double t, int df)
 }
 
 template <class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 SmoothImage(typename TImage::Pointer image, float sig)
 {
   typedef itk::DiscreteGaussianImageFilter<TImage, TImage> dgf;
@@ -420,7 +422,10 @@ GetClusterStat(typename TImage::Pointer image, float Tthreshold, unsigned int mi
     }
 }
 
-float median(std::vector<float> vec)
+/** The statistics below work in caller-owned scratch vectors so that the
+ *  per-voxel loop does not allocate; median uses selection instead of a
+ *  full sort. */
+float median(std::vector<float> & vec)
 {
   typedef  std::vector<float>::size_type vec_sz;
   vec_sz size = vec.size();
@@ -431,16 +436,18 @@ float median(std::vector<float> vec)
     }
   //            throw domain_error("median of an empty vector");
 
-  sort(vec.begin(), vec.end() );
-
   vec_sz mid = size / 2;
-
-  return size % 2 == 0
-         ? (vec[mid] + vec[mid - 1]) / 2
-         : vec[mid];
+  std::nth_element( vec.begin(), vec.begin() + mid, vec.end() );
+  if( size % 2 == 0 )
+    {
+    // after the selection the lower half holds the smaller values
+    const float lower = *std::max_element( vec.begin(), vec.begin() + mid );
+    return (vec[mid] + lower) / 2;
+    }
+  return vec[mid];
 }
 
-float npdf(std::vector<float> vec, bool opt,  float www)
+float npdf(const std::vector<float> & vec, bool opt,  float www)
 {
   typedef  std::vector<float>::size_type vec_sz;
   vec_sz size = vec.size();
@@ -482,7 +489,6 @@ float npdf(std::vector<float> vec, bool opt,  float www)
   //    else std::cout << " Mean " << mean << " var " << var << std::endl;
 
   // eval parzen probability
-  std::vector<float> prob(size);
   float              maxprob = 0;
 //        float maxprobval=0;
   float        weightedmean = 0;
@@ -508,8 +514,7 @@ float npdf(std::vector<float> vec, bool opt,  float www)
       {
       float delt = vec[i] - sample;
       delt *= delt;
-      prob[i] = 1.0 / (2.0 * 3.1214 * width) * exp(-0.5 * delt / (width * width) );
-      total += prob[i];
+      total += 1.0 / (2.0 * 3.1214 * width) * exp(-0.5 * delt / (width * width) );
       //            maxprobval+=prob[i]
       }
     if( total > maxprob )
@@ -535,7 +540,7 @@ float npdf(std::vector<float> vec, bool opt,  float www)
     }
 }
 
-float trimmean(std::vector<float> vec)
+float trimmean(const std::vector<float> & vec)
 {
   typedef  std::vector<float>::size_type vec_sz;
   vec_sz size = vec.size();
@@ -546,20 +551,19 @@ float trimmean(std::vector<float> vec)
     }
   //            throw domain_error("median of an empty vector");
 
-  sort(vec.begin(), vec.end() );
-
+  // the trimming bounds keep every sample, so no ordering is needed
   const unsigned int lo = 0;
   const unsigned int hi = size;
   const unsigned int ct = hi - lo;
-  float total = 0;
+  double total = 0;
   for( unsigned int i = lo; i < hi; i++ )
     {
     total += vec[i];
     }
-  return total / (float)ct;
+  return static_cast<float>( total / (double)ct );
 }
 
-float myantsmax(std::vector<float> vec)
+float myantsmax(const std::vector<float> & vec)
 {
   typedef  std::vector<float>::size_type vec_sz;
   vec_sz size = vec.size();
@@ -580,7 +584,7 @@ float myantsmax(std::vector<float> vec)
   return max;
 }
 
-float myantssimilaritymaxlabel(std::vector<float> labelvec, std::vector<float> similarityvec, bool opt)
+float myantssimilaritymaxlabel(const std::vector<float> & labelvec, const std::vector<float> & similarityvec, bool opt)
 {
   typedef  std::vector<float>::size_type vec_sz;
   vec_sz size = labelvec.size();
@@ -619,15 +623,109 @@ float myantssimilaritymaxlabel(std::vector<float> labelvec, std::vector<float> s
     }
 }
 
+/** Computes the requested statistic for a range of voxels of the current
+ *  slab.  Each thread owns one pair of scratch vectors. */
+template <class TImage>
+class ImageSetStatisticsSlabFunctor
+{
+public:
+  typedef typename TImage::IndexType  IndexType;
+  typedef typename TImage::RegionType RegionType;
+
+  ImageSetStatisticsSlabFunctor( unsigned int whichstat, float www, unsigned long nimages, unsigned long nsimilarity,
+                                 unsigned int nthreads ) :
+    m_WhichStat( whichstat ), m_Width( www ), m_NumberOfImages( nimages ), m_NumberOfSimilarityImages( nsimilarity ),
+    m_Values( nthreads, std::vector<float>( nimages ) ), m_Similarities( nthreads, std::vector<float>( nsimilarity ) ),
+    m_Data( ITK_NULLPTR ), m_SimilarityData( ITK_NULLPTR ), m_Output( ITK_NULLPTR ), m_ROI( ITK_NULLPTR )
+  {
+  }
+
+  void SetSlab( const RegionType & slab, const std::vector<float> * data, const std::vector<float> * simdata,
+                TImage * output, const TImage * roi )
+  {
+    this->m_Slab = slab;
+    this->m_Data = data;
+    this->m_SimilarityData = simdata;
+    this->m_Output = output;
+    this->m_ROI = roi;
+  }
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    std::vector<float> & voxels = this->m_Values[threadId];
+    std::vector<float> & similarities = this->m_Similarities[threadId];
+    for( itk::SizeValueType v = begin; v < end; v++ )
+      {
+      const IndexType ind = GetImageSetSlabIndex( this->m_Slab, v );
+      unsigned int    maxval = 0;
+      if( this->m_ROI )
+        {
+        if( this->m_ROI->GetPixel(ind) < 0.5 )
+          {
+          this->m_Output->SetPixel(ind, 0);
+          continue;
+          }
+        maxval = (unsigned int)(this->m_ROI->GetPixel(ind) - 1);
+        }
+      const float * values = &( *this->m_Data )[v * this->m_NumberOfImages];
+      std::copy( values, values + this->m_NumberOfImages, voxels.begin() );
+      if( this->m_NumberOfSimilarityImages > 0 )
+        {
+        const float * sims = &( *this->m_SimilarityData )[v * this->m_NumberOfSimilarityImages];
+        std::copy( sims, sims + this->m_NumberOfSimilarityImages, similarities.begin() );
+        }
+      float stat = 0;
+      switch( this->m_WhichStat )
+        {
+        case 1:
+          stat = npdf(voxels, true, this->m_Width);
+          break;
+        case 2:
+          stat = npdf(voxels, false, this->m_Width);
+          break;
+        case 3:
+          stat = trimmean(voxels);
+          break;
+        case 4:
+          stat = myantsmax(voxels);
+          break;
+        case 5:
+          stat = myantssimilaritymaxlabel(voxels, similarities, true);
+          break;
+        case 6:
+          stat = myantssimilaritymaxlabel(voxels, similarities, false);
+          break;
+        case 7:
+          stat = voxels[maxval];
+          break;
+        default:
+          stat = median(voxels);
+          break;
+        }
+      this->m_Output->SetPixel(ind, stat);
+      }
+  }
+
+private:
+  unsigned int                     m_WhichStat;
+  float                            m_Width;
+  unsigned long                    m_NumberOfImages;
+  unsigned long                    m_NumberOfSimilarityImages;
+  std::vector<std::vector<float> > m_Values;
+  std::vector<std::vector<float> > m_Similarities;
+  RegionType                       m_Slab;
+  const std::vector<float> *       m_Data;
+  const std::vector<float> *       m_SimilarityData;
+  TImage *                         m_Output;
+  const TImage *                   m_ROI;
+};
+
 template <unsigned int ImageDimension>
 int ImageSetStatistics(int argc, char *argv[])
 {
   typedef float                                                           PixelType;
   typedef itk::Image<PixelType, ImageDimension>                           ImageType;
   typedef itk::ImageFileReader<ImageType>                                 readertype;
-  typedef typename ImageType::IndexType                                   IndexType;
-  typedef itk::ImageRegionIteratorWithIndex<ImageType>                    Iterator;
-  unsigned int mch = 0;
   int          argct = 2;
   std::string  fn1 = std::string(argv[argct]); argct++;
   std::string  outfn = std::string(argv[argct]); argct++;
@@ -646,12 +744,11 @@ int ImageSetStatistics(int argc, char *argv[])
   // if (argc > argct) { www=atof(argv[argct]);argct++;}
   //  unsigned int mchmax= 0;
   // if (argc > argct) { mchmax=atoi(argv[argct]); argct++;}
-  unsigned int localmeanrad = 0;
+  // unsigned int localmeanrad = 0;
   // if (argc > argct) { localmeanrad=atoi(argv[argct]);argct++;}
 
   //  std::cout <<" roifn " << roifn << " fn1 " << fn1 << " whichstat " << whichstat << std::endl;
 
-  typename ImageType::Pointer outimage = ITK_NULLPTR;
   typename ImageType::Pointer ROIimg = ITK_NULLPTR;
 
   if( roifn.length() > 4 )
@@ -741,14 +838,8 @@ int ImageSetStatistics(int argc, char *argv[])
     } // fi simimagelist
   std::cout << " NFiles2 " << filecount2 << std::endl;
 
-  typename ImageType::Pointer meanimage;
-  std::vector<typename ImageType::Pointer> imagestack;
-  imagestack.resize(filecount1);
-  //  imagestack.fill(NULL);
-  std::vector<std::string> filenames(filecount1);
-  typename ImageType::Pointer StatImage;
-  unsigned int  ct = 0;
-  std::ifstream inputStreamA( fn1.c_str(), std::ios::in );
+  std::vector<std::string> filenames;
+  std::ifstream            inputStreamA( fn1.c_str(), std::ios::in );
   if( !inputStreamA.is_open() )
     {
     std::cout << "Can't open parameter file: " << fn1 << std::endl;
@@ -766,27 +857,14 @@ int ImageSetStatistics(int argc, char *argv[])
       }
     else
       {
-      filenames[ct] = std::string(filenm);
-      ReadImage<ImageType>(imagestack[ct], filenm, false);
-      if( ct == 0 )
-        {
-        meanimage = MakeNewImage<ImageType>(imagestack[ct], 0);
-        }
-      if( localmeanrad > 0 )
-        {
-        LocalMean<ImageType>(imagestack[ct], localmeanrad, meanimage);
-        }
-      std::cout << " done reading " << (float) ct / (float ) filecount1 << std::endl;
-      ct++;
+      filenames.push_back( std::string(filenm) );
       }
     }
 
   inputStreamA.close();
 
-  // read similarity images, if needed
-  std::vector<typename ImageType::Pointer> simimagestack;
-  simimagestack.resize(filecount2);
-  ct = 0;
+  // list the similarity images, if needed
+  std::vector<std::string> simfilenames;
   if( simimagelist.length() > 2 && ( whichstat == 5 || whichstat == 6 ) )
     {
     inputStreamA.open( simimagelist.c_str() );
@@ -804,152 +882,58 @@ int ImageSetStatistics(int argc, char *argv[])
         }
       else
         {
-        ReadImage<ImageType>(simimagestack[ct], filenm, false);
-        ct++;
+        simfilenames.push_back( std::string(filenm) );
         }
       }
 
     inputStreamA.close();
     } // fi read similarity images
-
-  ReadImage<ImageType>( StatImage, filenames[0].c_str(), false);
-  Iterator           vfIter(StatImage, StatImage->GetLargestPossibleRegion() );
-  std::vector<float> voxels(filecount1);
-  std::vector<float> similarities(filecount2);
-  unsigned long      nvox = 1;
-  for( unsigned int i = 0; i < ImageDimension; i++ )
+  if( filenames.empty() )
     {
-    nvox *= StatImage->GetLargestPossibleRegion().GetSize()[i];
+    std::cout << " no images listed in " << fn1 << std::endl;
+    return EXIT_FAILURE;
     }
 
-  ct = 0;
-  unsigned long prog = nvox / 15;
-  for(  vfIter.GoToBegin(); !vfIter.IsAtEnd(); ++vfIter )
+  // the output takes its geometry from the first image; the images
+  // themselves are only ever read one slab at a time
+  typename readertype::Pointer inforeader = readertype::New();
+  inforeader->SetFileName( filenames[0].c_str() );
+  inforeader->UpdateOutputInformation();
+  const typename ImageType::RegionType fullRegion = inforeader->GetOutput()->GetLargestPossibleRegion();
+  typename ImageType::Pointer StatImage = AllocImage<ImageType>( fullRegion,
+                                                                 inforeader->GetOutput()->GetSpacing(),
+                                                                 inforeader->GetOutput()->GetOrigin(),
+                                                                 inforeader->GetOutput()->GetDirection(), 0 );
+
+  // size the slabs along the slowest axis so that all subjects of one slab
+  // fit into a fixed memory budget; images that cannot be streamed are
+  // read whole, once
+  const unsigned int  slabAxis = ImageDimension - 1;
+  const unsigned long nslices = fullRegion.GetSize()[slabAxis];
+  const unsigned long slabThickness =
+    ( ImageSetCanStreamRead( filenames ) && ImageSetCanStreamRead( simfilenames ) ) ?
+    GetImageSetSlabThickness( fullRegion, filenames.size() + simfilenames.size() ) : nslices;
+
+  const itk::ThreadIdType nthreads =
+    ants::GetNumberOfThreadsForRange( fullRegion.GetNumberOfPixels() / nslices * slabThickness );
+  ImageSetStatisticsSlabFunctor<ImageType> functor( whichstat, www, filenames.size(), simfilenames.size(), nthreads );
+  std::vector<float> data;
+  std::vector<float> simdata;
+  for( unsigned long first = 0; first < nslices; first += slabThickness )
     {
-    if( ct % prog == 0 )
-      {
-      std::cout << " % " << (float) ct / (float) nvox << std::endl;
-      }
-    ct++;
-    IndexType    ind = vfIter.GetIndex();
-    unsigned int maxval = 0;
-    bool         takesample = true;
-    if( ROIimg )
-      {
-      if( ROIimg->GetPixel(ind) < 0.5 )
-        {
-        takesample = false;
-        }
-      else
-        {
-        maxval = (unsigned int)(ROIimg->GetPixel(ind) - 1);
-        }
-      }
-    if( takesample )
-      {
-      if( mch == 0 )
-        {
-        meanimage->SetPixel(ind, meanimage->GetPixel(ind) / filecount1 );
-        }
-      for( unsigned int j = 0; j < filecount1; j++ )
-        {
-        voxels[j] = imagestack[j]->GetPixel(ind);
-        }
-      for( unsigned int j = 0; j < filecount2; j++ )
-        {
-        similarities[j] = simimagestack[j]->GetPixel(ind);
-        }
-      float stat = 0;
-
-      switch( whichstat )
-        {
-        case 1:
-          {
-          stat = npdf(voxels, true, www);
-          if( ct == 1 )
-            {
-            std::cout << "the max prob appearance \n";
-            }
-          }
-          break;
-        case 2:
-          {
-          stat = npdf(voxels, false, www);
-          if( ct == 1 )
-            {
-            std::cout << "the probabilistically weighted appearance " << www << " \n";
-            }
-          }
-          break;
+    const typename ImageType::RegionType slab = GetImageSetSlab( fullRegion, first, slabThickness );
+    std::cout << " % " << (float) first / (float) nslices << std::endl;
 
-        case 3:
-          {
-          stat = trimmean(voxels);
-          if( ct == 1 )
-            {
-            std::cout << "the trimmed mean appearance \n";
-            }
-          }
-          break;
-
-        case 4:
-          {
-          stat = myantsmax(voxels);
-          if( ct == 1 )
-            {
-            std::cout << "the maximum appearance \n";
-            }
-          }
-          break;
-        case 5:
-          {
-          stat = myantssimilaritymaxlabel(voxels, similarities, true);
-          if( ct == 1 )
-            {
-            std::cout << "the maximum similarity-based label \n";
-            }
-          }
-          break;
-        case 6:
-          {
-          stat = myantssimilaritymaxlabel(voxels, similarities, false);
-          if( ct == 1 )
-            {
-            std::cout << "which image provides the maximum similarity-based label \n";
-            }
-          }
-          break;
-        case 7:
-          {
-          stat = voxels[maxval];
-          if( ct == 1 )
-            {
-            std::cout << "which image provides the maximum similarity-based label \n";
-            }
-          }
-          break;
-
-        default:
-          {
-          stat = median(voxels);
-          if( ct == 1 )
-            {
-            std::cout << "the median appearance \n";
-            }
-          }
-          break;
-        }
-      float sval = stat;
-      if( localmeanrad > 0 )
-        {
-        sval += meanimage->GetPixel(ind);
-        }
-      StatImage->SetPixel(ind, sval);
+    if( !ReadImageSetSlab<ImageType>( filenames, slab, fullRegion, data ) )
+      {
+      return EXIT_FAILURE;
       }
-    else
+    if( !simfilenames.empty() && !ReadImageSetSlab<ImageType>( simfilenames, slab, fullRegion, simdata ) )
       {
-      StatImage->SetPixel(ind, 0);
+      return EXIT_FAILURE;
       }
+    functor.SetSlab( slab, &data, &simdata, StatImage, ROIimg );
+    ants::ParallelizeRange( 0, slab.GetNumberOfPixels(), functor, nthreads );
     }
   WriteImage<ImageType>(StatImage, outfn.c_str() );
 
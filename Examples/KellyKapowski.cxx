@@ -16,6 +16,8 @@
 
 namespace ants
 {
+namespace
+{
 template <class TFilter>
 class CommandIterationUpdate : public itk::Command
 {
@@ -59,6 +61,7 @@ public:
     std::cout << std::endl;
   }
 };
+} // namespace
 
 template <unsigned int ImageDimension>
 int DiReCT( itk::ants::CommandLineParser *parser )
@@ -340,6 +343,30 @@ int DiReCT( itk::ants::CommandLineParser *parser )
                                                                  numberOfInvertDisplacementFieldIterationsOption->GetFunction( 0 )->GetName() ) );
     }
 
+  //
+  // restrict to the bounding region of the gray and white matters?
+  //
+  typename itk::ants::CommandLineParser::OptionType::Pointer
+    boundingRegionOption = parser->GetOption( "restrict-to-bounding-region" );
+  if( boundingRegionOption && boundingRegionOption->GetNumberOfFunctions() )
+    {
+    if( boundingRegionOption->GetFunction( 0 )->GetNumberOfParameters() == 0 )
+      {
+      direct->SetRestrictToBoundingRegion( parser->Convert<bool>(
+                                             boundingRegionOption->GetFunction( 0 )->GetName() ) );
+      }
+    else
+      {
+      direct->SetRestrictToBoundingRegion( parser->Convert<bool>(
+                                             boundingRegionOption->GetFunction( 0 )->GetParameter( 0 ) ) );
+      if( boundingRegionOption->GetFunction( 0 )->GetNumberOfParameters() > 1 )
+        {
+        direct->SetBoundingRegionPadding( parser->Convert<unsigned int>(
+                                            boundingRegionOption->GetFunction( 0 )->GetParameter( 1 ) ) );
+        }
+      }
+    }
+
   if( verbose )
     {
     typedef CommandIterationUpdate<DiReCTFilterType> CommandType;
@@ -585,6 +612,22 @@ void KellyKapowskiInitializeCommandLineOptions( itk::ants::CommandLineParser *pa
   parser->AddOption( option );
   }
 
+  {
+  std::string description =
+    std::string( "Restrict the computation to the bounding box of the gray and white matters, " )
+    + std::string( "padded by the given number of voxels.  The fields are then only as large as " )
+    + std::string( "the cortical ribbon's bounding box which reduces both run time and memory.  " )
+    + std::string( "Default = false, padding = 10." );
+
+  OptionType::Pointer option = OptionType::New();
+  option->SetLongName( "restrict-to-bounding-region" );
+  option->SetShortName( 'e' );
+  option->SetUsageOption( 0, "1/(0)" );
+  option->SetUsageOption( 1, "[1/(0),<padding=10>]" );
+  option->SetDescription( description );
+  parser->AddOption( option );
+  }
+
   {
   std::string description =
     std::string( "The output consists of a thickness map defined in the " )
@@ -35,7 +35,7 @@
 namespace ants
 {
 template <class TField, class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 GetVectorComponent(typename TField::Pointer field, unsigned int index)
 {
   // Initialize the Moving to the displacement field
@@ -81,7 +81,7 @@ MaurerDistanceMap(
 }
 
 template <class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 SmoothImage(typename TImage::Pointer image, double sig)
 {
 // find min value
@@ -108,7 +108,7 @@ SmoothImage(typename TImage::Pointer image, double sig)
 }
 
 template <class TImage>
-void
+static void
 SmoothDeformation(typename TImage::Pointer vectorimage, double sig)
 {
   enum { ImageDimension = TImage::ImageDimension };
@@ -158,7 +158,7 @@ CopyImage(TDisplacementField* field )
 }
 
 template <class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 LabelSurface(typename TImage::PixelType foreground,
              typename TImage::PixelType newval, typename TImage::Pointer input, double distthresh )
 {
@@ -219,7 +219,7 @@ LabelSurface(typename TImage::PixelType foreground,
 }
 
 template <class TImage, class TField>
-typename TField::Pointer
+static typename TField::Pointer
 LaplacianGrad(typename TImage::Pointer wm, typename TImage::Pointer gm, double sig)
 {
   typedef  typename TImage::IndexType IndexType;
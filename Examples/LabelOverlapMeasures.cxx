@@ -36,6 +36,11 @@ int LabelOverlapMeasures( int argc, char * argv[] )
     {
     outputCSVFormat = true;
     }
+  bool computeSurfaceDistances = false;
+  if( argc > 5 )
+    {
+    computeSurfaceDistances = ( atoi( argv[5] ) != 0 );
+    }
 
   typedef unsigned int                          PixelType;
   typedef itk::Image<PixelType, ImageDimension> ImageType;
@@ -50,6 +55,7 @@ int LabelOverlapMeasures( int argc, char * argv[] )
   typename FilterType::Pointer filter = FilterType::New();
   filter->SetSourceImage( reader1->GetOutput() );
   filter->SetTargetImage( reader2->GetOutput() );
+  filter->SetComputeSurfaceDistances( computeSurfaceDistances );
   filter->Update();
 
   typename FilterType::MapType labelMap = filter->GetLabelSetMeasures();
@@ -80,6 +86,11 @@ int LabelOverlapMeasures( int argc, char * argv[] )
     columnHeaders.push_back( std::string( "VolumeSimilarity" ) );
     columnHeaders.push_back( std::string( "FalseNegative" ) );
     columnHeaders.push_back( std::string( "FalsePositive" ) );
+    if( computeSurfaceDistances )
+      {
+      columnHeaders.push_back( std::string( "Hausdorff" ) );
+      columnHeaders.push_back( std::string( "MeanSurfaceDistance" ) );
+      }
 
     std::vector<std::string>   rowHeaders;
     rowHeaders.push_back( std::string( "All" ) );
@@ -93,7 +104,7 @@ int LabelOverlapMeasures( int argc, char * argv[] )
       ++itL;
       }
 
-    vnl_matrix<double> measures( allLabels.size() + 1, 6 );
+    vnl_matrix<double> measures( allLabels.size() + 1, computeSurfaceDistances ? 8 : 6 );
 
     measures( 0, 0 ) = filter->GetTotalOverlap();
     measures( 0, 1 ) = filter->GetUnionOverlap();
@@ -101,6 +112,11 @@ int LabelOverlapMeasures( int argc, char * argv[] )
     measures( 0, 3 ) = filter->GetVolumeSimilarity();
     measures( 0, 4 ) = filter->GetFalseNegativeError();
     measures( 0, 5 ) = filter->GetFalsePositiveError();
+    if( computeSurfaceDistances )
+      {
+      measures( 0, 6 ) = filter->GetHausdorffDistance();
+      measures( 0, 7 ) = filter->GetMeanSurfaceDistance();
+      }
 
     unsigned int rowIndex = 1;
     for( itL = allLabels.begin(); itL != allLabels.end(); ++itL )
@@ -111,6 +127,11 @@ int LabelOverlapMeasures( int argc, char * argv[] )
       measures( rowIndex, 3 ) = filter->GetVolumeSimilarity( *itL );
       measures( rowIndex, 4 ) = filter->GetFalseNegativeError( *itL );
       measures( rowIndex, 5 ) = filter->GetFalsePositiveError( *itL );
+      if( computeSurfaceDistances )
+        {
+        measures( rowIndex, 6 ) = filter->GetHausdorffDistance( *itL );
+        measures( rowIndex, 7 ) = filter->GetMeanSurfaceDistance( *itL );
+        }
       rowIndex++;
       }
 
@@ -141,7 +162,13 @@ int LabelOverlapMeasures( int argc, char * argv[] )
               << std::setw( 17 ) << "Mean (dice)"
               << std::setw( 17 ) << "Volume sim."
               << std::setw( 17 ) << "False negative"
-              << std::setw( 17 ) << "False positive" << std::endl;
+              << std::setw( 17 ) << "False positive";
+    if( computeSurfaceDistances )
+      {
+      std::cout << std::setw( 17 ) << "Hausdorff"
+                << std::setw( 17 ) << "Mean surface";
+      }
+    std::cout << std::endl;
     std::cout << std::setw( 10 ) << "   ";
     std::cout << std::setw( 17 ) << filter->GetTotalOverlap();
     std::cout << std::setw( 17 ) << filter->GetUnionOverlap();
@@ -149,6 +176,11 @@ int LabelOverlapMeasures( int argc, char * argv[] )
     std::cout << std::setw( 17 ) << filter->GetVolumeSimilarity();
     std::cout << std::setw( 17 ) << filter->GetFalseNegativeError();
     std::cout << std::setw( 17 ) << filter->GetFalsePositiveError();
+    if( computeSurfaceDistances )
+      {
+      std::cout << std::setw( 17 ) << filter->GetHausdorffDistance();
+      std::cout << std::setw( 17 ) << filter->GetMeanSurfaceDistance();
+      }
     std::cout << std::endl;
 
     std::cout << "                                       "
@@ -159,8 +191,13 @@ int LabelOverlapMeasures( int argc, char * argv[] )
               << std::setw( 17 ) << "Mean (dice)"
               << std::setw( 17 ) << "Volume sim."
               << std::setw( 17 ) << "False negative"
-              << std::setw( 17 ) << "False positive"
-              << std::endl;
+              << std::setw( 17 ) << "False positive";
+    if( computeSurfaceDistances )
+      {
+      std::cout << std::setw( 17 ) << "Hausdorff"
+                << std::setw( 17 ) << "Mean surface";
+      }
+    std::cout << std::endl;
     for( unsigned int i = 0; i < allLabels.size(); i++ )
       {
       int label = allLabels[i];
@@ -172,6 +209,11 @@ int LabelOverlapMeasures( int argc, char * argv[] )
       std::cout << std::setw( 17 ) << filter->GetVolumeSimilarity( label );
       std::cout << std::setw( 17 ) << filter->GetFalseNegativeError( label );
       std::cout << std::setw( 17 ) << filter->GetFalsePositiveError( label );
+      if( computeSurfaceDistances )
+        {
+        std::cout << std::setw( 17 ) << filter->GetHausdorffDistance( label );
+        std::cout << std::setw( 17 ) << filter->GetMeanSurfaceDistance( label );
+        }
       std::cout << std::endl;
       }
     }
@@ -228,7 +270,9 @@ private:
   if( argc < 4 )
     {
     std::cout << "Usage: " << argv[0] << " imageDimension sourceImage "
-              << "targetImage [outputCSVFile]" << std::endl;
+              << "targetImage [outputCSVFile] [computeSurfaceDistances=0]" << std::endl;
+    std::cout << "  computeSurfaceDistances: also report the Hausdorff and mean surface "
+              << "distances of every label, in physical units" << std::endl;
     if( argc >= 2 &&
         ( std::string( argv[1] ) == std::string("--help") || std::string( argv[1] ) == std::string("-h") ) )
       {
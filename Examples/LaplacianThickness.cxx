@@ -1,5 +1,6 @@
 #include "antsUtilities.h"
 #include "antsAllocImage.h"
+#include "antsParallelizeRange.h"
 #include <algorithm>
 
 #include "itkDanielssonDistanceMapImageFilter.h"
@@ -10,6 +11,8 @@
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkLaplacianRecursiveGaussianImageFilter.h"
 #include "itkRescaleIntensityImageFilter.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itkTimeProbe.h"
 #include "itkVectorCurvatureAnisotropicDiffusionImageFilter.h"
 #include "itkVectorIndexSelectionCastImageFilter.h"
 #include "itkVectorLinearInterpolateImageFunction.h"
@@ -21,7 +24,7 @@
 namespace ants
 {
 template <class TField, class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 GetVectorComponent(typename TField::Pointer field, unsigned int index)
 {
   // Initialize the Moving to the displacement field
@@ -42,7 +45,7 @@ GetVectorComponent(typename TField::Pointer field, unsigned int index)
 }
 
 template <class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 SmoothImage(typename TImage::Pointer image, float sig)
 {
 // find min value
@@ -69,7 +72,7 @@ SmoothImage(typename TImage::Pointer image, float sig)
 }
 
 template <class TImage>
-void
+static void
 SmoothDeformation(typename TImage::Pointer vectorimage, float sig)
 {
   typedef itk::Vector<float, 3> VectorType;
@@ -98,7 +101,7 @@ SmoothDeformation(typename TImage::Pointer vectorimage, float sig)
 }
 
 template <class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 LabelSurface(typename TImage::PixelType foreground,
              typename TImage::PixelType newval, typename TImage::Pointer input, float distthresh )
 {
@@ -317,9 +320,180 @@ FMMGrad(typename TImage::Pointer wm, typename TImage::Pointer gm )
   return sfield;
 }
 
+/** One half sweep of red-black successive over-relaxation for the Laplace
+ *  equation.  The range handed to the functor is the set of image rows along
+ *  the first axis; only the voxels of the current colour are updated, and as
+ *  those only read voxels of the other colour the rows can be split over
+ *  threads.  The image border is reflecting (zero normal derivative). */
+template <class TImage>
+class LaplacianSORFunctor
+{
+public:
+  enum { ImageDimension = TImage::ImageDimension };
+  typedef typename TImage::PixelType PixelType;
+
+  /** voxel labels: fixed values and the unknowns that are solved for */
+  enum { Fixed = 0, Unknown = 1 };
+
+  LaplacianSORFunctor( const TImage * image, itk::ThreadIdType numberOfThreads ) :
+    m_Color( 0 ),
+    m_Omega( 1.8 ),
+    m_MaximumChange( numberOfThreads, 0 )
+  {
+    const typename TImage::SizeType    size = image->GetBufferedRegion().GetSize();
+    const typename TImage::SpacingType spacing = image->GetSpacing();
+    double                             diagonal = 0;
+    itk::SizeValueType                 stride = 1;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      this->m_Size[d] = size[d];
+      this->m_Stride[d] = stride;
+      stride *= size[d];
+      // a dimension of extent one does not take part in the stencil
+      this->m_Weight[d] = ( size[d] > 1 ) ? 1.0 / ( spacing[d] * spacing[d] ) : 0.0;
+      diagonal += 2.0 * this->m_Weight[d];
+      }
+    this->m_InverseDiagonal = ( diagonal > 0 ) ? 1.0 / diagonal : 0.0;
+    this->m_NumberOfRows = stride / size[0];
+  }
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    double maximumChange = this->m_MaximumChange[threadId];
+
+    itk::SizeValueType index[ImageDimension];
+    for( itk::SizeValueType row = begin; row < end; row++ )
+      {
+      itk::SizeValueType r = row;
+      itk::SizeValueType rowOffset = 0;
+      itk::SizeValueType parity = 0;
+      for( unsigned int d = 1; d < ImageDimension; d++ )
+        {
+        index[d] = r % this->m_Size[d];
+        r /= this->m_Size[d];
+        rowOffset += index[d] * this->m_Stride[d];
+        parity += index[d];
+        }
+      for( index[0] = ( this->m_Color + parity ) % 2; index[0] < this->m_Size[0]; index[0] += 2 )
+        {
+        const itk::SizeValueType offset = rowOffset + index[0];
+        if( this->m_Labels[offset] != Unknown )
+          {
+          continue;
+          }
+        double sum = 0;
+        for( unsigned int d = 0; d < ImageDimension; d++ )
+          {
+          if( this->m_Weight[d] == 0 )
+            {
+            continue;
+            }
+          const itk::SizeValueType stride = this->m_Stride[d];
+          const itk::SizeValueType lower = ( index[d] > 0 ) ? offset - stride : offset + stride;
+          const itk::SizeValueType upper = ( index[d] + 1 < this->m_Size[d] ) ? offset + stride : offset - stride;
+          sum += this->m_Weight[d] * ( this->m_Values[lower] + this->m_Values[upper] );
+          }
+        const double value = this->m_Values[offset];
+        const double update = this->m_Omega * ( sum * this->m_InverseDiagonal - value );
+        this->m_Values[offset] = static_cast<PixelType>( value + update );
+        if( vnl_math_abs( update ) > maximumChange )
+          {
+          maximumChange = vnl_math_abs( update );
+          }
+        }
+      }
+    this->m_MaximumChange[threadId] = maximumChange;
+  }
+
+  itk::SizeValueType GetNumberOfRows() const
+  {
+    return this->m_NumberOfRows;
+  }
+
+  /** Largest update since the last reset, over all threads. */
+  double GetMaximumChange() const
+  {
+    return *std::max_element( this->m_MaximumChange.begin(), this->m_MaximumChange.end() );
+  }
+
+  void ResetMaximumChange()
+  {
+    std::fill( this->m_MaximumChange.begin(), this->m_MaximumChange.end(), 0.0 );
+  }
+
+  PixelType *           m_Values;
+  const unsigned char * m_Labels;
+  unsigned int          m_Color;
+  double                m_Omega;
+
+private:
+  itk::SizeValueType  m_Size[ImageDimension];
+  itk::SizeValueType  m_Stride[ImageDimension];
+  double              m_Weight[ImageDimension];
+  double              m_InverseDiagonal;
+  itk::SizeValueType  m_NumberOfRows;
+  std::vector<double> m_MaximumChange;
+};
+
+/** Solve for the potential that is 1 in the white matter, 2 outside the gray
+ *  matter and harmonic in the gray matter in between.  Iterates until no
+ *  voxel changes by more than tolerance in a full sweep. */
+template <class TImage>
+void SolveLaplacianRedBlackSOR( typename TImage::Pointer laplacian, typename TImage::Pointer wm,
+                                typename TImage::Pointer gm, unsigned int numits, float tolerance )
+{
+  typedef LaplacianSORFunctor<TImage> FunctorType;
+
+  const itk::SizeValueType               nvoxels = laplacian->GetBufferedRegion().GetNumberOfPixels();
+  const typename TImage::PixelType *     wmBuffer = wm->GetBufferPointer();
+  const typename TImage::PixelType *     gmBuffer = gm->GetBufferPointer();
+  typename TImage::PixelType *           values = laplacian->GetBufferPointer();
+  std::vector<unsigned char>             labels( nvoxels, FunctorType::Fixed );
+  for( itk::SizeValueType i = 0; i < nvoxels; i++ )
+    {
+    if( wmBuffer[i] >= 0.5 )
+      {
+      values[i] = 1;
+      }
+    else if( gmBuffer[i] < 0.5 )
+      {
+      values[i] = 2;
+      }
+    else
+      {
+      values[i] = 1.5;
+      labels[i] = FunctorType::Unknown;
+      }
+    }
+
+  FunctorType functor( laplacian, ants::GetNumberOfThreadsForRange( nvoxels ) );
+  functor.m_Values = values;
+  functor.m_Labels = &labels[0];
+
+  double       change = tolerance + 1;
+  unsigned int iterations = 0;
+  while( change > tolerance && iterations < numits )
+    {
+    iterations++;
+    functor.ResetMaximumChange();
+    for( unsigned int color = 0; color < 2; color++ )
+      {
+      functor.m_Color = color;
+      ants::ParallelizeRange( 0, functor.GetNumberOfRows(), functor );
+      }
+    change = functor.GetMaximumChange();
+    if( iterations % 10 == 1 )
+      {
+      std::cout << "  sweep " << iterations << " max-change " << change << std::endl;
+      }
+    }
+  std::cout << "  converged after " << iterations << " sweeps, max-change " << change << std::endl;
+}
+
 template <class TImage, class TField>
-typename TField::Pointer
-LaplacianGrad(typename TImage::Pointer wm, typename TImage::Pointer gm, float sig, unsigned int numits, float tolerance)
+static typename TField::Pointer
+LaplacianGrad(typename TImage::Pointer wm, typename TImage::Pointer gm, float sig, unsigned int numits, float tolerance,
+              bool useSOR = false)
 {
   typedef  typename TImage::IndexType IndexType;
   IndexType ind;
@@ -353,10 +527,15 @@ LaplacianGrad(typename TImage::Pointer wm, typename TImage::Pointer gm, float si
     ++Iterator;
     }
 
+  if( useSOR )
+    {
+    SolveLaplacianRedBlackSOR<TImage>(laplacian, wm, gm, numits, tolerance);
+    }
+
   // smooth and then reset the values
   float        meanvalue = 0, lastmean = 1;
   unsigned int iterations = 0;
-  while( fabs(meanvalue - lastmean) > tolerance  && iterations < numits )
+  while( !useSOR && fabs(meanvalue - lastmean) > tolerance  && iterations < numits )
     {
     iterations++;
     std::cout << "  % " << (float) iterations
@@ -608,6 +787,165 @@ float IntegrateLength( typename TImage::Pointer /* gmsurf */,  typename TImage::
   return totalmag;
 }
 
+/** Integrates the streamlines of the voxels for one pass over the image.
+ *  Streamline lengths vary a lot across the cortex, so instead of contiguous
+ *  chunks each thread takes every numberOfThreads-th block of voxels.  The
+ *  field interpolators are only evaluated, never modified, so they are
+ *  shared; every voxel writes only its own thickness value. */
+template <class TImage, class TField, class TInterp, class TInterp2>
+class LaplacianStreamlineFunctor
+{
+public:
+  typedef typename TImage::Pointer   ImagePointer;
+  typedef typename TImage::IndexType IndexType;
+  typedef typename TField::Pointer   FieldPointer;
+
+  itkStaticConstMacro( BlockSize, itk::SizeValueType, 64 );
+
+  LaplacianStreamlineFunctor( itk::ThreadIdType numberOfThreads ) :
+    m_NumberOfThreads( numberOfThreads ),
+    m_NumberOfMeasuredVoxels( numberOfThreads, 0 )
+  {
+  }
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    const itk::SizeValueType nvoxels = this->m_Thickness->GetBufferedRegion().GetNumberOfPixels();
+    const itk::SizeValueType blockStride = this->m_NumberOfThreads * BlockSize;
+
+    for( itk::SizeValueType slot = begin; slot < end; slot++ )
+      {
+      for( itk::SizeValueType blockBegin = slot * BlockSize; blockBegin < nvoxels; blockBegin += blockStride )
+        {
+        const itk::SizeValueType blockEnd = std::min( blockBegin + static_cast<itk::SizeValueType>( BlockSize ),
+                                                      nvoxels );
+        for( itk::SizeValueType offset = blockBegin; offset < blockEnd; offset++ )
+          {
+          this->IntegrateVoxel( this->m_Thickness->ComputeIndex( offset ), threadId );
+          }
+        }
+      }
+  }
+
+  itk::SizeValueType GetNumberOfMeasuredVoxels() const
+  {
+    itk::SizeValueType count = 0;
+    for( unsigned int n = 0; n < this->m_NumberOfMeasuredVoxels.size(); n++ )
+      {
+      count += this->m_NumberOfMeasuredVoxels[n];
+      }
+    return count;
+  }
+
+  ImagePointer                  m_GrayMatterSurface;
+  ImagePointer                  m_Thickness;
+  ImagePointer                  m_WhiteMatter;
+  ImagePointer                  m_GrayMatter;
+  ImagePointer                  m_SmoothThickness;
+  ImagePointer                  m_Sulci;
+  FieldPointer                  m_LaplacianGradient;
+  FieldPointer                  m_SulcalGradient;
+  typename TInterp::Pointer     m_LaplacianInterpolator;
+  typename TInterp::Pointer     m_SulcalInterpolator;
+  typename TInterp2::Pointer    m_ScalarInterpolator;
+  typename TImage::SpacingType  m_Spacing;
+  float                         m_StartTime;
+  float                         m_FinishTime;
+  float                         m_TimeSign;
+  double                        m_DeltaTime;
+  unsigned int                  m_NumberOfTimePoints;
+  float                         m_PriorThickness;
+  unsigned int                  m_SmoothingIteration;
+
+private:
+  void IntegrateVoxel( const IndexType & velind, itk::ThreadIdType threadId )
+  {
+    const unsigned int task = 0;
+    const bool         propagate = false;
+    float              itime = this->m_StartTime;
+    unsigned long      ct = 0;
+    bool               timedone = false;
+    double             deltaTime = this->m_DeltaTime, vecsign = 1.0;
+    bool               domeasure = false;
+    float              gradsign = 1.0;
+    bool               printprobability = false;
+
+    itk::SizeValueType cter = 0;
+    if( this->m_GrayMatter->GetPixel(velind) > 0.25 )
+      {
+      cter = ++this->m_NumberOfMeasuredVoxels[threadId];
+      domeasure = true;
+      }
+    gradsign = -1.0; vecsign = -1.0;
+    float len1 = IntegrateLength<TImage, TField, TInterp, TInterp2>
+        (this->m_GrayMatterSurface, this->m_Thickness, velind, this->m_LaplacianGradient, itime, this->m_StartTime,
+        this->m_FinishTime, timedone, deltaTime, this->m_LaplacianInterpolator, this->m_ScalarInterpolator, task,
+        propagate, domeasure, this->m_NumberOfTimePoints, this->m_Spacing, vecsign, gradsign, this->m_TimeSign, ct,
+        this->m_WhiteMatter, this->m_GrayMatter, this->m_PriorThickness, this->m_SmoothThickness, printprobability,
+        this->m_Sulci );
+
+    gradsign = 1.0;  vecsign = 1;
+    float len2 = IntegrateLength<TImage, TField, TInterp, TInterp2>
+        (this->m_GrayMatterSurface, this->m_Thickness, velind, this->m_LaplacianGradient, itime, this->m_StartTime,
+        this->m_FinishTime, timedone, deltaTime, this->m_LaplacianInterpolator, this->m_ScalarInterpolator, task,
+        propagate, domeasure, this->m_NumberOfTimePoints, this->m_Spacing, vecsign, gradsign, this->m_TimeSign, ct,
+        this->m_WhiteMatter, this->m_GrayMatter, this->m_PriorThickness - len1, this->m_SmoothThickness,
+        printprobability, this->m_Sulci );
+
+    float len3 = 1.e9, len4 = 1.e9;
+    if( this->m_SulcalGradient )
+      {
+      gradsign = -1.0; vecsign = -1.0;
+      len3 = IntegrateLength<TImage, TField, TInterp, TInterp2>
+          (this->m_GrayMatterSurface, this->m_Thickness, velind, this->m_SulcalGradient, itime, this->m_StartTime,
+          this->m_FinishTime, timedone, deltaTime, this->m_SulcalInterpolator, this->m_ScalarInterpolator, task,
+          propagate, domeasure, this->m_NumberOfTimePoints, this->m_Spacing, vecsign, gradsign, this->m_TimeSign, ct,
+          this->m_WhiteMatter, this->m_GrayMatter, this->m_PriorThickness, this->m_SmoothThickness, printprobability,
+          this->m_Sulci );
+
+      gradsign = 1.0;  vecsign = 1;
+      len4 = IntegrateLength<TImage, TField, TInterp, TInterp2>
+          (this->m_GrayMatterSurface, this->m_Thickness, velind, this->m_SulcalGradient, itime, this->m_StartTime,
+          this->m_FinishTime, timedone, deltaTime, this->m_SulcalInterpolator, this->m_ScalarInterpolator, task,
+          propagate, domeasure, this->m_NumberOfTimePoints, this->m_Spacing, vecsign, gradsign, this->m_TimeSign, ct,
+          this->m_WhiteMatter, this->m_GrayMatter, this->m_PriorThickness - len3, this->m_SmoothThickness,
+          printprobability, this->m_Sulci );
+      }
+    float totalength = len1 + len2;
+    if( len3 + len4 < totalength )
+      {
+      totalength = len3 + len4;
+      }
+
+    if( this->m_SmoothingIteration == 0 )
+      {
+      if( this->m_Thickness->GetPixel(velind) == 0  )
+        {
+        this->m_Thickness->SetPixel(velind, totalength);
+        }
+      else if( (totalength) > 0 &&  this->m_Thickness->GetPixel(velind) < (totalength) )
+        {
+        this->m_Thickness->SetPixel(velind, totalength);
+        }
+      }
+    if( this->m_SmoothingIteration > 0 && this->m_SmoothThickness )
+      {
+      this->m_Thickness->SetPixel(velind, (totalength) * 0.5 + this->m_SmoothThickness->GetPixel(velind) * 0.5 );
+      }
+
+    if( domeasure && (totalength) > 0 && cter % 10000 == 0 )
+      {
+      this->m_Mutex.Lock();
+      std::cout << " len1 " << len1 << " len2 " << len2 << " ind " << velind << std::endl;
+      this->m_Mutex.Unlock();
+      }
+  }
+
+  itk::ThreadIdType               m_NumberOfThreads;
+  std::vector<itk::SizeValueType> m_NumberOfMeasuredVoxels;
+  itk::SimpleFastMutexLock        m_Mutex;
+};
+
 template <unsigned int ImageDimension>
 int LaplacianThickness(int argc, char *argv[])
 {
@@ -649,6 +987,12 @@ int LaplacianThickness(int argc, char *argv[])
     }
   argct++;
   std::cout << " using tolerance " << tolerance << std::endl;
+  bool useSOR = false;
+  if( argc >  argct )
+    {
+    useSOR = ( atoi(argv[argct]) != 0 );
+    }
+  argct++;
   typedef float                                      PixelType;
   typedef itk::Vector<float, ImageDimension>         VectorType;
   typedef itk::Image<VectorType, ImageDimension>     DisplacementFieldType;
@@ -738,7 +1082,12 @@ int LaplacianThickness(int argc, char *argv[])
 /** sulc priors done */
     }
 
-  lapgrad = LaplacianGrad<ImageType, DisplacementFieldType>(wmb, gmb, smoothparam, 500, tolerance);
+  itk::TimeProbe laplacianTimer;
+  laplacianTimer.Start();
+  lapgrad = LaplacianGrad<ImageType, DisplacementFieldType>(wmb, gmb, smoothparam, 500, tolerance, useSOR);
+  laplacianTimer.Stop();
+  std::cout << "  laplacian solve (" << ( useSOR ? "red-black SOR" : "smoothing" ) << "): "
+           << laplacianTimer.GetTotal() << " s" << std::endl;
   //  lapgrad=FMMGrad<ImageType,DisplacementFieldType>(wmb,gmb);
 
   //  LabelSurface(typename TImage::PixelType foreground,
@@ -760,7 +1109,6 @@ int LaplacianThickness(int argc, char *argv[])
   float finishtime = timeone; // s[ImageDimension]-1;//timeone;
   // std::cout << " MUCKING WITH START FINISH TIME " <<  finishtime <<  std::endl;
 
-  typename DisplacementFieldType::IndexType velind;
   typename ImageType::Pointer smooththick = ITK_NULLPTR;
   float timesign = 1.0;
   if( starttime  >  finishtime )
@@ -822,102 +1170,53 @@ int LaplacianThickness(int argc, char *argv[])
     ++VIterator;
     }
 
-  bool propagate = false;
+  typename DefaultInterpolatorType::Pointer vinterp2 = ITK_NULLPTR;
+  vinterp->SetInputImage(lapgrad);
+  if( lapgrad2 )
+    {
+    vinterp2 = DefaultInterpolatorType::New();
+    vinterp2->SetInputImage(lapgrad2);
+    }
+
+  typedef LaplacianStreamlineFunctor<ImageType, DisplacementFieldType, DefaultInterpolatorType,
+                                     ScalarInterpolatorType> StreamlineFunctorType;
+  const itk::SizeValueType nvoxels = thickimage2->GetBufferedRegion().GetNumberOfPixels();
+  const itk::ThreadIdType  nthreads =
+    ants::GetNumberOfThreadsForRange( ( nvoxels + StreamlineFunctorType::BlockSize - 1 )
+                                      / StreamlineFunctorType::BlockSize );
   for( unsigned int smoothit = 0; smoothit < nsmooth; smoothit++ )
     {
     std::cout << " smoothit " << smoothit << std::endl;
-    Iterator.GoToBegin();
-    unsigned int cter = 0;
-    while(  !Iterator.IsAtEnd()  )
-      {
-      velind = Iterator.GetIndex();
-      //      float thislength=0;
-      for( unsigned int task = 0; task < 1; task++ )
-        {
-        float itime = starttime;
-
-        unsigned long ct = 0;
-        bool          timedone = false;
-
-        VectorType disp;
-        disp.Fill(0.0);
-        double deltaTime = dT, vecsign = 1.0;
-        bool   domeasure = false;
-        float  gradsign = 1.0;
-        bool   printprobability = false;
-//    std::cout << " wmb " << wmb->GetPixel(velind) << " gm " << gm->GetPixel(velind) << std::endl;
-//    if (surf->GetPixel(velind) != 0) printprobability=true;
-        if( gm->GetPixel(velind) > 0.25 ) // && wmb->GetPixel(velind) < 1 )
-          {
-          cter++;
-          domeasure = true;
-          }
-        vinterp->SetInputImage(lapgrad);
-        gradsign = -1.0; vecsign = -1.0;
-        float len1 = IntegrateLength<ImageType, DisplacementFieldType, DefaultInterpolatorType, ScalarInterpolatorType>
-            (gmsurf, thickimage, velind, lapgrad,  itime, starttime, finishtime,  timedone,  deltaTime,  vinterp,
-            sinterp, task, propagate, domeasure, m_NumberOfTimePoints, spacing, vecsign, gradsign, timesign, ct, wm, gm,
-            priorthickval, smooththick, printprobability,
-            sulci );
-
-        gradsign = 1.0;  vecsign = 1;
-        float len2 = IntegrateLength<ImageType, DisplacementFieldType, DefaultInterpolatorType, ScalarInterpolatorType>
-            (gmsurf, thickimage, velind, lapgrad,  itime, starttime, finishtime,  timedone,  deltaTime,  vinterp,
-            sinterp, task, propagate, domeasure, m_NumberOfTimePoints, spacing, vecsign, gradsign, timesign, ct, wm, gm,
-            priorthickval - len1, smooththick, printprobability,
-            sulci );
-
-        float len3 = 1.e9, len4 = 1.e9;
-        if( lapgrad2 )
-          {
-          vinterp->SetInputImage(lapgrad2);
-          gradsign = -1.0; vecsign = -1.0;
-          len3 = IntegrateLength<ImageType, DisplacementFieldType, DefaultInterpolatorType, ScalarInterpolatorType>
-              (gmsurf, thickimage, velind, lapgrad2,  itime, starttime, finishtime,  timedone,  deltaTime,  vinterp,
-              sinterp, task, propagate, domeasure, m_NumberOfTimePoints, spacing, vecsign, gradsign, timesign, ct, wm,
-              gm,
-              priorthickval, smooththick, printprobability,
-              sulci );
-
-          gradsign = 1.0;  vecsign = 1;
-          len4 = IntegrateLength<ImageType, DisplacementFieldType, DefaultInterpolatorType, ScalarInterpolatorType>
-              (gmsurf, thickimage, velind, lapgrad2,  itime, starttime, finishtime,  timedone,  deltaTime,  vinterp,
-              sinterp, task, propagate, domeasure, m_NumberOfTimePoints, spacing, vecsign, gradsign, timesign, ct, wm,
-              gm,
-              priorthickval - len3, smooththick, printprobability,
-              sulci );
-          }
-        float totalength = len1 + len2;
-//    if (totalength > 5 && totalength <  8) std::cout<< " t1 " << len3+len4 << " t2 " << len1+len2 << std::endl;
-        if( len3 + len4 < totalength )
-          {
-          totalength = len3 + len4;
-          }
-
-        if( smoothit == 0 )
-          {
-          if( thickimage2->GetPixel(velind) == 0  )
-            {
-            thickimage2->SetPixel(velind, totalength);
-            }
-          else if( (totalength) > 0 &&  thickimage2->GetPixel(velind) < (totalength) )
-            {
-            thickimage2->SetPixel(velind, totalength);
-            }
-          }
-        if( smoothit > 0 && smooththick )
-          {
-          thickimage2->SetPixel(velind, (totalength) * 0.5 + smooththick->GetPixel(velind) * 0.5 );
-          }
-
-        if( domeasure && (totalength) > 0 && cter % 10000 == 0 )
-          {
-          std::cout << " len1 " << len1 << " len2 " << len2 << " ind " << velind << std::endl;
-          }
-        }
-      ++Iterator;
-      }
 
+    itk::TimeProbe streamlineTimer;
+    streamlineTimer.Start();
+    StreamlineFunctorType streamlines( nthreads );
+    streamlines.m_GrayMatterSurface = gmsurf;
+    streamlines.m_Thickness = thickimage2;
+    streamlines.m_WhiteMatter = wm;
+    streamlines.m_GrayMatter = gm;
+    streamlines.m_SmoothThickness = smooththick;
+    streamlines.m_Sulci = sulci;
+    streamlines.m_LaplacianGradient = lapgrad;
+    streamlines.m_SulcalGradient = lapgrad2;
+    streamlines.m_LaplacianInterpolator = vinterp;
+    streamlines.m_SulcalInterpolator = vinterp2;
+    streamlines.m_ScalarInterpolator = sinterp;
+    streamlines.m_Spacing = spacing;
+    streamlines.m_StartTime = starttime;
+    streamlines.m_FinishTime = finishtime;
+    streamlines.m_TimeSign = timesign;
+    streamlines.m_DeltaTime = dT;
+    streamlines.m_NumberOfTimePoints = m_NumberOfTimePoints;
+    streamlines.m_PriorThickness = priorthickval;
+    streamlines.m_SmoothingIteration = smoothit;
+    ants::ParallelizeRange( 0, nthreads, streamlines, nthreads );
+    streamlineTimer.Stop();
+    std::cout << "  streamline integration (" << streamlines.GetNumberOfMeasuredVoxels() << " voxels, "
+             << nthreads << " threads): " << streamlineTimer.GetTotal() << " s" << std::endl;
+
+    itk::TimeProbe smoothingTimer;
+    smoothingTimer.Start();
     smooththick = SmoothImage<ImageType>(thickimage2, 1.0);
 
 // set non-gm voxels to zero
@@ -934,6 +1233,8 @@ int LaplacianThickness(int argc, char *argv[])
 
     std::cout << " writing " << outname << std::endl;
     WriteImage<ImageType>(thickimage2, outname.c_str() );
+    smoothingTimer.Stop();
+    std::cout << "  smoothing and writing: " << smoothingTimer.GetTotal() << " s" << std::endl;
     }
 //  WriteImage<ImageType>(thickimage,"turd.hdr");
 
@@ -990,8 +1291,12 @@ private:
     {
     std::cout << "Usage:   " << argv[0]
              <<
-      " WM.nii GM.nii   Out.nii  {smoothparam=3} {priorthickval=5}  {dT=0.01}  use-sulcus-prior optional-laplacian-tolerance=0.001"
+      " WM.nii GM.nii   Out.nii  {smoothparam=3} {priorthickval=5}  {dT=0.01}  use-sulcus-prior optional-laplacian-tolerance=0.001 {use-sor-solver=0}"
              << std::endl;
+    std::cout
+      <<
+      " use-sor-solver=0 (default) solves the laplacian with the original iterative smoothing (tolerance is the change of the mean); 1 uses multithreaded red-black SOR (tolerance is the largest change per sweep), which is faster but changes the results slightly "
+      << std::endl;
     std::cout
       <<
       " a good value for use sulcus prior is 0.15 -- in a function :  1/(1.+exp(-0.1*(laplacian-img-value-sulcprob)/0.01)) "
@@ -14,6 +14,8 @@
 
 namespace ants
 {
+namespace
+{
 template <class TFilter>
 class CommandIterationUpdate : public itk::Command
 {
@@ -51,6 +53,7 @@ public:
              << ")" << std::endl;
   }
 };
+} // namespace
 
 template <unsigned int ImageDimension>
 int N3BiasFieldCorrection( int argc, char *argv[] )
@@ -1,6 +1,7 @@
 #include "antsUtilities.h"
 #include "antsAllocImage.h"
 #include "antsCommandLineParser.h"
+#include "antsParallelizeRange.h"
 
 #include "ReadWriteData.h"
 
@@ -10,21 +11,27 @@
 #include "itkExpImageFilter.h"
 #include "itkExtractImageFilter.h"
 #include "itkImageRegionIterator.h"
+#include "itkImageDuplicator.h"
+#include "itkImageFileReader.h"
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkLabelStatisticsImageFilter.h"
 #include "itkN4BiasFieldCorrectionImageFilter.h"
 #include "itkOtsuThresholdImageFilter.h"
 #include "itkShrinkImageFilter.h"
+#include "itkSimpleFastMutexLock.h"
 #include "itkTimeProbe.h"
 
 #include <string>
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "ANTsVersion.h"
 
 namespace ants
 {
+namespace
+{
 template <class TFilter>
 class CommandIterationUpdate : public itk::Command
 {
@@ -68,6 +75,455 @@ public:
              << ")" << std::endl;
   }
 };
+} // namespace
+
+/** Pad an image by the given number of voxels on each side. */
+template <class TImage>
+typename TImage::Pointer PadN4Image( const TImage *image, const unsigned long *lowerBound,
+                                     const unsigned long *upperBound )
+{
+  typedef itk::ConstantPadImageFilter<TImage, TImage> PadderType;
+  typename PadderType::Pointer padder = PadderType::New();
+  padder->SetInput( image );
+  padder->SetPadLowerBound( lowerBound );
+  padder->SetPadUpperBound( upperBound );
+  padder->SetConstant( 0 );
+  padder->Update();
+
+  typename TImage::Pointer paddedImage = padder->GetOutput();
+  paddedImage->DisconnectPipeline();
+  return paddedImage;
+}
+
+/** Evaluate a log bias field control point lattice over the domain of
+ *  reference, starting at origin, and return it as a scalar image with the
+ *  region of reference. */
+template <class TImage, class TLattice>
+typename TImage::Pointer ReconstructN4LogBiasField( const TLattice *lattice, unsigned int splineOrder,
+                                                    const TImage *reference,
+                                                    const typename TImage::PointType & origin )
+{
+  typedef itk::Image<typename TLattice::PixelType, TImage::ImageDimension> ScalarImageType;
+  typedef itk::BSplineControlPointImageFilter<TLattice, ScalarImageType>   BSplinerType;
+  typename BSplinerType::Pointer bspliner = BSplinerType::New();
+  bspliner->SetInput( lattice );
+  bspliner->SetSplineOrder( splineOrder );
+  bspliner->SetSize( reference->GetLargestPossibleRegion().GetSize() );
+  bspliner->SetOrigin( origin );
+  bspliner->SetDirection( reference->GetDirection() );
+  bspliner->SetSpacing( reference->GetSpacing() );
+  bspliner->Update();
+
+  typename TImage::Pointer logField = AllocImage<TImage>( reference );
+
+  itk::ImageRegionIterator<ScalarImageType> ItB(
+    bspliner->GetOutput(),
+    bspliner->GetOutput()->GetLargestPossibleRegion() );
+  itk::ImageRegionIterator<TImage> ItF( logField,
+                                        logField->GetLargestPossibleRegion() );
+  for( ItB.GoToBegin(), ItF.GoToBegin(); !ItB.IsAtEnd(); ++ItB, ++ItF )
+    {
+    ItF.Set( ItB.Get()[0] );
+    }
+  return logField;
+}
+
+/** True if image lies on the grid of reference: the same region, and the same
+ *  spacing, origin and direction up to the coordinate tolerance ITK uses. */
+template <class TImage>
+bool IsOnN4BatchGrid( const TImage * image, const TImage * reference )
+{
+  const double tolerance = 1e-6;
+
+  if( image->GetLargestPossibleRegion() != reference->GetLargestPossibleRegion() )
+    {
+    return false;
+    }
+  for( unsigned int d = 0; d < TImage::ImageDimension; d++ )
+    {
+    const double spacing = reference->GetSpacing()[d];
+    if( std::fabs( image->GetSpacing()[d] - spacing ) > tolerance * spacing ||
+        std::fabs( image->GetOrigin()[d] - reference->GetOrigin()[d] ) > tolerance * spacing )
+      {
+      return false;
+      }
+    for( unsigned int e = 0; e < TImage::ImageDimension; e++ )
+      {
+      if( std::fabs( image->GetDirection()[d][e] - reference->GetDirection()[d][e] ) > tolerance )
+        {
+        return false;
+        }
+      }
+    }
+  return true;
+}
+
+/** Checks from the image headers that every image of a batch lies on the grid
+ *  of the first one, before any of them is corrected. */
+template <class TImage>
+bool CheckN4BatchGrid( const std::vector<std::string> & fileNames, const TImage * firstImage )
+{
+  typedef itk::ImageFileReader<TImage> ReaderType;
+  for( unsigned int n = 1; n < fileNames.size(); n++ )
+    {
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName( fileNames[n] );
+    try
+      {
+      reader->UpdateOutputInformation();
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      std::cerr << "Exception caught reading " << fileNames[n] << std::endl << e << std::endl;
+      return false;
+      }
+    if( !IsOnN4BatchGrid<TImage>( reader->GetOutput(), firstImage ) )
+      {
+      std::cerr << fileNames[n] << " does not match the grid (region, spacing, origin and direction) of "
+               << fileNames[0] << std::endl;
+      return false;
+      }
+    }
+  return true;
+}
+
+/**
+ * Corrects a batch of images that share a mask and an image grid, e.g. the
+ * echoes of a multi-echo acquisition or the time points of a longitudinal
+ * series.  The mask and weight images are padded and shrunk once for the
+ * whole batch.  The images are processed in waves of concurrent images; with
+ * a warm start every image of a wave starts from the log bias field lattice
+ * of the last image of the previous wave.  The N4 filter always starts from
+ * a zero field, so the warm start divides the shrunk input by the previous
+ * bias field and adds the previous lattice to the lattice N4 returns.  Both
+ * lattices live on the same control point grid, so their sum is the lattice
+ * of the total log bias field.
+ */
+template <unsigned int ImageDimension>
+class N4BatchCorrecter
+{
+public:
+  typedef float                                                                    RealType;
+  typedef itk::Image<RealType, ImageDimension>                                     ImageType;
+  typedef itk::Image<RealType, ImageDimension>                                     MaskImageType;
+  typedef itk::N4BiasFieldCorrectionImageFilter<ImageType, MaskImageType, ImageType> CorrecterType;
+  typedef typename CorrecterType::BiasFieldControlPointLatticeType                 LatticeType;
+  typedef itk::ShrinkImageFilter<ImageType, ImageType>                             ShrinkerType;
+
+  N4BatchCorrecter() :
+    m_UsePadding( false ),
+    m_IsMaskImageSpecified( false ),
+    m_DoRescale( false ),
+    m_Verbose( false ),
+    m_NumberOfThreadsPerImage( 1 ),
+    m_Failed( false )
+  {
+  }
+
+  /** Corrects the images [begin, end) of the current wave. */
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    for( itk::SizeValueType n = begin; n < end; n++ )
+      {
+      if( !this->CorrectImage( n ) )
+        {
+        this->m_Mutex.Lock();
+        this->m_Failed = true;
+        this->m_Mutex.Unlock();
+        }
+      }
+  }
+
+  bool GetFailed() const
+  {
+    this->m_Mutex.Lock();
+    const bool failed = this->m_Failed;
+    this->m_Mutex.Unlock();
+    return failed;
+  }
+
+  std::vector<std::string>                  m_InputFileNames;
+  std::vector<std::string>                  m_CorrectedFileNames;
+  std::vector<std::string>                  m_BiasFieldFileNames;
+  typename ImageType::Pointer               m_FirstInputImage;
+  typename ImageType::RegionType            m_InputRegion;
+  typename ImageType::PointType             m_Origin;
+  typename MaskImageType::Pointer           m_MaskImage;
+  typename MaskImageType::Pointer           m_ShrunkMaskImage;
+  typename ImageType::Pointer               m_ShrunkWeightImage;
+  typename ShrinkerType::ShrinkFactorsType  m_ShrinkFactors;
+  typename CorrecterType::Pointer           m_Settings;
+  typename CorrecterType::VariableSizeArrayType m_WarmStartIterations;
+  bool                                      m_UsePadding;
+  unsigned long                             m_PadLowerBound[ImageDimension];
+  unsigned long                             m_PadUpperBound[ImageDimension];
+  bool                                      m_IsMaskImageSpecified;
+  bool                                      m_DoRescale;
+  bool                                      m_Verbose;
+  itk::ThreadIdType                         m_NumberOfThreadsPerImage;
+  typename LatticeType::Pointer             m_InitialLattice;
+  std::vector<typename LatticeType::Pointer> m_Lattices;
+
+private:
+  bool CorrectImage( unsigned int n );
+
+  /** guards m_Failed and the console output of the concurrent images */
+  mutable itk::SimpleFastMutexLock m_Mutex;
+  bool                             m_Failed;
+};
+
+template <unsigned int ImageDimension>
+bool N4BatchCorrecter<ImageDimension>::CorrectImage( unsigned int n )
+{
+  typename ImageType::Pointer inputImage = this->m_FirstInputImage;
+  if( n > 0 )
+    {
+    inputImage = ITK_NULLPTR;
+    if( !ReadImage<ImageType>( inputImage, this->m_InputFileNames[n].c_str() ) )
+      {
+      return false;
+      }
+    if( inputImage->GetLargestPossibleRegion() != this->m_InputRegion ||
+        inputImage->GetSpacing() != this->m_FirstInputImage->GetSpacing() )
+      {
+      std::cerr << this->m_InputFileNames[n] << " does not match the grid of "
+               << this->m_InputFileNames[0] << std::endl;
+      return false;
+      }
+    if( this->m_UsePadding )
+      {
+      inputImage = PadN4Image<ImageType>( inputImage, this->m_PadLowerBound, this->m_PadUpperBound );
+      }
+    }
+
+  itk::TimeProbe timer;
+  timer.Start();
+
+  typename ShrinkerType::Pointer shrinker = ShrinkerType::New();
+  shrinker->SetInput( inputImage );
+  shrinker->SetShrinkFactors( this->m_ShrinkFactors );
+  shrinker->Update();
+
+  typename ImageType::Pointer shrunkImage = shrinker->GetOutput();
+  shrunkImage->DisconnectPipeline();
+
+  const bool isWarmStarted = this->m_InitialLattice.IsNotNull();
+  if( isWarmStarted )
+    {
+    // Remove the bias that is already known, the same way N4 itself maps its
+    // lattice onto the shrunk image.
+    typename ImageType::Pointer logField = ReconstructN4LogBiasField<ImageType, LatticeType>(
+        this->m_InitialLattice, this->m_Settings->GetSplineOrder(), shrunkImage, shrunkImage->GetOrigin() );
+    itk::ImageRegionIterator<ImageType> ItS( shrunkImage, shrunkImage->GetLargestPossibleRegion() );
+    itk::ImageRegionIterator<ImageType> ItL( logField, logField->GetLargestPossibleRegion() );
+    for( ItS.GoToBegin(), ItL.GoToBegin(); !ItS.IsAtEnd(); ++ItS, ++ItL )
+      {
+      ItS.Set( ItS.Get() / std::exp( ItL.Get() ) );
+      }
+    }
+
+  // The shared images are grafted so that the concurrent pipelines do not
+  // negotiate regions on the same data objects.
+  typename MaskImageType::Pointer shrunkMaskImage = MaskImageType::New();
+  shrunkMaskImage->Graft( this->m_ShrunkMaskImage );
+
+  typename CorrecterType::Pointer correcter = CorrecterType::New();
+  correcter->SetInput( shrunkImage );
+  correcter->SetMaskImage( shrunkMaskImage );
+  if( this->m_ShrunkWeightImage )
+    {
+    typename ImageType::Pointer shrunkWeightImage = ImageType::New();
+    shrunkWeightImage->Graft( this->m_ShrunkWeightImage );
+    correcter->SetConfidenceImage( shrunkWeightImage );
+    }
+  correcter->SetMaximumNumberOfIterations( isWarmStarted ? this->m_WarmStartIterations
+                                           : this->m_Settings->GetMaximumNumberOfIterations() );
+  correcter->SetNumberOfFittingLevels( this->m_Settings->GetNumberOfFittingLevels() );
+  correcter->SetConvergenceThreshold( this->m_Settings->GetConvergenceThreshold() );
+  correcter->SetSplineOrder( this->m_Settings->GetSplineOrder() );
+  correcter->SetNumberOfControlPoints( this->m_Settings->GetNumberOfControlPoints() );
+  correcter->SetBiasFieldFullWidthAtHalfMaximum( this->m_Settings->GetBiasFieldFullWidthAtHalfMaximum() );
+  correcter->SetWienerFilterNoise( this->m_Settings->GetWienerFilterNoise() );
+  correcter->SetNumberOfHistogramBins( this->m_Settings->GetNumberOfHistogramBins() );
+  correcter->SetNumberOfThreads( this->m_NumberOfThreadsPerImage );
+
+  if( this->m_Verbose && this->m_InputFileNames.size() == 1 )
+    {
+    typedef CommandIterationUpdate<CorrecterType> CommandType;
+    typename CommandType::Pointer observer = CommandType::New();
+    correcter->AddObserver( itk::IterationEvent(), observer );
+    }
+
+  try
+    {
+    // correcter->DebugOn();
+    correcter->Update();
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    if( this->m_Verbose )
+      {
+      std::cerr << "Exception caught: " << e << std::endl;
+      }
+    return false;
+    }
+
+  typedef itk::ImageDuplicator<LatticeType> DuplicatorType;
+  typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
+  duplicator->SetInputImage( correcter->GetLogBiasFieldControlPointLattice() );
+  duplicator->Update();
+
+  typename LatticeType::Pointer lattice = duplicator->GetModifiableOutput();
+  if( isWarmStarted )
+    {
+    if( lattice->GetLargestPossibleRegion() != this->m_InitialLattice->GetLargestPossibleRegion() )
+      {
+      std::cerr << "The control point lattice of " << this->m_InputFileNames[n]
+               << " does not match the warm start lattice." << std::endl;
+      return false;
+      }
+    itk::ImageRegionIterator<LatticeType> ItL( lattice, lattice->GetLargestPossibleRegion() );
+    itk::ImageRegionConstIterator<LatticeType> ItI( this->m_InitialLattice,
+                                                    this->m_InitialLattice->GetLargestPossibleRegion() );
+    for( ItL.GoToBegin(), ItI.GoToBegin(); !ItL.IsAtEnd(); ++ItL, ++ItI )
+      {
+      ItL.Set( ItL.Get() + ItI.Get() );
+      }
+    }
+  this->m_Lattices[n] = lattice;
+
+  if( this->m_Verbose )
+    {
+    this->m_Mutex.Lock();
+    if( this->m_InputFileNames.size() > 1 )
+      {
+      std::cout << "Corrected " << this->m_InputFileNames[n]
+               << ( isWarmStarted ? " (warm start)" : "" ) << std::endl;
+      }
+    correcter->Print( std::cout, 3 );
+    this->m_Mutex.Unlock();
+    }
+
+  timer.Stop();
+  if( this->m_Verbose )
+    {
+    std::cout << "Elapsed time: " << timer.GetMean() << std::endl;
+    }
+
+  /**
+   * output
+   */
+  if( this->m_CorrectedFileNames.empty() )
+    {
+    return true;
+    }
+
+  /**
+                  * Reconstruct the bias field at full image resolution.  Divide
+                  * the original input image by the bias field to get the final
+                  * corrected image.
+                  */
+  typename ImageType::Pointer logField = ReconstructN4LogBiasField<ImageType, LatticeType>(
+      lattice, this->m_Settings->GetSplineOrder(), inputImage, this->m_Origin );
+
+  typedef itk::ExpImageFilter<ImageType, ImageType> ExpFilterType;
+  typename ExpFilterType::Pointer expFilter = ExpFilterType::New();
+  expFilter->SetInput( logField );
+  expFilter->Update();
+
+  typedef itk::DivideImageFilter<ImageType, ImageType, ImageType> DividerType;
+  typename DividerType::Pointer divider = DividerType::New();
+  divider->SetInput1( inputImage );
+  divider->SetInput2( expFilter->GetOutput() );
+  divider->Update();
+
+  typename MaskImageType::Pointer maskImage = MaskImageType::New();
+  maskImage->Graft( this->m_MaskImage );
+
+  if( this->m_IsMaskImageSpecified )
+    {
+    itk::ImageRegionIteratorWithIndex<ImageType> ItD( divider->GetOutput(),
+                                                      divider->GetOutput()->GetLargestPossibleRegion() );
+    itk::ImageRegionIterator<ImageType> ItI( inputImage,
+                                             inputImage->GetLargestPossibleRegion() );
+    for( ItD.GoToBegin(), ItI.GoToBegin(); !ItD.IsAtEnd(); ++ItD, ++ItI )
+      {
+      if( maskImage->GetPixel( ItD.GetIndex() ) == itk::NumericTraits<typename MaskImageType::PixelType>::ZeroValue() )
+        {
+        ItD.Set( ItI.Get() );
+        }
+      }
+    }
+
+  if( this->m_DoRescale )
+    {
+    typedef itk::Image<unsigned short, ImageDimension> ShortImageType;
+
+    typedef itk::BinaryThresholdImageFilter<MaskImageType, ShortImageType> ThresholderType;
+    typename ThresholderType::Pointer thresholder = ThresholderType::New();
+    thresholder->SetInsideValue( itk::NumericTraits<typename ShortImageType::PixelType>::ZeroValue() );
+    thresholder->SetOutsideValue( itk::NumericTraits<typename ShortImageType::PixelType>::OneValue() );
+    thresholder->SetLowerThreshold( itk::NumericTraits<typename MaskImageType::PixelType>::ZeroValue() );
+    thresholder->SetUpperThreshold( itk::NumericTraits<typename MaskImageType::PixelType>::ZeroValue() );
+    thresholder->SetInput( maskImage );
+
+    typedef itk::LabelStatisticsImageFilter<ImageType, ShortImageType> StatsType;
+    typename StatsType::Pointer stats = StatsType::New();
+    stats->SetInput( inputImage );
+    stats->SetLabelInput( thresholder->GetOutput() );
+    stats->UseHistogramsOff();
+    stats->Update();
+
+    typedef typename StatsType::LabelPixelType StatsLabelType;
+    StatsLabelType maskLabel = itk::NumericTraits<StatsLabelType>::OneValue();
+
+    RealType minOriginal = stats->GetMinimum( maskLabel );
+    RealType maxOriginal = stats->GetMaximum( maskLabel );
+
+    typename StatsType::Pointer stats2 = StatsType::New();
+    stats2->SetInput( divider->GetOutput() );
+    stats2->SetLabelInput( thresholder->GetOutput() );
+    stats2->UseHistogramsOff();
+    stats2->Update();
+
+    RealType minBiasCorrected = stats2->GetMinimum( maskLabel );
+    RealType maxBiasCorrected = stats2->GetMaximum( maskLabel );
+
+    RealType slope = ( maxOriginal - minOriginal ) / ( maxBiasCorrected - minBiasCorrected );
+
+    itk::ImageRegionIteratorWithIndex<ImageType> ItD( divider->GetOutput(),
+                                                      divider->GetOutput()->GetLargestPossibleRegion() );
+    for( ItD.GoToBegin(); !ItD.IsAtEnd(); ++ItD )
+      {
+      if( maskImage->GetPixel( ItD.GetIndex() ) == maskLabel )
+        {
+        RealType originalIntensity = ItD.Get();
+        RealType rescaledIntensity = maxOriginal - slope * ( maxBiasCorrected - originalIntensity );
+        ItD.Set( rescaledIntensity );
+        }
+      }
+    }
+
+  typedef itk::ExtractImageFilter<ImageType, ImageType> CropperType;
+  typename CropperType::Pointer cropper = CropperType::New();
+  cropper->SetInput( divider->GetOutput() );
+  cropper->SetExtractionRegion( this->m_InputRegion );
+  cropper->SetDirectionCollapseToSubmatrix();
+  cropper->Update();
+
+  WriteImage<ImageType>( cropper->GetOutput(), this->m_CorrectedFileNames[n].c_str() );
+  if( !this->m_BiasFieldFileNames[n].empty() )
+    {
+    typename CropperType::Pointer biasFieldCropper = CropperType::New();
+    biasFieldCropper->SetInput( expFilter->GetOutput() );
+    biasFieldCropper->SetExtractionRegion( this->m_InputRegion );
+    biasFieldCropper->SetDirectionCollapseToSubmatrix();
+    biasFieldCropper->Update();
+
+    WriteImage<ImageType>( biasFieldCropper->GetOutput(), this->m_BiasFieldFileNames[n].c_str() );
+    }
+  return true;
+}
 
 template <unsigned int ImageDimension>
 int N4( itk::ants::CommandLineParser *parser )
@@ -96,13 +552,23 @@ int N4( itk::ants::CommandLineParser *parser )
 
   typedef itk::N4BiasFieldCorrectionImageFilter<ImageType, MaskImageType,
                                                 ImageType> CorrecterType;
+  // holds the settings that are applied to every image of the batch
   typename CorrecterType::Pointer correcter = CorrecterType::New();
+
+  std::vector<std::string> inputFileNames;
   typename itk::ants::CommandLineParser::OptionType::Pointer inputImageOption =
     parser->GetOption( "input-image" );
   if( inputImageOption && inputImageOption->GetNumberOfFunctions() )
     {
-    std::string inputFile = inputImageOption->GetFunction( 0 )->GetName();
-    ReadImage<ImageType>( inputImage, inputFile.c_str() );
+    for( int n = inputImageOption->GetNumberOfFunctions() - 1; n >= 0; n-- )
+      {
+      inputFileNames.push_back( inputImageOption->GetFunction( n )->GetName() );
+      }
+    ReadImage<ImageType>( inputImage, inputFileNames[0].c_str() );
+    if( !CheckN4BatchGrid<ImageType>( inputFileNames, inputImage ) )
+      {
+      return EXIT_FAILURE;
+      }
     }
   else
     {
@@ -209,6 +675,10 @@ int N4( itk::ants::CommandLineParser *parser )
 
   typename ImageType::PointType newOrigin = inputImage->GetOrigin();
 
+  bool          usePadding = false;
+  unsigned long padLowerBound[ImageDimension];
+  unsigned long padUpperBound[ImageDimension];
+
   typename itk::ants::CommandLineParser::OptionType::Pointer bsplineOption =
     parser->GetOption( "bspline-fitting" );
   if( bsplineOption && bsplineOption->GetNumberOfFunctions() )
@@ -249,39 +719,18 @@ int N4( itk::ants::CommandLineParser *parser )
           numberOfControlPoints[d] = numberOfSpans + correcter->GetSplineOrder();
           }
 
-        typedef itk::ConstantPadImageFilter<ImageType, ImageType> PadderType;
-        typename PadderType::Pointer padder = PadderType::New();
-        padder->SetInput( inputImage );
-        padder->SetPadLowerBound( lowerBound );
-        padder->SetPadUpperBound( upperBound );
-        padder->SetConstant( 0 );
-        padder->Update();
-
-        inputImage = padder->GetOutput();
-        inputImage->DisconnectPipeline();
-
-        typedef itk::ConstantPadImageFilter<MaskImageType, MaskImageType> MaskPadderType;
-        typename MaskPadderType::Pointer maskPadder = MaskPadderType::New();
-        maskPadder->SetInput( maskImage );
-        maskPadder->SetPadLowerBound( lowerBound );
-        maskPadder->SetPadUpperBound( upperBound );
-        maskPadder->SetConstant( 0 );
-        maskPadder->Update();
-
-        maskImage = maskPadder->GetOutput();
-        maskImage->DisconnectPipeline();
+        usePadding = true;
+        for( unsigned int d = 0; d < ImageDimension; d++ )
+          {
+          padLowerBound[d] = lowerBound[d];
+          padUpperBound[d] = upperBound[d];
+          }
 
+        inputImage = PadN4Image<ImageType>( inputImage, lowerBound, upperBound );
+        maskImage = PadN4Image<MaskImageType>( maskImage, lowerBound, upperBound );
         if( weightImage )
           {
-          typename PadderType::Pointer weightPadder = PadderType::New();
-          weightPadder->SetInput( weightImage );
-          weightPadder->SetPadLowerBound( lowerBound );
-          weightPadder->SetPadUpperBound( upperBound );
-          weightPadder->SetConstant( 0 );
-          weightPadder->Update();
-
-          weightImage = weightPadder->GetOutput();
-          weightImage->DisconnectPipeline();
+          weightImage = PadN4Image<ImageType>( weightImage, lowerBound, upperBound );
           }
 
         if( verbose )
@@ -313,15 +762,8 @@ int N4( itk::ants::CommandLineParser *parser )
       }
     }
 
-  typedef itk::ShrinkImageFilter<ImageType, ImageType> ShrinkerType;
-  typename ShrinkerType::Pointer shrinker = ShrinkerType::New();
-  shrinker->SetInput( inputImage );
-  shrinker->SetShrinkFactors( 1 );
-
-  typedef itk::ShrinkImageFilter<MaskImageType, MaskImageType> MaskShrinkerType;
-  typename MaskShrinkerType::Pointer maskshrinker = MaskShrinkerType::New();
-  maskshrinker->SetInput( maskImage );
-  maskshrinker->SetShrinkFactors( 1 );
+  typedef N4BatchCorrecter<ImageDimension>  BatchCorrecterType;
+  typedef typename BatchCorrecterType::ShrinkerType ShrinkerType;
 
   typename itk::ants::CommandLineParser::OptionType::Pointer shrinkFactorOption =
     parser->GetOption( "shrink-factor" );
@@ -330,38 +772,29 @@ int N4( itk::ants::CommandLineParser *parser )
     {
     shrinkFactor = parser->Convert<int>( shrinkFactorOption->GetFunction( 0 )->GetName() );
     }
-  shrinker->SetShrinkFactors( shrinkFactor );
-  maskshrinker->SetShrinkFactors( shrinkFactor );
+  typename ShrinkerType::ShrinkFactorsType shrinkFactors;
+  shrinkFactors.Fill( shrinkFactor );
   if( ImageDimension == 4 )
     {
-    shrinker->SetShrinkFactor( 3, 1 );
-    maskshrinker->SetShrinkFactor( 3, 1 );
+    shrinkFactors[3] = 1;
     }
-  shrinker->Update();
-  maskshrinker->Update();
 
-  itk::TimeProbe timer;
-  timer.Start();
+  // The mask and weight images are shared by every input image, so they are
+  // shrunk only once.
 
-  correcter->SetInput( shrinker->GetOutput() );
-  correcter->SetMaskImage( maskshrinker->GetOutput() );
+  typedef itk::ShrinkImageFilter<MaskImageType, MaskImageType> MaskShrinkerType;
+  typename MaskShrinkerType::Pointer maskshrinker = MaskShrinkerType::New();
+  maskshrinker->SetInput( maskImage );
+  maskshrinker->SetShrinkFactors( shrinkFactors );
+  maskshrinker->Update();
 
   typedef itk::ShrinkImageFilter<ImageType, ImageType> WeightShrinkerType;
   typename WeightShrinkerType::Pointer weightshrinker = WeightShrinkerType::New();
   if( weightImage )
     {
     weightshrinker->SetInput( weightImage );
-    weightshrinker->SetShrinkFactors( shrinker->GetShrinkFactors() );
+    weightshrinker->SetShrinkFactors( shrinkFactors );
     weightshrinker->Update();
-
-    correcter->SetConfidenceImage( weightshrinker->GetOutput() );
-    }
-
-  if( verbose )
-    {
-    typedef CommandIterationUpdate<CorrecterType> CommandType;
-    typename CommandType::Pointer observer = CommandType::New();
-    correcter->AddObserver( itk::IterationEvent(), observer );
     }
 
   /**
@@ -388,181 +821,154 @@ int N4( itk::ants::CommandLineParser *parser )
       }
     }
 
-  try
+  /**
+   * batch options
+   */
+  bool useWarmStart = false;
+  typename CorrecterType::VariableSizeArrayType warmStartIterations =
+    correcter->GetMaximumNumberOfIterations();
+  for( unsigned int d = 0; d < warmStartIterations.Size(); d++ )
     {
-    // correcter->DebugOn();
-    correcter->Update();
+    warmStartIterations[d] = std::max( warmStartIterations[d] / 2, static_cast<unsigned int>( 1 ) );
     }
-  catch( itk::ExceptionObject & e )
+
+  typename itk::ants::CommandLineParser::OptionType::Pointer warmStartOption =
+    parser->GetOption( "warm-start" );
+  if( warmStartOption && warmStartOption->GetNumberOfFunctions() )
     {
-    if( verbose )
+    if( warmStartOption->GetFunction( 0 )->GetNumberOfParameters() > 0 )
       {
-      std::cerr << "Exception caught: " << e << std::endl;
+      useWarmStart = parser->Convert<bool>( warmStartOption->GetFunction( 0 )->GetParameter( 0 ) );
+      }
+    else
+      {
+      useWarmStart = parser->Convert<bool>( warmStartOption->GetFunction( 0 )->GetName() );
+      }
+    if( warmStartOption->GetFunction( 0 )->GetNumberOfParameters() > 1 )
+      {
+      std::vector<unsigned int> numIters = parser->ConvertVector<unsigned int>(
+          warmStartOption->GetFunction( 0 )->GetParameter( 1 ) );
+      if( numIters.size() != warmStartIterations.Size() )
+        {
+        if( verbose )
+          {
+          std::cerr << "The warm start iterations must have one entry per fitting level." << std::endl;
+          }
+        return EXIT_FAILURE;
+        }
+      for( unsigned int d = 0; d < numIters.size(); d++ )
+        {
+        warmStartIterations[d] = numIters[d];
+        }
       }
-    return EXIT_FAILURE;
-    }
-
-  if( verbose )
-    {
-    correcter->Print( std::cout, 3 );
     }
 
-  timer.Stop();
-  if( verbose )
+  unsigned int numberOfConcurrentImages = 1;
+  typename itk::ants::CommandLineParser::OptionType::Pointer concurrentOption =
+    parser->GetOption( "number-of-concurrent-images" );
+  if( concurrentOption && concurrentOption->GetNumberOfFunctions() )
     {
-    std::cout << "Elapsed time: " << timer.GetMean() << std::endl;
+    numberOfConcurrentImages = std::max( parser->Convert<unsigned int>(
+                                           concurrentOption->GetFunction( 0 )->GetName() ), 1u );
     }
 
   /**
-   * output
+   * outputs, one per input image
    */
+  std::vector<std::string> correctedFileNames;
+  std::vector<std::string> biasFieldFileNames;
   typename itk::ants::CommandLineParser::OptionType::Pointer outputOption =
     parser->GetOption( "output" );
   if( outputOption && outputOption->GetNumberOfFunctions() )
     {
-    /**
-                    * Reconstruct the bias field at full image resolution.  Divide
-                    * the original input image by the bias field to get the final
-                    * corrected image.
-                    */
-    typedef itk::BSplineControlPointImageFilter<typename
-                                                CorrecterType::BiasFieldControlPointLatticeType, typename
-                                                CorrecterType::ScalarImageType> BSplinerType;
-    typename BSplinerType::Pointer bspliner = BSplinerType::New();
-    bspliner->SetInput( correcter->GetLogBiasFieldControlPointLattice() );
-    bspliner->SetSplineOrder( correcter->GetSplineOrder() );
-    bspliner->SetSize( inputImage->GetLargestPossibleRegion().GetSize() );
-    bspliner->SetOrigin( newOrigin );
-    bspliner->SetDirection( inputImage->GetDirection() );
-    bspliner->SetSpacing( inputImage->GetSpacing() );
-    bspliner->Update();
-
-    typename ImageType::Pointer logField = AllocImage<ImageType>( inputImage );
-
-    itk::ImageRegionIterator<typename CorrecterType::ScalarImageType> ItB(
-      bspliner->GetOutput(),
-      bspliner->GetOutput()->GetLargestPossibleRegion() );
-    itk::ImageRegionIterator<ImageType> ItF( logField,
-                                             logField->GetLargestPossibleRegion() );
-    for( ItB.GoToBegin(), ItF.GoToBegin(); !ItB.IsAtEnd(); ++ItB, ++ItF )
-      {
-      ItF.Set( ItB.Get()[0] );
-      }
-
-    typedef itk::ExpImageFilter<ImageType, ImageType> ExpFilterType;
-    typename ExpFilterType::Pointer expFilter = ExpFilterType::New();
-    expFilter->SetInput( logField );
-    expFilter->Update();
-
-    typedef itk::DivideImageFilter<ImageType, ImageType, ImageType> DividerType;
-    typename DividerType::Pointer divider = DividerType::New();
-    divider->SetInput1( inputImage );
-    divider->SetInput2( expFilter->GetOutput() );
-    divider->Update();
-
-    if( maskImageOption && maskImageOption->GetNumberOfFunctions() > 0 )
-      {
-      itk::ImageRegionIteratorWithIndex<ImageType> ItD( divider->GetOutput(),
-                                                        divider->GetOutput()->GetLargestPossibleRegion() );
-      itk::ImageRegionIterator<ImageType> ItI( inputImage,
-                                               inputImage->GetLargestPossibleRegion() );
-      for( ItD.GoToBegin(), ItI.GoToBegin(); !ItD.IsAtEnd(); ++ItD, ++ItI )
+    for( int n = outputOption->GetNumberOfFunctions() - 1; n >= 0; n-- )
+      {
+      if( outputOption->GetFunction( n )->GetNumberOfParameters() == 0 )
         {
-        if( maskImage->GetPixel( ItD.GetIndex() ) == itk::NumericTraits<typename MaskImageType::PixelType>::ZeroValue() )
-          {
-          ItD.Set( ItI.Get() );
-          }
+        correctedFileNames.push_back( outputOption->GetFunction( n )->GetName() );
+        biasFieldFileNames.push_back( std::string() );
+        }
+      else
+        {
+        correctedFileNames.push_back( outputOption->GetFunction( n )->GetParameter( 0 ) );
+        biasFieldFileNames.push_back( outputOption->GetFunction( n )->GetNumberOfParameters() > 1 ?
+                                      outputOption->GetFunction( n )->GetParameter( 1 ) : std::string() );
         }
       }
-
-    bool doRescale = true;
-
-    typename itk::ants::CommandLineParser::OptionType::Pointer rescaleOption =
-      parser->GetOption( "rescale-intensities" );
-    if( ! isMaskImageSpecified || ( rescaleOption && rescaleOption->GetNumberOfFunctions() &&
-      ! parser->Convert<bool>( rescaleOption->GetFunction()->GetName() ) ) )
-      {
-      doRescale = false;
-      }
-
-    if( doRescale )
+    if( correctedFileNames.size() != inputFileNames.size() )
       {
-      typedef itk::Image<unsigned short, ImageDimension> ShortImageType;
-
-      typedef itk::BinaryThresholdImageFilter<MaskImageType, ShortImageType> ThresholderType;
-      typename ThresholderType::Pointer thresholder = ThresholderType::New();
-      thresholder->SetInsideValue( itk::NumericTraits<typename ShortImageType::PixelType>::ZeroValue() );
-      thresholder->SetOutsideValue( itk::NumericTraits<typename ShortImageType::PixelType>::OneValue() );
-      thresholder->SetLowerThreshold( itk::NumericTraits<typename MaskImageType::PixelType>::ZeroValue() );
-      thresholder->SetUpperThreshold( itk::NumericTraits<typename MaskImageType::PixelType>::ZeroValue() );
-      thresholder->SetInput( maskImage );
-
-      typedef itk::LabelStatisticsImageFilter<ImageType, ShortImageType> StatsType;
-      typename StatsType::Pointer stats = StatsType::New();
-      stats->SetInput( inputImage );
-      stats->SetLabelInput( thresholder->GetOutput() );
-      stats->UseHistogramsOff();
-      stats->Update();
-
-      typedef typename StatsType::LabelPixelType StatsLabelType;
-      StatsLabelType maskLabel = itk::NumericTraits<StatsLabelType>::OneValue();
-
-      RealType minOriginal = stats->GetMinimum( maskLabel );
-      RealType maxOriginal = stats->GetMaximum( maskLabel );
-
-      typename StatsType::Pointer stats2 = StatsType::New();
-      stats2->SetInput( divider->GetOutput() );
-      stats2->SetLabelInput( thresholder->GetOutput() );
-      stats2->UseHistogramsOff();
-      stats2->Update();
-
-      RealType minBiasCorrected = stats2->GetMinimum( maskLabel );
-      RealType maxBiasCorrected = stats2->GetMaximum( maskLabel );
-
-      RealType slope = ( maxOriginal - minOriginal ) / ( maxBiasCorrected - minBiasCorrected );
-
-      itk::ImageRegionIteratorWithIndex<ImageType> ItD( divider->GetOutput(),
-                                                        divider->GetOutput()->GetLargestPossibleRegion() );
-      for( ItD.GoToBegin(); !ItD.IsAtEnd(); ++ItD )
+      if( verbose )
         {
-        if( maskImage->GetPixel( ItD.GetIndex() ) == maskLabel )
-          {
-          RealType originalIntensity = ItD.Get();
-          RealType rescaledIntensity = maxOriginal - slope * ( maxBiasCorrected - originalIntensity );
-          ItD.Set( rescaledIntensity );
-          }
+        std::cerr << "The number of outputs (" << correctedFileNames.size()
+                 << ") does not match the number of input images (" << inputFileNames.size() << ")." << std::endl;
         }
+      return EXIT_FAILURE;
       }
+    }
 
-    typename ImageType::RegionType inputRegion;
-    inputRegion.SetIndex( inputImageIndex );
-    inputRegion.SetSize( inputImageSize );
+  bool doRescale = true;
 
-    typedef itk::ExtractImageFilter<ImageType, ImageType> CropperType;
-    typename CropperType::Pointer cropper = CropperType::New();
-    cropper->SetInput( divider->GetOutput() );
-    cropper->SetExtractionRegion( inputRegion );
-    cropper->SetDirectionCollapseToSubmatrix();
-    cropper->Update();
+  typename itk::ants::CommandLineParser::OptionType::Pointer rescaleOption =
+    parser->GetOption( "rescale-intensities" );
+  if( ! isMaskImageSpecified || ( rescaleOption && rescaleOption->GetNumberOfFunctions() &&
+    ! parser->Convert<bool>( rescaleOption->GetFunction()->GetName() ) ) )
+    {
+    doRescale = false;
+    }
 
-    typename CropperType::Pointer biasFieldCropper = CropperType::New();
-    biasFieldCropper->SetInput( expFilter->GetOutput() );
-    biasFieldCropper->SetExtractionRegion( inputRegion );
-    biasFieldCropper->SetDirectionCollapseToSubmatrix();
-    biasFieldCropper->Update();
+  typename ImageType::RegionType inputRegion;
+  inputRegion.SetIndex( inputImageIndex );
+  inputRegion.SetSize( inputImageSize );
+
+  BatchCorrecterType batch;
+  batch.m_InputFileNames = inputFileNames;
+  batch.m_CorrectedFileNames = correctedFileNames;
+  batch.m_BiasFieldFileNames = biasFieldFileNames;
+  batch.m_FirstInputImage = inputImage;
+  batch.m_InputRegion = inputRegion;
+  batch.m_Origin = newOrigin;
+  batch.m_MaskImage = maskImage;
+  batch.m_ShrunkMaskImage = maskshrinker->GetOutput();
+  if( weightImage )
+    {
+    batch.m_ShrunkWeightImage = weightshrinker->GetOutput();
+    }
+  batch.m_ShrinkFactors = shrinkFactors;
+  batch.m_Settings = correcter;
+  batch.m_WarmStartIterations = warmStartIterations;
+  batch.m_UsePadding = usePadding;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    batch.m_PadLowerBound[d] = usePadding ? padLowerBound[d] : 0;
+    batch.m_PadUpperBound[d] = usePadding ? padUpperBound[d] : 0;
+    }
+  batch.m_IsMaskImageSpecified = isMaskImageSpecified;
+  batch.m_DoRescale = doRescale;
+  batch.m_Verbose = verbose;
+  batch.m_NumberOfThreadsPerImage = std::max( itk::MultiThreader::GetGlobalDefaultNumberOfThreads()
+                                              / numberOfConcurrentImages, 1u );
+  batch.m_Lattices.resize( inputFileNames.size() );
+
+  // With a warm start the first image is corrected on its own and seeds the
+  // following waves; otherwise all waves are independent.
+  const unsigned int numberOfImages = inputFileNames.size();
+  unsigned int       waveBegin = 0;
+  while( waveBegin < numberOfImages )
+    {
+    const unsigned int waveSize = ( useWarmStart && waveBegin == 0 ) ? 1 : numberOfConcurrentImages;
+    const unsigned int waveEnd = std::min( waveBegin + waveSize, numberOfImages );
 
-    if( outputOption->GetFunction( 0 )->GetNumberOfParameters() == 0 )
+    batch.m_InitialLattice = ITK_NULLPTR;
+    if( useWarmStart && waveBegin > 0 )
       {
-      WriteImage<ImageType>( cropper->GetOutput(),  ( outputOption->GetFunction( 0 )->GetName() ).c_str() );
+      batch.m_InitialLattice = batch.m_Lattices[waveBegin - 1];
       }
-    else if( outputOption->GetFunction( 0 )->GetNumberOfParameters() > 0 )
+    ParallelizeRange( waveBegin, waveEnd, batch, waveEnd - waveBegin );
+    if( batch.GetFailed() )
       {
-      WriteImage<ImageType>( cropper->GetOutput(),  ( outputOption->GetFunction( 0 )->GetParameter( 0 ) ).c_str() );
-      if( outputOption->GetFunction( 0 )->GetNumberOfParameters() > 1 )
-        {
-        WriteImage<ImageType>( biasFieldCropper->GetOutput(),  ( outputOption->GetFunction( 0 )->GetParameter( 1 ) ).c_str() );
-        }
+      return EXIT_FAILURE;
       }
+    waveBegin = waveEnd;
     }
 
   return EXIT_SUCCESS;
@@ -590,7 +996,11 @@ void N4InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
     std::string( "A scalar image is expected as input for bias correction.  " )
     + std::string( "Since N4 log transforms the intensities, negative values " )
     + std::string( "or values close to zero should be processed prior to " )
-    + std::string( "correction." );
+    + std::string( "correction.  The option can be repeated to correct a batch " )
+    + std::string( "of images on the same grid, e.g. the echoes of a multi-echo " )
+    + std::string( "acquisition or the time points of a longitudinal series, " )
+    + std::string( "which then share the mask and weight images.  In that case " )
+    + std::string( "one output has to be given per input image, in the same order." );
 
   OptionType::Pointer option = OptionType::New();
   option->SetLongName( "input-image" );
@@ -729,6 +1139,39 @@ void N4InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
   parser->AddOption( option );
   }
 
+  {
+  std::string description =
+    std::string( "When correcting a batch of images, start each image from the " )
+    + std::string( "log bias field estimated for the previous image instead of " )
+    + std::string( "from a flat field.  As the bias fields of such series are " )
+    + std::string( "nearly identical, fewer iterations are needed; by default half " )
+    + std::string( "the number of iterations specified with the convergence " )
+    + std::string( "option is used at each level." );
+
+  OptionType::Pointer option = OptionType::New();
+  option->SetLongName( "warm-start" );
+  option->SetUsageOption( 0, "(0)/1" );
+  option->SetUsageOption( 1, "[(0)/1,<numberOfIterations>]" );
+  option->SetDescription( description );
+  parser->AddOption( option );
+  }
+
+  {
+  std::string description =
+    std::string( "When correcting a batch of images, the number of images that " )
+    + std::string( "are corrected at the same time.  The available threads are " )
+    + std::string( "divided among them.  Each image being corrected needs its own " )
+    + std::string( "full resolution copies, so use this when memory allows.  With " )
+    + std::string( "a warm start, the images of one wave all start from the bias " )
+    + std::string( "field of the last image of the previous wave." );
+
+  OptionType::Pointer option = OptionType::New();
+  option->SetLongName( "number-of-concurrent-images" );
+  option->SetUsageOption( 0, "(1)/2/3/..." );
+  option->SetDescription( description );
+  parser->AddOption( option );
+  }
+
   {
   std::string description =
     std::string( "The output consists of the bias corrected version of the " )
@@ -108,7 +108,7 @@ get_rai_code(itk::SpatialOrientation::ValidCoordinateOrientationFlags code)
 }
 
 template <unsigned int ImageDimension>
-int PrintHeader(int argc, char *argv[])
+static int PrintHeader(int argc, char *argv[])
 {
   typedef  float                                     inPixelType;
   typedef itk::Image<inPixelType, ImageDimension>    ImageType;
@@ -358,7 +358,7 @@ int PrintHeader(int argc, char *argv[])
   return EXIT_FAILURE;
 }
 
-bool FileExists(string strFilename)
+static bool FileExists(string strFilename)
 {
   struct stat stFileInfo;
   bool        blnReturn;
@@ -35,7 +35,7 @@
 namespace ants
 {
 template <unsigned int ImageDimension>
-int ResetDirection(int argc, char *argv[])
+static int ResetDirection(int argc, char *argv[])
 {
   if( argc < 3 )
     {
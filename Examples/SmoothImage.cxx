@@ -22,7 +22,7 @@
 namespace ants
 {
 template <unsigned int ImageDimension>
-int SmoothImage(int argc, char *argv[])
+static int SmoothImage(int argc, char *argv[])
 {
   typedef float                                                           PixelType;
   typedef itk::Image<PixelType, ImageDimension>                           ImageType;
@@ -14,6 +14,9 @@
 #include <float.h>
 #include <assert.h>
 #include "ReadWriteData.h"
+#include "antsImageSetSlab.h"
+#include "antsParallelizeRange.h"
+#include "itksys/SystemTools.hxx"
 
 #include <vnl/algo/vnl_symmetric_eigensystem.h>
 
@@ -56,7 +59,7 @@ int smallerStatElem(StatElement * elem1, StatElement * elem2)
 }
 
 template <class TImageType>
-void ReadImage(itk::SmartPointer<TImageType> & target, const char *file, bool copy)
+static void ReadImage(itk::SmartPointer<TImageType> & target, const char *file, bool copy)
 {
   //  std::cout << " reading b " << std::string(file) << std::endl;
   typedef itk::ImageFileReader<TImageType> readertype;
@@ -421,6 +424,180 @@ double TTest(int numSubjects,   int* groupLabel, double * featureValue )
   return tt;
 }
 
+/** One-pass form of TTest for group sums: the "small" group has nSmall
+ *  subjects with sum sumSmall and sum of squares sqSmall, the rest of the
+ *  subjects make up the other group.  Uses the same biased variances and
+ *  unequal-variance denominator as TTest. */
+inline double PartitionedTTest( double sumSmall, double sqSmall, double sumTotal, double sqTotal,
+                                double nSmall, double nLarge, bool smallIsA )
+{
+  const double meanSmall = sumSmall / nSmall;
+  const double meanLarge = ( sumTotal - sumSmall ) / nLarge;
+  const double varSmall = std::max( sqSmall / nSmall - meanSmall * meanSmall, 0.0 );
+  const double varLarge = std::max( ( sqTotal - sqSmall ) / nLarge - meanLarge * meanLarge, 0.0 );
+  const double denom = varSmall / nSmall + varLarge / nLarge;
+
+  if( !( denom > 0 ) )
+    {
+    return 0;
+    }
+  const double tt = ( meanSmall - meanLarge ) / sqrt( denom );
+  return smallIsA ? tt : -tt;
+}
+
+/** Computes the t-statistic and, if permutations were generated, the
+ *  permutation p-value for a range of voxels of the current slab.
+ *
+ *  The permutations are drawn once and shared by all voxels.  Each is stored
+ *  as the list of subjects that fall into the smaller group, so one
+ *  permutation of a block of voxels costs a sum over contiguous subject rows
+ *  of the slab (data is subject-major) and the other group follows from the
+ *  totals. */
+template <class TImage>
+class PermutationTTestSlabFunctor
+{
+public:
+  typedef typename TImage::RegionType RegionType;
+
+  itkStaticConstMacro( BlockSize, unsigned long, 256 );
+
+  PermutationTTestSlabFunctor( int* groupLabel, unsigned int numSubjectsA, unsigned int numSubjectsB,
+                               const std::vector<std::vector<unsigned int> > & permutedGroups,
+                               const std::vector<unsigned int> & observedGroup, unsigned int nthreads ) :
+    m_GroupLabel( groupLabel ), m_NumberOfSubjects( numSubjectsA + numSubjectsB ),
+    m_NumberOfSmallGroup( std::min( numSubjectsA, numSubjectsB ) ),
+    m_NumberOfLargeGroup( std::max( numSubjectsA, numSubjectsB ) ),
+    m_SmallGroupIsA( numSubjectsA <= numSubjectsB ), m_PermutedGroups( permutedGroups ),
+    m_ObservedGroup( observedGroup ), m_Feature( nthreads, std::vector<double>( numSubjectsA + numSubjectsB ) ),
+    m_Accumulators( nthreads, std::vector<double>( 5 * BlockSize ) ),
+    m_Counts( nthreads, std::vector<unsigned long>( BlockSize ) ),
+    m_Data( ITK_NULLPTR ), m_StatImage( ITK_NULLPTR ), m_PImage( ITK_NULLPTR )
+  {
+  }
+
+  void SetSlab( const RegionType & slab, const std::vector<float> * data, TImage * statImage, TImage * pImage )
+  {
+    this->m_Slab = slab;
+    this->m_Data = data;
+    this->m_StatImage = statImage;
+    this->m_PImage = pImage;
+  }
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    const unsigned long   nvoxels = this->m_Slab.GetNumberOfPixels();
+    const float *         data = &( *this->m_Data )[0];
+    std::vector<double> & feature = this->m_Feature[threadId];
+    double *              sumTotal = &this->m_Accumulators[threadId][0];
+    double *              sqTotal = sumTotal + BlockSize;
+    double *              sumSmall = sqTotal + BlockSize;
+    double *              sqSmall = sumSmall + BlockSize;
+    double *              observed = sqSmall + BlockSize;
+    unsigned long *       counts = &this->m_Counts[threadId][0];
+
+    const double nSmall = this->m_NumberOfSmallGroup;
+    const double nLarge = this->m_NumberOfLargeGroup;
+    for( itk::SizeValueType blockBegin = begin; blockBegin < end; blockBegin += BlockSize )
+      {
+      const unsigned long n = std::min( static_cast<unsigned long>( end - blockBegin ),
+                                        static_cast<unsigned long>( BlockSize ) );
+
+      // the t image itself still comes from TTest so that it is unchanged
+      for( unsigned long v = 0; v < n; v++ )
+        {
+        for( unsigned int subj = 0; subj < this->m_NumberOfSubjects; subj++ )
+          {
+          feature[subj] = data[subj * nvoxels + blockBegin + v];
+          }
+        const double stat = TTest( this->m_NumberOfSubjects, this->m_GroupLabel, &feature[0] );
+        this->m_StatImage->SetPixel( GetImageSetSlabIndex( this->m_Slab, blockBegin + v ), stat );
+        }
+      if( this->m_PermutedGroups.empty() )
+        {
+        continue;
+        }
+
+      this->SumRows( this->m_NumberOfSubjects, ITK_NULLPTR, data + blockBegin, nvoxels, n, sumTotal, sqTotal );
+      this->SumRows( this->m_ObservedGroup.size(), &this->m_ObservedGroup[0], data + blockBegin, nvoxels, n,
+                     sumSmall, sqSmall );
+      for( unsigned long v = 0; v < n; v++ )
+        {
+        observed[v] = PartitionedTTest( sumSmall[v], sqSmall[v], sumTotal[v], sqTotal[v], nSmall, nLarge,
+                                        this->m_SmallGroupIsA );
+        counts[v] = 0;
+        }
+      for( unsigned long perm = 0; perm < this->m_PermutedGroups.size(); perm++ )
+        {
+        const std::vector<unsigned int> & group = this->m_PermutedGroups[perm];
+        this->SumRows( group.size(), &group[0], data + blockBegin, nvoxels, n, sumSmall, sqSmall );
+        for( unsigned long v = 0; v < n; v++ )
+          {
+          const double tt = PartitionedTTest( sumSmall[v], sqSmall[v], sumTotal[v], sqTotal[v], nSmall, nLarge,
+                                              this->m_SmallGroupIsA );
+          if( tt >= observed[v] )
+            {
+            ++counts[v];
+            }
+          }
+        }
+      const double npermutations = this->m_PermutedGroups.size();
+      for( unsigned long v = 0; v < n; v++ )
+        {
+        const double pval = ( counts[v] + 1.0 ) / ( npermutations + 1.0 );
+        this->m_PImage->SetPixel( GetImageSetSlabIndex( this->m_Slab, blockBegin + v ), pval );
+        }
+      }
+  }
+
+private:
+  /** sum and sum of squares over the given subject rows (all rows if
+   *  subjects is null) of a block of n voxels */
+  static void SumRows( unsigned long nrows, const unsigned int * subjects, const float * data, unsigned long stride,
+                       unsigned long n, double * sum, double * sq )
+  {
+    std::fill( sum, sum + n, 0.0 );
+    std::fill( sq, sq + n, 0.0 );
+    for( unsigned long r = 0; r < nrows; r++ )
+      {
+      const float * row = data + ( subjects ? subjects[r] : r ) * stride;
+      for( unsigned long v = 0; v < n; v++ )
+        {
+        const double x = row[v];
+        sum[v] += x;
+        sq[v] += x * x;
+        }
+      }
+  }
+
+  int*                                          m_GroupLabel;
+  unsigned int                                  m_NumberOfSubjects;
+  unsigned int                                  m_NumberOfSmallGroup;
+  unsigned int                                  m_NumberOfLargeGroup;
+  bool                                          m_SmallGroupIsA;
+  const std::vector<std::vector<unsigned int> > & m_PermutedGroups;
+  const std::vector<unsigned int> &             m_ObservedGroup;
+  std::vector<std::vector<double> >             m_Feature;
+  std::vector<std::vector<double> >             m_Accumulators;
+  std::vector<std::vector<unsigned long> >      m_Counts;
+  RegionType                                    m_Slab;
+  const std::vector<float> *                    m_Data;
+  TImage *                                      m_StatImage;
+  TImage *                                      m_PImage;
+};
+
+/** name.nii.gz -> namePvals.nii.gz */
+std::string GetPValueFileName( const std::string & outname )
+{
+  std::string extension = itksys::SystemTools::GetFilenameLastExtension( outname );
+
+  if( extension == ".gz" )
+    {
+    extension = itksys::SystemTools::GetFilenameLastExtension( outname.substr( 0, outname.length() - 3 ) )
+      + extension;
+    }
+  return outname.substr( 0, outname.length() - extension.length() ) + std::string( "Pvals" ) + extension;
+}
+
 template <unsigned int ImageDimension>
 int StudentsTestOnImages(int argc, char *argv[])
 {
@@ -506,52 +683,82 @@ int StudentsTestOnImages(int argc, char *argv[])
 
 //   unsigned int sizeofpixel=sizeof(PixelType);
 
-  std::vector<typename ImageType::Pointer> imagestack;
-  imagestack.resize(numvals);
+  std::vector<std::string> filenames;
   for( unsigned int j = 0; j < numvals; j++ )
     {
-    std::string ifn = std::string(argv[5 + j]);
-    std::cout << "reading " << ifn << std::endl;
-    ReadImage<ImageType>(imagestack[j], ifn.c_str(), false);
+    filenames.push_back( std::string(argv[5 + j]) );
     }
-
-  typedef itk::ImageRegionIteratorWithIndex<ImageType> Iterator;
-  Iterator      vfIter(PImage, PImage->GetLargestPossibleRegion() );
-  unsigned long nvox = 1;
-  for( unsigned int i = 0; i < ImageDimension; i++ )
+  unsigned int npermutations = 0;
+  if( argc > static_cast<int>( 5 + numvals ) )
     {
-    nvox *= PImage->GetLargestPossibleRegion().GetSize()[i];
+    npermutations = atoi(argv[5 + numvals]);
     }
 
-  unsigned long ct = 0;
-  unsigned long prog = nvox / 20;
-  std::cout << " NVals " << numvals << " NSub " << numSubjects <<  std::endl;
-  for(  vfIter.GoToBegin(); !vfIter.IsAtEnd(); ++vfIter )
+  // draw the permutations once; every voxel is tested against the same set
+  const bool                               smallGroupIsA = numSubjectsA <= numSubjectsB;
+  const int                                smallGroupLabel = smallGroupIsA ? GROUPALABEL : GROUPBLABEL;
+  std::vector<unsigned int>                observedGroup;
+  std::vector<std::vector<unsigned int> >  permutedGroups;
+  for( unsigned int subj = 0; subj < numSubjects; subj++ )
     {
-    typename ImageType::IndexType index = vfIter.GetIndex();
-    for( unsigned int subj = 0; subj < numSubjects; subj++ )
+    if( groupLabel[subj] == smallGroupLabel )
       {
-      feature[subj] = imagestack[subj]->GetPixel(index);
+      observedGroup.push_back( subj );
       }
-    if( ct % prog == 0 )
+    }
+  if( numSubjectsA > 0 && numSubjectsB > 0 )
+    {
+    int* permutedLabel = new int[numSubjects];
+    permutedGroups.resize( npermutations );
+    for( unsigned int perm = 0; perm < npermutations; perm++ )
       {
-      std::cout << " % " << (float) ct / (float) nvox << std::endl;
+      generatePermGroup( groupLabel, numSubjectsA, numSubjectsB, permutedLabel );
+      for( unsigned int subj = 0; subj < numSubjects; subj++ )
+        {
+        if( permutedLabel[subj] == smallGroupLabel )
+          {
+          permutedGroups[perm].push_back( subj );
+          }
+        }
       }
-
-    double stat = 0;
-//      if (mask->GetPixel(index) >= 0.5)
-    if( true )
+    delete [] permutedLabel;
+    }
+
+  // stream the subjects one slab at a time and test the voxels of each slab
+  // in parallel
+  const unsigned int  slabAxis = ImageDimension - 1;
+  const unsigned long nslices = region.GetSize()[slabAxis];
+  const unsigned long slabThickness =
+    ImageSetCanStreamRead( filenames ) ? GetImageSetSlabThickness( region, numvals ) : nslices;
+
+  const itk::ThreadIdType nthreads =
+    ants::GetNumberOfThreadsForRange( region.GetNumberOfPixels() / nslices * slabThickness );
+  PermutationTTestSlabFunctor<ImageType> functor( groupLabel, numSubjectsA, numSubjectsB, permutedGroups,
+                                                  observedGroup, nthreads );
+  std::cout << " NVals " << numvals << " NSub " << numSubjects << " NPermutations " << npermutations << std::endl;
+  std::vector<float> data;
+  for( unsigned long first = 0; first < nslices; first += slabThickness )
+    {
+    const typename ImageType::RegionType slab = GetImageSetSlab( region, first, slabThickness );
+    std::cout << " % " << (float) first / (float) nslices << std::endl;
+    if( !ReadImageSetSlab<ImageType>( filenames, slab, region, data, false ) )
       {
-      stat = TTest(numSubjects, groupLabel, feature);
+      delete [] feature;
+      delete [] groupLabel;
+      return EXIT_FAILURE;
       }
-    ct++;
-    StatImage->SetPixel(  index,   stat);
+    functor.SetSlab( slab, &data, StatImage, PImage );
+    ants::ParallelizeRange( 0, slab.GetNumberOfPixels(), functor, nthreads );
     }
 
   typedef itk::Statistics::TDistribution DistributionType;
   typename DistributionType::Pointer distributionFunction = DistributionType::New();
 
   WriteImage(StatImage, outname.c_str() );
+  if( !permutedGroups.empty() )
+    {
+    WriteImage(PImage, GetPValueFileName( outname ).c_str() );
+    }
 
   delete [] feature;
   delete [] groupLabel;
@@ -624,10 +831,13 @@ private:
 
   if( argc < 6 )
     {
-    std::cout << "Usage: " << argv[0] <<  " ImageDimension  OutName NGroup1 NGroup2 ControlV1*   SubjectV1*   "
+    std::cout << "Usage: " << argv[0]
+             <<  " ImageDimension  OutName NGroup1 NGroup2 ControlV1*   SubjectV1*  {NPermutations} "
              << std::endl;
     std::cout << " Assume all images the same size " << std::endl;
     std::cout << " Writes out an F-Statistic image " << std::endl;
+    std::cout << " With NPermutations > 0, also writes OutNamePvals, the one-sided permutation p-values " << std::endl;
+    std::cout << " for group 1 > group 2, using the same permutations at every voxel " << std::endl;
     std::cout <<  " \n example call \n  \n ";
     std::cout << argv[0] << "  2  TEST.nii.gz 4 8 FawtJandADCcon/*SUB.nii  FawtJandADCsub/*SUB.nii  \n ";
     return 1;
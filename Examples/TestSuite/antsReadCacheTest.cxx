@@ -0,0 +1,104 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+/** Check the read cache used by antsServer: repeated reads are served from
+ *  the cache as independent copies, writing a file drops its entry, and the
+ *  cache never holds more than its capacity. */
+
+#include "ReadWriteData.h"
+#include "antsReadCache.h"
+#include "itkImage.h"
+#include "antsTestHelpers.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace
+{
+using ants::testing::Check;
+
+typedef itk::Image<float, 3> ImageType;
+
+ImageType::Pointer MakeImage( float value )
+{
+  ImageType::RegionType region;
+  ImageType::SizeType   size;
+  size.Fill( 32 );
+  region.SetSize( size );
+  return AllocImage<ImageType>( region, value );
+}
+
+bool CacheReports( const char *text )
+{
+  std::ostringstream statistics;
+  ants::PrintReadCacheStatistics( statistics );
+  return statistics.str().find( text ) != std::string::npos;
+}
+}
+
+int main( int argc, char * argv[] )
+{
+  const std::string directory = argc > 1 ? std::string( argv[1] ) + "/" : std::string();
+  const std::string first = directory + "antsReadCacheTest1.nii";
+  const std::string second = directory + "antsReadCacheTest2.nii";
+
+  WriteImage<ImageType>( MakeImage( 1.0f ), first.c_str() );
+  WriteImage<ImageType>( MakeImage( 2.0f ), second.c_str() );
+
+  // one image is 128 kB; room for one of them only
+  ants::SetReadCacheCapacity( 160 * 1024 );
+
+  int                failures = 0;
+  ImageType::Pointer image;
+  failures += Check( ReadImage<ImageType>( image, first.c_str() ), "first read" );
+  failures += Check( CacheReports( "1 entries" ) && CacheReports( "1 misses" ), "first read is cached" );
+
+  image->FillBuffer( -1.0f );
+  ImageType::Pointer again;
+  failures += Check( ReadImage<ImageType>( again, first.c_str() ), "second read" );
+  failures += Check( CacheReports( "1 hits" ), "second read is a hit" );
+  failures += Check( again.GetPointer() != image.GetPointer() && again->GetPixel( again->GetBufferedRegion().GetIndex() ) == 1.0f,
+                     "hit is an unmodified copy" );
+
+  ImageType::Pointer other;
+  failures += Check( ReadImage<ImageType>( other, second.c_str() ), "read of another file" );
+  failures += Check( CacheReports( "1 entries" ) && CacheReports( "1 evictions" ), "capacity is respected" );
+
+  // writing a file drops its entry, even when the rewrite keeps the size
+  // and lands within the modification time resolution
+  WriteImage<ImageType>( MakeImage( 3.0f ), second.c_str() );
+  failures += Check( CacheReports( "0 entries" ), "writing a file drops its entry" );
+  ImageType::Pointer rewritten;
+  failures += Check( ReadImage<ImageType>( rewritten, second.c_str() ), "read of a rewritten file" );
+  failures += Check( rewritten->GetPixel( rewritten->GetBufferedRegion().GetIndex() ) == 3.0f,
+                     "rewritten file is not served from the cache" );
+
+  ants::SetReadCacheCapacity( 0 );
+  failures += Check( CacheReports( "0 entries" ), "disabling empties the cache" );
+
+  remove( first.c_str() );
+  remove( second.c_str() );
+
+  if( failures > 0 )
+    {
+    std::cerr << failures << " read cache checks failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "read cache checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
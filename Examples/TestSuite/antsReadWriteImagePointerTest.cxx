@@ -0,0 +1,121 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+/** Check the in-memory "0x..." handoff of ReadImage and WriteImage: a
+ *  matching type must share the caller's image, another scalar type must be
+ *  converted into a separate image, and the shared image must stay alive for
+ *  as long as any holder references it. */
+
+#include "ReadWriteData.h"
+#include "itkImage.h"
+#include "itkVector.h"
+#include "antsTestHelpers.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace
+{
+using ants::testing::Check;
+
+typedef itk::Image<float, 3>                 FloatImageType;
+typedef itk::Image<double, 3>                DoubleImageType;
+typedef itk::Image<unsigned char, 3>         ByteImageType;
+typedef itk::Image<itk::Vector<float, 3>, 3> VectorImageType;
+
+template <class TImageType>
+std::string PointerName( itk::SmartPointer<TImageType> * slot )
+{
+  char name[64];
+
+  sprintf( name, "%p", static_cast<void *>( slot ) );
+  return std::string( name );
+}
+}
+
+int main( int, char * [] )
+{
+  FloatImageType::SizeType size;
+  size.Fill( 17 );
+  FloatImageType::Pointer image = AllocImage<FloatImageType>( size );
+  float *                 buffer = image->GetBufferPointer();
+  const itk::SizeValueType numberOfPixels = image->GetBufferedRegion().GetNumberOfPixels();
+  for( itk::SizeValueType i = 0; i < numberOfPixels; i++ )
+    {
+    buffer[i] = static_cast<float>( i % 251 ) + 0.25f;
+    }
+
+  int failures = 0;
+
+  // same type: the buffer is shared, not copied
+  FloatImageType::Pointer slot = image;
+  const std::string       name = PointerName( &slot );
+  FloatImageType::Pointer shared;
+  failures += Check( ReadImage<FloatImageType>( shared, name.c_str() ), "same-type read" );
+  failures += Check( shared.GetPointer() == image.GetPointer(), "same-type read shares the image" );
+  failures += Check( shared->GetBufferPointer() == buffer, "same-type read shares the buffer" );
+
+  // other scalar types: converted into a separate image
+  DoubleImageType::Pointer converted;
+  failures += Check( ReadImage<DoubleImageType>( converted, name.c_str() ), "float to double read" );
+  failures += Check( converted.IsNotNull() && converted->GetBufferedRegion() == image->GetBufferedRegion(),
+                     "converted image has the input region" );
+  bool equal = converted.IsNotNull();
+  for( itk::SizeValueType i = 0; equal && i < numberOfPixels; i++ )
+    {
+    equal = converted->GetBufferPointer()[i] == static_cast<double>( buffer[i] );
+    }
+  failures += Check( equal, "float to double values" );
+
+  ByteImageType::Pointer bytes;
+  failures += Check( ReadImage<ByteImageType>( bytes, name.c_str() ), "float to unsigned char read" );
+  failures += Check( bytes.IsNotNull() && bytes->GetBufferPointer()[300] == static_cast<unsigned char>( buffer[300] ),
+                     "float to unsigned char values" );
+
+  // non-scalar pixels are never converted
+  VectorImageType::Pointer vectors;
+  failures += Check( !ReadImage<VectorImageType>( vectors, name.c_str() ) && vectors.IsNull(),
+                     "scalar to vector read is refused" );
+
+  // a null pointer is an error, not a crash
+  FloatImageType::Pointer empty;
+  const std::string       emptyName = PointerName( &empty );
+  FloatImageType::Pointer fromEmpty;
+  failures += Check( !ReadImage<FloatImageType>( fromEmpty, emptyName.c_str() ), "null read is refused" );
+
+  // writing stores a reference in the caller's pointer
+  FloatImageType::Pointer written;
+  const std::string       writtenName = PointerName( &written );
+  failures += Check( WriteImage<FloatImageType>( shared, writtenName.c_str() ), "in-memory write" );
+  failures += Check( written.GetPointer() == image.GetPointer(), "in-memory write shares the image" );
+
+  // lifetime: the image survives as long as one holder is left
+  image = ITK_NULLPTR;
+  slot = ITK_NULLPTR;
+  shared = ITK_NULLPTR;
+  failures += Check( written->GetReferenceCount() == 1, "last holder owns the image" );
+  failures += Check( written->GetBufferPointer()[numberOfPixels - 1] == buffer[numberOfPixels - 1],
+                     "image outlives the other holders" );
+
+  if( failures > 0 )
+    {
+    std::cerr << failures << " in-memory handoff checks failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "in-memory handoff checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,189 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+/** Register a small synthetic pair with greedy SyN and a mask, once on the
+ *  full grid and once with --restrict-to-mask-region.  Inside the bounding
+ *  box of the mask the two warps must agree to within a small fraction of a
+ *  voxel.  They are not identical, which is why the option is labelled
+ *  approximate: the restricted run does not smooth or invert the total
+ *  fields outside of the padded box, and that reaches back into it a
+ *  little.  Far outside of the padded box the restricted warp must stay
+ *  zero. */
+
+#include <string>
+#include <vector>
+
+#include "include/ANTS_.h"
+#include "ReadWriteData.h"
+#include "antsAllocImage.h"
+#include "itkImage.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkVector.h"
+#include "antsTestHelpers.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+using ants::testing::Check;
+
+typedef itk::Image<float, 2>                 ImageType;
+typedef itk::Image<itk::Vector<float, 2>, 2> FieldType;
+
+const long ImageSize = 64;
+const long MaskBegin = 20;
+const long MaskEnd = 44;
+
+ImageType::Pointer MakeImage()
+{
+  ImageType::RegionType region;
+  ImageType::SizeType   size;
+  size.Fill( ImageSize );
+  region.SetSize( size );
+  return AllocImage<ImageType>( region, 0 );
+}
+
+ImageType::Pointer MakeBlob( double cx, double cy, double sigma )
+{
+  ImageType::Pointer image = MakeImage();
+
+  itk::ImageRegionIteratorWithIndex<ImageType> it( image, image->GetLargestPossibleRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const double dx = it.GetIndex()[0] - cx;
+    const double dy = it.GetIndex()[1] - cy;
+    it.Set( static_cast<float>( 100.0 * std::exp( -( dx * dx + dy * dy ) / ( 2.0 * sigma * sigma ) ) ) );
+    }
+  return image;
+}
+
+ImageType::Pointer MakeMask()
+{
+  ImageType::Pointer image = MakeImage();
+
+  itk::ImageRegionIteratorWithIndex<ImageType> it( image, image->GetLargestPossibleRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const bool inside = it.GetIndex()[0] >= MaskBegin && it.GetIndex()[0] <= MaskEnd
+      && it.GetIndex()[1] >= MaskBegin && it.GetIndex()[1] <= MaskEnd;
+    it.Set( inside ? 1.0f : 0.0f );
+    }
+  return image;
+}
+
+bool Register( const std::string & fixed, const std::string & moving, const std::string & mask,
+               const std::string & output, bool restrictToMask )
+{
+  std::vector<std::string> args;
+  args.push_back( "2" );
+  args.push_back( "-m" );
+  args.push_back( "MSQ[" + fixed + "," + moving + ",1,0]" );
+  args.push_back( "-t" );
+  args.push_back( "SyN[0.25]" );
+  args.push_back( "-r" );
+  args.push_back( "Gauss[3,1]" );
+  args.push_back( "-i" );
+  args.push_back( "20" );
+  args.push_back( "--number-of-affine-iterations" );
+  args.push_back( "0" );
+  args.push_back( "-x" );
+  args.push_back( mask );
+  if( restrictToMask )
+    {
+    args.push_back( "--restrict-to-mask-region" );
+    args.push_back( "[1,10]" );
+    }
+  args.push_back( "-o" );
+  args.push_back( output + ".nii.gz" );
+  return ants::ANTS( args, ITK_NULLPTR ) == EXIT_SUCCESS;
+}
+} // namespace
+
+int main( int argc, char * argv[] )
+{
+  const std::string directory = argc > 1 ? std::string( argv[1] ) + "/" : std::string();
+  const std::string fixed = directory + "antsRestrictToMaskRegionTestFixed.nii.gz";
+  const std::string moving = directory + "antsRestrictToMaskRegionTestMoving.nii.gz";
+  const std::string mask = directory + "antsRestrictToMaskRegionTestMask.nii.gz";
+  const std::string full = directory + "antsRestrictToMaskRegionTestFull";
+  const std::string restricted = directory + "antsRestrictToMaskRegionTestRestricted";
+
+  WriteImage<ImageType>( MakeBlob( 30, 32, 6 ), fixed.c_str() );
+  WriteImage<ImageType>( MakeBlob( 33, 31, 5 ), moving.c_str() );
+  WriteImage<ImageType>( MakeMask(), mask.c_str() );
+
+  int failures = 0;
+  failures += Check( Register( fixed, moving, mask, full, false ), "unrestricted registration" );
+  failures += Check( Register( fixed, moving, mask, restricted, true ), "restricted registration" );
+  if( failures > 0 )
+    {
+    return EXIT_FAILURE;
+    }
+
+  FieldType::Pointer fullWarp;
+  FieldType::Pointer restrictedWarp;
+  ReadImage<FieldType>( fullWarp, ( full + "Warp.nii.gz" ).c_str() );
+  ReadImage<FieldType>( restrictedWarp, ( restricted + "Warp.nii.gz" ).c_str() );
+
+  double largestDifference = 0;
+  double largestDisplacement = 0;
+  double largestOutside = 0;
+  itk::ImageRegionConstIteratorWithIndex<FieldType> it( fullWarp, fullWarp->GetLargestPossibleRegion() );
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const FieldType::IndexType index = it.GetIndex();
+    const FieldType::PixelType value = restrictedWarp->GetPixel( index );
+    const bool                 inMask = index[0] >= MaskBegin && index[0] <= MaskEnd
+      && index[1] >= MaskBegin && index[1] <= MaskEnd;
+    const bool                 corner = ( index[0] < 2 || index[0] >= ImageSize - 2 )
+      && ( index[1] < 2 || index[1] >= ImageSize - 2 );
+    if( inMask )
+      {
+      largestDifference = std::max( largestDifference, static_cast<double>( ( it.Get() - value ).GetNorm() ) );
+      largestDisplacement = std::max( largestDisplacement, static_cast<double>( value.GetNorm() ) );
+      }
+    if( corner )
+      {
+      largestOutside = std::max( largestOutside, static_cast<double>( value.GetNorm() ) );
+      }
+    }
+  std::cout << "largest displacement " << largestDisplacement << ", largest difference in the mask box "
+            << largestDifference << ", largest displacement in the corners " << largestOutside << std::endl;
+
+  failures += Check( largestDisplacement > 0.5, "the blobs are registered" );
+  failures += Check( largestDifference < 0.1, "restricted warp matches the full warp in the mask box" );
+  failures += Check( largestOutside == 0.0, "restricted warp is zero far outside of the mask box" );
+
+  const std::string files[] = { fixed, moving, mask, full + "Warp.nii.gz", full + "InverseWarp.nii.gz",
+                                full + "Affine.txt", restricted + "Warp.nii.gz", restricted + "InverseWarp.nii.gz",
+                                restricted + "Affine.txt" };
+  for( unsigned int n = 0; n < sizeof( files ) / sizeof( files[0] ); n++ )
+    {
+    remove( files[n].c_str() );
+    }
+
+  if( failures > 0 )
+    {
+    std::cerr << failures << " restricted registration checks failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "restricted registration checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
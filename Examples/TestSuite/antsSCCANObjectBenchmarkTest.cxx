@@ -0,0 +1,159 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+/** Benchmark the in-place / by-reference matrix interface of antsSCCANObject
+ *  against the by-value formulation it replaced.  Both paths must agree; the
+ *  timings are printed so that regressions show up in the dashboard log. */
+
+#include "antsSCCANObject.h"
+#include "itkImage.h"
+#include "itkTimeProbe.h"
+#include "vnl/vnl_random.h"
+
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+typedef itk::Image<double, 3>                         ImageType;
+typedef itk::ants::antsSCCANObject<ImageType, double> SCCANType;
+typedef SCCANType::MatrixType                         MatrixType;
+typedef SCCANType::VectorType                         VectorType;
+
+/** the by-value whitening that antsSCCANObject used before */
+MatrixType ReferenceWhitenMatrix( SCCANType * sccan, MatrixType p, double regularization )
+{
+  double reg = 1.e-9;
+
+  if( p.rows() < p.cols() )
+    {
+    reg = regularization;
+    }
+  MatrixType cov;
+  if( p.rows() < p.columns() )
+    {
+    cov = p * p.transpose();
+    cov.set_identity();
+    cov = cov * reg + p * p.transpose();
+    }
+  else
+    {
+    cov = p.transpose() * p;
+    cov.set_identity();
+    cov = cov * reg + p.transpose() * p;
+    }
+  MatrixType invcov = sccan->PseudoInverse( cov, true );
+  if( p.rows() < p.columns() )
+    {
+    return invcov * p;
+    }
+  return p * invcov;
+}
+
+/** the by-value orthogonalization that antsSCCANObject used before */
+MatrixType ReferenceOrthogonalizeMatrix( MatrixType M, VectorType V )
+{
+  for( unsigned int j = 0; j < M.cols(); j++ )
+    {
+    VectorType Mvec = M.get_column(j);
+    double     vnorm = inner_product(V, V);
+    double     ratio = inner_product(Mvec, V) / vnorm;
+    VectorType ortho = Mvec - V * ratio;
+    M.set_column(j, ortho);
+    }
+  return M;
+}
+
+double RelativeDifference( const MatrixType & a, const MatrixType & b )
+{
+  const double denom = a.frobenius_norm();
+  if( denom <= 0 )
+    {
+    return ( a - b ).frobenius_norm();
+    }
+  return ( a - b ).frobenius_norm() / denom;
+}
+}
+
+int main( int argc, char *argv[] )
+{
+  unsigned int nsubjects = 100;
+  unsigned int nvoxels = 5000;
+  unsigned int niterations = 3;
+  if( argc > 1 )
+    {
+    nsubjects = atoi( argv[1] );
+    }
+  if( argc > 2 )
+    {
+    nvoxels = atoi( argv[2] );
+    }
+  if( argc > 3 )
+    {
+    niterations = atoi( argv[3] );
+    }
+
+  SCCANType::Pointer sccan = SCCANType::New();
+  sccan->SetSilent( true );
+
+  vnl_random rng( 12345 );
+  MatrixType data( nsubjects, nvoxels );
+  for( unsigned int i = 0; i < nsubjects; i++ )
+    {
+    for( unsigned int j = 0; j < nvoxels; j++ )
+      {
+      data( i, j ) = rng.normal();
+      }
+    }
+  VectorType v( nsubjects );
+  for( unsigned int i = 0; i < nsubjects; i++ )
+    {
+    v( i ) = rng.normal();
+    }
+
+  MatrixType    byvalue;
+  itk::TimeProbe byvalueprobe;
+  byvalueprobe.Start();
+  for( unsigned int it = 0; it < niterations; it++ )
+    {
+    byvalue = ReferenceOrthogonalizeMatrix( data, v );
+    byvalue = ReferenceWhitenMatrix( sccan, byvalue, 1.e-2 );
+    }
+  byvalueprobe.Stop();
+
+  MatrixType    inplace( nsubjects, nvoxels );
+  itk::TimeProbe inplaceprobe;
+  inplaceprobe.Start();
+  for( unsigned int it = 0; it < niterations; it++ )
+    {
+    inplace = data;
+    sccan->OrthogonalizeMatrixInPlace( inplace, v );
+    sccan->WhitenMatrixInPlace( inplace, 1.e-2 );
+    }
+  inplaceprobe.Stop();
+
+  const double difference = RelativeDifference( byvalue, inplace );
+  std::cout << "matrix " << nsubjects << " x " << nvoxels << ", " << niterations << " iterations" << std::endl;
+  std::cout << "  by value  : " << byvalueprobe.GetTotal() << " s" << std::endl;
+  std::cout << "  in place  : " << inplaceprobe.GetTotal() << " s" << std::endl;
+  std::cout << "  rel. diff : " << difference << std::endl;
+
+  if( difference > 1.e-8 )
+    {
+    std::cerr << "in-place and by-value results differ" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,310 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+/** Check the closed-form 3x3 eigensolver of antsSymmetricEigenSystem3.h
+ *  against vnl_symmetric_eigensystem, one tensor at a time and through
+ *  SymmetricEigenSystem3Batch.  The tensors are random, have repeated or
+ *  nearly repeated eigenvalues, or are (nearly) zero.  Eigenvalues must
+ *  match vnl.  Eigenvectors must be orthonormal and satisfy A v = lambda v,
+ *  and where an eigenvalue is well separated its eigenvector must match
+ *  vnl's up to sign. */
+
+#include "antsSymmetricEigenSystem3.h"
+
+#include "vnl/vnl_matrix.h"
+#include "vnl/algo/vnl_symmetric_eigensystem.h"
+#include "antsTestHelpers.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+using ants::testing::Check;
+
+struct Tensor
+  {
+  double m_Component[6];
+
+  double operator[]( unsigned int c ) const
+  {
+    return this->m_Component[c];
+  }
+  };
+
+double Random()
+{
+  return 2.0 * std::rand() / RAND_MAX - 1.0;
+}
+
+/** Random rotation from Gram-Schmidt on two random vectors. */
+void RandomRotation( double R[3][3] )
+{
+  double u[3], v[3];
+  double norm = 0;
+  while( norm < 1e-3 )
+    {
+    u[0] = Random();
+    u[1] = Random();
+    u[2] = Random();
+    norm = std::sqrt( u[0] * u[0] + u[1] * u[1] + u[2] * u[2] );
+    }
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    u[i] /= norm;
+    }
+  norm = 0;
+  while( norm < 1e-3 )
+    {
+    v[0] = Random();
+    v[1] = Random();
+    v[2] = Random();
+    const double projection = u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      v[i] -= projection * u[i];
+      }
+    norm = std::sqrt( v[0] * v[0] + v[1] * v[1] + v[2] * v[2] );
+    }
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    v[i] /= norm;
+    R[i][0] = u[i];
+    R[i][1] = v[i];
+    }
+  R[0][2] = u[1] * v[2] - u[2] * v[1];
+  R[1][2] = u[2] * v[0] - u[0] * v[2];
+  R[2][2] = u[0] * v[1] - u[1] * v[0];
+}
+
+/** R diag( d0, d1, d2 ) R^T, optionally with a random rotation. */
+Tensor MakeTensor( double d0, double d1, double d2, bool rotate )
+{
+  double R[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+  if( rotate )
+    {
+    RandomRotation( R );
+    }
+  const double       d[3] = { d0, d1, d2 };
+  const unsigned int rows[6] = { 0, 0, 0, 1, 1, 2 };
+  const unsigned int columns[6] = { 0, 1, 2, 1, 2, 2 };
+  Tensor             tensor;
+  for( unsigned int c = 0; c < 6; c++ )
+    {
+    double sum = 0;
+    for( unsigned int k = 0; k < 3; k++ )
+      {
+      sum += R[rows[c]][k] * d[k] * R[columns[c]][k];
+      }
+    tensor.m_Component[c] = sum;
+    }
+  return tensor;
+}
+
+vnl_matrix<double> ToMatrix( const Tensor & tensor )
+{
+  vnl_matrix<double> A( 3, 3 );
+  A( 0, 0 ) = tensor[0];
+  A( 0, 1 ) = A( 1, 0 ) = tensor[1];
+  A( 0, 2 ) = A( 2, 0 ) = tensor[2];
+  A( 1, 1 ) = tensor[3];
+  A( 1, 2 ) = A( 2, 1 ) = tensor[4];
+  A( 2, 2 ) = tensor[5];
+  return A;
+}
+
+/** Compares one decomposition with vnl; returns the number of failures. */
+int CheckDecomposition( const Tensor & tensor, const double D[3], const double V[3][3], bool checkVectors,
+                        const char *name )
+{
+  const vnl_matrix<double>                A = ToMatrix( tensor );
+  const vnl_symmetric_eigensystem<double> reference( A );
+
+  double scale = 0;
+  for( unsigned int k = 0; k < 3; k++ )
+    {
+    scale = std::max( scale, std::fabs( reference.get_eigenvalue( k ) ) );
+    }
+  const double valueTolerance = 1e-7 * scale + 1e-300;
+
+  bool valuesMatch = true;
+  for( unsigned int k = 0; k < 3; k++ )
+    {
+    valuesMatch = valuesMatch && std::fabs( D[k] - reference.get_eigenvalue( k ) ) <= valueTolerance;
+    }
+  int failures = Check( valuesMatch, name );
+  if( !checkVectors )
+    {
+    return failures;
+    }
+
+  bool orthonormal = true;
+  bool residualSmall = true;
+  bool vectorsMatch = true;
+  for( unsigned int k = 0; k < 3; k++ )
+    {
+    for( unsigned int l = 0; l < 3; l++ )
+      {
+      const double dot = V[0][k] * V[0][l] + V[1][k] * V[1][l] + V[2][k] * V[2][l];
+      orthonormal = orthonormal && std::fabs( dot - ( k == l ? 1.0 : 0.0 ) ) < 1e-8;
+      }
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      const double Av = A( i, 0 ) * V[0][k] + A( i, 1 ) * V[1][k] + A( i, 2 ) * V[2][k];
+      residualSmall = residualSmall && std::fabs( Av - D[k] * V[i][k] ) <= 1e-6 * scale + 1e-300;
+      }
+
+    // eigenvectors are only defined, up to sign, for separated eigenvalues
+    double gap = vnl_huge_val( double() );
+    for( unsigned int l = 0; l < 3; l++ )
+      {
+      if( l != k )
+        {
+        gap = std::min( gap, std::fabs( reference.get_eigenvalue( k ) - reference.get_eigenvalue( l ) ) );
+        }
+      }
+    if( gap > 1e-3 * scale )
+      {
+      const vnl_vector<double> v = reference.get_eigenvector( k );
+      const double             dot = v[0] * V[0][k] + v[1] * V[1][k] + v[2] * V[2][k];
+      vectorsMatch = vectorsMatch && std::fabs( dot ) > 1.0 - 1e-8;
+      }
+    }
+  failures += Check( orthonormal, name );
+  failures += Check( residualSmall, name );
+  failures += Check( vectorsMatch, name );
+  return failures;
+}
+
+std::vector<Tensor> MakeTensors()
+{
+  std::vector<Tensor> tensors;
+
+  // random symmetric tensors, including diffusion-sized ones
+  for( unsigned int n = 0; n < 400; n++ )
+    {
+    Tensor       tensor;
+    const double scale = ( n % 4 == 0 ) ? 1e-3 : 1.0;
+    for( unsigned int c = 0; c < 6; c++ )
+      {
+      tensor.m_Component[c] = scale * Random();
+      }
+    tensors.push_back( tensor );
+    }
+  for( unsigned int n = 0; n < 100; n++ )
+    {
+    tensors.push_back( MakeTensor( 1e-4 * std::fabs( Random() ), 1e-3 * std::fabs( Random() ),
+                                   2e-3 * std::fabs( Random() ), true ) );
+    }
+
+  // repeated eigenvalues
+  tensors.push_back( MakeTensor( 3, 3, 3, false ) );
+  tensors.push_back( MakeTensor( 3, 1, 2, false ) );
+  for( unsigned int n = 0; n < 10; n++ )
+    {
+    tensors.push_back( MakeTensor( 1, 1, 2, true ) );
+    tensors.push_back( MakeTensor( 1, 2, 2, true ) );
+    tensors.push_back( MakeTensor( 0, 0, 1, true ) );
+    tensors.push_back( MakeTensor( -1, 1, 1, true ) );
+    }
+
+  // nearly repeated eigenvalues, on both sides of the closed-form tolerance
+  const double gaps[] = { 1e-9, 1e-7, 5e-6, 2e-5, 1e-4, 1e-2 };
+  for( unsigned int g = 0; g < sizeof( gaps ) / sizeof( gaps[0] ); g++ )
+    {
+    for( unsigned int n = 0; n < 5; n++ )
+      {
+      tensors.push_back( MakeTensor( 1, 1 + gaps[g], 2, true ) );
+      tensors.push_back( MakeTensor( 1, 2 - gaps[g], 2, true ) );
+      tensors.push_back( MakeTensor( 1e-3, 1e-3 * ( 1 + gaps[g] ), 1e-3 * ( 1 + 2 * gaps[g] ), true ) );
+      }
+    }
+
+  // zero and nearly zero tensors
+  tensors.push_back( MakeTensor( 0, 0, 0, false ) );
+  for( unsigned int n = 0; n < 10; n++ )
+    {
+    Tensor tensor;
+    for( unsigned int c = 0; c < 6; c++ )
+      {
+      tensor.m_Component[c] = 1e-15 * Random();
+      }
+    tensors.push_back( tensor );
+    tensors.push_back( MakeTensor( 1e-20, 2e-20, 4e-20, true ) );
+    }
+  return tensors;
+}
+} // namespace
+
+int main( int, char * [] )
+{
+  std::srand( 43 );
+
+  const std::vector<Tensor> tensors = MakeTensors();
+  int                       failures = 0;
+
+  for( unsigned int n = 0; n < tensors.size(); n++ )
+    {
+    double D[3];
+    double V[3][3];
+    ants::SymmetricEigenSystem3( tensors[n].m_Component, D, V );
+    failures += CheckDecomposition( tensors[n], D, V, true, "SymmetricEigenSystem3 matches vnl" );
+
+    ants::SymmetricEigenValues3( tensors[n].m_Component, D );
+    failures += CheckDecomposition( tensors[n], D, V, false, "SymmetricEigenValues3 matches vnl" );
+    }
+
+  // the batch, over several blocks with a partial last one
+  ants::SymmetricEigenSystem3Batch *batch = new ants::SymmetricEigenSystem3Batch;
+  for( unsigned int begin = 0; begin < tensors.size(); begin += ants::SymmetricEigenSystem3Batch::BlockSize )
+    {
+    const unsigned int count = std::min( static_cast<unsigned int>( tensors.size() ) - begin,
+                                         static_cast<unsigned int>( ants::SymmetricEigenSystem3Batch::BlockSize ) );
+    for( unsigned int i = 0; i < count; i++ )
+      {
+      batch->SetTensor( i, tensors[begin + i] );
+      }
+
+    batch->ComputeEigenSystem( count );
+    for( unsigned int i = 0; i < count; i++ )
+      {
+      double D[3];
+      double V[3][3];
+      batch->GetEigenValues( i, D );
+      batch->GetEigenVectors( i, V );
+      failures += CheckDecomposition( tensors[begin + i], D, V, true, "batch ComputeEigenSystem matches vnl" );
+      }
+
+    batch->ComputeEigenValues( count );
+    for( unsigned int i = 0; i < count; i++ )
+      {
+      double D[3];
+      double V[3][3];
+      batch->GetEigenValues( i, D );
+      failures += CheckDecomposition( tensors[begin + i], D, V, false, "batch ComputeEigenValues matches vnl" );
+      }
+    }
+  delete batch;
+
+  if( failures > 0 )
+    {
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "All " << tensors.size() << " tensors passed" << std::endl;
+  return EXIT_SUCCESS;
+}
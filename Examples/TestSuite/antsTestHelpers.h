@@ -0,0 +1,48 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __antsTestHelpers_h
+#define __antsTestHelpers_h
+
+#include <cmath>
+#include <iostream>
+
+namespace ants
+{
+namespace testing
+{
+/** Helpers shared by the standalone unit tests of the TestSuite.  A test
+ *  adds up the return values of Check and fails if the sum is not zero. */
+
+/** 0 if condition holds; otherwise reports what failed and returns 1. */
+inline int Check( bool condition, const char *what )
+{
+  if( !condition )
+    {
+    std::cerr << "FAILED: " << what << std::endl;
+    return 1;
+    }
+  return 0;
+}
+
+/** True if value is within tolerance of expected, relative to the size of
+ *  expected once that is larger than one. */
+inline bool Close( double value, double expected, double tolerance = 1e-6 )
+{
+  return std::fabs( value - expected ) <= tolerance * ( 1 + std::fabs( expected ) );
+}
+} // namespace testing
+} // namespace ants
+
+#endif
@@ -0,0 +1,308 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+/** Check DijkstrasQueryEngine against DijkstrasAlgorithm.  Both search the
+ *  same 8-connected grid with unit steps, so every query must give the hop
+ *  count of the path DijkstrasAlgorithm backtracks.  On a randomly weighted
+ *  graph the bidirectional, A*, batched and one-to-many queries must all
+ *  give the plain Dijkstra costs, and every path must be a valid path of
+ *  that cost. */
+
+#include "itkDijkstrasAlgorithm.h"
+#include "antsTestHelpers.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace
+{
+using ants::testing::Check;
+using ants::testing::Close;
+
+typedef itk::GraphSearchNode<float, float, 2>   NodeType;
+typedef itk::DijkstrasAlgorithm<NodeType>       DijkstraType;
+typedef itk::DijkstrasQueryEngine<double, 2>    EngineType;
+typedef EngineType::NodeIdType                  NodeIdType;
+typedef EngineType::PathType                    PathType;
+
+const unsigned int GridSize = 16;
+const double       CostTolerance = 1e-9;
+
+NodeIdType GridNode( unsigned int x, unsigned int y )
+{
+  return y * GridSize + x;
+}
+
+/** Number of steps of the path DijkstrasAlgorithm finds from (sx,sy) to
+ *  (tx,ty), or -1 if it finds none. */
+int DijkstrasAlgorithmSteps( unsigned int sx, unsigned int sy, unsigned int tx, unsigned int ty )
+{
+  DijkstraType::Pointer dijkstra = DijkstraType::New();
+
+  DijkstraType::GraphSizeType size;
+  size.Fill( GridSize );
+  dijkstra->SetGraphSize( size );
+  dijkstra->InitializeGraph();
+
+  NodeType::NodeLocationType location;
+  NodeType::Pointer          source = NodeType::New();
+  location[0] = sx;
+  location[1] = sy;
+  source->SetLocation( location );
+  source->SetTotalCost( 0 );
+  dijkstra->SetSource( source );
+
+  NodeType::Pointer sink = NodeType::New();
+  location[0] = tx;
+  location[1] = ty;
+  sink->SetLocation( location );
+  sink->SetTotalCost( vnl_huge_val( float() ) );
+  dijkstra->SetSink( sink );
+
+  dijkstra->InitializeQueue();
+  dijkstra->FindPath();
+  dijkstra->BackTrack( sink );
+  if( dijkstra->GetPathSize() == 0 )
+    {
+    return -1;
+    }
+  return dijkstra->GetPathSize();
+}
+
+/** The grid DijkstrasAlgorithm searches: every node links to its eight
+ *  neighbors with unit cost, but only nodes at least two steps from the
+ *  edge of the graph are expanded. */
+void MakeGrid( EngineType *engine )
+{
+  std::vector<EngineType::LocationType> locations( GridSize * GridSize );
+  std::vector<NodeIdType>               sources;
+  std::vector<NodeIdType>               targets;
+  std::vector<double>                   weights;
+  for( unsigned int y = 0; y < GridSize; y++ )
+    {
+    for( unsigned int x = 0; x < GridSize; x++ )
+      {
+      locations[GridNode( x, y )][0] = x;
+      locations[GridNode( x, y )][1] = y;
+      if( x < 2 || y < 2 || x > GridSize - 2 || y > GridSize - 2 )
+        {
+        continue;
+        }
+      for( int dy = -1; dy <= 1; dy++ )
+        {
+        for( int dx = -1; dx <= 1; dx++ )
+          {
+          if( dx == 0 && dy == 0 )
+            {
+            continue;
+            }
+          sources.push_back( GridNode( x, y ) );
+          targets.push_back( GridNode( x + dx, y + dy ) );
+          weights.push_back( 1 );
+          }
+        }
+      }
+    }
+  engine->SetGraph( GridSize * GridSize, locations, sources, targets, weights );
+}
+
+/** A path must run from source to target along graph edges and add up to
+ *  the reported cost. */
+bool IsPath( const PathType & path, NodeIdType source, NodeIdType target, double cost,
+             const std::vector<NodeIdType> & edgeSources, const std::vector<NodeIdType> & edgeTargets,
+             const std::vector<double> & edgeWeights )
+{
+  if( path.empty() || path.front() != source || path.back() != target )
+    {
+    return false;
+    }
+  double sum = 0;
+  for( unsigned int i = 1; i < path.size(); i++ )
+    {
+    double step = -1;
+    for( unsigned int e = 0; e < edgeSources.size(); e++ )
+      {
+      if( edgeSources[e] == path[i - 1] && edgeTargets[e] == path[i] && ( step < 0 || edgeWeights[e] < step ) )
+        {
+        step = edgeWeights[e];
+        }
+      }
+    if( step < 0 )
+      {
+      return false;
+      }
+    sum += step;
+    }
+  return Close( sum, cost, CostTolerance );
+}
+
+int CheckGrid()
+{
+  int failures = 0;
+
+  EngineType::Pointer engine = EngineType::New();
+  MakeGrid( engine );
+
+  const unsigned int queries[][4] = {
+      { 2, 2, 14, 14 }, { 2, 14, 14, 2 }, { 5, 3, 12, 9 }, { 7, 7, 8, 7 },
+      { 13, 4, 3, 11 }, { 4, 10, 4, 2 }, { 9, 12, 2, 12 }, { 14, 8, 6, 13 } };
+  const unsigned int numberOfQueries = sizeof( queries ) / sizeof( queries[0] );
+
+  std::vector<NodeIdType> sources( numberOfQueries );
+  std::vector<NodeIdType> targets( numberOfQueries );
+  std::vector<double>     expected( numberOfQueries );
+  for( unsigned int q = 0; q < numberOfQueries; q++ )
+    {
+    sources[q] = GridNode( queries[q][0], queries[q][1] );
+    targets[q] = GridNode( queries[q][2], queries[q][3] );
+    expected[q] = DijkstrasAlgorithmSteps( queries[q][0], queries[q][1], queries[q][2], queries[q][3] );
+    failures += Check( expected[q] > 0, "DijkstrasAlgorithm finds a path on the grid" );
+    }
+
+  for( unsigned int mode = 0; mode < 4; mode++ )
+    {
+    engine->SetUseBidirectionalSearch( ( mode & 1 ) != 0 );
+    engine->SetUseAStar( ( mode & 2 ) != 0 );
+    for( unsigned int q = 0; q < numberOfQueries; q++ )
+      {
+      PathType     path;
+      const double cost = engine->FindPath( sources[q], targets[q], &path );
+      failures += Check( Close( cost, expected[q], CostTolerance ), "grid cost matches DijkstrasAlgorithm" );
+      failures += Check( path.size() == expected[q] + 1 && path.front() == sources[q] && path.back() == targets[q],
+                         "grid path has the DijkstrasAlgorithm length" );
+      }
+    }
+
+  std::vector<double> costs;
+  engine->FindPaths( sources, targets, costs );
+  for( unsigned int q = 0; q < numberOfQueries; q++ )
+    {
+    failures += Check( Close( costs[q], expected[q], CostTolerance ),
+                       "batched grid cost matches DijkstrasAlgorithm" );
+    }
+  return failures;
+}
+
+int CheckRandomGraph()
+{
+  int failures = 0;
+
+  const unsigned int numberOfNodes = 200;
+  std::srand( 17 );
+
+  std::vector<EngineType::LocationType> locations( numberOfNodes );
+  for( unsigned int n = 0; n < numberOfNodes; n++ )
+    {
+    locations[n][0] = std::rand() % 1000 / 10.0;
+    locations[n][1] = std::rand() % 1000 / 10.0;
+    }
+
+  // each node links to a few random nodes, weighted by at least their
+  // distance so that A* has something to work with; a few nodes stay
+  // unreachable
+  std::vector<NodeIdType> edgeSources;
+  std::vector<NodeIdType> edgeTargets;
+  std::vector<double>     edgeWeights;
+  for( unsigned int n = 10; n < numberOfNodes; n++ )
+    {
+    for( unsigned int k = 0; k < 4; k++ )
+      {
+      const NodeIdType m = 10 + std::rand() % ( numberOfNodes - 10 );
+      edgeSources.push_back( n );
+      edgeTargets.push_back( m );
+      edgeWeights.push_back( ( locations[n] - locations[m] ).GetNorm() * ( 1 + std::rand() % 100 / 50.0 ) );
+      }
+    }
+
+  EngineType::Pointer engine = EngineType::New();
+  engine->SetGraph( numberOfNodes, locations, edgeSources, edgeTargets, edgeWeights );
+
+  std::vector<NodeIdType> sources;
+  std::vector<NodeIdType> targets;
+  for( unsigned int q = 0; q < 60; q++ )
+    {
+    sources.push_back( std::rand() % numberOfNodes );
+    targets.push_back( std::rand() % numberOfNodes );
+    }
+
+  // plain Dijkstra is the reference
+  engine->SetUseBidirectionalSearch( false );
+  engine->SetUseAStar( false );
+  std::vector<double> expected( sources.size() );
+  for( unsigned int q = 0; q < sources.size(); q++ )
+    {
+    expected[q] = engine->FindPath( sources[q], targets[q] );
+    }
+
+  for( unsigned int mode = 1; mode < 4; mode++ )
+    {
+    engine->SetUseBidirectionalSearch( ( mode & 1 ) != 0 );
+    engine->SetUseAStar( ( mode & 2 ) != 0 );
+    for( unsigned int q = 0; q < sources.size(); q++ )
+      {
+      PathType     path;
+      const double cost = engine->FindPath( sources[q], targets[q], &path );
+      if( expected[q] >= engine->GetInfinity() )
+        {
+        failures += Check( cost >= engine->GetInfinity() && path.empty(), "unreachable target stays unreachable" );
+        }
+      else
+        {
+        failures += Check( Close( cost, expected[q], CostTolerance ), "cost matches plain Dijkstra" );
+        failures += Check( IsPath( path, sources[q], targets[q], cost, edgeSources, edgeTargets, edgeWeights ),
+                           "path is a graph path of the reported cost" );
+        }
+      }
+    }
+
+  std::vector<double>   costs;
+  std::vector<PathType> paths;
+  engine->SetNumberOfThreads( 4 );
+  engine->FindPaths( sources, targets, costs, &paths );
+  for( unsigned int q = 0; q < sources.size(); q++ )
+    {
+    failures += Check( costs[q] == engine->FindPath( sources[q], targets[q] ), "FindPaths matches FindPath" );
+    }
+
+  engine->FindDistances( sources[0], targets, costs );
+  engine->SetUseBidirectionalSearch( false );
+  engine->SetUseAStar( false );
+  for( unsigned int q = 0; q < targets.size(); q++ )
+    {
+    const double reference = engine->FindPath( sources[0], targets[q] );
+    failures += Check( reference >= engine->GetInfinity() ? costs[q] >= engine->GetInfinity() :
+                       Close( costs[q], reference, CostTolerance ), "FindDistances matches FindPath" );
+    }
+  return failures;
+}
+} // namespace
+
+int main( int, char * [] )
+{
+  int failures = 0;
+
+  failures += CheckGrid();
+  failures += CheckRandomGraph();
+
+  if( failures > 0 )
+    {
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "All DijkstrasQueryEngine checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,129 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+
+/** Check LabelOverlapMeasuresImageFilter on two shifted squares: the flat
+ *  accumulators (small integer labels) and the hash map (far apart or
+ *  floating point labels) must agree, and the surface distances must match
+ *  the values worked out by hand. */
+
+#include "antsAllocImage.h"
+#include "itkImage.h"
+#include "itkLabelOverlapMeasuresImageFilter.h"
+#include "antsTestHelpers.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+using ants::testing::Check;
+using ants::testing::Close;
+
+template <class TImage>
+void FillBox( TImage *image, long x0, long x1, long y0, long y1, typename TImage::PixelType label )
+{
+  typename TImage::IndexType index;
+  for( index[1] = y0; index[1] <= y1; index[1]++ )
+    {
+    for( index[0] = x0; index[0] <= x1; index[0]++ )
+      {
+      image->SetPixel( index, label );
+      }
+    }
+}
+
+/** Source: label a on [5,14]^2 and label b on [17,20]^2.  Target: label a
+ *  shifted by two voxels along x.  Label a has Dice 0.8, a Hausdorff
+ *  distance of 2 and 36 boundary voxels per image whose distances add up to
+ *  36 in either direction; label b is missing from the target. */
+template <class TImage>
+int CheckSquares( typename TImage::PixelType a, typename TImage::PixelType b, const char *name )
+{
+  typename TImage::RegionType region;
+  typename TImage::SizeType   size;
+  size.Fill( 24 );
+  region.SetSize( size );
+
+  typename TImage::Pointer source = AllocImage<TImage>( region, 0 );
+  typename TImage::Pointer target = AllocImage<TImage>( region, 0 );
+  FillBox<TImage>( source, 5, 14, 5, 14, a );
+  FillBox<TImage>( source, 17, 20, 17, 20, b );
+  FillBox<TImage>( target, 7, 16, 5, 14, a );
+
+  typedef itk::LabelOverlapMeasuresImageFilter<TImage> FilterType;
+  typename FilterType::Pointer filter = FilterType::New();
+  filter->SetSourceImage( source );
+  filter->SetTargetImage( target );
+  filter->ComputeSurfaceDistancesOn();
+  filter->Update();
+
+  int failures = 0;
+  std::cout << name << std::endl;
+  failures += Check( filter->GetLabelSetMeasures().size() == 3, "labels found" );
+  failures += Check( Close( filter->GetDiceCoefficient( a ), 0.8 ), "Dice" );
+  failures += Check( Close( filter->GetTargetOverlap( a ), 0.8 ), "target overlap" );
+  failures += Check( Close( filter->GetFalsePositiveError( a ), 0.2 ), "false positive error" );
+  failures += Check( Close( filter->GetUnionOverlap( b ), 0.0 ), "missing label overlap" );
+  failures += Check( Close( filter->GetHausdorffDistance( a ), 2.0 ), "Hausdorff distance" );
+  failures += Check( Close( filter->GetMeanSurfaceDistance( a ), 1.0 ), "mean surface distance" );
+  failures += Check( !( filter->GetHausdorffDistance( b ) < 1e300 ), "missing label distance is infinite" );
+  failures += Check( !( filter->GetHausdorffDistance() < 1e300 ), "Hausdorff distance over all labels" );
+  return failures;
+}
+
+/** Two background-only images have no boundary voxels, so the distances
+ *  over all labels are 0 rather than 0 / 0. */
+int CheckBackground()
+{
+  typedef itk::Image<unsigned int, 2> ImageType;
+  ImageType::RegionType region;
+  ImageType::SizeType   size;
+  size.Fill( 8 );
+  region.SetSize( size );
+
+  typedef itk::LabelOverlapMeasuresImageFilter<ImageType> FilterType;
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetSourceImage( AllocImage<ImageType>( region, 0 ) );
+  filter->SetTargetImage( AllocImage<ImageType>( region, 0 ) );
+  filter->ComputeSurfaceDistancesOn();
+  filter->Update();
+
+  int failures = 0;
+  std::cout << "background only" << std::endl;
+  failures += Check( filter->GetMeanSurfaceDistance() == 0.0, "mean surface distance without labels" );
+  failures += Check( filter->GetHausdorffDistance() == 0.0, "Hausdorff distance without labels" );
+  return failures;
+}
+}
+
+int main( int, char * [] )
+{
+  int failures = 0;
+
+  failures += CheckSquares<itk::Image<unsigned int, 2> >( 1, 3, "flat accumulators" );
+  failures += CheckSquares<itk::Image<unsigned int, 2> >( 1, 1000000, "hash map, far apart labels" );
+  failures += CheckSquares<itk::Image<float, 2> >( 1.5f, 3.0f, "hash map, floating point labels" );
+  failures += CheckSquares<itk::Image<short, 2> >( -7, 3, "flat accumulators, negative labels" );
+  failures += CheckBackground();
+
+  if( failures > 0 )
+    {
+    std::cerr << failures << " label overlap checks failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  std::cout << "label overlap checks passed" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -91,7 +91,7 @@ typename TImage::Pointer BinaryThreshold_AltInsideOutside_threashold(
 }
 
 template <class TImage>
-typename TImage::Pointer
+static typename TImage::Pointer
 LabelSurface(typename TImage::PixelType foreground,
              typename TImage::PixelType newval, typename TImage::Pointer input)
 {
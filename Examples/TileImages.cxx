@@ -41,7 +41,7 @@ int TileImages( unsigned int argc, char *argv[] )
   return EXIT_SUCCESS;
 }
 
-int CreateMosaic( unsigned int argc, char *argv[] )
+static int CreateMosaic( unsigned int argc, char *argv[] )
 {
   if( argc != 5 )
     {
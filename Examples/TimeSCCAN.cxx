@@ -30,7 +30,7 @@ namespace ants
 {
 
 template <class TComp>
-double vnl_pearson_corr( vnl_vector<TComp> v1, vnl_vector<TComp> v2 )
+static double vnl_pearson_corr( vnl_vector<TComp> v1, vnl_vector<TComp> v2 )
 {
   double xysum = 0;
 
@@ -581,7 +581,7 @@ int timesccan( itk::ants::CommandLineParser *parser )
   return 0;
 }
 
-void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
+static void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
 {
   /** in this function, list all the operations you will perform */
 
@@ -302,7 +302,7 @@ static bool WarpImageMultiTransform_ParseInput(int argc, char * *argv, char *& m
 }
 
 template <class AffineTransformPointer>
-void GetIdentityTransform(AffineTransformPointer & aff)
+static void GetIdentityTransform(AffineTransformPointer & aff)
 {
   typedef typename AffineTransformPointer::ObjectType AffineTransform;
   aff = AffineTransform::New();
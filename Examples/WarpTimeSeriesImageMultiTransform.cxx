@@ -217,7 +217,7 @@ static bool WarpTimeSeriesImageMultiTransform_ParseInput(int argc, char * *argv,
 }
 
 template <class AffineTransformPointer>
-void GetIdentityTransform(AffineTransformPointer & aff)
+static void GetIdentityTransform(AffineTransformPointer & aff)
 {
   typedef typename AffineTransformPointer::ObjectType AffineTransform;
   aff = AffineTransform::New();
@@ -35,6 +35,8 @@ namespace ants
 //      Transform traits to generalize the different linear transforms
 // ##########################################################################
 
+namespace
+{
 template <class TComputeType, unsigned int ImageDimension>
 class RigidTransformTraits
 {
@@ -149,18 +151,19 @@ class SimilarityTransformTraits<float, 3>
 public:
 typedef itk::Similarity3DTransform<float> TransformType;
 };
+} // namespace
 
 // ##########################################################################
 // ##########################################################################
 
 template<class TImage, class TGradientImage, class TInterpolator, class TReal>
-TReal PatchCorrelation( itk::NeighborhoodIterator<TImage> fixedNeighborhood,
-                        itk::NeighborhoodIterator<TImage> movingNeighborhood,
-                        std::vector<unsigned int> activeIndex,
-                        std::vector<TReal> weights,
-                        typename TGradientImage::Pointer fixedGradientImage,
-                        typename TGradientImage::Pointer movingGradientImage,
-                        typename TInterpolator::Pointer movingInterpolator )
+static TReal PatchCorrelation( itk::NeighborhoodIterator<TImage> fixedNeighborhood,
+                               itk::NeighborhoodIterator<TImage> movingNeighborhood,
+                               std::vector<unsigned int> activeIndex,
+                               std::vector<TReal> weights,
+                               typename TGradientImage::Pointer fixedGradientImage,
+                               typename TGradientImage::Pointer movingGradientImage,
+                               typename TInterpolator::Pointer movingInterpolator )
 {
   typedef TReal                                          RealType;
   typedef TImage                                         ImageType;
@@ -1404,7 +1407,7 @@ int antsAI( itk::ants::CommandLineParser *parser )
   return EXIT_SUCCESS;
 }
 
-void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
+static void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
 {
   typedef itk::ants::CommandLineParser::OptionType OptionType;
 
@@ -119,6 +119,8 @@
 namespace ants
 {
 
+namespace
+{
 template <class TComputeType, unsigned int ImageDimension>
 class SimilarityTransformTraits
 {
@@ -156,6 +158,7 @@ class SimilarityTransformTraits<float, 3>
 public:
   typedef itk::Similarity3DTransform<float> TransformType;
 };
+} // namespace
 
 
 template <unsigned int ImageDimension>
@@ -5,8 +5,10 @@
 #include "TensorFunctions.h"
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
+#include "itkImageIOFactory.h"
 #include "itkExtractImageFilter.h"
 #include "itkResampleImageFilter.h"
+#include "itkStreamingResampleImageFilter.h"
 #include "itkVectorIndexSelectionCastImageFilter.h"
 
 #include "itkAffineTransform.h"
@@ -109,6 +111,106 @@ unsigned int numTensorElements<0>()
   return 0;
 }
 
+/** Reads only the geometry of an image, for tiled resampling.  The reader
+ *  is returned because its output does not keep it alive, and the tiles
+ *  are read through it. */
+template <class TImage>
+typename itk::ImageFileReader<TImage>::Pointer ReadImageInformation( const std::string & filename, bool verbose )
+{
+  typedef itk::ImageFileReader<TImage> ReaderType;
+  typename ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( filename.c_str() );
+  try
+    {
+    reader->UpdateOutputInformation();
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    if( verbose )
+      {
+      std::cerr << "Unable to read " << filename << std::endl << e << std::endl;
+      }
+    return ITK_NULLPTR;
+    }
+  return reader;
+}
+
+/** Resamples the output of reader onto the grid of reference in tiles of at
+ *  most tileSize voxels, writing each tile before the next one is computed.
+ *  Each tile reads only the input region that it maps to; only the geometry
+ *  of reference is used. */
+template <class TImage, class TRealType>
+bool ResampleInTiles( itk::ImageFileReader<TImage> * reader, const TImage * reference,
+                      const itk::Transform<TRealType, TImage::ImageDimension, TImage::ImageDimension> * transform,
+                      itk::InterpolateImageFunction<TImage, TRealType> * interpolator,
+                      typename TImage::PixelType defaultValue, itk::SizeValueType tileSize,
+                      const std::string & outputFileName, bool verbose )
+{
+  TImage *input = reader->GetOutput();
+
+  typedef itk::StreamingResampleImageFilter<TImage, TImage, TRealType> ResamplerType;
+  typename ResamplerType::Pointer resampleFilter = ResamplerType::New();
+  resampleFilter->SetInput( input );
+  resampleFilter->SetOutputParametersFromImage( reference );
+  resampleFilter->SetTransform( transform );
+  resampleFilter->SetInterpolator( interpolator );
+  resampleFilter->SetDefaultPixelValue( defaultValue );
+
+  // the Gaussian kernels reach alpha * sigma, which can exceed the default
+  // radius that covers the B-spline and windowed sinc kernels
+  typedef itk::GaussianInterpolateImageFunction<TImage, TRealType> GaussianInterpolatorType;
+  const GaussianInterpolatorType *gaussianInterpolator = dynamic_cast<const GaussianInterpolatorType *>( interpolator );
+  if( gaussianInterpolator != ITK_NULLPTR )
+    {
+    double radius = resampleFilter->GetInterpolationRadius();
+    for( unsigned int d = 0; d < TImage::ImageDimension; d++ )
+      {
+      radius = std::max( radius, gaussianInterpolator->GetAlpha() * gaussianInterpolator->GetSigma()[d]
+                         / input->GetSpacing()[d] + 1.0 );
+      }
+    resampleFilter->SetInterpolationRadius( static_cast<unsigned int>( std::ceil( radius ) ) );
+    }
+
+  itk::ImageIOBase::Pointer imageIO =
+    itk::ImageIOFactory::CreateImageIO( outputFileName.c_str(), itk::ImageIOFactory::WriteMode );
+  if( imageIO.IsNull() )
+    {
+    std::cerr << "No image format can write " << outputFileName << std::endl;
+    return false;
+    }
+  if( !imageIO->CanStreamWrite() )
+    {
+    std::cerr << "WARNING: " << imageIO->GetNameOfClass() << " cannot write " << outputFileName
+              << " in pieces, so the whole output is held in memory.  Write an uncompressed "
+              << "MetaImage (.mha, .mhd) to bound the memory by the tile size." << std::endl;
+    }
+
+  const itk::SizeValueType numberOfVoxels = reference->GetLargestPossibleRegion().GetNumberOfPixels();
+  const unsigned int       numberOfTiles =
+    static_cast<unsigned int>( std::max<itk::SizeValueType>( 1, ( numberOfVoxels + tileSize - 1 ) / tileSize ) );
+  if( verbose )
+    {
+    std::cout << "Resampling in " << numberOfTiles << " tiles of at most " << tileSize << " voxels" << std::endl;
+    }
+
+  typedef itk::ImageFileWriter<TImage> WriterType;
+  typename WriterType::Pointer writer = WriterType::New();
+  writer->SetImageIO( imageIO );
+  writer->SetFileName( outputFileName.c_str() );
+  writer->SetInput( resampleFilter->GetOutput() );
+  writer->SetNumberOfStreamDivisions( numberOfTiles );
+  try
+    {
+    writer->Update();
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::cerr << "Tiled resampling into " << outputFileName << " failed" << std::endl << e << std::endl;
+    return false;
+    }
+  return true;
+}
+
 template <class T, unsigned int Dimension>
 int antsApplyTransforms( itk::ants::CommandLineParser::Pointer & parser, unsigned int inputImageType = 0 )
 {
@@ -143,6 +245,9 @@ int antsApplyTransforms( itk::ants::CommandLineParser::Pointer & parser, unsigne
   std::vector<typename ImageType::Pointer> outputImages;
   outputImages.clear();
 
+  // with --tile-size the input is streamed through its reader
+  typename itk::ImageFileReader<ImageType>::Pointer inputReader = ITK_NULLPTR;
+
   bool verbose = false;
   typename itk::ants::CommandLineParser::OptionType::Pointer verboseOption =
     parser->GetOption( "verbose" );
@@ -151,6 +256,22 @@ int antsApplyTransforms( itk::ants::CommandLineParser::Pointer & parser, unsigne
     verbose = parser->Convert<bool>( verboseOption->GetFunction( 0 )->GetName() );
     }
 
+  itk::SizeValueType tileSize = 0;
+  typename itk::ants::CommandLineParser::OptionType::Pointer tileSizeOption =
+    parser->GetOption( "tile-size" );
+  if( tileSizeOption && tileSizeOption->GetNumberOfFunctions() )
+    {
+    tileSize = parser->Convert<itk::SizeValueType>( tileSizeOption->GetFunction( 0 )->GetName() );
+    }
+  if( tileSize > 0 && inputImageType != 0 )
+    {
+    if( verbose )
+      {
+      std::cerr << "Tiled resampling is only supported for scalar images." << std::endl;
+      }
+    return EXIT_FAILURE;
+    }
+
   /**
    * Input object option - for now, we're limiting this to images.
    */
@@ -180,7 +301,20 @@ int antsApplyTransforms( itk::ants::CommandLineParser::Pointer & parser, unsigne
       std::cout << "Input scalar image: " << inputOption->GetFunction( 0 )->GetName() << std::endl;
       }
     typename ImageType::Pointer image;
-    ReadImage<ImageType>( image, ( inputOption->GetFunction( 0 )->GetName() ).c_str()  );
+    if( tileSize > 0 )
+      {
+      // the pixels are streamed tile by tile
+      inputReader = ReadImageInformation<ImageType>( inputOption->GetFunction( 0 )->GetName(), verbose );
+      if( inputReader.IsNull() )
+        {
+        return EXIT_FAILURE;
+        }
+      image = inputReader->GetOutput();
+      }
+    else
+      {
+      ReadImage<ImageType>( image, ( inputOption->GetFunction( 0 )->GetName() ).c_str()  );
+      }
     inputImages.push_back( image );
     }
   else if( inputImageType == 1 && inputOption && inputOption->GetNumberOfFunctions() )
@@ -248,7 +382,20 @@ int antsApplyTransforms( itk::ants::CommandLineParser::Pointer & parser, unsigne
       {
       std::cout << "Reference image: " << referenceOption->GetFunction( 0 )->GetName() << std::endl;
       }
-    ReadImage<ReferenceImageType>( referenceImage,  ( referenceOption->GetFunction( 0 )->GetName() ).c_str() );
+    if( tileSize > 0 )
+      {
+      typename itk::ImageFileReader<ReferenceImageType>::Pointer referenceReader =
+        ReadImageInformation<ReferenceImageType>( referenceOption->GetFunction( 0 )->GetName(), verbose );
+      if( referenceReader.IsNull() )
+        {
+        return EXIT_FAILURE;
+        }
+      referenceImage = referenceReader->GetOutput();
+      }
+    else
+      {
+      ReadImage<ReferenceImageType>( referenceImage,  ( referenceOption->GetFunction( 0 )->GetName() ).c_str() );
+      }
     }
   else if( needReferenceImage == true )
     {
@@ -381,7 +528,8 @@ int antsApplyTransforms( itk::ants::CommandLineParser::Pointer & parser, unsigne
     {
     std::cout << "Default pixel value: " << defaultValue << std::endl;
     }
-  for( unsigned int n = 0; n < inputImages.size(); n++ )
+  // tiled resampling happens while the output is written
+  for( unsigned int n = 0; n < inputImages.size() && tileSize == 0; n++ )
     {
     typedef itk::ResampleImageFilter<ImageType, ImageType, RealType> ResamplerType;
     typename ResamplerType::Pointer resampleFilter = ResamplerType::New();
@@ -465,8 +613,8 @@ int antsApplyTransforms( itk::ants::CommandLineParser::Pointer & parser, unsigne
       typedef typename itk::TransformToDisplacementFieldFilter<DisplacementFieldType, RealType> ConverterType;
       typename ConverterType::Pointer converter = ConverterType::New();
       converter->SetOutputOrigin( referenceImage->GetOrigin() );
-      converter->SetOutputStartIndex( referenceImage->GetBufferedRegion().GetIndex() );
-      converter->SetSize( referenceImage->GetBufferedRegion().GetSize() );
+      converter->SetOutputStartIndex( referenceImage->GetLargestPossibleRegion().GetIndex() );
+      converter->SetSize( referenceImage->GetLargestPossibleRegion().GetSize() );
       converter->SetOutputSpacing( referenceImage->GetSpacing() );
       converter->SetOutputDirection( referenceImage->GetDirection() );
       converter->SetTransform( compositeTransform );
@@ -627,6 +775,14 @@ int antsApplyTransforms( itk::ants::CommandLineParser::Pointer & parser, unsigne
           }
         WriteImage<TimeSeriesImageType>( outputTimeSeriesImage, ( outputFileName ).c_str() );
         }
+      else if( tileSize > 0 )
+        {
+        if( !ResampleInTiles<ImageType, RealType>( inputReader, referenceImage, compositeTransform, interpolator,
+                                                   defaultValue, tileSize, outputFileName, verbose ) )
+          {
+          return EXIT_FAILURE;
+          }
+        }
       else
         {
         try
@@ -830,6 +986,25 @@ static void antsApplyTransformsInitializeCommandLineOptions( itk::ants::CommandL
   parser->AddOption( option );
   }
 
+  {
+  std::string description =
+    std::string( "Resample and write the output in tiles of at most this many " )
+    + std::string( "voxels, reading from the input only the region that each " )
+    + std::string( "tile maps to through the transforms, so that peak memory " )
+    + std::string( "is set by the tile size instead of the image size.  Only " )
+    + std::string( "the header of the reference image is read.  Supported for " )
+    + std::string( "scalar images.  The memory is only bounded when the input " )
+    + std::string( "can be read in pieces and the output written in pieces, " )
+    + std::string( "e.g. uncompressed MetaImage (.mha, .mhd); otherwise the " )
+    + std::string( "whole image is held in memory as without this option." );
+
+  OptionType::Pointer option = OptionType::New();
+  option->SetLongName( "tile-size" );
+  option->SetUsageOption( 0, "numberOfVoxels" );
+  option->SetDescription( description );
+  parser->AddOption( option );
+  }
+
   {
   std::string description = std::string( "Print the help menu (short version)." );
 
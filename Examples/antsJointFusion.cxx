@@ -19,6 +19,8 @@
 namespace ants
 {
 
+namespace
+{
 template <class TFilter>
 class CommandProgressUpdate : public itk::Command
 {
@@ -82,6 +84,7 @@ public:
       }
     }
 };
+} // namespace
 
 template <unsigned int ImageDimension>
 int antsJointFusion( itk::ants::CommandLineParser *parser )
@@ -587,7 +590,7 @@ int antsJointFusion( itk::ants::CommandLineParser *parser )
   return EXIT_SUCCESS;
 }
 
-void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
+static void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
 {
   typedef itk::ants::CommandLineParser::OptionType OptionType;
 
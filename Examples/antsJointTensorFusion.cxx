@@ -24,6 +24,8 @@
 namespace ants
 {
 
+namespace
+{
 template <class TFilter>
 class CommandProgressUpdate : public itk::Command
 {
@@ -87,6 +89,7 @@ public:
       }
     }
 };
+} // namespace
 
 template <unsigned int ImageDimension>
 int antsJointTensorFusion( itk::ants::CommandLineParser *parser )
@@ -592,7 +595,7 @@ int antsJointTensorFusion( itk::ants::CommandLineParser *parser )
   return EXIT_SUCCESS;
 }
 
-void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
+static void InitializeCommandLineOptions( itk::ants::CommandLineParser *parser )
 {
   typedef itk::ants::CommandLineParser::OptionType OptionType;
 
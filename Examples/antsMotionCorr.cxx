@@ -235,6 +235,8 @@ typename ImageType::Pointer PreprocessImage( ImageType * inputImage,
   return outputImage;
 }
 
+namespace
+{
 template <class T>
 struct ants_moco_index_cmp
   {
@@ -362,6 +364,7 @@ class SimilarityTransformTraits<3>
 public:
   typedef itk::Similarity3DTransform<double> TransformType;
 };
+} // namespace
 
 /*
 template <unsigned int ImageDimension>
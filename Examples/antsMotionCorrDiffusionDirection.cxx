@@ -80,6 +80,8 @@ inline std::string ants_moco_to_string(const T& t)
   return ss.str();
 }
 
+namespace
+{
 template <class T>
 struct ants_moco_index_cmp
   {
@@ -146,6 +148,7 @@ class SimilarityTransformTraits<3>
 public:
   typedef itk::Similarity3DTransform<double> TransformType;
 };
+} // namespace
 
 
 int ants_motion_directions( itk::ants::CommandLineParser *parser )
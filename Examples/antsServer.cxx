@@ -0,0 +1,696 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "antsUtilities.h"
+#include "antsCommandLineParser.h"
+#include "antsReadCache.h"
+#include "ReadWriteData.h"
+#include "antsServerTools.h"
+
+#include "itkConditionVariable.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleMutexLock.h"
+#include "itkTimeProbe.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <sstream>
+
+#if !defined( _WIN32 )
+#include <csignal>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define ANTS_SERVER_USE_SOCKET
+#endif
+
+namespace ants
+{
+namespace
+{
+typedef itk::ants::CommandLineParser ParserType;
+typedef ParserType::OptionType       OptionType;
+
+/** Splits a command into words like a POSIX shell does for plain words,
+ *  '...' and "..." quoting and backslash escapes; nothing is expanded.
+ *  Returns false on an unterminated quote. */
+bool SplitServerCommand( const std::string & line, std::vector<std::string> & words )
+{
+  std::string word;
+  bool        inWord = false;
+  char        quote = '\0';
+
+  words.clear();
+  for( std::string::size_type i = 0; i < line.length(); i++ )
+    {
+    const char c = line[i];
+    if( quote == '\'' )
+      {
+      if( c == '\'' )
+        {
+        quote = '\0';
+        }
+      else
+        {
+        word += c;
+        }
+      }
+    else if( quote == '"' )
+      {
+      if( c == '"' )
+        {
+        quote = '\0';
+        }
+      else if( c == '\\' && i + 1 < line.length() && ( line[i + 1] == '"' || line[i + 1] == '\\' ) )
+        {
+        word += line[++i];
+        }
+      else
+        {
+        word += c;
+        }
+      }
+    else if( c == '\'' || c == '"' )
+      {
+      quote = c;
+      inWord = true;
+      }
+    else if( c == '\\' && i + 1 < line.length() )
+      {
+      word += line[++i];
+      inWord = true;
+      }
+    else if( c == ' ' || c == '\t' || c == '\r' || c == '\n' )
+      {
+      if( inWord )
+        {
+        words.push_back( word );
+        word.clear();
+        inWord = false;
+        }
+      }
+    else
+      {
+      word += c;
+      inWord = true;
+      }
+    }
+  if( inWord )
+    {
+    words.push_back( word );
+    }
+  return quote == '\0';
+}
+
+struct ServerJob
+{
+  unsigned long            m_Id;
+  std::vector<std::string> m_Arguments; // tool name first
+  int                      m_Reply;     // socket that receives the exit code, or -1
+};
+
+/** Jobs waiting for a worker.  Also counts the jobs that have not finished
+ *  yet, for the "wait" command. */
+class ServerJobQueue
+{
+public:
+  ServerJobQueue() : m_Unfinished( 0 ), m_Closed( false )
+  {
+    this->m_Changed = itk::ConditionVariable::New();
+  }
+
+  void Push( const ServerJob & job )
+  {
+    this->m_Mutex.Lock();
+    this->m_Jobs.push_back( job );
+    this->m_Unfinished++;
+    this->m_Changed->Broadcast();
+    this->m_Mutex.Unlock();
+  }
+
+  /** Blocks until a job is available; false once closed and drained. */
+  bool Pop( ServerJob & job )
+  {
+    this->m_Mutex.Lock();
+    while( this->m_Jobs.empty() && !this->m_Closed )
+      {
+      this->m_Changed->Wait( &this->m_Mutex );
+      }
+    const bool available = !this->m_Jobs.empty();
+    if( available )
+      {
+      job = this->m_Jobs.front();
+      this->m_Jobs.pop_front();
+      }
+    this->m_Mutex.Unlock();
+    return available;
+  }
+
+  void Finish()
+  {
+    this->m_Mutex.Lock();
+    this->m_Unfinished--;
+    this->m_Changed->Broadcast();
+    this->m_Mutex.Unlock();
+  }
+
+  /** Blocks until every job pushed so far has finished. */
+  void Wait()
+  {
+    this->m_Mutex.Lock();
+    while( this->m_Unfinished > 0 )
+      {
+      this->m_Changed->Wait( &this->m_Mutex );
+      }
+    this->m_Mutex.Unlock();
+  }
+
+  void Close()
+  {
+    this->m_Mutex.Lock();
+    this->m_Closed = true;
+    this->m_Changed->Broadcast();
+    this->m_Mutex.Unlock();
+  }
+
+private:
+  itk::SimpleMutexLock            m_Mutex;
+  itk::ConditionVariable::Pointer m_Changed;
+  std::deque<ServerJob>           m_Jobs;
+  unsigned long                   m_Unfinished;
+  bool                            m_Closed;
+};
+
+struct ServerState
+{
+  ServerJobQueue                            m_Queue;
+  std::map<std::string, ServerToolFunction> m_Tools;
+  itk::SimpleMutexLock                      m_OutputMutex;
+  unsigned long                             m_NumberOfJobs;
+  unsigned long                             m_NumberOfFailures;
+};
+
+void ReportServerError( ServerState & state, const std::string & message )
+{
+  state.m_OutputMutex.Lock();
+  std::cerr << "antsServer: " << message << std::endl;
+  state.m_OutputMutex.Unlock();
+}
+
+/** Answers a socket client and closes the connection; nothing for stdin. */
+void ReplyToServerClient( int reply, const std::string & text )
+{
+#if defined( ANTS_SERVER_USE_SOCKET )
+  if( reply < 0 )
+    {
+    return;
+    }
+  std::string::size_type written = 0;
+  while( written < text.length() )
+    {
+    const ssize_t n = write( reply, text.data() + written, text.length() - written );
+    if( n < 0 && errno == EINTR )
+      {
+      continue;
+      }
+    if( n <= 0 )
+      {
+      break;
+      }
+    written += static_cast<std::string::size_type>( n );
+    }
+  close( reply );
+#else
+  (void)reply;
+  (void)text;
+#endif
+}
+
+std::string GetServerStatistics( const ServerState & state )
+{
+  std::ostringstream os;
+
+  os << "antsServer: " << state.m_NumberOfJobs << " jobs, " << state.m_NumberOfFailures << " failed" << std::endl;
+  PrintReadCacheStatistics( os );
+  ANTSPrintIOStatistics( os );
+  return os.str();
+}
+
+int RunServerJob( ServerState & state, const ServerJob & job )
+{
+  const std::string & name = job.m_Arguments[0];
+  const std::vector<std::string> arguments( job.m_Arguments.begin() + 1, job.m_Arguments.end() );
+
+  int            status = EXIT_FAILURE;
+  itk::TimeProbe timer;
+  timer.Start();
+  try
+    {
+    status = state.m_Tools.find( name )->second( arguments, &std::cout );
+    }
+  catch( itk::ExceptionObject & e )
+    {
+    std::ostringstream message;
+    message << "job " << job.m_Id << " (" << name << ") threw " << e;
+    ReportServerError( state, message.str() );
+    }
+  catch( std::exception & e )
+    {
+    std::ostringstream message;
+    message << "job " << job.m_Id << " (" << name << ") threw " << e.what();
+    ReportServerError( state, message.str() );
+    }
+  catch( ... )
+    {
+    std::ostringstream message;
+    message << "job " << job.m_Id << " (" << name << ") threw an unknown exception";
+    ReportServerError( state, message.str() );
+    }
+  timer.Stop();
+
+  state.m_OutputMutex.Lock();
+  state.m_NumberOfFailures += ( status != EXIT_SUCCESS );
+  std::cout << "antsServer: job " << job.m_Id << " (" << name << ") returned " << status << " in "
+            << timer.GetTotal() << " s" << std::endl;
+  state.m_OutputMutex.Unlock();
+  return status;
+}
+
+ITK_THREAD_RETURN_TYPE ServerWorkerCallback( void *arg )
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+  ServerState * state = static_cast<ServerState *>( static_cast<ThreadInfoType *>( arg )->UserData );
+
+  ServerJob job;
+  while( state->m_Queue.Pop( job ) )
+    {
+    const int          status = RunServerJob( *state, job );
+    std::ostringstream reply;
+    reply << status << std::endl;
+    ReplyToServerClient( job.m_Reply, reply.str() );
+    state->m_Queue.Finish();
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** Queues a tool invocation or runs a control command.  Returns false when
+ *  the client asked the server to stop. */
+bool HandleServerCommand( ServerState & state, const std::string & line, int reply )
+{
+  std::vector<std::string> words;
+
+  if( !SplitServerCommand( line, words ) )
+    {
+    ReportServerError( state, "unterminated quote in: " + line );
+    ReplyToServerClient( reply, "1\n" );
+    return true;
+    }
+  if( words.empty() || words[0][0] == '#' )
+    {
+    ReplyToServerClient( reply, "" );
+    return true;
+    }
+  if( words[0] == "quit" )
+    {
+    ReplyToServerClient( reply, "0\n" );
+    return false;
+    }
+  if( words[0] == "wait" )
+    {
+    state.m_Queue.Wait();
+    ReplyToServerClient( reply, "0\n" );
+    return true;
+    }
+  if( words[0] == "stats" )
+    {
+    state.m_OutputMutex.Lock();
+    const std::string statistics = GetServerStatistics( state );
+    if( reply < 0 )
+      {
+      std::cout << statistics;
+      }
+    state.m_OutputMutex.Unlock();
+    ReplyToServerClient( reply, statistics );
+    return true;
+    }
+  if( state.m_Tools.find( words[0] ) == state.m_Tools.end() )
+    {
+    ReportServerError( state, "unknown tool " + words[0] );
+    ReplyToServerClient( reply, "1\n" );
+    return true;
+    }
+
+  ServerJob job;
+  state.m_OutputMutex.Lock();
+  job.m_Id = ++state.m_NumberOfJobs;
+  state.m_OutputMutex.Unlock();
+  job.m_Arguments = words;
+  job.m_Reply = reply;
+  state.m_Queue.Push( job );
+  return true;
+}
+
+void RunServerStandardInput( ServerState & state )
+{
+  std::string line;
+
+  while( std::getline( std::cin, line ) )
+    {
+    if( !HandleServerCommand( state, line, -1 ) )
+      {
+      break;
+      }
+    }
+}
+
+#if defined( ANTS_SERVER_USE_SOCKET )
+bool ReadServerLine( int client, std::string & line )
+{
+  char c;
+
+  line.clear();
+  while( true )
+    {
+    const ssize_t n = read( client, &c, 1 );
+    if( n < 0 && errno == EINTR )
+      {
+      continue;
+      }
+    if( n <= 0 )
+      {
+      return !line.empty();
+      }
+    if( c == '\n' )
+      {
+      return true;
+      }
+    line += c;
+    }
+}
+
+int RunServerSocket( ServerState & state, const std::string & path )
+{
+  struct sockaddr_un address;
+
+  if( path.length() >= sizeof( address.sun_path ) )
+    {
+    ReportServerError( state, "socket path is too long: " + path );
+    return EXIT_FAILURE;
+    }
+  memset( &address, 0, sizeof( address ) );
+  address.sun_family = AF_UNIX;
+  strncpy( address.sun_path, path.c_str(), sizeof( address.sun_path ) - 1 );
+
+  // replace the socket of an earlier server, but never any other file
+  struct stat fileInfo;
+  if( lstat( path.c_str(), &fileInfo ) == 0 )
+    {
+    if( !S_ISSOCK( fileInfo.st_mode ) )
+      {
+      ReportServerError( state, "refusing to replace " + path + ", which is not a socket" );
+      return EXIT_FAILURE;
+      }
+    unlink( path.c_str() );
+    }
+
+  // a client that hangs up must not take the server down with SIGPIPE
+  signal( SIGPIPE, SIG_IGN );
+  const int listener = socket( AF_UNIX, SOCK_STREAM, 0 );
+
+  // anyone who can connect can run any tool as this user, so the socket is
+  // created readable and writable by its owner only
+  const mode_t previousMask = umask( 077 );
+  const bool   bound = listener >= 0
+    && bind( listener, reinterpret_cast<struct sockaddr *>( &address ), sizeof( address ) ) == 0;
+  umask( previousMask );
+  if( !bound || listen( listener, 64 ) != 0 )
+    {
+    ReportServerError( state, "cannot listen on " + path + ": " + strerror( errno ) );
+    if( listener >= 0 )
+      {
+      close( listener );
+      }
+    return EXIT_FAILURE;
+    }
+  std::cout << "antsServer: listening on " << path << std::endl;
+
+  bool running = true;
+  while( running )
+    {
+    const int client = accept( listener, ITK_NULLPTR, ITK_NULLPTR );
+    if( client < 0 )
+      {
+      if( errno == EINTR )
+        {
+        continue;
+        }
+      break;
+      }
+    std::string line;
+    if( !ReadServerLine( client, line ) )
+      {
+      close( client );
+      continue;
+      }
+    running = HandleServerCommand( state, line, client );
+    }
+  close( listener );
+  unlink( path.c_str() );
+  return EXIT_SUCCESS;
+}
+#endif
+
+void antsServerInitializeCommandLineOptions( ParserType *parser )
+{
+  {
+  std::string description =
+    std::string( "Number of tool invocations run at the same time.  Jobs " )
+    + std::string( "start in the order they arrive; with one worker (the " )
+    + std::string( "default) they also finish in that order, so a script can " )
+    + std::string( "send dependent steps one after the other.  With more " )
+    + std::string( "workers, send 'wait' between dependent steps.  Every tool " )
+    + std::string( "still uses all threads it is given, and the tools' own " )
+    + std::string( "output is not serialized." );
+
+  OptionType::Pointer option = OptionType::New();
+  option->SetLongName( "workers" );
+  option->SetShortName( 'w' );
+  option->SetUsageOption( 0, "1" );
+  option->SetDescription( description );
+  parser->AddOption( option );
+  }
+
+  {
+  std::string description =
+    std::string( "Memory, in MB, for decoded images and transforms that are " )
+    + std::string( "kept to serve later reads of the same file.  An entry is " )
+    + std::string( "keyed by file name, modification time, size and the type " )
+    + std::string( "it was read as; least recently used entries are dropped " )
+    + std::string( "first.  Every read gets its own copy.  0 disables the " )
+    + std::string( "cache.  Default = 2048." );
+
+  OptionType::Pointer option = OptionType::New();
+  option->SetLongName( "cache-size" );
+  option->SetShortName( 'c' );
+  option->SetUsageOption( 0, "2048" );
+  option->SetDescription( description );
+  parser->AddOption( option );
+  }
+
+#if defined( ANTS_SERVER_USE_SOCKET )
+  {
+  std::string description =
+    std::string( "Listen on this local (Unix domain) socket instead of " )
+    + std::string( "reading commands from standard input.  Each connection " )
+    + std::string( "sends one command line and receives the exit code of the " )
+    + std::string( "tool, e.g. " )
+    + std::string( "echo \"antsApplyTransforms -d 3 ...\" | socat - UNIX-CONNECT:/tmp/ants.sock  " )
+    + std::string( "Only the owner can connect to the socket.  An existing " )
+    + std::string( "socket at path is replaced; any other file is left alone " )
+    + std::string( "and the server exits." );
+
+  OptionType::Pointer option = OptionType::New();
+  option->SetLongName( "socket" );
+  option->SetShortName( 's' );
+  option->SetUsageOption( 0, "path" );
+  option->SetDescription( description );
+  parser->AddOption( option );
+  }
+#endif
+
+  {
+  std::string description = std::string( "Print the help menu (short version)." );
+
+  OptionType::Pointer option = OptionType::New();
+  option->SetShortName( 'h' );
+  option->SetDescription( description );
+  parser->AddOption( option );
+  }
+
+  {
+  std::string description = std::string( "Print the help menu." );
+
+  OptionType::Pointer option = OptionType::New();
+  option->SetLongName( "help" );
+  option->SetDescription( description );
+  parser->AddOption( option );
+  }
+}
+} // namespace
+
+// entry point for the library; parameter 'args' is equivalent to 'argv' in (argc,argv) of commandline parameters to
+// 'main()'
+int antsServer( std::vector<std::string> args, std::ostream * /*out_stream = NULL */ )
+{
+  // put the arguments coming in as 'args' into standard (argc,argv) format;
+  // 'args' doesn't have the command name as first, argument, so add it manually;
+  // 'args' may have adjacent arguments concatenated into one argument,
+  // which the parser should handle
+  args.insert( args.begin(), "antsServer" );
+  int     argc = args.size();
+  char* * argv = new char *[args.size() + 1];
+  for( unsigned int i = 0; i < args.size(); ++i )
+    {
+    // allocate space for the string plus a null character
+    argv[i] = new char[args[i].length() + 1];
+    std::strncpy( argv[i], args[i].c_str(), args[i].length() );
+    // place the null character in the end
+    argv[i][args[i].length()] = '\0';
+    }
+  argv[argc] = ITK_NULLPTR;
+  // class to automatically cleanup argv upon destruction
+  class Cleanup_argv
+  {
+public:
+    Cleanup_argv( char* * argv_, int argc_plus_one_ ) : argv( argv_ ), argc_plus_one( argc_plus_one_ )
+    {
+    }
+
+    ~Cleanup_argv()
+    {
+      for( unsigned int i = 0; i < argc_plus_one; ++i )
+        {
+        delete[] argv[i];
+        }
+      delete[] argv;
+    }
+
+private:
+    char* *      argv;
+    unsigned int argc_plus_one;
+  };
+  Cleanup_argv cleanup_argv( argv, argc + 1 );
+
+  ParserType::Pointer parser = ParserType::New();
+
+  parser->SetCommand( argv[0] );
+
+  std::string commandDescription =
+    std::string( "antsServer runs ANTs tools inside one long-lived process.  " )
+    + std::string( "It reads one command per line, a tool name followed by the " )
+    + std::string( "tool's arguments exactly as on the command line, e.g. " )
+    + std::string( "'antsApplyTransforms -d 3 -i in.nii.gz -r template.nii.gz -o out.nii.gz -t warp.nii.gz'.  " )
+    + std::string( "Process startup and ITK factory registration are paid once, " )
+    + std::string( "and images and transforms that several commands read, such " )
+    + std::string( "as templates, priors and warps, are decoded only once.  " )
+    + std::string( "Besides tool names, 'wait' blocks until all queued jobs " )
+    + std::string( "have finished, 'stats' prints job and cache statistics and " )
+    + std::string( "'quit' stops the server after the queued jobs.  Relative " )
+    + std::string( "paths are relative to the server's working directory.  A " )
+    + std::string( "tool that exits the process on an error stops the server." );
+
+  parser->SetCommandDescription( commandDescription );
+  antsServerInitializeCommandLineOptions( parser );
+
+  if( parser->Parse( argc, argv ) == EXIT_FAILURE )
+    {
+    return EXIT_FAILURE;
+    }
+
+  if( parser->GetOption( "help" )->GetFunction() && parser->Convert<bool>( parser->GetOption( "help" )->GetFunction()->GetName() ) )
+    {
+    parser->PrintMenu( std::cout, 5, false );
+    return EXIT_SUCCESS;
+    }
+  else if( parser->GetOption( 'h' )->GetFunction() && parser->Convert<bool>( parser->GetOption( 'h' )->GetFunction()->GetName() ) )
+    {
+    parser->PrintMenu( std::cout, 5, true );
+    return EXIT_SUCCESS;
+    }
+
+  unsigned int numberOfWorkers = 1;
+  OptionType::Pointer workersOption = parser->GetOption( "workers" );
+  if( workersOption && workersOption->GetNumberOfFunctions() )
+    {
+    numberOfWorkers = parser->Convert<unsigned int>( workersOption->GetFunction( 0 )->GetName() );
+    }
+  if( numberOfWorkers < 1 || numberOfWorkers >= ITK_MAX_THREADS )
+    {
+    std::cerr << "The number of workers must be between 1 and " << ITK_MAX_THREADS - 1 << "." << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  double cacheSize = 2048.0;
+  OptionType::Pointer cacheOption = parser->GetOption( "cache-size" );
+  if( cacheOption && cacheOption->GetNumberOfFunctions() )
+    {
+    cacheSize = parser->Convert<double>( cacheOption->GetFunction( 0 )->GetName() );
+    }
+  SetReadCacheCapacity( static_cast<itk::SizeValueType>( std::max( cacheSize, 0.0 ) * 1024.0 * 1024.0 ) );
+
+  ServerState state;
+  state.m_NumberOfJobs = 0;
+  state.m_NumberOfFailures = 0;
+  for( unsigned int i = 0; i < sizeof( serverTools ) / sizeof( serverTools[0] ); i++ )
+    {
+    state.m_Tools[serverTools[i].m_Name] = serverTools[i].m_Function;
+    }
+
+  itk::MultiThreader::Pointer    threader = itk::MultiThreader::New();
+  std::vector<itk::ThreadIdType> workers;
+  for( unsigned int w = 0; w < numberOfWorkers; w++ )
+    {
+    workers.push_back( threader->SpawnThread( ServerWorkerCallback, &state ) );
+    }
+
+  int status = EXIT_SUCCESS;
+#if defined( ANTS_SERVER_USE_SOCKET )
+  OptionType::Pointer socketOption = parser->GetOption( "socket" );
+  if( socketOption && socketOption->GetNumberOfFunctions() )
+    {
+    status = RunServerSocket( state, socketOption->GetFunction( 0 )->GetName() );
+    }
+  else
+#endif
+    {
+    RunServerStandardInput( state );
+    }
+
+  // finish the queued jobs before leaving
+  state.m_Queue.Close();
+  for( unsigned int w = 0; w < workers.size(); w++ )
+    {
+    threader->TerminateThread( workers[w] );
+    }
+  std::cout << GetServerStatistics( state );
+  SetReadCacheCapacity( 0 );
+
+  return status;
+}
+} // namespace ants
@@ -250,6 +250,8 @@ struct ants_slice_regularized_index_cmp
   const T arr;
   };
 
+namespace
+{
 template <class TFilter>
 class CommandIterationUpdate : public itk::Command
 {
@@ -301,6 +303,7 @@ private:
 
   std::vector<unsigned int> m_NumberOfIterations;
 };
+} // namespace
 
 template <unsigned int ImageDimension>
 int ants_slice_regularized_registration( itk::ants::CommandLineParser *parser )
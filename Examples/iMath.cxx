@@ -31,71 +31,6 @@ void WIP(int argc, char **argv)
   exit(1);
 }
 
-template <class T>
-bool from_string(T& t,
-                 const std::string& s,
-                 std::ios_base & (*f)(std::ios_base &) )
-{
-  std::istringstream iss(s);
-
-  iss >> f >> t;
-
-  // Check to see that there is nothing left over
-  if( !iss.eof() )
-    {
-    return false;
-    }
-
-  return true;
-}
-
-template <class T>
-std::string ants_to_string(T t)
-{
-  std::stringstream istream;
-
-  istream << t;
-  return istream.str();
-}
-
-std::string ANTSOptionName(const char *str)
-{
-  std::string            filename = str;
-  std::string::size_type pos = filename.rfind( "=" );
-  std::string            name = std::string( filename, 0, pos );
-
-  return name;
-}
-
-std::string ANTSOptionValue(const char *str)
-{
-  std::string            filename = str;
-  std::string::size_type pos = filename.rfind( "=" );
-  std::string            value = std::string( filename, pos + 1, filename.length() );
-
-  return value;
-}
-
-std::string ANTSGetFilePrefix(const char *str)
-{
-  const std::string      filename = str;
-  std::string::size_type pos = filename.rfind( "." );
-  std::string            filepre = std::string( filename, 0, pos );
-
-#if 0 // HACK:  This does nothing useful
-  if( pos != std::string::npos )
-    {
-    std::string extension = std::string( filename, pos, filename.length() - 1);
-    if( extension == std::string(".gz") )
-      {
-      pos = filepre.rfind( "." );
-      // extension = std::string( filepre, pos, filepre.length() - 1 );
-      }
-    }
-#endif
-  return filepre;
-}
-
 //
 // iMath was a gigantic switch statement that had 3 duplicated
 // lists of 'if (operation == <op>)' clauses for 2d, 3d, and 4d. I
@@ -25,6 +25,8 @@
 
 #include "antsJointTensorFusion.h"
 
+#include "antsServer.h"
+
 #include "antsTransformInfo.h"
 
 #include "ANTSConformalMapping.h"
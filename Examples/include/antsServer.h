@@ -0,0 +1,12 @@
+
+#ifndef ANTSSERVER_H
+#define ANTSSERVER_H
+
+namespace ants
+{
+extern int antsServer( std::vector<std::string>, // equivalent to argv of command line parameters to main()
+                       std::ostream* out_stream  // [optional] output stream to write
+                       );
+} // namespace ants
+
+#endif // ANTSSERVER_H
@@ -29,12 +29,13 @@
 #include "itkCSVArray2DFileReader.h"
 #include "itkExtractImageFilter.h"
 #include "ReadWriteData.h"
+#include "antsSubjectVoxelMatrix.h"
 
 namespace ants
 {
 // namespace antssccan {
 template <class TComp>
-double vnl_pearson_corr( vnl_vector<TComp> v1, vnl_vector<TComp> v2 )
+static double vnl_pearson_corr( vnl_vector<TComp> v1, vnl_vector<TComp> v2 )
 {
   double xysum = 0;
 
@@ -106,7 +107,7 @@ inline std::string sccan_to_string(const T& t)
 
 template <class TImage, class TComp>
 void WriteSortedVariatesToSpatialImage( std::string filename, std::string post, vnl_matrix<TComp> varmat,
-                                        typename TImage::Pointer  mask,  vnl_matrix<TComp> data_mat, bool have_mask,
+                                        typename TImage::Pointer  mask,  const vnl_matrix<TComp> & data_mat, bool have_mask,
                                         vnl_vector<TComp> l_array,
                                         vnl_matrix<TComp> prior_mat )
 {
@@ -233,7 +234,7 @@ void WriteSortedVariatesToSpatialImage( std::string filename, std::string post,
 
 template <class TImage, class TComp>
 void WriteVariatesToSpatialImage( std::string filename, std::string post, vnl_matrix<TComp> varmat,
-                                  typename TImage::Pointer  mask,  vnl_matrix<TComp> data_mat,
+                                  typename TImage::Pointer  mask,  const vnl_matrix<TComp> & data_mat,
                                   bool have_mask, vnl_matrix<TComp> u_mat  )
 {
   vnl_matrix<TComp>      projections = data_mat * varmat;
@@ -461,13 +462,24 @@ CompareMatrixSizes(  vnl_matrix<RealType> & p,  vnl_matrix<RealType> & q )
 }
 
 template <class PixelType>
-void
+bool
 ReadMatrixFromCSVorImageSet( std::string matname, vnl_matrix<PixelType> & p )
 {
   typedef PixelType                             Scalar;
   typedef itk::Image<PixelType, 2>              MatrixImageType;
   typedef itk::ImageFileReader<MatrixImageType> matReaderType;
   std::string ext = itksys::SystemTools::GetFilenameExtension( matname );
+  if( itk::ants::SubjectVoxelMatrix::IsSubjectVoxelMatrixFileName( matname ) )
+    {
+    itk::ants::SubjectVoxelMatrix::Pointer store = itk::ants::SubjectVoxelMatrix::New();
+    if( !store->Open( matname ) )
+      {
+      std::cerr << " cannot read the matrix " << matname << std::endl;
+      return false;
+      }
+    store->CopyToMatrix<PixelType>( p );
+    return true;
+    }
   if( strcmp(ext.c_str(), ".csv") == 0 )
     {
     typedef itk::CSVArray2DFileReader<double> ReaderType;
@@ -490,7 +502,7 @@ ReadMatrixFromCSVorImageSet( std::string matname, vnl_matrix<PixelType> & p )
     typedef itk::CSVArray2DDataObject<double> DataFrameObjectType;
     DataFrameObjectType::Pointer dfo = reader->GetOutput();
     p = dfo->GetMatrix();
-    return;
+    return true;
     }
   else
     {
@@ -499,7 +511,26 @@ ReadMatrixFromCSVorImageSet( std::string matname, vnl_matrix<PixelType> & p )
     matreader1->Update();
     p = CopyImageToVnlMatrix<MatrixImageType, Scalar>( matreader1->GetOutput() );
     }
-  return;
+  return true;
+}
+
+/** An .antsmat matrix keeps the mask it was built with; a mask given with it
+ *  must select the same voxels, so that its rows map back to image space. */
+template <class ImageType>
+bool
+CheckMatrixAgainstMask( std::string matname, const ImageType * mask )
+{
+  if( !mask || !itk::ants::SubjectVoxelMatrix::IsSubjectVoxelMatrixFileName( matname ) )
+    {
+    return true;
+    }
+  itk::ants::SubjectVoxelMatrix::Pointer store = itk::ants::SubjectVoxelMatrix::New();
+  if( !store->Open( matname ) || !itk::ants::SubjectVoxelMatrixMatchesMask<ImageType>( store, mask ) )
+    {
+    std::cerr << " the voxels of the matrix " << matname << " do not match its mask " << std::endl;
+    return false;
+    }
+  return true;
 }
 
 template <unsigned int ImageDimension, class PixelType>
@@ -556,6 +587,24 @@ ConvertImageListToMatrix( std::string imagelist, std::string maskfn, std::string
     inputStreamA.close();
     }
 
+  /** the binary store is built in parallel and then serves as the source of
+   *  the returned matrix, so each subject image is read only once */
+  if( itk::ants::SubjectVoxelMatrix::IsSubjectVoxelMatrixFileName( outname ) )
+    {
+    if( !itk::ants::ConvertImageListToSubjectVoxelMatrix<ImageType>( image_fn_list, mask, outname ) )
+      {
+      return zmat;
+      }
+    itk::ants::SubjectVoxelMatrix::Pointer store = itk::ants::SubjectVoxelMatrix::New();
+    if( !store->Open( outname ) )
+      {
+      return zmat;
+      }
+    MatrixType matrix;
+    store->CopyToMatrix<double>( matrix );
+    return matrix;
+    }
+
   /** declare the output matrix image */
   unsigned long xsize = image_fn_list.size();
   unsigned long ysize = voxct;
@@ -920,7 +969,10 @@ ConvertCSVVectorToImage( std::string csvfn, std::string maskfn, std::string outn
   /** we refer to the two view matrices as P and Q */
   vMatrix p;
   p.fill(0);
-  ReadMatrixFromCSVorImageSet<Scalar>(csvfn, p);
+  if( !ReadMatrixFromCSVorImageSet<Scalar>(csvfn, p) )
+    {
+    return EXIT_FAILURE;
+    }
   if( mct != p.rows() && mct != p.cols() )
     {
     // std::cout << " csv-vec rows " << p.rows() << " cols " << p.cols() << " mask non zero elements " << mct  <<  std::endl;
@@ -1171,10 +1223,17 @@ int SVD_One_View( itk::ants::CommandLineParser *sccanparser, unsigned int permct
 
   std::string pmatname = std::string(option->GetFunction( 0 )->GetParameter( 0 ) );
   vMatrix     p;
-  ReadMatrixFromCSVorImageSet<Scalar>(pmatname, p);
+  if( !ReadMatrixFromCSVorImageSet<Scalar>(pmatname, p) )
+    {
+    return EXIT_FAILURE;
+    }
   typename ImageType::Pointer mask1 = ITK_NULLPTR;
   bool have_p_mask = false;
   have_p_mask = ReadImage<ImageType>(mask1, option->GetFunction( 0 )->GetParameter( 1 ).c_str() );
+  if( have_p_mask && !CheckMatrixAgainstMask<ImageType>( pmatname, mask1 ) )
+    {
+    return EXIT_FAILURE;
+    }
   double  FracNonZero1 = sccanparser->Convert<double>( option->GetFunction( 0 )->GetParameter( 2 ) );
   vMatrix priorScaleMat;
   if( svd_option == 7 )
@@ -1185,7 +1244,10 @@ int SVD_One_View( itk::ants::CommandLineParser *sccanparser, unsigned int permct
     std::string outname = "prior.mhd";
     ConvertImageListToMatrix<ImageDimension, double>( imagelistPrior, option->GetFunction( 0 )->GetParameter(
                                                         1 ), outname );
-    ReadMatrixFromCSVorImageSet<Scalar>(outname, priorROIMat);
+    if( !ReadMatrixFromCSVorImageSet<Scalar>(outname, priorROIMat) )
+      {
+      return EXIT_FAILURE;
+      }
     // ReadMatrixFromCSVorImageSet<Scalar>(priorScaleFile, priorScaleMat);
     }
   // std::cout << " frac nonzero " << FracNonZero1 << std::endl;
@@ -1211,7 +1273,10 @@ int SVD_One_View( itk::ants::CommandLineParser *sccanparser, unsigned int permct
     if( nuis_img.length() > 3 && svd_option != 7 )
       {
       // std::cout << " nuis_img " << nuis_img << std::endl;
-      ReadMatrixFromCSVorImageSet<Scalar>(nuis_img, r);
+      if( !ReadMatrixFromCSVorImageSet<Scalar>(nuis_img, r) )
+        {
+        return EXIT_FAILURE;
+        }
       if( CompareMatrixSizes<Scalar>( p, r ) == EXIT_FAILURE )
         {
         return EXIT_FAILURE;
@@ -1467,11 +1532,17 @@ int SCCA_vnl( itk::ants::CommandLineParser *sccanparser, unsigned int permct, un
   std::string pmatname = std::string(option->GetFunction( 0 )->GetParameter( 0 ) );
   vMatrix     p;
   // // std::cout <<" read-p "<< std::endl;
-  ReadMatrixFromCSVorImageSet<Scalar>(pmatname, p);
+  if( !ReadMatrixFromCSVorImageSet<Scalar>(pmatname, p) )
+    {
+    return EXIT_FAILURE;
+    }
   std::string qmatname = std::string(option->GetFunction( 0 )->GetParameter( 1 ) );
   vMatrix     q;
   // // std::cout <<" read-q "<< std::endl;
-  ReadMatrixFromCSVorImageSet<Scalar>(qmatname, q);
+  if( !ReadMatrixFromCSVorImageSet<Scalar>(qmatname, q) )
+    {
+    return EXIT_FAILURE;
+    }
   //  // std::cout << q.get_row(0) << std::endl;
   //  // std::cout << q.mean() << std::endl;
   if( CompareMatrixSizes<Scalar>( p, q ) == EXIT_FAILURE )
@@ -1494,6 +1565,11 @@ int SCCA_vnl( itk::ants::CommandLineParser *sccanparser, unsigned int permct, un
     {
     have_q_mask = ReadImage<ImageType>(mask2, mask2fn.c_str() );
     }
+  if( ( have_p_mask && !CheckMatrixAgainstMask<ImageType>( pmatname, mask1.GetPointer() ) )
+      || ( have_q_mask && !CheckMatrixAgainstMask<ImageType>( qmatname, mask2.GetPointer() ) ) )
+    {
+    return EXIT_FAILURE;
+    }
 
   /** the penalties define the fraction of non-zero values for each view */
   double FracNonZero1 = sccanparser->Convert<double>( option->GetFunction( 0 )->GetParameter( 4 ) );
@@ -1566,7 +1642,10 @@ int SCCA_vnl( itk::ants::CommandLineParser *sccanparser, unsigned int permct, un
       sccanobj->SetFractionNonZeroQ(FracNonZero2);
       sccanobj->SetGradStep( gradstep );
       sccanobj->SetMatrixP( p );
-      ReadMatrixFromCSVorImageSet<Scalar>(qmatname, q);
+      if( !ReadMatrixFromCSVorImageSet<Scalar>(qmatname, q) )
+        {
+        return EXIT_FAILURE;
+        }
       vMatrix q_perm = PermuteMatrix<Scalar>( q );
       sccanobj->SetMatrixQ( q_perm );
       sccanobj->SparsePartialArnoldiCCA(n_evec );
@@ -1714,13 +1793,22 @@ int mSCCA_vnl( itk::ants::CommandLineParser *sccanparser,
   /** read the matrix images */
   std::string pmatname = std::string(option->GetFunction( 0 )->GetParameter( 0 ) );
   vMatrix     pin;
-  ReadMatrixFromCSVorImageSet<Scalar>(pmatname, pin);
+  if( !ReadMatrixFromCSVorImageSet<Scalar>(pmatname, pin) )
+    {
+    return EXIT_FAILURE;
+    }
   std::string qmatname = std::string(option->GetFunction( 0 )->GetParameter( 1 ) );
   vMatrix     qin;
-  ReadMatrixFromCSVorImageSet<Scalar>(qmatname, qin);
+  if( !ReadMatrixFromCSVorImageSet<Scalar>(qmatname, qin) )
+    {
+    return EXIT_FAILURE;
+    }
   std::string rmatname = std::string(option->GetFunction( 0 )->GetParameter( 2 ) );
   vMatrix     rin;
-  ReadMatrixFromCSVorImageSet<Scalar>(rmatname, rin);
+  if( !ReadMatrixFromCSVorImageSet<Scalar>(rmatname, rin) )
+    {
+    return EXIT_FAILURE;
+    }
   if( CompareMatrixSizes<Scalar>( pin, qin ) == EXIT_FAILURE )
     {
     return EXIT_FAILURE;
@@ -2767,7 +2855,11 @@ private:
     std::string description =
       std::string( "takes a list of image files names (one per line) " )
       + std::string(
-        "and converts it to a 2D matrix / image in binary or csv format depending on the filetype used to define the output." );
+        "and converts it to a 2D matrix / image in binary or csv format depending on the filetype used to define the output. " )
+      + std::string(
+        "An .antsmat output is a memory-mapped binary subject x voxel matrix that keeps the mask geometry in its header; " )
+      + std::string(
+        "it is built by reading the images in parallel and can be passed anywhere sccan expects a matrix." );
     OptionType::Pointer option = OptionType::New();
     option->SetLongName( "imageset-to-matrix" );
     option->SetUsageOption( 0, "[list.txt,mask.nii.gz]" );
@@ -2,6 +2,8 @@
 #define ANTS_AFFINE_REGISTRATION2_H_
 
 #include <vector>
+#include <limits>
+#include <sstream>
 #include <stdlib.h>
 #include <time.h>
 #include "itkImage.h"
@@ -37,6 +39,8 @@
 #include "itkImageRegionIterator.h"
 #include "itkRandomImageSource.h"
 #include "itkAddImageFilter.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+#include "antsParallelizeRange.h"
 
 typedef enum { AffineWithMutualInformation = 1, AffineWithMeanSquareDifference, AffineWithHistogramCorrelation,
                AffineWithNormalizedCorrelation, AffineWithGradientDifference } AffineMetricType;
@@ -56,6 +60,7 @@ public:
     MI_bins = 32;
     MI_samples = 6000;
     number_of_seeds = 0;
+    number_of_concurrent_seeds = 0;
     time_seed = (unsigned int) time(ITK_NULLPTR);
     number_of_levels = 3;
     number_of_iteration_list.resize(number_of_levels, 10000);
@@ -82,6 +87,7 @@ public:
   int                 MI_bins;
   int                 MI_samples;
   int                 number_of_seeds;
+  int                 number_of_concurrent_seeds;
   unsigned int        time_seed;
   int                 number_of_levels;
   std::vector<int>    number_of_iteration_list;
@@ -118,7 +124,8 @@ std::ostream & operator<<(std::ostream& os, const OptAffine<TAffineTransform,  T
       os << "AffineWithGradientDifference" << std::endl; break;
     }
   os << "MI_bins=" << p.MI_bins << " " << "MI_samples=" << p.MI_samples << std::endl;
-  os << "number_of_seeds=" << p.number_of_seeds << " " << "time_seed=" << p.time_seed << std::endl;
+  os << "number_of_seeds=" << p.number_of_seeds << " " << "number_of_concurrent_seeds="
+     << p.number_of_concurrent_seeds << " " << "time_seed=" << p.time_seed << std::endl;
   os << "number_of_levels=" << p.number_of_levels << std::endl;
   os << "number_of_iteration_list=" << "[";
   for( unsigned int i = 0; i < p.number_of_iteration_list.size() - 1; i++ )
@@ -390,6 +397,7 @@ inline void PreConversionInAffine(ImagePointerType & fixedImage, RunningImagePoi
   R_opt.MI_bins = opt.MI_bins;
   R_opt.MI_samples = opt.MI_samples;
   R_opt.number_of_seeds = opt.number_of_seeds;
+  R_opt.number_of_concurrent_seeds = opt.number_of_concurrent_seeds;
   R_opt.time_seed = opt.time_seed;
   R_opt.number_of_levels = opt.number_of_levels;
   R_opt.number_of_iteration_list = opt.number_of_iteration_list;
@@ -465,7 +473,7 @@ void ComputeSingleAffineTransform2D3D(typename ImageType::Pointer & fixed_image,
 
       RunningAffineCacheType running_cache;
       InitializeRunningAffineCache(fixed_image, moving_image, opt, running_cache);
-      RegisterImageAffineMutualInformationMultiResolution(running_cache, opt, para_final);
+      RegisterImageAffineWithSeeds(running_cache, opt, para_final);
       }
       break;
     case AffineWithHistogramCorrelation:
@@ -476,14 +484,8 @@ void ComputeSingleAffineTransform2D3D(typename ImageType::Pointer & fixed_image,
                                  InterpolatorType> RunningAffineCacheType;
 
       RunningAffineCacheType running_cache;
-
       InitializeRunningAffineCache(fixed_image, moving_image, opt, running_cache);
-      unsigned int nBins = 32;
-      typename MetricType::HistogramType::SizeType histSize;
-      histSize[0] = nBins;
-      histSize[1] = nBins;
-      running_cache.metric->SetHistogramSize(histSize);
-      RegisterImageAffineMutualInformationMultiResolution(running_cache, opt, para_final);
+      RegisterImageAffineWithSeeds(running_cache, opt, para_final);
       }
       break;
     case AffineWithNormalizedCorrelation:
@@ -495,7 +497,7 @@ void ComputeSingleAffineTransform2D3D(typename ImageType::Pointer & fixed_image,
 
       RunningAffineCacheType running_cache;
       InitializeRunningAffineCache(fixed_image, moving_image, opt, running_cache);
-      RegisterImageAffineMutualInformationMultiResolution(running_cache, opt, para_final);
+      RegisterImageAffineWithSeeds(running_cache, opt, para_final);
       }
       break;
     case AffineWithGradientDifference:
@@ -507,7 +509,7 @@ void ComputeSingleAffineTransform2D3D(typename ImageType::Pointer & fixed_image,
 
       RunningAffineCacheType running_cache;
       InitializeRunningAffineCache(fixed_image, moving_image, opt, running_cache);
-      RegisterImageAffineMutualInformationMultiResolution(running_cache, opt, para_final);
+      RegisterImageAffineWithSeeds(running_cache, opt, para_final);
       }
       break;
     case AffineWithMutualInformation:
@@ -519,11 +521,7 @@ void ComputeSingleAffineTransform2D3D(typename ImageType::Pointer & fixed_image,
 
       RunningAffineCacheType running_cache;
       InitializeRunningAffineCache(fixed_image, moving_image, opt, running_cache);
-
-      running_cache.metric->SetNumberOfHistogramBins( opt.MI_bins );
-      running_cache.metric->SetNumberOfSpatialSamples( opt.MI_samples );
-
-      RegisterImageAffineMutualInformationMultiResolution(running_cache, opt, para_final);
+      RegisterImageAffineWithSeeds(running_cache, opt, para_final);
       }
       break;
     default:
@@ -918,6 +916,34 @@ void BuildImagePyramid(const ImagePointerType & image, int number_of_levels, Ima
   // std::endl;
 }
 
+// metric specific settings of the running cache; the other metrics use their defaults
+template <class TMetric, class OptAffineType>
+void ConfigureRunningAffineMetric(TMetric * /* metric */, const OptAffineType & /* opt */)
+{
+}
+
+template <class TFixedImage, class TMovingImage, class OptAffineType>
+void ConfigureRunningAffineMetric(itk::MattesMutualInformationImageToImageMetric<TFixedImage, TMovingImage> * metric,
+                                  const OptAffineType & opt)
+{
+  metric->SetNumberOfHistogramBins( opt.MI_bins );
+  metric->SetNumberOfSpatialSamples( opt.MI_samples );
+}
+
+template <class TFixedImage, class TMovingImage, class OptAffineType>
+void ConfigureRunningAffineMetric(
+  itk::CorrelationCoefficientHistogramImageToImageMetric<TFixedImage, TMovingImage> * metric,
+  const OptAffineType & /* opt */)
+{
+  typedef itk::CorrelationCoefficientHistogramImageToImageMetric<TFixedImage, TMovingImage> MetricType;
+
+  unsigned int nBins = 32;
+  typename MetricType::HistogramType::SizeType histSize;
+  histSize[0] = nBins;
+  histSize[1] = nBins;
+  metric->SetHistogramSize(histSize);
+}
+
 template <class ImagePointerType, class OptAffineType, class RunningAffineCacheType>
 void InitializeRunningAffineCache(ImagePointerType & fixed_image, ImagePointerType & moving_image, OptAffineType & opt,
                                   RunningAffineCacheType & running_cache)
@@ -932,6 +958,59 @@ void InitializeRunningAffineCache(ImagePointerType & fixed_image, ImagePointerTy
   running_cache.interpolator = InterpolatorType::New();
   running_cache.metric = MetricType::New();
   running_cache.invmetric = MetricType::New();
+  ConfigureRunningAffineMetric(running_cache.metric.GetPointer(), opt);
+  ConfigureRunningAffineMetric(running_cache.invmetric.GetPointer(), opt);
+}
+
+// images that share the pixel buffers of an image pyramid but not its pipeline, so that
+// metrics running concurrently do not update the same pipeline
+template <class ImagePyramidType>
+void GraftImagePyramid(const ImagePyramidType & image_pyramid, ImagePyramidType & grafted_pyramid)
+{
+  typedef typename ImagePyramidType::value_type ImagePointerType;
+  typedef typename ImagePointerType::ObjectType ImageType;
+
+  grafted_pyramid.resize(image_pyramid.size() );
+  for( unsigned int i = 0; i < image_pyramid.size(); i++ )
+    {
+    grafted_pyramid[i] = ImageType::New();
+    grafted_pyramid[i]->Graft(image_pyramid[i]);
+    }
+}
+
+// a running cache for one seed: the pixel buffers of the image pyramids and of the mask are
+// shared with running_cache, the metric, interpolator and mask spatial object are its own.
+// The metrics sample with random_seed rather than with a seed drawn from the global
+// generator, which the seeds running at once would reach in a different order every run.
+template <class OptAffineType, class RunningAffineCacheType>
+void InitializeSeedAffineCache(const RunningAffineCacheType & running_cache, const OptAffineType & opt,
+                               itk::ThreadIdType number_of_metric_threads, int random_seed,
+                               RunningAffineCacheType & seed_cache)
+{
+  typedef typename RunningAffineCacheType::InterpolatorType InterpolatorType;
+  typedef typename RunningAffineCacheType::MetricType       MetricType;
+  typedef typename RunningAffineCacheType::MaskObjectType   MaskObjectType;
+  typedef typename MaskObjectType::ImageType                MaskImageType;
+
+  GraftImagePyramid(running_cache.fixed_image_pyramid, seed_cache.fixed_image_pyramid);
+  GraftImagePyramid(running_cache.moving_image_pyramid, seed_cache.moving_image_pyramid);
+  if( running_cache.mask_fixed_object.IsNotNull() )
+    {
+    typename MaskImageType::Pointer mask_image = MaskImageType::New();
+    mask_image->Graft(running_cache.mask_fixed_object->GetImage() );
+    seed_cache.mask_fixed_object = MaskObjectType::New();
+    seed_cache.mask_fixed_object->SetImage( mask_image );
+    }
+
+  seed_cache.interpolator = InterpolatorType::New();
+  seed_cache.metric = MetricType::New();
+  seed_cache.invmetric = MetricType::New();
+  ConfigureRunningAffineMetric(seed_cache.metric.GetPointer(), opt);
+  ConfigureRunningAffineMetric(seed_cache.invmetric.GetPointer(), opt);
+  seed_cache.metric->SetNumberOfThreads( number_of_metric_threads );
+  seed_cache.invmetric->SetNumberOfThreads( number_of_metric_threads );
+  seed_cache.metric->ReinitializeSeed( random_seed );
+  seed_cache.invmetric->ReinitializeSeed( random_seed );
 }
 
 template <class ImagePointerType, class OptAffineType>
@@ -1205,7 +1284,7 @@ bool SymmRegisterImageAffineMutualInformationMultiResolution(RunningAffineCacheT
 // template<class ImagePointerType, class ImageMaskSpatialObjectPointerType, class ParaType>
 template <class RunningAffineCacheType, class OptAffine, class ParaType>
 bool RegisterImageAffineMutualInformationMultiResolution(RunningAffineCacheType & running_cache, OptAffine & opt,
-                                                         ParaType & para_final)
+                                                         ParaType & para_final, std::ostream & os = std::cout)
 {
   typedef typename RunningAffineCacheType::ImagePyramidType      ImagePyramidType;
   typedef typename RunningAffineCacheType::ImagePointerType      ImagePointerType;
@@ -1288,8 +1367,8 @@ bool RegisterImageAffineMutualInformationMultiResolution(RunningAffineCacheType
         }
       catch( itk::ExceptionObject & err )
         {
-        std::cout << "ExceptionObject caught !" << std::endl;
-        std::cout << err << std::endl;
+        os << "ExceptionObject caught !" << std::endl;
+        os << err << std::endl;
         return false;
         }
 
@@ -1359,21 +1438,21 @@ bool RegisterImageAffineMutualInformationMultiResolution(RunningAffineCacheType
       last_gradient = current_gradient;
       }
 
-    std::cout << "level " << i << ", iter " << used_iterations
-                     << ", size: fix" << fixed_image->GetRequestedRegion().GetSize()
-                     << "-mov" << moving_image->GetRequestedRegion().GetSize();
+    os << "level " << i << ", iter " << used_iterations
+       << ", size: fix" << fixed_image->GetRequestedRegion().GetSize()
+       << "-mov" << moving_image->GetRequestedRegion().GetSize();
 
-    std::cout << ", affine para: " << current_para << std::endl;
+    os << ", affine para: " << current_para << std::endl;
 
     if( is_converged )
       {
-      std::cout << "    reach oscillation, current step: " << current_step_length << "<" << minimum_step_length
-                       << std::endl;
+      os << "    reach oscillation, current step: " << current_step_length << "<" << minimum_step_length
+         << std::endl;
       }
     else
       {
-      std::cout << "    does not reach oscillation, current step: " << current_step_length << ">"
-                       << minimum_step_length << std::endl;
+      os << "    does not reach oscillation, current step: " << current_step_length << ">"
+         << minimum_step_length << std::endl;
       }
     }
 
@@ -1435,8 +1514,8 @@ bool RegisterImageAffineMutualInformationMultiResolution(RunningAffineCacheType
           }
         catch( itk::ExceptionObject & err )
           {
-          std::cout << "ExceptionObject caught !" << std::endl;
-          std::cout << err << std::endl;
+          os << "ExceptionObject caught !" << std::endl;
+          os << err << std::endl;
           // don't have to return here if got anything from the previous forward direction
 //          return false;
           break;
@@ -1508,39 +1587,240 @@ bool RegisterImageAffineMutualInformationMultiResolution(RunningAffineCacheType
         last_gradient = current_gradient;
         }
 
-      std::cout << "level " << i << ", iter " << used_iterations
-                       << ", size: fix" << fixed_image->GetRequestedRegion().GetSize()
-                       << "-mov" << moving_image->GetRequestedRegion().GetSize();
+      os << "level " << i << ", iter " << used_iterations
+         << ", size: fix" << fixed_image->GetRequestedRegion().GetSize()
+         << "-mov" << moving_image->GetRequestedRegion().GetSize();
 
-      std::cout << ", affine para: " << current_para2 << std::endl;
+      os << ", affine para: " << current_para2 << std::endl;
 
       if( is_converged )
         {
-        std::cout << "    reach oscillation, current step: " << current_step_length << "<"
-                         << minimum_step_length
-                         << std::endl;
+        os << "    reach oscillation, current step: " << current_step_length << "<"
+           << minimum_step_length
+           << std::endl;
         }
       else
         {
-        std::cout << "    does not reach oscillation, current step: " << current_step_length << ">"
-                         << minimum_step_length << std::endl;
+        os << "    does not reach oscillation, current step: " << current_step_length << ">"
+           << minimum_step_length << std::endl;
         }
       }
-    std::cout << " v1 " << value1 << " v2 " << value << std::endl;
+    os << " v1 " << value1 << " v2 " << value << std::endl;
     if( value < value1 )
       {
-      std::cout << " last params " << transform->GetParameters() << std::endl;
-      std::cout << " my params " << transform2->GetParameters() << std::endl;
+      os << " last params " << transform->GetParameters() << std::endl;
+      os << " my params " << transform2->GetParameters() << std::endl;
       transform2->GetInverse(transform);
-      std::cout << " new params " << transform->GetParameters() << std::endl;
+      os << " new params " << transform->GetParameters() << std::endl;
       para_final = transform->GetParameters();
       return true;
       }
     }
 
   para_final = current_para;
-  std::cout << "final " << para_final << std::endl;
+  os << "final " << para_final << std::endl;
   return true;
 }
 
+// /////////////////////////////////////////////////////////////////////////////
+// a seed for a restart of the affine optimization: the initial transform rotated about its
+// center by a random angle in [-pi/2, pi/2], around a random axis in 3D
+template <class AffineTransformPointerType, class GeneratorPointerType>
+AffineTransformPointerType GenerateAffineSeedTransform(const AffineTransformPointerType & transform_initial,
+                                                       GeneratorPointerType & generator)
+{
+  typedef typename AffineTransformPointerType::ObjectType TransformType;
+  typedef typename TransformType::MatrixType              MatrixType;
+  const unsigned int kImageDim = TransformType::InputSpaceDimension;
+
+  const double mypi = 3.1415926536;
+  const double a = generator->GetUniformVariate( mypi * (-0.5), mypi * (0.5) );
+
+  MatrixType rotation;
+  rotation.SetIdentity();
+  if( kImageDim == 2 )
+    {
+    rotation[0][0] = cos(a);  rotation[0][1] = -sin(a);
+    rotation[1][0] = sin(a);  rotation[1][1] = cos(a);
+    }
+  else if( kImageDim == 3 )
+    {
+    double axis[3];
+    double axis_mag = 0.0;
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      axis[i] = generator->GetUniformVariate( -1.0, 1.0 );
+      axis_mag += axis[i] * axis[i];
+      }
+    axis_mag = sqrt(axis_mag);
+    if( axis_mag == 0.0 )
+      {
+      axis[0] = 0.0; axis[1] = 0.0; axis[2] = 1.0; axis_mag = 1.0;
+      }
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      axis[i] /= axis_mag;
+      }
+    // Rodrigues' rotation formula
+    const double c = cos(a);
+    const double s = sin(a);
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      for( unsigned int j = 0; j < 3; j++ )
+        {
+        rotation[i][j] = (1.0 - c) * axis[i] * axis[j] + ( (i == j) ? c : 0.0 );
+        }
+      }
+    rotation[0][1] -= s * axis[2];  rotation[1][0] += s * axis[2];
+    rotation[0][2] += s * axis[1];  rotation[2][0] -= s * axis[1];
+    rotation[1][2] -= s * axis[0];  rotation[2][1] += s * axis[0];
+    }
+
+  AffineTransformPointerType transform = TransformType::New();
+  transform->SetCenter(transform_initial->GetCenter() );
+  transform->SetMatrix(transform_initial->GetMatrix() * rotation);
+  transform->SetTranslation(transform_initial->GetTranslation() );
+  return transform;
+}
+
+// the metric of running_cache at the finest level for the final parameters of a seed; all
+// seeds build their metric the same way, so the values rank the seeds
+template <class RunningAffineCacheType, class OptAffine, class ParaType>
+double EvaluateRunningAffineMetric(RunningAffineCacheType & running_cache, OptAffine & opt, const ParaType & para)
+{
+  typedef typename RunningAffineCacheType::ImagePointerType ImagePointerType;
+  typedef typename OptAffine::AffineTransformType           TransformType;
+
+  const int        finest_level = opt.number_of_levels - 1;
+  ImagePointerType fixed_image = running_cache.fixed_image_pyramid[finest_level];
+  ImagePointerType moving_image = running_cache.moving_image_pyramid[finest_level];
+
+  typename TransformType::Pointer transform = TransformType::New();
+  transform->SetParameters(para);
+  transform->SetCenter(opt.transform_initial->GetCenter() );
+
+  running_cache.interpolator->SetInputImage( moving_image );
+  running_cache.metric->SetMovingImage( moving_image );
+  running_cache.metric->SetFixedImage( fixed_image );
+  running_cache.metric->SetTransform( transform );
+  running_cache.metric->SetInterpolator( running_cache.interpolator );
+  running_cache.metric->SetFixedImageRegion(fixed_image->GetLargestPossibleRegion() );
+  if( running_cache.mask_fixed_object.IsNotNull() )
+    {
+    running_cache.metric->SetFixedImageMask(running_cache.mask_fixed_object);
+    }
+
+  double value = std::numeric_limits<double>::max();
+  try
+    {
+    running_cache.metric->Initialize();
+    value = running_cache.metric->GetValue(para);
+    }
+  catch( itk::ExceptionObject & )
+    {
+    value = std::numeric_limits<double>::max();
+    }
+  return value;
+}
+
+// runs a range of seeds for ::ants::ParallelizeRange; every seed has its own options,
+// running cache and log, and only writes its own slot of the results
+template <class RunningAffineCacheType, class OptAffine, class ParaType>
+class AffineSeedFunctor
+{
+public:
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    for( itk::SizeValueType n = begin; n < end; n++ )
+      {
+      RunningAffineCacheType seed_cache;
+      InitializeSeedAffineCache(*m_RunningCache, m_SeedOptions[n], m_NumberOfMetricThreads,
+                                static_cast<int>( m_SeedOptions[n].time_seed + n ), seed_cache);
+
+      std::ostringstream os;
+      ParaType           para(m_SeedOptions[n].transform_initial->GetParameters() );
+      bool               is_ok = RegisterImageAffineMutualInformationMultiResolution(seed_cache, m_SeedOptions[n],
+                                                                                     para, os);
+      m_Parameters[n] = para;
+      m_Values[n] = is_ok ? EvaluateRunningAffineMetric(seed_cache, m_SeedOptions[n], para) :
+        std::numeric_limits<double>::max();
+      m_Logs[n] = os.str();
+      }
+  }
+
+  const RunningAffineCacheType * m_RunningCache;
+  itk::ThreadIdType              m_NumberOfMetricThreads;
+  std::vector<OptAffine>         m_SeedOptions;
+  std::vector<ParaType>          m_Parameters;
+  std::vector<double>            m_Values;
+  std::vector<std::string>       m_Logs;
+};
+
+// restarts the affine optimization from opt.number_of_seeds initial positions: seed 0 is
+// opt.transform_initial, the others are random rotations of it drawn from opt.time_seed.
+// Up to opt.number_of_concurrent_seeds seeds (0: as many as there are threads) run at once
+// and split the threads between their metrics.  The seed with the lowest final metric
+// value wins, the lowest seed index on ties, so the choice does not depend on the order
+// in which the seeds finish.
+template <class RunningAffineCacheType, class OptAffine, class ParaType>
+void RegisterImageAffineWithSeeds(RunningAffineCacheType & running_cache, OptAffine & opt, ParaType & para_final)
+{
+  if( opt.number_of_seeds <= 1 )
+    {
+    RegisterImageAffineMutualInformationMultiResolution(running_cache, opt, para_final);
+    return;
+    }
+
+  typedef AffineSeedFunctor<RunningAffineCacheType, OptAffine, ParaType> SeedFunctorType;
+  typedef itk::Statistics::MersenneTwisterRandomVariateGenerator         GeneratorType;
+
+  const itk::SizeValueType number_of_seeds = opt.number_of_seeds;
+  const itk::ThreadIdType  number_of_concurrent_seeds =
+    ::ants::GetNumberOfThreadsForRange( number_of_seeds,
+                                        (opt.number_of_concurrent_seeds > 0) ? opt.number_of_concurrent_seeds : 0 );
+  itk::ThreadIdType number_of_metric_threads =
+    itk::MultiThreader::GetGlobalDefaultNumberOfThreads() / number_of_concurrent_seeds;
+  if( number_of_metric_threads < 1 )
+    {
+    number_of_metric_threads = 1;
+    }
+
+  std::cout << "affine seeds: " << number_of_seeds << ", concurrent: " << number_of_concurrent_seeds
+            << ", metric threads per seed: " << number_of_metric_threads << ", time_seed: " << opt.time_seed
+            << std::endl;
+
+  SeedFunctorType seed_functor;
+  seed_functor.m_RunningCache = &running_cache;
+  seed_functor.m_NumberOfMetricThreads = number_of_metric_threads;
+  seed_functor.m_SeedOptions.assign( number_of_seeds, opt );
+  seed_functor.m_Parameters.assign( number_of_seeds, para_final );
+  seed_functor.m_Values.assign( number_of_seeds, std::numeric_limits<double>::max() );
+  seed_functor.m_Logs.resize( number_of_seeds );
+
+  typename GeneratorType::Pointer generator = GeneratorType::New();
+  generator->Initialize( opt.time_seed );
+  for( itk::SizeValueType n = 1; n < number_of_seeds; n++ )
+    {
+    seed_functor.m_SeedOptions[n].transform_initial = GenerateAffineSeedTransform(opt.transform_initial, generator);
+    }
+
+  ::ants::ParallelizeRange( 0, number_of_seeds, seed_functor, number_of_concurrent_seeds );
+
+  itk::SizeValueType best = 0;
+  for( itk::SizeValueType n = 0; n < number_of_seeds; n++ )
+    {
+    std::cout << "seed [" << n << "]: para0: " << seed_functor.m_SeedOptions[n].transform_initial->GetParameters()
+              << std::endl;
+    std::cout << seed_functor.m_Logs[n];
+    std::cout << "seed [" << n << "]: rval: " << seed_functor.m_Values[n] << std::endl << std::endl;
+    if( seed_functor.m_Values[n] < seed_functor.m_Values[best] )
+      {
+      best = n;
+      }
+    }
+  std::cout << "best seed [" << best << "]: rval: " << seed_functor.m_Values[best] << std::endl;
+
+  para_final = seed_functor.m_Parameters[best];
+}
+
 #endif /*ANTS_AFFINE_REGISTRATION2_H_*/
@@ -30,10 +30,191 @@
 #include "vnl/vnl_math.h"
 #include "ANTS_affine_registration2.h"
 #include "itkWarpImageMultiTransformFilter.h"
+#include "antsParallelizeRange.h"
 // #include "itkVectorImageFileWriter.h"
 
+#include <algorithm>
+
 namespace itk
 {
+namespace ANTSImageRegistrationOptimizerFunctor
+{
+/**
+ * Loops of the greedy SyN update, written as functors over slabs of a region
+ * for ::ants::ParallelizeRange.  The range is the extent of the region along
+ * its last dimension; each functor only writes the voxels of its own slab.
+ */
+template <class TRegion>
+TRegion GetSlab( const TRegion & region, SizeValueType begin, SizeValueType end )
+{
+  const unsigned int last = TRegion::ImageDimension - 1;
+  TRegion            slab = region;
+
+  slab.SetIndex( last, region.GetIndex()[last] + static_cast<IndexValueType>( begin ) );
+  slab.SetSize( last, end - begin );
+  return slab;
+}
+
+/** The loop of ComposeDiffs. */
+template <class TField, class TInterpolator, class TReal>
+class ComposeFunctor
+{
+public:
+  typedef typename TField::PixelType                VectorType;
+  typedef typename TField::IndexType                IndexType;
+  typedef typename TField::RegionType               RegionType;
+  typedef Point<TReal, TField::ImageDimension>      PointType;
+  typedef typename TInterpolator::OutputType        InterpolatorOutputType;
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType )
+  {
+    ImageRegionConstIteratorWithIndex<TField> it( this->m_FieldToWarpBy, GetSlab( this->m_Region, begin, end ) );
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+      {
+      const IndexType index = it.GetIndex();
+      PointType       pointIn1;
+      this->m_FieldToWarpBy->TransformIndexToPhysicalPoint( index, pointIn1 );
+
+      const VectorType disp = it.Get();
+      PointType        pointIn2;
+      for( unsigned int jj = 0; jj < TField::ImageDimension; jj++ )
+        {
+        pointIn2[jj] = disp[jj] + pointIn1[jj];
+        }
+      InterpolatorOutputType disp2;
+      if( this->m_Interpolator->IsInsideBuffer( pointIn2 ) )
+        {
+        disp2 = this->m_Interpolator->Evaluate( pointIn2 );
+        }
+      else
+        {
+        disp2.Fill( 0 );
+        }
+      PointType pointIn3;
+      for( unsigned int jj = 0; jj < TField::ImageDimension; jj++ )
+        {
+        pointIn3[jj] = disp2[jj] * this->m_TimeSign + pointIn2[jj];
+        }
+      VectorType out;
+      for( unsigned int jj = 0; jj < TField::ImageDimension; jj++ )
+        {
+        out[jj] = pointIn3[jj] - pointIn1[jj];
+        }
+      this->m_FieldOut->SetPixel( index, out );
+      }
+  }
+
+  const TField *        m_FieldToWarpBy;
+  const TInterpolator * m_Interpolator;
+  TField *              m_FieldOut;
+  RegionType            m_Region;
+  TReal                 m_TimeSign;
+};
+
+/** One pass of the Gaussian smoothing along m_Direction, with the zero flux
+ *  Neumann boundary that the neighborhood operator filter uses at the edges
+ *  of m_Bounds.  m_Input must be buffered wherever the kernel reaches from
+ *  m_Region. */
+template <class TField>
+class GaussianPassFunctor
+{
+public:
+  typedef typename TField::PixelType  VectorType;
+  typedef typename TField::IndexType  IndexType;
+  typedef typename TField::RegionType RegionType;
+  typedef typename VectorType::ValueType ScalarType;
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType )
+  {
+    const unsigned int    d = this->m_Direction;
+    const IndexValueType  radius = static_cast<IndexValueType>( this->m_Kernel.size() / 2 );
+    const IndexValueType  first = this->m_Bounds.GetIndex()[d];
+    const IndexValueType  last = first + static_cast<IndexValueType>( this->m_Bounds.GetSize()[d] ) - 1;
+    const VectorType *    buffer = this->m_Input->GetBufferPointer();
+    const OffsetValueType stride = this->m_Input->GetOffsetTable()[d];
+
+    ImageRegionIteratorWithIndex<TField> it( this->m_Output, GetSlab( this->m_Region, begin, end ) );
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+      {
+      const IndexType       index = it.GetIndex();
+      const OffsetValueType center = this->m_Input->ComputeOffset( index );
+      VectorType            sum;
+      sum.Fill( 0 );
+      for( IndexValueType k = 0; k < static_cast<IndexValueType>( this->m_Kernel.size() ); k++ )
+        {
+        IndexValueType j = index[d] + k - radius;
+        if( j < first )
+          {
+          j = first;
+          }
+        else if( j > last )
+          {
+          j = last;
+          }
+        sum += buffer[center + ( j - index[d] ) * stride] * this->m_Kernel[k];
+        }
+      it.Set( sum );
+      }
+  }
+
+  const TField *          m_Input;
+  TField *                m_Output;
+  std::vector<ScalarType> m_Kernel;
+  unsigned int            m_Direction;
+  RegionType              m_Region;
+  RegionType              m_Bounds;
+};
+
+/** The edge zeroing and weighting at the end of the Gaussian smoothing. */
+template <class TField, class TReal>
+class GaussianBlendFunctor
+{
+public:
+  typedef typename TField::PixelType  VectorType;
+  typedef typename TField::IndexType  IndexType;
+  typedef typename TField::RegionType RegionType;
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType )
+  {
+    const IndexType                   first = this->m_Bounds.GetIndex();
+    const typename TField::SizeType   size = this->m_Bounds.GetSize();
+
+    ImageRegionIteratorWithIndex<TField> it( this->m_Field, GetSlab( this->m_Region, begin, end ) );
+    for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+      {
+      const IndexType index = it.GetIndex();
+      bool            onboundary = false;
+      for( unsigned int i = 0; i < TField::ImageDimension; i++ )
+        {
+        if( index[i] < first[i] + 1 || index[i] >= first[i] + static_cast<IndexValueType>( size[i] ) - 1 )
+          {
+          onboundary = true;
+          }
+        }
+      if( onboundary )
+        {
+        VectorType vec;
+        vec.Fill( 0.0 );
+        it.Set( vec );
+        }
+      else
+        {
+        it.Set( this->m_Smoothed->GetPixel( index ) * this->m_Weight + this->m_Previous->GetPixel( index )
+                * this->m_Weight2 );
+        }
+      }
+  }
+
+  const TField * m_Smoothed;
+  const TField * m_Previous;
+  TField *       m_Field;
+  TReal          m_Weight;
+  TReal          m_Weight2;
+  RegionType     m_Region;
+  RegionType     m_Bounds;
+};
+} // end namespace ANTSImageRegistrationOptimizerFunctor
+
 template <unsigned int TDimension, class TReal>
 ANTSImageRegistrationOptimizer<TDimension, TReal>
 ::ANTSImageRegistrationOptimizer()
@@ -50,6 +231,9 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
   this->m_UseMulti = true;
   this->m_UseROI = false;
   this->m_MaskImage = ITK_NULLPTR;
+  this->m_RestrictToMaskRegion = false;
+  this->m_MaskRegionPadding = 10;
+  this->m_UseActiveRegion = false;
   this->m_ReferenceSpaceImage = ITK_NULLPTR;
   this->m_Debug = false;
 
@@ -161,6 +345,11 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
     {
     std::cout << " No Field in gauss Smoother " << std::endl; return;
     }
+  if( this->m_UseActiveRegion )
+    {
+    this->SmoothDisplacementFieldGaussInRegion( field, sig, lodim, this->GetActiveRegion( field ) );
+    return;
+    }
   DisplacementFieldPointer tempField =
     AllocImage<DisplacementFieldType>(field);
 
@@ -252,6 +441,94 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
   delete oper;
 }
 
+template <unsigned int TDimension, class TReal>
+void
+ANTSImageRegistrationOptimizer<TDimension, TReal>
+::SmoothDisplacementFieldGaussInRegion(DisplacementFieldPointer field, TReal sig, unsigned int lodim,
+                                       const typename ImageType::RegionType & region)
+{
+  // SmoothDisplacementFieldGauss, computed only in region.  Each pass is
+  // computed in region grown by the kernel radius along the directions of the
+  // passes still to come, into a temporary buffer of that size, so that the
+  // result in region is the one of the full grid for the same field.  The
+  // field outside of region is read but not smoothed, so over several
+  // updates the restricted and full-grid fields drift apart near the border.
+  typedef typename DisplacementFieldType::PixelType    DispVectorType;
+  typedef typename DispVectorType::ValueType           ScalarType;
+  typedef GaussianOperator<ScalarType, ImageDimension> OperatorType;
+  typedef typename ImageType::RegionType               RegionType;
+  typedef ANTSImageRegistrationOptimizerFunctor::GaussianPassFunctor<DisplacementFieldType>         PassFunctorType;
+  typedef ANTSImageRegistrationOptimizerFunctor::GaussianBlendFunctor<DisplacementFieldType, TReal> BlendFunctorType;
+
+  const RegionType bounds = field->GetLargestPossibleRegion();
+  const unsigned int last = ImageDimension - 1;
+
+  std::vector<std::vector<ScalarType> > kernels( lodim );
+  for( unsigned int j = 0; j < lodim; j++ )
+    {
+    OperatorType oper;
+    oper.SetDirection( j );
+    oper.SetVariance( sig );
+    oper.SetMaximumError( 0.001 );
+    oper.SetMaximumKernelWidth( (unsigned int) this->m_GaussianTruncation );
+    oper.CreateDirectional();
+    for( unsigned int k = 0; k < oper.Size(); k++ )
+      {
+      kernels[j].push_back( oper[k] );
+      }
+    }
+
+  DisplacementFieldPointer previous = field;
+  DisplacementFieldPointer smoothed = field;
+  for( unsigned int j = 0; j < lodim; j++ )
+    {
+    typename ImageType::SizeType radius;
+    radius.Fill( 0 );
+    for( unsigned int k = j + 1; k < lodim; k++ )
+      {
+      radius[k] = kernels[k].size() / 2;
+      }
+    RegionType passRegion = region;
+    passRegion.PadByRadius( radius );
+    passRegion.Crop( bounds );
+
+    PassFunctorType functor;
+    functor.m_Input = smoothed;
+    functor.m_Kernel = kernels[j];
+    functor.m_Direction = j;
+    functor.m_Region = passRegion;
+    functor.m_Bounds = bounds;
+
+    previous = smoothed;
+    smoothed = AllocImage<DisplacementFieldType>( passRegion );
+    functor.m_Output = smoothed;
+    ::ants::ParallelizeRange( 0, passRegion.GetSize()[last], functor );
+    }
+
+  // make sure boundary does not move; like the full grid smoothing, this
+  // weights against the input of the last pass
+  TReal weight = 1.0;
+  if( sig < 0.5 )
+    {
+    weight = 1.0 - 1.0 * (sig / 0.5);
+    }
+
+  BlendFunctorType blend;
+  blend.m_Smoothed = smoothed;
+  blend.m_Previous = previous;
+  blend.m_Field = field;
+  blend.m_Weight = weight;
+  blend.m_Weight2 = 1.0 - weight;
+  blend.m_Region = region;
+  blend.m_Bounds = bounds;
+  ::ants::ParallelizeRange( 0, region.GetSize()[last], blend );
+
+  if( this->m_Debug )
+    {
+    std::cout << " done gauss smooth in " << region.GetSize() << std::endl;
+    }
+}
+
 template <unsigned int TDimension, class TReal>
 void
 ANTSImageRegistrationOptimizer<TDimension, TReal>
@@ -449,8 +726,6 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
                DisplacementFieldPointer fieldout,
                TReal timesign)
 {
-  typedef Point<TReal, itkGetStaticConstMacro(ImageDimension)> VPointType;
-
 //  field->SetSpacing( fieldtowarpby->GetSpacing() );
 //  field->SetOrigin( fieldtowarpby->GetOrigin() );
 //  field->SetDirection( fieldtowarpby->GetDirection() );
@@ -460,64 +735,33 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
     VectorType zero;  zero.Fill(0);
     fieldout = AllocImage<DisplacementFieldType>(fieldtowarpby);
     }
-  typedef typename DisplacementFieldType::PixelType DispVectorType;
-
-
-  typedef itk::ImageRegionIteratorWithIndex<DisplacementFieldType> FieldIterator;
-
-  typedef typename DisplacementFieldType::IndexType DispIndexType;
-
   typedef itk::VectorLinearInterpolateImageFunction<DisplacementFieldType, TReal>   DefaultInterpolatorType;
   typename DefaultInterpolatorType::Pointer vinterp =  DefaultInterpolatorType::New();
   vinterp->SetInputImage(field);
   //    vinterp->SetParameters(NULL,1);
 
-  VPointType pointIn1;
-  VPointType pointIn2;
-  typename DefaultInterpolatorType::ContinuousIndexType  contind;   // married to pointIn2
-  VPointType   pointIn3;
-  unsigned int ct = 0;
   // iterate through fieldtowarpby finding the points that it maps to via field.
   // then take the difference from the original point and put it in the output field.
-  //      std::cout << " begin iteration " << std::endl;
-  FieldIterator m_FieldIter( fieldtowarpby, fieldtowarpby->GetLargestPossibleRegion() );
-  for(  m_FieldIter.GoToBegin(); !m_FieldIter.IsAtEnd(); ++m_FieldIter )
+  typedef ANTSImageRegistrationOptimizerFunctor::ComposeFunctor<DisplacementFieldType, DefaultInterpolatorType,
+                                                                TReal> ComposeFunctorType;
+  ComposeFunctorType functor;
+  functor.m_FieldToWarpBy = fieldtowarpby;
+  functor.m_Interpolator = vinterp;
+  functor.m_FieldOut = fieldout;
+  functor.m_Region = this->GetActiveRegion( fieldtowarpby );
+  functor.m_TimeSign = timesign;
+
+  const SizeValueType numberOfSlabs = functor.m_Region.GetSize()[ImageDimension - 1];
+  if( field == fieldout )
+    {
+    // field is interpolated while it is being overwritten, so the result
+    // depends on the order of the voxels: keep the serial raster order
+    functor( 0, numberOfSlabs, 0 );
+    }
+  else
     {
-    DispIndexType index = m_FieldIter.GetIndex();
-    bool          dosample = true;
-    //      if (sub && m_TRealImage->GetPixel(index) < 0.5) dosample=false;
-    if( dosample )
-      {
-      fieldtowarpby->TransformIndexToPhysicalPoint( index, pointIn1 );
-      DispVectorType disp = m_FieldIter.Get();
-      for( unsigned int jj = 0; jj < ImageDimension; jj++ )
-        {
-        pointIn2[jj] = disp[jj] + pointIn1[jj];
-        }
-      typename DefaultInterpolatorType::OutputType disp2;
-      if( vinterp->IsInsideBuffer(pointIn2) )
-        {
-        disp2 = vinterp->Evaluate( pointIn2 );
-        }
-      else
-        {
-        disp2.Fill(0);
-        }
-      for( unsigned int jj = 0; jj < ImageDimension; jj++ )
-        {
-        pointIn3[jj] = disp2[jj] * timesign + pointIn2[jj];
-        }
-
-      DispVectorType out;
-      for( unsigned int jj = 0; jj < ImageDimension; jj++ )
-        {
-        out[jj] = pointIn3[jj] - pointIn1[jj];
-        }
-
-      fieldout->SetPixel(m_FieldIter.GetIndex(), out);
-      ct++;
-      } // endif
-    }   // end iteration
+    ::ants::ParallelizeRange( 0, numberOfSlabs, functor );
+    }
 }
 
 template <unsigned int TDimension, class TReal>
@@ -537,6 +781,68 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
   return diffmap;
 }
 
+template <unsigned int TDimension, class TReal>
+bool
+ANTSImageRegistrationOptimizer<TDimension, TReal>
+::ComputeActiveRegion(ImagePointer mask, DisplacementFieldPointer field)
+{
+  if( !mask )
+    {
+    return false;
+    }
+
+  // the voxels ComputeUpdateField samples
+  typename ImageType::IndexType lower;
+  typename ImageType::IndexType upper;
+  lower.Fill( NumericTraits<IndexValueType>::max() );
+  upper.Fill( NumericTraits<IndexValueType>::NonpositiveMin() );
+  bool found = false;
+
+  typedef ImageRegionConstIteratorWithIndex<ImageType> MaskIterator;
+  MaskIterator mIter( mask, mask->GetLargestPossibleRegion() );
+  for( mIter.GoToBegin(); !mIter.IsAtEnd(); ++mIter )
+    {
+    if( mIter.Get() >= 0.1 )
+      {
+      const typename ImageType::IndexType index = mIter.GetIndex();
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        lower[d] = std::min( lower[d], index[d] );
+        upper[d] = std::max( upper[d], index[d] );
+        }
+      found = true;
+      }
+    }
+  if( !found )
+    {
+    return false;
+    }
+
+  // the smoothed update reaches about three standard deviations beyond the
+  // mask; the padding is added on top of that
+  const TReal gradSmoothingSigma = sqrt( std::max( this->m_GradSmoothingparam, static_cast<TReal>( 0 ) ) );
+  typename ImageType::SizeType padding;
+  padding.Fill( this->m_MaskRegionPadding + static_cast<SizeValueType>( 3 * gradSmoothingSigma ) + 1 );
+
+  typename ImageType::RegionType region;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    region.SetIndex( d, lower[d] );
+    region.SetSize( d, static_cast<SizeValueType>( upper[d] - lower[d] + 1 ) );
+    }
+  region.PadByRadius( padding );
+  if( !region.Crop( field->GetLargestPossibleRegion() ) )
+    {
+    return false;
+    }
+  this->m_ActiveRegion = region;
+  if( this->m_Debug )
+    {
+    std::cout << " active region " << this->m_ActiveRegion << std::endl;
+    }
+  return true;
+}
+
 template <unsigned int TDimension, class TReal>
 typename ANTSImageRegistrationOptimizer<TDimension, TReal>::DisplacementFieldPointer
 ANTSImageRegistrationOptimizer<TDimension, TReal>
@@ -561,6 +867,11 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
     {
     std::cout << " NO F WARP " << std::endl;  fixedwarp = this->m_DisplacementField;
     }
+  if( this->m_UseActiveRegion )
+    {
+    // a greedy SyN update restricted to the mask
+    this->m_UseActiveRegion = this->ComputeActiveRegion( mask, fixedwarp );
+    }
   // if ( !movingwarp) std::cout<< " NO M WARP " << std::endl;
 
   // /     std::cout << " get upd field " << std::endl;
@@ -715,12 +1026,14 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
     typename FaceListType::iterator fIt = faceList.begin();
     globalData = df->GetGlobalDataPointer();
 
-    // Process the non-boundary region.
-    NeighborhoodIteratorType nD(radius, updateField, *fIt);
-    UpdateIteratorType       nU(updateField,  *fIt);
+    // Process the non-boundary region, or its part in the active region.
+    typename ImageType::RegionType updateRegion = *fIt;
+    const bool                     hasUpdateRegion = updateRegion.Crop( this->GetActiveRegion( updateField ) );
+    NeighborhoodIteratorType       nD(radius, updateField, updateRegion);
+    UpdateIteratorType             nU(updateField,  updateRegion);
     nD.GoToBegin();
     nU.GoToBegin();
-    while( !nD.IsAtEnd() )
+    while( hasUpdateRegion && !nD.IsAtEnd() )
       {
       bool  oktosample = true;
       TReal maskprob = 1.0;
@@ -767,7 +1080,7 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
         restrict = true;
         }
       }
-    if( restrict && this->m_RestrictDeformation.size() == ImageDimension )
+    if( hasUpdateRegion && restrict && this->m_RestrictDeformation.size() == ImageDimension )
       {
       nU.GoToBegin();
       while( !nU.IsAtEnd() )
@@ -872,7 +1185,7 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
     */
     // normalize update field then add to total field
     typedef ImageRegionIteratorWithIndex<DisplacementFieldType> Iterator;
-    Iterator      dIter(totalUpdateField, totalUpdateField->GetLargestPossibleRegion() );
+    Iterator      dIter(totalUpdateField, this->GetActiveRegion( totalUpdateField ) );
     TReal         mag = 0.0;
     TReal         max = 0.0;
     unsigned long ct = 0;
@@ -960,7 +1273,7 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
 
     if( totalUpdateInvField )
       {
-      Iterator invDIter(totalUpdateInvField, totalUpdateInvField->GetLargestPossibleRegion() );
+      Iterator invDIter(totalUpdateInvField, this->GetActiveRegion( totalUpdateInvField ) );
       mag = 0.0;
       max = 0.0;
       ct = 0;
@@ -1718,7 +2031,9 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
     wfpoints = this->WarpMultiTransform(this->m_ReferenceSpaceImage, fixedImage, fpoints,  ITK_NULLPTR, this->m_SyNF, false,
                                         this->m_FixedImageAffineTransform  );
     }
-  // syncom
+  // syncom; with --restrict-to-mask-region, ComputeUpdateField sets the
+  // active region that the rest of this update is computed in
+  this->m_UseActiveRegion = this->m_RestrictToMaskRegion;
   totalUpdateField =
     this->ComputeUpdateField(this->m_SyNMInv, this->m_SyNFInv, wfpoints, wmpoints, totalUpdateInvField);
 
@@ -1735,6 +2050,7 @@ ANTSImageRegistrationOptimizer<TDimension, TReal>
   this->InvertField(this->m_SyNM, this->m_SyNMInv);
   this->InvertField(this->m_SyNFInv, this->m_SyNF);
   this->InvertField(this->m_SyNMInv, this->m_SyNM);
+  this->m_UseActiveRegion = false;
 
 //      std::cout <<  " F " << this->MeasureDeformation(this->m_SyNF) << " F1 " <<
 // this->MeasureDeformation(this->m_SyNFInv) << std::endl;
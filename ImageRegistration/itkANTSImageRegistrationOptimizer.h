@@ -156,6 +156,21 @@ public:
     this->m_MaskImage = m;
   }
 
+  /** Restrict the greedy SyN update to the bounding box of the mask, padded by
+   *  MaskRegionPadding voxels beyond the reach of the gradient smoothing.
+   *  Experimental, and only approximate: smoothing, composition and
+   *  inversion outside of the box are skipped, so the warp near its edge differs from the
+   *  unrestricted one. */
+  void SetRestrictToMaskRegion( bool b )
+  {
+    this->m_RestrictToMaskRegion = b;
+  }
+
+  void SetMaskRegionPadding( unsigned int p )
+  {
+    this->m_MaskRegionPadding = p;
+  }
+
   void SetReferenceSpaceImage( ImagePointer m)
   {
     this->m_ReferenceSpaceImage = m;
@@ -332,6 +347,9 @@ public:
   void SmoothDisplacementFieldGauss(DisplacementFieldPointer field = NULL, TReal sig = 0.0, bool useparamimage = false,
                                     unsigned int lodim = ImageDimension);
 
+  void SmoothDisplacementFieldGaussInRegion(DisplacementFieldPointer field, TReal sig, unsigned int lodim,
+                                            const typename ImageType::RegionType & region);
+
 //  TReal = smoothingparam, int = maxdim to smooth
   void SmoothVelocityGauss(TimeVaryingVelocityFieldPointer field, TReal, unsigned int);
 
@@ -348,6 +366,28 @@ public:
                                               PointSetPointer  fpoints = NULL,  PointSetPointer wpoints = NULL,
                                               DisplacementFieldPointer updateFieldInv = NULL, bool updateenergy = true);
 
+  /** Sets the active region to the bounding box of the voxels of mask, which
+   *  shares the grid of field, that are sampled by ComputeUpdateField.
+   *  Returns false if there is no such voxel. */
+  bool ComputeActiveRegion(ImagePointer mask, DisplacementFieldPointer field);
+
+  /** The region of field that the greedy SyN update visits: the active region
+   *  while SyNRegistrationUpdate runs restricted to the mask, the whole field
+   *  otherwise. */
+  typename ImageType::RegionType GetActiveRegion(DisplacementFieldPointer field) const
+  {
+    typename ImageType::RegionType region = field->GetLargestPossibleRegion();
+    if( this->m_UseActiveRegion )
+      {
+      typename ImageType::RegionType activeRegion = this->m_ActiveRegion;
+      if( activeRegion.Crop( region ) )
+        {
+        return activeRegion;
+        }
+      }
+    return region;
+  }
+
   TimeVaryingVelocityFieldPointer ExpandVelocity()
   {
     float expandFactors[ImageDimension + 1];
@@ -849,6 +889,26 @@ public:
         }
       }
 
+    typename OptionType::Pointer maskRegionOption = this->m_Parser->GetOption( "restrict-to-mask-region" );
+    if( maskRegionOption && maskRegionOption->GetNumberOfFunctions() )
+      {
+      if( maskRegionOption->GetFunction( 0 )->GetNumberOfParameters() == 0 )
+        {
+        this->m_RestrictToMaskRegion = this->m_Parser->template Convert<bool>(
+            maskRegionOption->GetFunction( 0 )->GetName() );
+        }
+      else
+        {
+        this->m_RestrictToMaskRegion = this->m_Parser->template Convert<bool>(
+            maskRegionOption->GetFunction( 0 )->GetParameter( 0 ) );
+        if( maskRegionOption->GetFunction( 0 )->GetNumberOfParameters() > 1 )
+          {
+          this->m_MaskRegionPadding = this->m_Parser->template Convert<unsigned int>(
+              maskRegionOption->GetFunction( 0 )->GetParameter( 1 ) );
+          }
+        }
+      }
+
     typename ParserType::OptionType::Pointer oOption = this->m_Parser->GetOption( "output-naming" );
     if( oOption->GetNumberOfFunctions() )
       {
@@ -1863,7 +1923,11 @@ public:
       scale = 1.0;
       }
 //    TReal initscale=scale;
-    Iterator vfIter( inverseField, inverseField->GetLargestPossibleRegion() );
+    // only the active region is inverted.  Outside of it both fields keep
+    // their values, which are not the identity once an earlier update has
+    // reached there, so near the border of the region the inverse matches the
+    // unrestricted one only approximately
+    Iterator vfIter( inverseField, this->GetActiveRegion( inverseField ) );
 
 //  int num=10;
 //  for (int its=0; its<num; its++)
@@ -2126,6 +2190,10 @@ private:
   typename ParserType::Pointer m_Parser;
   SimilarityMetricListType  m_SimilarityMetrics;
   ImagePointer              m_MaskImage;
+  bool                      m_RestrictToMaskRegion;
+  unsigned int              m_MaskRegionPadding;
+  bool                      m_UseActiveRegion;
+  typename ImageType::RegionType m_ActiveRegion;
   ImagePointer              m_ReferenceSpaceImage;
   TReal                     m_ScaleFactor;
   bool                      m_UseMulti;
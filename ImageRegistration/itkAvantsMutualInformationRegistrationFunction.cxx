@@ -14,7 +14,10 @@
 #ifndef _itkAvantsMutualInformationRegistrationFunction_hxx
 #define _itkAvantsMutualInformationRegistrationFunction_hxx
 
+#include <algorithm>
+
 #include "antsAllocImage.h"
+#include "antsParallelizeRange.h"
 #include "itkAvantsMutualInformationRegistrationFunction.h"
 #include "itkBSplineInterpolateImageFunction.h"
 #include "itkCovariantVector.h"
@@ -23,11 +26,108 @@
 #include "itkImageRegionIterator.h"
 #include "itkImageIterator.h"
 #include "vnl/vnl_math.h"
-#include "itkDiscreteGaussianImageFilter.h"
+#include "itkGaussianOperator.h"
 #include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMath.h"
 
 namespace itk
 {
+namespace AvantsMutualInformationFunctor
+{
+/**
+ * Bins the (fixed, moving) intensity pairs of a range of fixed image buffer
+ * offsets into the flat joint histogram of the calling thread, for
+ * ::ants::ParallelizeRange.  The bin of a pair is the rounded continuous
+ * index of its joint PDF point, with the same arithmetic as
+ * JointPDFType::TransformPhysicalPointToIndex.  When the moving image and
+ * the mask share the buffered region of the fixed image they are read by
+ * buffer offset, otherwise by index.
+ */
+template <class TFunction>
+class JointHistogramFunctor
+{
+public:
+  typedef typename TFunction::FixedImageType  FixedImageType;
+  typedef typename TFunction::MovingImageType MovingImageType;
+  typedef typename TFunction::JointPDFType    JointPDFType;
+  typedef typename FixedImageType::IndexType  IndexType;
+  typedef typename FixedImageType::PixelType  FixedPixelType;
+  typedef typename MovingImageType::PixelType MovingPixelType;
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType threadId )
+  {
+    SizeValueType *         histogram = &( this->m_Histograms[threadId][0] );
+    const long              lastBin = static_cast<long>( this->m_NumberOfHistogramBins ) - 1;
+    const FixedPixelType *  fixedBuffer = this->m_FixedImage->GetBufferPointer();
+    const MovingPixelType * movingBuffer = this->m_MovingImage->GetBufferPointer();
+    const FixedPixelType *  maskBuffer = this->m_Mask ? this->m_Mask->GetBufferPointer() : ITK_NULLPTR;
+
+    for( SizeValueType i = begin; i < end; i++ )
+      {
+      double fixedImageValue;
+      double movingImageValue;
+      if( this->m_SharedBuffer )
+        {
+        if( maskBuffer && maskBuffer[i] < 1.e-6 )
+          {
+          continue;
+          }
+        fixedImageValue = static_cast<double>( fixedBuffer[i] );
+        movingImageValue = static_cast<double>( movingBuffer[i] );
+        }
+      else
+        {
+        const IndexType index = this->m_FixedImage->ComputeIndex( static_cast<OffsetValueType>( i ) );
+        if( this->m_Mask && this->m_Mask->GetPixel( index ) < 1.e-6 )
+          {
+          continue;
+          }
+        fixedImageValue = static_cast<double>( fixedBuffer[i] );
+        movingImageValue = static_cast<double>( this->m_MovingImage->GetPixel( index ) );
+        }
+
+      double point[2];
+      point[0] = ( fixedImageValue - this->m_FixedImageTrueMin ) / ( this->m_FixedImageTrueMax - this->m_FixedImageTrueMin );
+      point[1] = ( movingImageValue - this->m_MovingImageTrueMin )
+        / ( this->m_MovingImageTrueMax - this->m_MovingImageTrueMin );
+
+      long bin[2];
+      for( unsigned int r = 0; r < 2; r++ )
+        {
+        double sum = 0.0;
+        for( unsigned int c = 0; c < 2; c++ )
+          {
+          sum += this->m_PhysicalPointToIndex[r][c] * ( point[c] - this->m_Origin[c] );
+          }
+        bin[r] = Math::RoundHalfIntegerUp<long>( sum );
+        if( bin[r] < 0 )
+          {
+          bin[r] = 0;
+          }
+        else if( bin[r] > lastBin )
+          {
+          bin[r] = lastBin;
+          }
+        }
+      ++histogram[bin[1] * this->m_NumberOfHistogramBins + bin[0]];
+      }
+  }
+
+  const FixedImageType *                   m_FixedImage;
+  const MovingImageType *                  m_MovingImage;
+  const FixedImageType *                   m_Mask;
+  bool                                     m_SharedBuffer;
+  double                                   m_FixedImageTrueMin;
+  double                                   m_FixedImageTrueMax;
+  double                                   m_MovingImageTrueMin;
+  double                                   m_MovingImageTrueMax;
+  typename JointPDFType::PointType         m_Origin;
+  typename JointPDFType::DirectionType     m_PhysicalPointToIndex;
+  SizeValueType                            m_NumberOfHistogramBins;
+  std::vector<std::vector<SizeValueType> > m_Histograms;
+};
+} // end namespace AvantsMutualInformationFunctor
+
 /**
  * Constructor
  */
@@ -268,6 +368,8 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
   origin[0] = this->m_JointPDFSpacing[0] * (double)this->m_Padding * (-1.0);
   origin[1] = origin[0];
   this->m_JointPDF->SetOrigin(origin);
+  this->m_JointPDFOrigin = this->m_JointPDF->GetOrigin();
+  this->m_JointPDFPhysicalPointToIndex = this->m_JointPDF->GetPhysicalPointToIndex();
 
   // Instantiate a region, index, size
   typedef typename MarginalPDFType::RegionType MarginalPDFRegionType;
@@ -316,6 +418,7 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
   pdfinterpolator->SetInputImage(m_JointPDF);
   pdfinterpolator2->SetInputImage(m_FixedImageMarginalPDF);
   pdfinterpolator3->SetInputImage(m_MovingImageMarginalPDF);
+  this->ComputeJointPDFTables();
   /*  pdfinterpolator->SetSplineOrder(3);
   pdfinterpolator2->SetSplineOrder(3);
   pdfinterpolator3->SetSplineOrder(3);
@@ -330,51 +433,42 @@ void
 AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
 ::GetProbabilities()
 {
-  typedef ImageRegionConstIteratorWithIndex<FixedImageType> RandomIterator;
-  RandomIterator randIter( this->m_FixedImage, this->m_FixedImage->GetLargestPossibleRegion() );
   this->m_FixedImageMarginalPDF->FillBuffer(0);
   this->m_MovingImageMarginalPDF->FillBuffer(0);
 
-  // Reset the joint pdfs to zero
-  m_JointPDF->FillBuffer( 0.0 );
-
-  unsigned long  nSamples = 0;
-  RandomIterator iter( this->m_FixedImage, this->m_FixedImage->GetLargestPossibleRegion() );
-  for( iter.GoToBegin(); !iter.IsAtEnd(); ++iter )
+  // Bin the fixed image into one flat joint histogram per thread
+  typedef AvantsMutualInformationFunctor::JointHistogramFunctor<Self> HistogramFunctorType;
+  HistogramFunctorType histogramFunctor;
+  histogramFunctor.m_FixedImage = this->m_FixedImage;
+  histogramFunctor.m_MovingImage = this->m_MovingImage;
+  histogramFunctor.m_Mask = this->m_FixedImageMask;
+  const typename FixedImageType::RegionType & bufferedRegion = this->m_FixedImage->GetBufferedRegion();
+  histogramFunctor.m_SharedBuffer = ( this->m_MovingImage->GetBufferedRegion() == bufferedRegion )
+    && ( !this->m_FixedImageMask || this->m_FixedImageMask->GetBufferedRegion() == bufferedRegion );
+  histogramFunctor.m_FixedImageTrueMin = this->m_FixedImageTrueMin;
+  histogramFunctor.m_FixedImageTrueMax = this->m_FixedImageTrueMax;
+  histogramFunctor.m_MovingImageTrueMin = this->m_MovingImageTrueMin;
+  histogramFunctor.m_MovingImageTrueMax = this->m_MovingImageTrueMax;
+  histogramFunctor.m_Origin = this->m_JointPDFOrigin;
+  histogramFunctor.m_PhysicalPointToIndex = this->m_JointPDFPhysicalPointToIndex;
+  histogramFunctor.m_NumberOfHistogramBins = this->m_NumberOfHistogramBins;
+
+  const SizeValueType numberOfBins = this->m_NumberOfHistogramBins * this->m_NumberOfHistogramBins;
+  const SizeValueType numberOfVoxels = bufferedRegion.GetNumberOfPixels();
+  const ThreadIdType  numberOfThreads = ::ants::GetNumberOfThreadsForRange( numberOfVoxels );
+  histogramFunctor.m_Histograms.assign( numberOfThreads, std::vector<SizeValueType>( numberOfBins, 0 ) );
+  ::ants::ParallelizeRange( 0, numberOfVoxels, histogramFunctor, numberOfThreads );
+
+  // Merge the thread histograms in thread order
+  PDFValueType * jointPDF = m_JointPDF->GetBufferPointer();
+  for( SizeValueType k = 0; k < numberOfBins; k++ )
     {
-    bool takesample = true;
-    if( this->m_FixedImageMask )
-      {
-      if( this->m_FixedImageMask->GetPixel( iter.GetIndex() ) < 1.e-6 )
-        {
-        takesample = false;
-        }
-      }
-
-    if( takesample )
-      {
-      // Get sampled index
-      FixedImageIndexType index = iter.GetIndex();
-/*    bool inimage=true;
-    for (unsigned int dd=0; dd<ImageDimension; dd++)
+    SizeValueType count = 0;
+    for( ThreadIdType t = 0; t < numberOfThreads; t++ )
       {
-        if ( index[dd] < 1 ||    index[dd] >= static_cast<typename IndexType::IndexValueType>(imagesize[dd]-1) )
-          inimage=false;
-      }
-*/
-      double movingImageValue = this->GetMovingParzenTerm(  this->m_MovingImage->GetPixel( index )  );
-      double fixedImageValue = this->GetFixedParzenTerm(  this->m_FixedImage->GetPixel( index )  );
-
-      /** add the paired intensity points to the joint histogram */
-      JointPDFPointType jointPDFpoint;
-      this->ComputeJointPDFPoint(fixedImageValue, movingImageValue, jointPDFpoint);
-      JointPDFIndexType jointPDFIndex;
-      jointPDFIndex.Fill(0);
-      this->m_JointPDF->TransformPhysicalPointToIndex(jointPDFpoint, jointPDFIndex);
-      this->m_JointPDF->SetPixel(jointPDFIndex, this->m_JointPDF->GetPixel(jointPDFIndex) + 1);
-
-      ++nSamples;
+      count += histogramFunctor.m_Histograms[t][k];
       }
+    jointPDF[k] = static_cast<PDFValueType>( count );
     }
 
   /**
@@ -411,14 +505,7 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
   bool smoothjh = true;
   if( smoothjh )
     {
-    typedef DiscreteGaussianImageFilter<JointPDFType, JointPDFType> dgtype;
-    typename dgtype::Pointer dg = dgtype::New();
-    dg->SetInput(this->m_JointPDF);
-    dg->SetVariance(1.5);
-    dg->SetUseImageSpacingOff();
-    dg->SetMaximumError(.01f);
-    dg->Update();
-    this->m_JointPDF = dg->GetOutput();
+    this->SmoothJointPDF();
     }
 
   // Compute moving image marginal PDF by summing over fixed image bins.
@@ -464,6 +551,106 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
     }
 }
 
+/**
+ * Smooth the joint PDF with a separable Gaussian kernel
+ */
+template <class TFixedImage, class TMovingImage, class TDisplacementField>
+void
+AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
+::SmoothJointPDF()
+{
+  // The kernel DiscreteGaussianImageFilter builds for these settings
+  typedef GaussianOperator<double, 1> GaussianOperatorType;
+  GaussianOperatorType gaussian;
+  gaussian.SetVariance( 1.5 );
+  gaussian.SetMaximumError( .01f );
+  gaussian.SetMaximumKernelWidth( 32 );
+  gaussian.CreateDirectional();
+
+  const long          radius = static_cast<long>( gaussian.GetRadius( 0 ) );
+  const unsigned long kernelSize = gaussian.Size();
+  std::vector<double> kernel( kernelSize );
+  for( unsigned long k = 0; k < kernelSize; k++ )
+    {
+    kernel[k] = gaussian[k];
+    }
+
+  // Filter the moving axis first and the fixed axis second, accumulating in
+  // double with zero flux Neumann borders as the filter pipeline does.
+  const long     nbins = static_cast<long>( this->m_NumberOfHistogramBins );
+  PDFValueType * jointPDF = m_JointPDF->GetBufferPointer();
+
+  std::vector<double> smoothed( nbins * nbins );
+  for( long y = 0; y < nbins; y++ )
+    {
+    for( long x = 0; x < nbins; x++ )
+      {
+      double sum = 0.0;
+      for( long k = 0; k < static_cast<long>( kernelSize ); k++ )
+        {
+        const long yy = std::min( std::max( y + k - radius, 0L ), nbins - 1 );
+        sum += kernel[k] * static_cast<double>( jointPDF[yy * nbins + x] );
+        }
+      smoothed[y * nbins + x] = sum;
+      }
+    }
+  for( long y = 0; y < nbins; y++ )
+    {
+    const double * row = &( smoothed[y * nbins] );
+    for( long x = 0; x < nbins; x++ )
+      {
+      double sum = 0.0;
+      for( long k = 0; k < static_cast<long>( kernelSize ); k++ )
+        {
+        const long xx = std::min( std::max( x + k - radius, 0L ), nbins - 1 );
+        sum += kernel[k] * row[xx];
+        }
+      jointPDF[y * nbins + x] = static_cast<PDFValueType>( sum );
+      }
+    }
+}
+
+/**
+ * Tabulate the joint PDF and its derivatives
+ */
+template <class TFixedImage, class TMovingImage, class TDisplacementField>
+void
+AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplacementField>
+::ComputeJointPDFTables()
+{
+  const SizeValueType  nbins = this->m_NumberOfHistogramBins;
+  const PDFValueType * jointPDF = m_JointPDF->GetBufferPointer();
+
+  this->m_JointPDFTable.assign( jointPDF, jointPDF + nbins * nbins );
+
+  // ComputeJointPDFDerivative differences the bilinear joint PDF half a bin
+  // to each side, so along its axis it is linear between half bin samples
+  // and across it linear between bin samples.  Away from the clamped ends
+  // of the intensity range the tables therefore reproduce it exactly (see
+  // EvaluateJointPDFDerivative).
+  for( unsigned int ind = 0; ind < 2; ind++ )
+    {
+    SizeValueType * size = this->m_JointPDFDerivativeTableSize[ind];
+    size[ind] = 2 * nbins - 1;
+    size[1 - ind] = nbins;
+
+    std::vector<double> & table = this->m_JointPDFDerivativeTable[ind];
+    table.resize( size[0] * size[1] );
+    for( SizeValueType j = 0; j < size[1]; j++ )
+      {
+      for( SizeValueType i = 0; i < size[0]; i++ )
+        {
+        ContinuousIndex<double, 2> cindex;
+        cindex[0] = ( ind == 0 ) ? 0.5 * i : static_cast<double>( i );
+        cindex[1] = ( ind == 1 ) ? 0.5 * j : static_cast<double>( j );
+        JointPDFPointType point;
+        m_JointPDF->TransformContinuousIndexToPhysicalPoint( cindex, point );
+        table[j * size[0] + i] = this->ComputeJointPDFDerivative( point, 0, ind );
+        }
+      }
+    }
+}
+
 /**
  * Get the both Value and Derivative Measure
  */
@@ -484,8 +671,11 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
 
   JointPDFPointType pdfind;
   this->ComputeJointPDFPoint(fixedImageValue, movingImageValue, pdfind);
-  const double jointPDFValue = pdfinterpolator->Evaluate(pdfind);
-  const double dJPDF = this->ComputeJointPDFDerivative( pdfind, 0, 0 );
+  double cindex[2];
+  this->ComputeJointPDFContinuousIndex( pdfind, cindex );
+  const SizeValueType pdfSize[2] = { m_NumberOfHistogramBins, m_NumberOfHistogramBins };
+  const double        jointPDFValue = EvaluateJointPDFTable( m_JointPDFTable, pdfSize, cindex[0], cindex[1] );
+  const double        dJPDF = this->EvaluateJointPDFDerivative( pdfind, cindex, 0 );
 
   typename   pdfintType2::ContinuousIndexType  mind;
   mind[0] = pdfind[0];
@@ -524,8 +714,11 @@ AvantsMutualInformationRegistrationFunction<TFixedImage, TMovingImage, TDisplace
 
   JointPDFPointType pdfind;
   this->ComputeJointPDFPoint(fixedImageValue, movingImageValue, pdfind);
-  const double jointPDFValue = pdfinterpolator->Evaluate(pdfind);
-  const double dJPDF = this->ComputeJointPDFDerivative( pdfind, 0, 1 );
+  double cindex[2];
+  this->ComputeJointPDFContinuousIndex( pdfind, cindex );
+  const SizeValueType pdfSize[2] = { m_NumberOfHistogramBins, m_NumberOfHistogramBins };
+  const double        jointPDFValue = EvaluateJointPDFTable( m_JointPDFTable, pdfSize, cindex[0], cindex[1] );
+  const double        dJPDF = this->EvaluateJointPDFDerivative( pdfind, cindex, 1 );
 
   typename   pdfintType2::ContinuousIndexType  mind;
   mind[0] = pdfind[1];
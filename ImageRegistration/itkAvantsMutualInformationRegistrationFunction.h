@@ -15,6 +15,7 @@
 #define __itkAvantsMutualInformationRegistrationFunction_h
 #include <vcl_compiler.h>
 #include <iostream>
+#include <vector>
 #include "cmath"
 #include "itkImageFileWriter.h"
 #include "itkImageToImageMetric.h"
@@ -315,6 +316,85 @@ public:
 
   void GetProbabilities();
 
+  /** Smooths the normalized joint PDF in place with the separable kernel of
+   *  DiscreteGaussianImageFilter (variance 1.5 bins, maximum error .01). */
+  void SmoothJointPDF();
+
+  /** Tabulates the joint PDF and its finite difference derivatives along
+   *  both axes for the per-voxel lookups of the gradient path. */
+  void ComputeJointPDFTables();
+
+  /** The continuous joint PDF index of a joint PDF point, computed like
+   *  JointPDFType::TransformPhysicalPointToContinuousIndex. */
+  inline void ComputeJointPDFContinuousIndex( const JointPDFPointType & jointPDFpoint, double cindex[2] ) const
+  {
+    for( unsigned int r = 0; r < 2; r++ )
+      {
+      double sum = 0.0;
+      for( unsigned int c = 0; c < 2; c++ )
+        {
+        sum += this->m_JointPDFPhysicalPointToIndex[r][c] * ( jointPDFpoint[c] - this->m_JointPDFOrigin[c] );
+        }
+      cindex[r] = sum;
+      }
+  }
+
+  /** ComputeJointPDFDerivative at a joint PDF point with continuous index
+   *  cindex.  Within the intensity range the derivative tables are exact;
+   *  near the ends, where the finite difference is clamped, it is evaluated
+   *  directly. */
+  inline double EvaluateJointPDFDerivative( const JointPDFPointType & jointPDFpoint, const double cindex[2],
+                                            unsigned int ind )
+  {
+    const double c = cindex[ind];
+    if( c >= this->m_Padding + 1.5 && c <= this->m_NumberOfHistogramBins - this->m_Padding - 1.5 )
+      {
+      const double x = ( ind == 0 ) ? 2.0 * cindex[0] : cindex[0];
+      const double y = ( ind == 1 ) ? 2.0 * cindex[1] : cindex[1];
+      return EvaluateJointPDFTable( this->m_JointPDFDerivativeTable[ind], this->m_JointPDFDerivativeTableSize[ind],
+                                    x, y );
+      }
+    return this->ComputeJointPDFDerivative( jointPDFpoint, 0, ind );
+  }
+
+  /** Bilinear lookup in one of the joint PDF tables.  The table holds
+   *  size[0] x size[1] samples with the first axis varying fastest;
+   *  coordinates outside the table are clamped to its border. */
+  static inline double EvaluateJointPDFTable( const std::vector<double> & table, const SizeValueType size[2],
+                                              double x, double y )
+  {
+    const double coordinate[2] = { x, y };
+    SizeValueType base[2];
+    double        weight[2];
+
+    for( unsigned int d = 0; d < 2; d++ )
+      {
+      const double upper = static_cast<double>( size[d] - 1 );
+      double       c = coordinate[d];
+      if( !( c > 0.0 ) )
+        {
+        c = 0.0;
+        }
+      else if( c > upper )
+        {
+        c = upper;
+        }
+      base[d] = static_cast<SizeValueType>( c );
+      if( base[d] + 1 >= size[d] )
+        {
+        base[d] = ( size[d] > 1 ) ? size[d] - 2 : 0;
+        }
+      weight[d] = c - static_cast<double>( base[d] );
+      }
+
+    const double * row0 = &( table[base[1] * size[0] + base[0]] );
+    const double * row1 = ( size[1] > 1 ) ? row0 + size[0] : row0;
+    const SizeValueType step = ( size[0] > 1 ) ? 1 : 0;
+    const double v0 = row0[0] + ( row0[step] - row0[0] ) * weight[0];
+    const double v1 = row1[0] + ( row1[step] - row1[0] ) * weight[0];
+    return v0 + ( v1 - v0 ) * weight[1];
+  }
+
   void ComputeJointPDFPoint( double fixedImageValue, double movingImageValue, JointPDFPointType& jointPDFpoint )
   {
     double a = (fixedImageValue - this->m_FixedImageTrueMin) / (this->m_FixedImageTrueMax - this->m_FixedImageTrueMin);
@@ -788,6 +868,17 @@ private:
 
   unsigned int        m_Padding;
   JointPDFSpacingType m_JointPDFSpacing;
+
+  /** Geometry of the joint PDF used by ComputeJointPDFContinuousIndex. */
+  JointPDFPointType                      m_JointPDFOrigin;
+  typename JointPDFType::DirectionType   m_JointPDFPhysicalPointToIndex;
+
+  /** The smoothed joint PDF and its derivatives along the fixed (0) and
+   *  moving (1) axes.  The derivative tables are sampled every half bin
+   *  along their own axis and every bin along the other one. */
+  std::vector<double> m_JointPDFTable;
+  std::vector<double> m_JointPDFDerivativeTable[2];
+  SizeValueType       m_JointPDFDerivativeTableSize[2][2];
 };
 } // end namespace itk
 
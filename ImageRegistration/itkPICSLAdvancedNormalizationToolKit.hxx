@@ -256,6 +256,17 @@ PICSLAdvancedNormalizationToolKit<TDimension, TReal>
       std::vector<int> mi_option = this->m_Parser->template ConvertVector<int>(temp);
       affine_opt.MI_bins = mi_option[0];
       affine_opt.MI_samples = mi_option[1];
+      temp = this->m_Parser->GetOption( "affine-seed-option" )->GetFunction( 0 )->GetName();
+      std::vector<int> seed_option = this->m_Parser->template ConvertVector<int>(temp);
+      affine_opt.number_of_seeds = seed_option[0];
+      if( seed_option.size() > 1 )
+        {
+        affine_opt.number_of_concurrent_seeds = seed_option[1];
+        }
+      if( seed_option.size() > 2 )
+        {
+        affine_opt.time_seed = static_cast<unsigned int>( seed_option[2] );
+        }
       temp = this->m_Parser->GetOption( "rigid-affine" )->GetFunction( 0 )->GetName();
       std::string temp2 = this->m_Parser->GetOption( "do-rigid" )->GetFunction( 0 )->GetName();
       affine_opt.is_rigid = (
@@ -958,6 +969,29 @@ PICSLAdvancedNormalizationToolKit<TDimension, TReal>
     this->m_Parser->AddOption( option );
     }
 
+  if( true )
+    {
+    std::string description =
+      std::string( "EXPERIMENTAL, APPROXIMATE: " )
+      + std::string( "compute the greedy SyN update only in the bounding box of " )
+      + std::string( "the mask, padded by the given number of voxels beyond the " )
+      + std::string( "reach of the gradient smoothing.  The metric gradient, the update " )
+      + std::string( "field, its smoothing, composition and inversion are " )
+      + std::string( "restricted to that box; the deformation outside of it is " )
+      + std::string( "left unchanged, so near the edge of the box the result differs " )
+      + std::string( "slightly from the unrestricted one.  The box is not grown " )
+      + std::string( "to follow the deformation, so use it only where the " )
+      + std::string( "deformation stays well inside the padding and check the " )
+      + std::string( "result against an unrestricted run.  Requires --mask-image. " );
+
+    OptionType::Pointer option = OptionType::New();
+    option->SetLongName( "restrict-to-mask-region" );
+    option->SetDescription( description );
+    option->SetUsageOption( 0, "1/(0)" );
+    option->SetUsageOption( 1, "[1/(0),<padding=10>]" );
+    this->m_Parser->AddOption( option );
+    }
+
   if( false )
     {
     OptionType::Pointer option = OptionType::New();
@@ -1370,6 +1404,17 @@ PICSLAdvancedNormalizationToolKit<TDimension, TReal>
     this->m_Parser->AddOption( option );
     }
 
+  if( true )
+    {
+    OptionType::Pointer option = OptionType::New();
+    option->SetLongName( "affine-seed-option" );
+    option->SetDescription(
+      "restart the affine optimization from randomly rotated initial positions and keep the best: number_of_seeds x number_of_concurrent_seeds x random_seed (default: 0x0, no restarts; 0 concurrent seeds uses all threads; the random seed defaults to the time)" );
+    std::string nitdefault = std::string("0x0");
+    option->AddFunction(nitdefault);
+    this->m_Parser->AddOption( option );
+    }
+
   if( true )
     {
     OptionType::Pointer option = OptionType::New();
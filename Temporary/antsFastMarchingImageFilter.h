@@ -22,8 +22,7 @@ Program:   Advanced Normalization Tools
 
 #include "vnl/vnl_math.h"
 
-#include <functional>
-#include <queue>
+#include <vector>
 
 namespace itk
 {
@@ -37,7 +36,7 @@ namespace itk
  *
  * Updates are preformed using an entropy satisfy scheme where only
  * "upwind" neighborhoods are used. This implementation of Fast Marching
- * uses a std::priority_queue to locate the next proper grid position to
+ * uses an indexed binary min-heap to locate the next proper grid position to
  * update.
  *
  * Fast Marching sweeps through N grid points in (N log N) steps to obtain
@@ -82,17 +81,16 @@ namespace itk
  * and SetOutputOrigin(). Else if the speed image is not NULL, the output information
  * is copied from the input speed image.
  *
- * Possible Improvements:
- * In the current implemenation, std::priority_queue only allows
- * taking nodes out from the front and putting nodes in from the back.
- * To update a value already on the heap, a new node is added to the heap.
- * The defunct old node is left on the heap. When it is removed from the
- * top, it will be recognized as invalid and not used.
- * Future implementations can implement the heap in a different way
- * allowing the values to be updated. This will generally require
- * some sift-up and sift-down functions and
- * an image of back-pointers going from the image to heap in order
- * to locate the node which is to be updated.
+ * Implementation notes:
+ * The trial heap keeps, for every voxel of the output buffer, its position
+ * in the heap, so that a new arrival time for a voxel already on the heap
+ * moves the existing entry (decrease-key) instead of leaving a stale copy
+ * behind.  Equal arrival times are popped in buffer order.  Voxels are
+ * addressed by their offset into the output buffer and neighbors are
+ * reached through the buffer offset table.  The topology checks encode the
+ * alive points of the 3x3 (2-D) or 3x3x3 (3-D) neighborhood as a bitmask
+ * and look the critical configurations up in tables built once in
+ * Initialize().
  *
  * \sa LevelSetTypeDefault
  * \ingroup LevelSetSegmentation
@@ -340,14 +338,13 @@ protected:
 
   virtual void Initialize( LevelSetImageType * );
 
-  virtual void UpdateNeighbors( const IndexType& index, const SpeedImageType *, LevelSetImageType * );
+  /** Voxels are passed both as an index and as their offset into the
+   * output buffer. */
+  virtual void UpdateNeighbors( const IndexType& index, OffsetValueType offset, const SpeedImageType *,
+                                LevelSetImageType * );
 
-  virtual double UpdateValue( const IndexType& index, const SpeedImageType *, LevelSetImageType * );
-
-  const AxisNodeType & GetNodeUsedInCalculation(unsigned int idx) const
-  {
-    return m_NodesUsed[idx];
-  }
+  virtual double UpdateValue( const IndexType& index, OffsetValueType offset, const SpeedImageType *,
+                              LevelSetImageType * );
 
   void GenerateData() ITK_OVERRIDE;
 
@@ -393,17 +390,42 @@ private:
   bool                m_OverrideOutputInformation;
 
   typename LevelSetImageType::PixelType         m_LargeValue;
-  AxisNodeType m_NodesUsed[SetDimension];
 
-  /** Trial points are stored in a min-heap. This allow efficient access
-   * to the trial point with minimum value which is the next grid point
-   * the algorithm processes. */
-  typedef std::vector<AxisNodeType>  HeapContainer;
-  typedef std::greater<AxisNodeType> NodeComparer;
-  typedef std::priority_queue<AxisNodeType, HeapContainer, NodeComparer>
-    HeapType;
+  /** Trial points are stored in an indexed min-heap. This allow efficient
+   * access to the trial point with minimum value which is the next grid
+   * point the algorithm processes, and in-place updates of trial values. */
+  struct HeapEntry
+    {
+    PixelType       Value;
+    OffsetValueType Offset;
+    };
+
+  bool HeapEntryLess( const HeapEntry & a, const HeapEntry & b ) const
+  {
+    return a.Value < b.Value || ( a.Value == b.Value && a.Offset < b.Offset );
+  }
+
+  void HeapPush( OffsetValueType offset, PixelType value );
+
+  HeapEntry HeapPop();
+
+  void HeapSiftUp( SizeValueType position );
 
-  HeapType m_TrialHeap;
+  void HeapSiftDown( SizeValueType position );
+
+  void HeapClear();
+
+  std::vector<HeapEntry> m_TrialHeap;
+
+  /** heap position of every voxel of the output buffer, or
+   *  NumericTraits<unsigned int>::max() if it is not on the heap */
+  std::vector<unsigned int> m_HeapPositions;
+
+  /** raw buffers and offset table of the current update */
+  PixelType *                             m_OutputBuffer;
+  unsigned char *                         m_LabelBuffer;
+  const typename SpeedImageType::PixelType * m_SpeedBuffer;
+  OffsetValueType                         m_OffsetTable[SetDimension];
 
   double m_NormalizationFactor;
 
@@ -415,7 +437,8 @@ private:
   // Functions/data for the 2-D case
   void InitializeIndices2D();
 
-  bool IsChangeWellComposed2D( IndexType );
+  bool IsChangeWellComposed2D( unsigned int aliveMask );
+
   bool IsCriticalC1Configuration2D( Array<short> );
 
   bool IsCriticalC2Configuration2D( Array<short> );
@@ -424,11 +447,11 @@ private:
 
   bool IsCriticalC4Configuration2D( Array<short> );
 
-  bool IsSpecialCaseOfC4Configuration2D(
-    PixelType, IndexType, IndexType, IndexType );
+  unsigned int m_RotationIndices[4][9];
+  unsigned int m_ReflectionIndices[2][9];
 
-  Array<unsigned int> m_RotationIndices[4];
-  Array<unsigned int> m_ReflectionIndices[2];
+  /** well-composedness of every 3x3 alive configuration */
+  std::vector<bool> m_WellComposedTable2D;
 
   // Functions/data for the 3-D case
   void InitializeIndices3D();
@@ -437,14 +460,30 @@ private:
 
   unsigned int IsCriticalC2Configuration3D( Array<short> );
 
-  bool IsChangeWellComposed3D( IndexType );
+  bool IsChangeWellComposed3D( unsigned int aliveMask );
 
-  Array<unsigned int> m_C1Indices[12];
-  Array<unsigned int> m_C2Indices[8];
+  unsigned int m_C1Indices[12][4];
+  unsigned int m_C2Indices[8][8];
+
+  /** criticality of every 4-voxel (C1) and 2x2x2 (C2) configuration */
+  bool m_C1Table3D[16];
+  bool m_C2Table3D[256];
 
   // Functions for both 2D/3D cases
-  bool DoesVoxelChangeViolateWellComposedness( IndexType );
-  bool DoesVoxelChangeViolateStrictTopology( IndexType );
+
+  /** Buffer offsets of the 3^SetDimension neighborhood of a voxel, in
+   * NeighborhoodIterator order; neighbors outside the buffer are clamped to
+   * the border as the zero-flux Neumann boundary condition would. */
+  void ComputeNeighborhoodOffsets( const IndexType & index, OffsetValueType offset,
+                                   OffsetValueType * neighbors ) const;
+
+  /** Bit n is set if neighbor n is an alive point. */
+  unsigned int ComputeAliveNeighborhoodMask( const OffsetValueType * neighbors ) const;
+
+  bool DoesVoxelChangeViolateWellComposedness( unsigned int aliveMask );
+  bool DoesVoxelChangeViolateStrictTopology( unsigned int aliveMask );
+
+  std::vector<OffsetValueType> m_NeighborhoodOffsets;
 };
 } // namespace itk
 
@@ -61,6 +61,10 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
 
   this->m_NormalizationFactor = 1.0;
   this->m_TopologyCheck = None;
+
+  this->m_OutputBuffer = ITK_NULLPTR;
+  this->m_LabelBuffer = ITK_NULLPTR;
+  this->m_SpeedBuffer = ITK_NULLPTR;
 }
 
 template <class TLevelSet, class TSpeedImage>
@@ -183,31 +187,27 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
     this->m_ConnectedComponentImage->SetDirection( output->GetDirection() );
     }
 
-  // set all output value to infinity
-  typedef ImageRegionIterator<LevelSetImageType>
-    OutputIterator;
-
-  OutputIterator outIt( output, output->GetBufferedRegion() );
+  // set all output value to infinity and all points type to FarPoint
+  output->FillBuffer( this->m_LargeValue );
+  this->m_LabelImage->FillBuffer( FarPoint );
 
-  PixelType outputPixel;
-  outputPixel = this->m_LargeValue;
-  for( outIt.GoToBegin(); !outIt.IsAtEnd(); ++outIt )
+  // all voxels are visited through their offset into the buffers
+  this->m_OutputBuffer = output->GetBufferPointer();
+  this->m_LabelBuffer = this->m_LabelImage->GetBufferPointer();
+  for( unsigned int d = 0; d < SetDimension; d++ )
     {
-    outIt.Set( outputPixel );
+    this->m_OffsetTable[d] = output->GetOffsetTable()[d];
     }
-
-  // set all points type to FarPoint
-  typedef ImageRegionIterator<LabelImageType> LabelIterator;
-
-  LabelIterator typeIt( this->m_LabelImage,
-                        this->m_LabelImage->GetBufferedRegion() );
-  for( typeIt.GoToBegin(); !typeIt.IsAtEnd(); ++typeIt )
+  this->m_SpeedBuffer = ITK_NULLPTR;
+  const SpeedImageType * speedImage = this->GetInput();
+  if( speedImage && speedImage->GetBufferedRegion() == this->m_BufferedRegion )
     {
-    typeIt.Set( FarPoint );
+    this->m_SpeedBuffer = speedImage->GetBufferPointer();
     }
 
   // process input alive points
   AxisNodeType node;
+  PixelType    outputPixel;
 
   if( this->m_AlivePoints )
     {
@@ -259,10 +259,9 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
     }
 
   // make sure the heap is empty
-  while( !this->m_TrialHeap.empty() )
-    {
-    this->m_TrialHeap.pop();
-    }
+  this->m_TrialHeap.clear();
+  this->m_HeapPositions.assign( this->m_BufferedRegion.GetNumberOfPixels(),
+                                NumericTraits<unsigned int>::max() );
 
   // process the input trial points
   if( this->m_TrialPoints )
@@ -291,7 +290,7 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
       outputPixel = node.GetValue();
       output->SetPixel( node.GetIndex(), outputPixel );
 
-      this->m_TrialHeap.push( node );
+      this->HeapPush( output->ComputeOffset( node.GetIndex() ), outputPixel );
       }
     }
 
@@ -311,6 +310,25 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
       itkExceptionMacro(
         "Topology checking is only valid for level set dimensions of 2 and 3" );
       }
+
+    // neighborhood offsets in NeighborhoodIterator order
+    unsigned int neighborhoodSize = 1;
+    for( unsigned int d = 0; d < SetDimension; d++ )
+      {
+      neighborhoodSize *= 3;
+      }
+    this->m_NeighborhoodOffsets.resize( neighborhoodSize );
+    for( unsigned int n = 0; n < neighborhoodSize; n++ )
+      {
+      OffsetValueType neighborOffset = 0;
+      unsigned int    k = n;
+      for( unsigned int d = 0; d < SetDimension; d++ )
+        {
+        neighborOffset += ( static_cast<OffsetValueType>( k % 3 ) - 1 ) * this->m_OffsetTable[d];
+        k /= 3;
+        }
+      this->m_NeighborhoodOffsets[n] = neighborOffset;
+      }
     }
 }
 
@@ -329,106 +347,109 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
     this->m_ProcessedPoints = NodeContainer::New();
     }
 
+  typedef typename ConnectedComponentImageType::PixelType ComponentType;
+  ComponentType * componentBuffer = ITK_NULLPTR;
+  if( this->m_TopologyCheck == NoHandles )
+    {
+    componentBuffer = this->m_ConnectedComponentImage->GetBufferPointer();
+    }
+  std::vector<OffsetValueType> neighbors( this->m_NeighborhoodOffsets.size() );
+  const unsigned int           center = this->m_NeighborhoodOffsets.size() / 2;
+
   // process points on the heap
-  AxisNodeType node;
-  double       currentValue;
-  double       oldProgress = 0;
+  double currentValue;
+  double oldProgress = 0;
 
   this->UpdateProgress( 0.0 ); // Send first progress event
 
   while( !this->m_TrialHeap.empty() )
     {
-    // get the node with the smallest value
-    node = this->m_TrialHeap.top();
-    this->m_TrialHeap.pop();
-
-    // does this node contain the current value ?
-    currentValue = (double) output->GetPixel( node.GetIndex() );
-
-    if( node.GetValue() != currentValue )
-      {
-      continue;
-      }
+    // get the node with the smallest value; values on the heap are always
+    // current, so no stale nodes need to be skipped
+    const HeapEntry       top = this->HeapPop();
+    const OffsetValueType offset = top.Offset;
+    currentValue = static_cast<double>( this->m_OutputBuffer[offset] );
 
     // is this node already alive ?
 #ifdef ITK_USE_DEPRECATED_FAST_MARCHING
-    if( m_LabelImage->GetPixel( node.GetIndex() ) != TrialPoint )
+    if( this->m_LabelBuffer[offset] != TrialPoint )
 #else
-    if( m_LabelImage->GetPixel( node.GetIndex() ) == AlivePoint )
+    if( this->m_LabelBuffer[offset] == AlivePoint )
 #endif
       {
       continue;
       }
 
+    const IndexType index = output->ComputeIndex( offset );
+
     if( this->m_TopologyCheck != None )
       {
+      this->ComputeNeighborhoodOffsets( index, offset, &neighbors[0] );
+      const unsigned int aliveMask = this->ComputeAliveNeighborhoodMask( &neighbors[0] );
+
       bool wellComposednessViolation
-        = this->DoesVoxelChangeViolateWellComposedness( node.GetIndex() );
+        = this->DoesVoxelChangeViolateWellComposedness( aliveMask );
       bool strictTopologyViolation
-        = this->DoesVoxelChangeViolateStrictTopology( node.GetIndex() );
+        = this->DoesVoxelChangeViolateStrictTopology( aliveMask );
       if( this->m_TopologyCheck == Strict && ( wellComposednessViolation
                                                || strictTopologyViolation ) )
         {
-        output->SetPixel( node.GetIndex(), -0.00000001 );
-        this->m_LabelImage->SetPixel( node.GetIndex(), TopologyPoint );
+        this->m_OutputBuffer[offset] = -0.00000001;
+        this->m_LabelBuffer[offset] = TopologyPoint;
         continue;
         }
       if( this->m_TopologyCheck == NoHandles )
         {
         if( wellComposednessViolation )
           {
-          output->SetPixel( node.GetIndex(), -0.00000001 );
-          this->m_LabelImage->SetPixel( node.GetIndex(), TopologyPoint );
+          this->m_OutputBuffer[offset] = -0.00000001;
+          this->m_LabelBuffer[offset] = TopologyPoint;
           continue;
           }
         if( strictTopologyViolation )
           {
           // check for handles
-          typename NeighborhoodIteratorType::RadiusType radius;
-          radius.Fill( 1 );
-          NeighborhoodIteratorType ItL( radius, this->m_LabelImage,
-                                        this->m_LabelImage->GetBufferedRegion() );
-          ItL.SetLocation( node.GetIndex() );
-          NeighborhoodIterator<ConnectedComponentImageType> ItC(
-            radius, this->m_ConnectedComponentImage,
-            this->m_ConnectedComponentImage->GetBufferedRegion() );
-          ItC.SetLocation( node.GetIndex() );
-
-          typename ConnectedComponentImageType::PixelType minLabel
-            = NumericTraits<typename ConnectedComponentImageType::PixelType>::ZeroValue();
-          typename ConnectedComponentImageType::PixelType otherLabel
-            = NumericTraits<typename ConnectedComponentImageType::PixelType>::ZeroValue();
-
-          bool doesChangeCreateHandle = false;
+          ComponentType minLabel = NumericTraits<ComponentType>::ZeroValue();
+          ComponentType otherLabel = NumericTraits<ComponentType>::ZeroValue();
+
+          bool         doesChangeCreateHandle = false;
+          unsigned int stride = 1;
           for( unsigned int d = 0; d < SetDimension; d++ )
             {
-            if( ItL.GetNext( d ) == AlivePoint && ItL.GetPrevious( d ) == AlivePoint )
+            const unsigned int next = center + stride;
+            const unsigned int previous = center - stride;
+            stride *= 3;
+            if( ( aliveMask >> next & 1 ) && ( aliveMask >> previous & 1 ) )
               {
-              if( ItC.GetNext( d ) == ItC.GetPrevious( d ) )
+              const ComponentType nextLabel = componentBuffer[neighbors[next]];
+              const ComponentType previousLabel = componentBuffer[neighbors[previous]];
+              if( nextLabel == previousLabel )
                 {
                 doesChangeCreateHandle = true;
                 }
               else
                 {
-                minLabel = vnl_math_min( ItC.GetNext( d ), ItC.GetPrevious( d ) );
-                otherLabel = vnl_math_max( ItC.GetNext( d ), ItC.GetPrevious( d ) );
+                minLabel = vnl_math_min( nextLabel, previousLabel );
+                otherLabel = vnl_math_max( nextLabel, previousLabel );
                 }
               break;
               }
             }
           if( doesChangeCreateHandle )
             {
-            output->SetPixel( node.GetIndex(), -0.0001 );
-            this->m_LabelImage->SetPixel( node.GetIndex(), TopologyPoint );
+            this->m_OutputBuffer[offset] = -0.0001;
+            this->m_LabelBuffer[offset] = TopologyPoint;
             continue;
             }
-          else
+          else if( otherLabel != minLabel )
             {
-            for( ItC.GoToBegin(); !ItC.IsAtEnd(); ++ItC )
+            // the two components meet here, so merge them everywhere
+            const SizeValueType numberOfPixels = this->m_BufferedRegion.GetNumberOfPixels();
+            for( SizeValueType n = 0; n < numberOfPixels; n++ )
               {
-              if( ItC.GetCenterPixel() == otherLabel )
+              if( componentBuffer[n] == otherLabel )
                 {
-                ItC.SetCenterPixel( minLabel );
+                componentBuffer[n] = minLabel;
                 }
               }
             }
@@ -443,47 +464,37 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
 
     if( this->m_CollectPoints )
       {
+      AxisNodeType node;
+      node.SetValue( top.Value );
+      node.SetIndex( index );
       this->m_ProcessedPoints->InsertElement(
         this->m_ProcessedPoints->Size(), node );
       }
 
     // set this node as alive
-    this->m_LabelImage->SetPixel( node.GetIndex(), AlivePoint );
+    this->m_LabelBuffer[offset] = AlivePoint;
 
     // for topology handle checks, we need to update the connected
     // component image at the current node with the appropriate label.
     if( this->m_TopologyCheck == NoHandles )
       {
-      typename ConnectedComponentImageType::PixelType neighborhoodLabel
-        = NumericTraits<typename ConnectedComponentImageType::PixelType>::ZeroValue();
-
-      typename NeighborhoodIteratorType::RadiusType radius;
-      radius.Fill( 1 );
-      NeighborhoodIterator<ConnectedComponentImageType> ItC(
-        radius, this->m_ConnectedComponentImage,
-        this->m_ConnectedComponentImage->GetBufferedRegion() );
-      ItC.SetLocation( node.GetIndex() );
-      for( unsigned int n = 0; n < ItC.Size(); n++ )
+      for( unsigned int n = 0; n < neighbors.size(); n++ )
         {
-        if( n == static_cast<unsigned int>( 0.5 * ItC.Size() ) )
+        if( n == center )
           {
           continue;
           }
-        typename ConnectedComponentImageType::PixelType c = ItC.GetPixel( n );
+        const ComponentType c = componentBuffer[neighbors[n]];
         if( c > 0 )
           {
-          neighborhoodLabel = c;
+          componentBuffer[offset] = c;
           break;
           }
         }
-      if( neighborhoodLabel > 0 )
-        {
-        ItC.SetCenterPixel( neighborhoodLabel );
-        }
       }
 
     // update its neighbors
-    this->UpdateNeighbors( node.GetIndex(), speedImage, output );
+    this->UpdateNeighbors( index, offset, speedImage, output );
 
     // Send events every certain number of points.
     const double newProgress = currentValue / this->m_StoppingValue;
@@ -502,6 +513,8 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
         }
       }
     }
+  this->HeapClear();
+  std::vector<unsigned int>().swap( this->m_HeapPositions );
 }
 
 template <class TLevelSet, class TSpeedImage>
@@ -509,6 +522,7 @@ void
 FMarchingImageFilter<TLevelSet, TSpeedImage>
 ::UpdateNeighbors(
   const IndexType& index,
+  OffsetValueType offset,
   const SpeedImageType * speedImage,
   LevelSetImageType * output )
 {
@@ -516,34 +530,25 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
 
   for( unsigned int j = 0; j < SetDimension; j++ )
     {
-    // update left neighbor
-    if( index[j] > this->m_StartIndex[j] )
-      {
-      neighIndex[j] = index[j] - 1;
-      }
-#ifdef ITK_USE_DEPRECATED_FAST_MARCHING
-    if( m_LabelImage->GetPixel( neighIndex ) != AlivePoint )
-#else
-    unsigned char label = m_LabelImage->GetPixel( neighIndex );
-    if( label != AlivePoint && label != InitialTrialPoint )
-#endif
-      {
-      this->UpdateValue( neighIndex, speedImage, output );
-      }
-
-    // update right neighbor
-    if( index[j] < this->m_LastIndex[j] )
+    // update left and right neighbors
+    for( int s = -1; s < 2; s = s + 2 )
       {
-      neighIndex[j] = index[j] + 1;
-      }
+      if( ( s < 0 && index[j] <= this->m_StartIndex[j] ) ||
+          ( s > 0 && index[j] >= this->m_LastIndex[j] ) )
+        {
+        continue;
+        }
+      const OffsetValueType neighOffset = offset + s * this->m_OffsetTable[j];
+      const unsigned char   label = this->m_LabelBuffer[neighOffset];
 #ifdef ITK_USE_DEPRECATED_FAST_MARCHING
-    if( m_LabelImage->GetPixel( neighIndex ) != AlivePoint )
+      if( label != AlivePoint )
 #else
-    label = m_LabelImage->GetPixel( neighIndex );
-    if( label != AlivePoint && label != InitialTrialPoint )
+      if( label != AlivePoint && label != InitialTrialPoint )
 #endif
-      {
-      this->UpdateValue( neighIndex, speedImage, output );
+        {
+        neighIndex[j] = index[j] + s;
+        this->UpdateValue( neighIndex, neighOffset, speedImage, output );
+        }
       }
 
     // reset neighIndex
@@ -556,52 +561,41 @@ double
 FMarchingImageFilter<TLevelSet, TSpeedImage>
 ::UpdateValue(
   const IndexType& index,
+  OffsetValueType offset,
   const SpeedImageType * speedImage,
   LevelSetImageType * output )
 {
-  IndexType neighIndex = index;
+  // smallest alive neighbor value along each axis, sorted ascending
+  double       neighValues[SetDimension];
+  unsigned int neighAxes[SetDimension];
 
-  typename TLevelSet::PixelType neighValue;
-  PixelType    outputPixel;
-  AxisNodeType node;
   for( unsigned int j = 0; j < SetDimension; j++ )
     {
-    node.SetValue( this->m_LargeValue );
+    double value = this->m_LargeValue;
     // find smallest valued neighbor in this dimension
-    for( int s = -1; s < 2; s = s + 2 )
+    if( index[j] > this->m_StartIndex[j] &&
+        this->m_LabelBuffer[offset - this->m_OffsetTable[j]] == AlivePoint )
       {
-      neighIndex[j] = index[j] + s;
-
-      if( neighIndex[j] > this->m_LastIndex[j] ||
-          neighIndex[j] < this->m_StartIndex[j] )
-        {
-        continue;
-        }
-
-      if( this->m_LabelImage->GetPixel( neighIndex ) == AlivePoint )
-        {
-        outputPixel = output->GetPixel( neighIndex );
-        neighValue = outputPixel;
-
-        if( node.GetValue() > neighValue )
-          {
-          node.SetValue( neighValue );
-          node.SetIndex( neighIndex );
-          }
-        }
+      value = vnl_math_min( value, static_cast<double>( this->m_OutputBuffer[offset - this->m_OffsetTable[j]] ) );
+      }
+    if( index[j] < this->m_LastIndex[j] &&
+        this->m_LabelBuffer[offset + this->m_OffsetTable[j]] == AlivePoint )
+      {
+      value = vnl_math_min( value, static_cast<double>( this->m_OutputBuffer[offset + this->m_OffsetTable[j]] ) );
       }
 
-    // put the minimum neighbor onto the heap
-    this->m_NodesUsed[j] = node;
-    this->m_NodesUsed[j].SetAxis(j);
-
-    // reset neighIndex
-    neighIndex[j] = index[j];
+    // insertion sort of the local list
+    unsigned int k = j;
+    while( k > 0 && neighValues[k - 1] > value )
+      {
+      neighValues[k] = neighValues[k - 1];
+      neighAxes[k] = neighAxes[k - 1];
+      k--;
+      }
+    neighValues[k] = value;
+    neighAxes[k] = j;
     }
 
-  // sort the local list
-  std::sort( this->m_NodesUsed, this->m_NodesUsed + SetDimension );
-
   // solve quadratic equation
   double aa, bb, cc;
   double solution = this->m_LargeValue;
@@ -610,7 +604,14 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
   bb = 0.0;
   if( speedImage )
     {
-    cc = (double) speedImage->GetPixel( index ) / this->m_NormalizationFactor;
+    if( this->m_SpeedBuffer )
+      {
+      cc = (double) this->m_SpeedBuffer[offset] / this->m_NormalizationFactor;
+      }
+    else
+      {
+      cc = (double) speedImage->GetPixel( index ) / this->m_NormalizationFactor;
+      }
     cc = -1.0 * vnl_math_sqr( 1.0 / cc );
     }
   else
@@ -618,18 +619,16 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
     cc = this->m_InverseSpeed;
     }
 
-  OutputSpacingType spacing = this->GetOutput()->GetSpacing();
+  OutputSpacingType spacing = output->GetSpacing();
 
   double discrim;
   for( unsigned int j = 0; j < SetDimension; j++ )
     {
-    node = this->m_NodesUsed[j];
-
-    if( solution >= node.GetValue() )
+    if( solution >= neighValues[j] )
       {
-      const int    axis = node.GetAxis();
-      const double spaceFactor = vnl_math_sqr( 1.0 / spacing[axis] );
-      const double value = double(node.GetValue() );
+      const unsigned int axis = neighAxes[j];
+      const double       spaceFactor = vnl_math_sqr( 1.0 / spacing[axis] );
+      const double       value = neighValues[j];
       aa += spaceFactor;
       bb += value * spaceFactor;
       cc += vnl_math_sqr( value ) * spaceFactor;
@@ -655,36 +654,209 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
   if( solution < this->m_LargeValue )
     {
     // write solution to this->m_OutputLevelSet
-    outputPixel = static_cast<PixelType>( solution );
-    output->SetPixel( index, outputPixel );
-
-    // insert point into trial heap
-    this->m_LabelImage->SetPixel( index, TrialPoint );
-    node.SetValue( static_cast<PixelType>( solution ) );
-    node.SetIndex( index );
-    this->m_TrialHeap.push( node );
+    const PixelType outputPixel = static_cast<PixelType>( solution );
+    this->m_OutputBuffer[offset] = outputPixel;
+
+    // insert point into trial heap, or move it if it is already there
+    this->m_LabelBuffer[offset] = TrialPoint;
+    this->HeapPush( offset, outputPixel );
     }
 
   return solution;
 }
 
+/**
+ * Trial heap
+ */
+template <class TLevelSet, class TSpeedImage>
+void
+FMarchingImageFilter<TLevelSet, TSpeedImage>
+::HeapPush( OffsetValueType offset, PixelType value )
+{
+  SizeValueType position = this->m_HeapPositions[offset];
+
+  if( position == NumericTraits<unsigned int>::max() )
+    {
+    position = this->m_TrialHeap.size();
+    HeapEntry entry;
+    entry.Value = value;
+    entry.Offset = offset;
+    this->m_TrialHeap.push_back( entry );
+    this->m_HeapPositions[offset] = static_cast<unsigned int>( position );
+    this->HeapSiftUp( position );
+    }
+  else if( value < this->m_TrialHeap[position].Value )
+    {
+    this->m_TrialHeap[position].Value = value;
+    this->HeapSiftUp( position );
+    }
+  else if( this->m_TrialHeap[position].Value < value )
+    {
+    this->m_TrialHeap[position].Value = value;
+    this->HeapSiftDown( position );
+    }
+}
+
+template <class TLevelSet, class TSpeedImage>
+typename FMarchingImageFilter<TLevelSet, TSpeedImage>::HeapEntry
+FMarchingImageFilter<TLevelSet, TSpeedImage>
+::HeapPop()
+{
+  const HeapEntry top = this->m_TrialHeap.front();
+
+  this->m_HeapPositions[top.Offset] = NumericTraits<unsigned int>::max();
+  const HeapEntry last = this->m_TrialHeap.back();
+  this->m_TrialHeap.pop_back();
+  if( !this->m_TrialHeap.empty() )
+    {
+    this->m_TrialHeap[0] = last;
+    this->m_HeapPositions[last.Offset] = 0;
+    this->HeapSiftDown( 0 );
+    }
+  return top;
+}
+
+template <class TLevelSet, class TSpeedImage>
+void
+FMarchingImageFilter<TLevelSet, TSpeedImage>
+::HeapSiftUp( SizeValueType position )
+{
+  const HeapEntry entry = this->m_TrialHeap[position];
+
+  while( position > 0 )
+    {
+    const SizeValueType parent = ( position - 1 ) / 2;
+    if( !this->HeapEntryLess( entry, this->m_TrialHeap[parent] ) )
+      {
+      break;
+      }
+    this->m_TrialHeap[position] = this->m_TrialHeap[parent];
+    this->m_HeapPositions[this->m_TrialHeap[position].Offset] = static_cast<unsigned int>( position );
+    position = parent;
+    }
+  this->m_TrialHeap[position] = entry;
+  this->m_HeapPositions[entry.Offset] = static_cast<unsigned int>( position );
+}
+
+template <class TLevelSet, class TSpeedImage>
+void
+FMarchingImageFilter<TLevelSet, TSpeedImage>
+::HeapSiftDown( SizeValueType position )
+{
+  const HeapEntry     entry = this->m_TrialHeap[position];
+  const SizeValueType size = this->m_TrialHeap.size();
+
+  while( true )
+    {
+    SizeValueType child = 2 * position + 1;
+    if( child >= size )
+      {
+      break;
+      }
+    if( child + 1 < size && this->HeapEntryLess( this->m_TrialHeap[child + 1], this->m_TrialHeap[child] ) )
+      {
+      child++;
+      }
+    if( !this->HeapEntryLess( this->m_TrialHeap[child], entry ) )
+      {
+      break;
+      }
+    this->m_TrialHeap[position] = this->m_TrialHeap[child];
+    this->m_HeapPositions[this->m_TrialHeap[position].Offset] = static_cast<unsigned int>( position );
+    position = child;
+    }
+  this->m_TrialHeap[position] = entry;
+  this->m_HeapPositions[entry.Offset] = static_cast<unsigned int>( position );
+}
+
+template <class TLevelSet, class TSpeedImage>
+void
+FMarchingImageFilter<TLevelSet, TSpeedImage>
+::HeapClear()
+{
+  for( SizeValueType i = 0; i < this->m_TrialHeap.size(); i++ )
+    {
+    this->m_HeapPositions[this->m_TrialHeap[i].Offset] = NumericTraits<unsigned int>::max();
+    }
+  this->m_TrialHeap.clear();
+}
+
 /**
  * Topology check functions
  */
+template <class TLevelSet, class TSpeedImage>
+void
+FMarchingImageFilter<TLevelSet, TSpeedImage>
+::ComputeNeighborhoodOffsets( const IndexType & index, OffsetValueType offset,
+                              OffsetValueType * neighbors ) const
+{
+  bool isInterior = true;
+
+  for( unsigned int d = 0; d < SetDimension; d++ )
+    {
+    if( index[d] <= this->m_StartIndex[d] || index[d] >= this->m_LastIndex[d] )
+      {
+      isInterior = false;
+      }
+    }
+  const unsigned int neighborhoodSize = this->m_NeighborhoodOffsets.size();
+  if( isInterior )
+    {
+    for( unsigned int n = 0; n < neighborhoodSize; n++ )
+      {
+      neighbors[n] = offset + this->m_NeighborhoodOffsets[n];
+      }
+    return;
+    }
+  for( unsigned int n = 0; n < neighborhoodSize; n++ )
+    {
+    OffsetValueType neighborOffset = offset;
+    unsigned int    k = n;
+    for( unsigned int d = 0; d < SetDimension; d++ )
+      {
+      const int step = static_cast<int>( k % 3 ) - 1;
+      k /= 3;
+      if( ( step < 0 && index[d] > this->m_StartIndex[d] ) ||
+          ( step > 0 && index[d] < this->m_LastIndex[d] ) )
+        {
+        neighborOffset += step * this->m_OffsetTable[d];
+        }
+      }
+    neighbors[n] = neighborOffset;
+    }
+}
+
+template <class TLevelSet, class TSpeedImage>
+unsigned int
+FMarchingImageFilter<TLevelSet, TSpeedImage>
+::ComputeAliveNeighborhoodMask( const OffsetValueType * neighbors ) const
+{
+  unsigned int aliveMask = 0;
+
+  for( unsigned int n = 0; n < this->m_NeighborhoodOffsets.size(); n++ )
+    {
+    if( this->m_LabelBuffer[neighbors[n]] == AlivePoint )
+      {
+      aliveMask |= ( 1u << n );
+      }
+    }
+  return aliveMask;
+}
+
 template <class TLevelSet, class TSpeedImage>
 bool
 FMarchingImageFilter<TLevelSet, TSpeedImage>
-::DoesVoxelChangeViolateWellComposedness( IndexType idx )
+::DoesVoxelChangeViolateWellComposedness( unsigned int aliveMask )
 {
   bool isChangeWellComposed = false;
 
   if( SetDimension == 2 )
     {
-    isChangeWellComposed = this->IsChangeWellComposed2D( idx );
+    isChangeWellComposed = this->m_WellComposedTable2D[aliveMask];
     }
   else  // SetDimension == 3
     {
-    isChangeWellComposed = this->IsChangeWellComposed3D( idx );
+    isChangeWellComposed = this->IsChangeWellComposed3D( aliveMask );
     }
 
   return !isChangeWellComposed;
@@ -693,27 +865,27 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
 template <class TLevelSet, class TSpeedImage>
 bool
 FMarchingImageFilter<TLevelSet, TSpeedImage>
-::DoesVoxelChangeViolateStrictTopology( IndexType idx )
+::DoesVoxelChangeViolateStrictTopology( unsigned int aliveMask )
 {
-  typename NeighborhoodIteratorType::RadiusType radius;
-  radius.Fill( 1 );
-  NeighborhoodIteratorType It( radius, this->m_LabelImage,
-                               this->m_LabelImage->GetBufferedRegion() );
-  It.SetLocation( idx );
+  const unsigned int center = this->m_NeighborhoodOffsets.size() / 2;
 
   unsigned int numberOfCriticalC3Configurations = 0;
   unsigned int numberOfFaces = 0;
+  unsigned int stride = 1;
   for( unsigned int d = 0; d < SetDimension; d++ )
     {
-    if( It.GetNext( d ) == AlivePoint )
+    const bool isNextAlive = ( aliveMask >> ( center + stride ) ) & 1;
+    const bool isPreviousAlive = ( aliveMask >> ( center - stride ) ) & 1;
+    stride *= 3;
+    if( isNextAlive )
       {
       numberOfFaces++;
       }
-    if( It.GetPrevious( d ) == AlivePoint )
+    if( isPreviousAlive )
       {
       numberOfFaces++;
       }
-    if( It.GetNext( d ) == AlivePoint && It.GetPrevious( d ) == AlivePoint )
+    if( isNextAlive && isPreviousAlive )
       {
       numberOfCriticalC3Configurations++;
       }
@@ -730,22 +902,17 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
 template <class TLevelSet, class TSpeedImage>
 bool
 FMarchingImageFilter<TLevelSet, TSpeedImage>
-::IsChangeWellComposed2D( IndexType idx )
+::IsChangeWellComposed2D( unsigned int aliveMask )
 {
-  typename NeighborhoodIteratorType::RadiusType radius;
-  radius.Fill( 1 );
-  NeighborhoodIteratorType It( radius, this->m_LabelImage,
-                               this->m_LabelImage->GetBufferedRegion() );
-  It.SetLocation( idx );
-
   Array<short> neighborhoodPixels( 9 );
+
   // Check for critical configurations: 4 90-degree rotations
   for( unsigned int i = 0; i < 4; i++ )
     {
     for( unsigned int j = 0; j < 9; j++ )
       {
       neighborhoodPixels[j] =
-        ( It.GetPixel( this->m_RotationIndices[i][j] ) != AlivePoint );
+        !( ( aliveMask >> this->m_RotationIndices[i][j] ) & 1 );
       if( this->m_RotationIndices[i][j] == 4 )
         {
         neighborhoodPixels[j] = !neighborhoodPixels[j];
@@ -769,7 +936,7 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
     for( unsigned int j = 0; j < 9; j++ )
       {
       neighborhoodPixels[j] =
-        ( It.GetPixel( this->m_ReflectionIndices[i][j] ) != AlivePoint );
+        !( ( aliveMask >> this->m_ReflectionIndices[i][j] ) & 1 );
       if( this->m_ReflectionIndices[i][j] == 4 )
         {
         neighborhoodPixels[j] = !neighborhoodPixels[j];
@@ -838,100 +1005,52 @@ void
 FMarchingImageFilter<TLevelSet, TSpeedImage>
 ::InitializeIndices2D()
 {
-  this->m_RotationIndices[0].SetSize( 9 );
-  this->m_RotationIndices[1].SetSize( 9 );
-  this->m_RotationIndices[2].SetSize( 9 );
-  this->m_RotationIndices[3].SetSize( 9 );
-
-  this->m_RotationIndices[0][0] = 0;
-  this->m_RotationIndices[0][1] = 1;
-  this->m_RotationIndices[0][2] = 2;
-  this->m_RotationIndices[0][3] = 3;
-  this->m_RotationIndices[0][4] = 4;
-  this->m_RotationIndices[0][5] = 5;
-  this->m_RotationIndices[0][6] = 6;
-  this->m_RotationIndices[0][7] = 7;
-  this->m_RotationIndices[0][8] = 8;
-
-  this->m_RotationIndices[1][0] = 2;
-  this->m_RotationIndices[1][1] = 5;
-  this->m_RotationIndices[1][2] = 8;
-  this->m_RotationIndices[1][3] = 1;
-  this->m_RotationIndices[1][4] = 4;
-  this->m_RotationIndices[1][5] = 7;
-  this->m_RotationIndices[1][6] = 0;
-  this->m_RotationIndices[1][7] = 3;
-  this->m_RotationIndices[1][8] = 6;
-
-  this->m_RotationIndices[2][0] = 8;
-  this->m_RotationIndices[2][1] = 7;
-  this->m_RotationIndices[2][2] = 6;
-  this->m_RotationIndices[2][3] = 5;
-  this->m_RotationIndices[2][4] = 4;
-  this->m_RotationIndices[2][5] = 3;
-  this->m_RotationIndices[2][6] = 2;
-  this->m_RotationIndices[2][7] = 1;
-  this->m_RotationIndices[2][8] = 0;
-
-  this->m_RotationIndices[3][0] = 6;
-  this->m_RotationIndices[3][1] = 3;
-  this->m_RotationIndices[3][2] = 0;
-  this->m_RotationIndices[3][3] = 7;
-  this->m_RotationIndices[3][4] = 4;
-  this->m_RotationIndices[3][5] = 1;
-  this->m_RotationIndices[3][6] = 8;
-  this->m_RotationIndices[3][7] = 5;
-  this->m_RotationIndices[3][8] = 2;
-
-  this->m_ReflectionIndices[0].SetSize( 9 );
-  this->m_ReflectionIndices[1].SetSize( 9 );
-
-  this->m_ReflectionIndices[0][0] = 6;
-  this->m_ReflectionIndices[0][1] = 7;
-  this->m_ReflectionIndices[0][2] = 8;
-  this->m_ReflectionIndices[0][3] = 3;
-  this->m_ReflectionIndices[0][4] = 4;
-  this->m_ReflectionIndices[0][5] = 5;
-  this->m_ReflectionIndices[0][6] = 0;
-  this->m_ReflectionIndices[0][7] = 1;
-  this->m_ReflectionIndices[0][8] = 2;
-
-  this->m_ReflectionIndices[1][0] = 2;
-  this->m_ReflectionIndices[1][1] = 1;
-  this->m_ReflectionIndices[1][2] = 0;
-  this->m_ReflectionIndices[1][3] = 5;
-  this->m_ReflectionIndices[1][4] = 4;
-  this->m_ReflectionIndices[1][5] = 3;
-  this->m_ReflectionIndices[1][6] = 8;
-  this->m_ReflectionIndices[1][7] = 7;
-  this->m_ReflectionIndices[1][8] = 6;
+  const unsigned int rotationIndices[4][9] = {
+    { 0, 1, 2, 3, 4, 5, 6, 7, 8 },
+    { 2, 5, 8, 1, 4, 7, 0, 3, 6 },
+    { 8, 7, 6, 5, 4, 3, 2, 1, 0 },
+    { 6, 3, 0, 7, 4, 1, 8, 5, 2 } };
+  const unsigned int reflectionIndices[2][9] = {
+    { 6, 7, 8, 3, 4, 5, 0, 1, 2 },
+    { 2, 1, 0, 5, 4, 3, 8, 7, 6 } };
+
+  for( unsigned int j = 0; j < 9; j++ )
+    {
+    for( unsigned int i = 0; i < 4; i++ )
+      {
+      this->m_RotationIndices[i][j] = rotationIndices[i][j];
+      }
+    for( unsigned int i = 0; i < 2; i++ )
+      {
+      this->m_ReflectionIndices[i][j] = reflectionIndices[i][j];
+      }
+    }
+
+  // tabulate the check for every configuration of the 3x3 neighborhood
+  this->m_WellComposedTable2D.resize( 512 );
+  for( unsigned int aliveMask = 0; aliveMask < 512; aliveMask++ )
+    {
+    this->m_WellComposedTable2D[aliveMask] = this->IsChangeWellComposed2D( aliveMask );
+    }
 }
 
 template <class TLevelSet, class TSpeedImage>
 bool
 FMarchingImageFilter<TLevelSet, TSpeedImage>
-::IsChangeWellComposed3D( IndexType idx )
+::IsChangeWellComposed3D( unsigned int aliveMask )
 {
-  Array<short> neighborhoodPixels( 8 );
+  // the voxel being changed enters the configurations inverted
+  aliveMask ^= ( 1u << 13 );
 
-  typename NeighborhoodIteratorType::RadiusType radius;
-  radius.Fill( 1 );
-  NeighborhoodIteratorType It( radius, this->m_LabelImage,
-                               this->m_LabelImage->GetRequestedRegion() );
-  It.SetLocation( idx );
   // Check for C1 critical configurations
   for( unsigned int i = 0; i < 12; i++ )
     {
+    unsigned int configuration = 0;
     for( unsigned int j = 0; j < 4; j++ )
       {
-      neighborhoodPixels[j]
-        = ( It.GetPixel( this->m_C1Indices[i][j] ) == AlivePoint );
-      if( this->m_C1Indices[i][j] == 13 )
-        {
-        neighborhoodPixels[j] = !neighborhoodPixels[j];
-        }
+      configuration |= ( ( aliveMask >> this->m_C1Indices[i][j] ) & 1 ) << j;
       }
-    if( this->IsCriticalC1Configuration3D( neighborhoodPixels ) )
+    if( this->m_C1Table3D[configuration] )
       {
       return false;
       }
@@ -939,16 +1058,12 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
   // Check for C2 critical configurations
   for( unsigned int i = 0; i < 8; i++ )
     {
+    unsigned int configuration = 0;
     for( unsigned int j = 0; j < 8; j++ )
       {
-      neighborhoodPixels[j]
-        = ( It.GetPixel( this->m_C2Indices[i][j] ) == AlivePoint );
-      if( this->m_C2Indices[i][j] == 13 )
-        {
-        neighborhoodPixels[j] = !neighborhoodPixels[j];
-        }
+      configuration |= ( ( aliveMask >> this->m_C2Indices[i][j] ) & 1 ) << j;
       }
-    if( this->IsCriticalC2Configuration3D( neighborhoodPixels ) )
+    if( this->m_C2Table3D[configuration] )
       {
       return false;
       }
@@ -1010,92 +1125,35 @@ void
 FMarchingImageFilter<TLevelSet, TSpeedImage>
 ::InitializeIndices3D()
 {
-  for( unsigned int i = 0; i <  12; i++ )
+  const unsigned int c1Indices[12][4] = {
+    {  1, 13,  4, 10 },
+    {  9, 13, 10, 12 },
+    {  3, 13,  4, 12 },
+    {  4, 14,  5, 13 },
+    { 12, 22, 13, 21 },
+    { 13, 23, 14, 22 },
+    {  4, 16,  7, 13 },
+    { 13, 25, 16, 22 },
+    { 10, 22, 13, 19 },
+    { 12, 16, 13, 15 },
+    { 13, 17, 14, 16 },
+    { 10, 14, 11, 13 } };
+
+  for( unsigned int i = 0; i < 12; i++ )
     {
-    this->m_C1Indices[i].SetSize( 4 );
+    for( unsigned int j = 0; j < 4; j++ )
+      {
+      this->m_C1Indices[i][j] = c1Indices[i][j];
+      }
     }
-  for( unsigned int i = 0; i <  8; i++ )
+
+  const unsigned int c2Indices0[8] = { 0, 13, 1, 12, 3, 10, 4, 9 };
+  const unsigned int c2Indices4[8] = { 9, 22, 10, 21, 12, 19, 13, 18 };
+  for( unsigned int j = 0; j < 8; j++ )
     {
-    this->m_C2Indices[i].SetSize( 8 );
+    this->m_C2Indices[0][j] = c2Indices0[j];
+    this->m_C2Indices[4][j] = c2Indices4[j];
     }
-
-  this->m_C1Indices[0][0] = 1;
-  this->m_C1Indices[0][1] = 13;
-  this->m_C1Indices[0][2] = 4;
-  this->m_C1Indices[0][3] = 10;
-
-  this->m_C1Indices[1][0] = 9;
-  this->m_C1Indices[1][1] = 13;
-  this->m_C1Indices[1][2] = 10;
-  this->m_C1Indices[1][3] = 12;
-
-  this->m_C1Indices[2][0] = 3;
-  this->m_C1Indices[2][1] = 13;
-  this->m_C1Indices[2][2] = 4;
-  this->m_C1Indices[2][3] = 12;
-
-  this->m_C1Indices[3][0] = 4;
-  this->m_C1Indices[3][1] = 14;
-  this->m_C1Indices[3][2] = 5;
-  this->m_C1Indices[3][3] = 13;
-
-  this->m_C1Indices[4][0] = 12;
-  this->m_C1Indices[4][1] = 22;
-  this->m_C1Indices[4][2] = 13;
-  this->m_C1Indices[4][3] = 21;
-
-  this->m_C1Indices[5][0] = 13;
-  this->m_C1Indices[5][1] = 23;
-  this->m_C1Indices[5][2] = 14;
-  this->m_C1Indices[5][3] = 22;
-
-  this->m_C1Indices[6][0] = 4;
-  this->m_C1Indices[6][1] = 16;
-  this->m_C1Indices[6][2] = 7;
-  this->m_C1Indices[6][3] = 13;
-
-  this->m_C1Indices[7][0] = 13;
-  this->m_C1Indices[7][1] = 25;
-  this->m_C1Indices[7][2] = 16;
-  this->m_C1Indices[7][3] = 22;
-
-  this->m_C1Indices[8][0] = 10;
-  this->m_C1Indices[8][1] = 22;
-  this->m_C1Indices[8][2] = 13;
-  this->m_C1Indices[8][3] = 19;
-
-  this->m_C1Indices[9][0] = 12;
-  this->m_C1Indices[9][1] = 16;
-  this->m_C1Indices[9][2] = 13;
-  this->m_C1Indices[9][3] = 15;
-
-  this->m_C1Indices[10][0] = 13;
-  this->m_C1Indices[10][1] = 17;
-  this->m_C1Indices[10][2] = 14;
-  this->m_C1Indices[10][3] = 16;
-
-  this->m_C1Indices[11][0] = 10;
-  this->m_C1Indices[11][1] = 14;
-  this->m_C1Indices[11][2] = 11;
-  this->m_C1Indices[11][3] = 13;
-
-  this->m_C2Indices[0][0] = 0;
-  this->m_C2Indices[0][1] = 13;
-  this->m_C2Indices[0][2] = 1;
-  this->m_C2Indices[0][3] = 12;
-  this->m_C2Indices[0][4] = 3;
-  this->m_C2Indices[0][5] = 10;
-  this->m_C2Indices[0][6] = 4;
-  this->m_C2Indices[0][7] = 9;
-
-  this->m_C2Indices[4][0] = 9;
-  this->m_C2Indices[4][1] = 22;
-  this->m_C2Indices[4][2] = 10;
-  this->m_C2Indices[4][3] = 21;
-  this->m_C2Indices[4][4] = 12;
-  this->m_C2Indices[4][5] = 19;
-  this->m_C2Indices[4][6] = 13;
-  this->m_C2Indices[4][7] = 18;
   for( unsigned int i = 1; i < 4; i++ )
     {
     int addend;
@@ -1113,6 +1171,25 @@ FMarchingImageFilter<TLevelSet, TSpeedImage>
       this->m_C2Indices[i + 4][j] = this->m_C2Indices[i + 3][j] + addend;
       }
     }
+
+  // tabulate the critical configurations
+  Array<short> neighborhoodPixels( 8 );
+  for( unsigned int configuration = 0; configuration < 16; configuration++ )
+    {
+    for( unsigned int j = 0; j < 4; j++ )
+      {
+      neighborhoodPixels[j] = ( configuration >> j ) & 1;
+      }
+    this->m_C1Table3D[configuration] = this->IsCriticalC1Configuration3D( neighborhoodPixels );
+    }
+  for( unsigned int configuration = 0; configuration < 256; configuration++ )
+    {
+    for( unsigned int j = 0; j < 8; j++ )
+      {
+      neighborhoodPixels[j] = ( configuration >> j ) & 1;
+      }
+    this->m_C2Table3D[configuration] = ( this->IsCriticalC2Configuration3D( neighborhoodPixels ) != 0 );
+    }
 }
 } // namespace itk
 
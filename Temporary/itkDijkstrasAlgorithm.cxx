@@ -7,6 +7,9 @@
 #define _itkDijkstrasAlgorithm_cxx_
 
 #include "itkDijkstrasAlgorithm.h"
+#include <algorithm>
+#include <functional>
+#include <map>
 namespace itk
 {
 template <class TGraphSearchNode>
@@ -274,6 +277,495 @@ void DijkstrasAlgorithm<TGraphSearchNode>::FindPath()
 
   return;
 }
+
+template <class TCost, unsigned int NDimension>
+DijkstrasQueryEngine<TCost, NDimension>::DijkstrasQueryEngine() :
+  m_NumberOfNodes( 0 ),
+  m_HeuristicScale( 0 ),
+  m_UseBidirectionalSearch( true ),
+  m_UseAStar( true ),
+  m_NumberOfThreads( 0 )
+{
+}
+
+template <class TCost, unsigned int NDimension>
+void DijkstrasQueryEngine<TCost, NDimension>::SetGraph( unsigned int numberOfNodes,
+                                                        const std::vector<LocationType> & locations,
+                                                        const std::vector<NodeIdType> & edgeSources,
+                                                        const std::vector<NodeIdType> & edgeTargets,
+                                                        const std::vector<CostType> & edgeWeights )
+{
+  const SizeValueType numberOfEdges = edgeSources.size();
+
+  if( edgeTargets.size() != numberOfEdges || edgeWeights.size() != numberOfEdges )
+    {
+    itkExceptionMacro( "The edge sources, targets and weights differ in length." );
+    }
+  if( !locations.empty() && locations.size() != numberOfNodes )
+    {
+    itkExceptionMacro( "Expected " << numberOfNodes << " node locations but got " << locations.size() );
+    }
+  for( SizeValueType e = 0; e < numberOfEdges; e++ )
+    {
+    if( edgeSources[e] >= numberOfNodes || edgeTargets[e] >= numberOfNodes )
+      {
+      itkExceptionMacro( "Edge " << e << " refers to a node outside the graph." );
+      }
+    if( edgeWeights[e] < NumericTraits<CostType>::ZeroValue() )
+      {
+      itkExceptionMacro( "Edge " << e << " has a negative weight." );
+      }
+    }
+
+  this->m_NumberOfNodes = numberOfNodes;
+  this->m_Locations = locations;
+
+  // counting sort of the edges by their tail ([0]) and by their head ([1])
+  for( unsigned int direction = 0; direction < 2; direction++ )
+    {
+    const std::vector<NodeIdType> & from = ( direction == 0 ) ? edgeSources : edgeTargets;
+    const std::vector<NodeIdType> & to = ( direction == 0 ) ? edgeTargets : edgeSources;
+
+    std::vector<SizeValueType> & rowOffsets = this->m_RowOffsets[direction];
+    rowOffsets.assign( numberOfNodes + 1, 0 );
+    for( SizeValueType e = 0; e < numberOfEdges; e++ )
+      {
+      rowOffsets[from[e] + 1]++;
+      }
+    for( unsigned int n = 0; n < numberOfNodes; n++ )
+      {
+      rowOffsets[n + 1] += rowOffsets[n];
+      }
+
+    std::vector<SizeValueType> cursor( rowOffsets.begin(), rowOffsets.end() - 1 );
+    this->m_Neighbors[direction].resize( numberOfEdges );
+    this->m_Weights[direction].resize( numberOfEdges );
+    for( SizeValueType e = 0; e < numberOfEdges; e++ )
+      {
+      const SizeValueType position = cursor[from[e]]++;
+      this->m_Neighbors[direction][position] = to[e];
+      this->m_Weights[direction][position] = edgeWeights[e];
+      }
+    }
+
+  // the largest scale that keeps scale * Euclidean distance a lower bound
+  // on every edge, and so on every path
+  this->m_HeuristicScale = 0;
+  if( !this->m_Locations.empty() )
+    {
+    bool found = false;
+    for( SizeValueType e = 0; e < numberOfEdges; e++ )
+      {
+      const double length = ( this->m_Locations[edgeSources[e]] - this->m_Locations[edgeTargets[e]] ).GetNorm();
+      if( length > 0 )
+        {
+        const double ratio = static_cast<double>( edgeWeights[e] ) / length;
+        if( !found || ratio < this->m_HeuristicScale )
+          {
+          this->m_HeuristicScale = ratio;
+          found = true;
+          }
+        }
+      }
+    }
+
+  this->InitializeWorkspace( this->m_Workspace );
+}
+
+template <class TCost, unsigned int NDimension>
+template <class TGraphSearchNode>
+void DijkstrasQueryEngine<TCost, NDimension>::SetGraphFromSearchNodes(
+  const std::vector<typename TGraphSearchNode::Pointer> & nodes )
+{
+  const unsigned int numberOfNodes = nodes.size();
+  const unsigned int dimension = std::min( static_cast<unsigned int>( TGraphSearchNode::GraphDimension ),
+                                           static_cast<unsigned int>( NDimension ) );
+
+  std::map<unsigned int, NodeIdType> identities;
+  std::vector<LocationType>          locations( numberOfNodes );
+  for( unsigned int i = 0; i < numberOfNodes; i++ )
+    {
+    identities[nodes[i]->GetIdentity()] = i;
+    locations[i].Fill( 0 );
+    for( unsigned int d = 0; d < dimension; d++ )
+      {
+      locations[i][d] = nodes[i]->GetLocation()[d];
+      }
+    }
+
+  std::vector<NodeIdType> edgeSources;
+  std::vector<NodeIdType> edgeTargets;
+  std::vector<CostType>   edgeWeights;
+  for( unsigned int i = 0; i < numberOfNodes; i++ )
+    {
+    for( int k = 0; k < nodes[i]->GetNumberOfNeighbors(); k++ )
+      {
+      typename TGraphSearchNode::Pointer neighbor = nodes[i]->GetNeighbor( k );
+      if( !neighbor )
+        {
+        continue;
+        }
+      typename std::map<unsigned int, NodeIdType>::const_iterator it = identities.find( neighbor->GetIdentity() );
+      if( it == identities.end() )
+        {
+        continue;
+        }
+      edgeSources.push_back( i );
+      edgeTargets.push_back( it->second );
+      edgeWeights.push_back( static_cast<CostType>( ( locations[i] - locations[it->second] ).GetNorm() ) );
+      }
+    }
+  this->SetGraph( numberOfNodes, locations, edgeSources, edgeTargets, edgeWeights );
+}
+
+template <class TCost, unsigned int NDimension>
+void DijkstrasQueryEngine<TCost, NDimension>::InitializeWorkspace( SearchWorkspace & workspace ) const
+{
+  if( workspace.Distance[0].size() == this->m_NumberOfNodes )
+    {
+    this->ResetWorkspace( workspace );
+    return;
+    }
+  for( unsigned int direction = 0; direction < 2; direction++ )
+    {
+    workspace.Distance[direction].assign( this->m_NumberOfNodes, vnl_huge_val( double() ) );
+    workspace.Parent[direction].assign( this->m_NumberOfNodes, 0 );
+    workspace.Settled[direction].assign( this->m_NumberOfNodes, 0 );
+    workspace.Heap[direction].clear();
+    }
+  workspace.Touched.clear();
+}
+
+template <class TCost, unsigned int NDimension>
+void DijkstrasQueryEngine<TCost, NDimension>::ResetWorkspace( SearchWorkspace & workspace ) const
+{
+  // only the nodes reached by the last query need to be cleared
+  for( SizeValueType i = 0; i < workspace.Touched.size(); i++ )
+    {
+    const NodeIdType n = workspace.Touched[i];
+    for( unsigned int direction = 0; direction < 2; direction++ )
+      {
+      workspace.Distance[direction][n] = vnl_huge_val( double() );
+      workspace.Settled[direction][n] = 0;
+      }
+    }
+  workspace.Touched.clear();
+  workspace.Heap[0].clear();
+  workspace.Heap[1].clear();
+}
+
+template <class TCost, unsigned int NDimension>
+double DijkstrasQueryEngine<TCost, NDimension>::Heuristic( NodeIdType a, NodeIdType b ) const
+{
+  if( !this->m_UseAStar || this->m_HeuristicScale <= 0 || this->m_Locations.empty() )
+    {
+    return 0;
+    }
+  return this->m_HeuristicScale * ( this->m_Locations[a] - this->m_Locations[b] ).GetNorm();
+}
+
+template <class TCost, unsigned int NDimension>
+double DijkstrasQueryEngine<TCost, NDimension>::Potential( NodeIdType v, NodeIdType source, NodeIdType target,
+                                                           bool bidirectional ) const
+{
+  if( bidirectional )
+    {
+    return 0.5 * ( this->Heuristic( v, target ) - this->Heuristic( v, source ) );
+    }
+  return this->Heuristic( v, target );
+}
+
+template <class TCost, unsigned int NDimension>
+typename DijkstrasQueryEngine<TCost, NDimension>::CostType
+DijkstrasQueryEngine<TCost, NDimension>::Search( NodeIdType source, NodeIdType target,
+                                                 SearchWorkspace & workspace, PathType * path ) const
+{
+  typedef std::pair<double, NodeIdType> HeapEntryType;
+  typedef std::greater<HeapEntryType>   HeapCompareType;
+
+  const double infinity = vnl_huge_val( double() );
+  const bool   bidirectional = this->m_UseBidirectionalSearch;
+
+  this->InitializeWorkspace( workspace );
+  if( path )
+    {
+    path->clear();
+    }
+  if( source == target )
+    {
+    if( path )
+      {
+      path->push_back( source );
+      }
+    return NumericTraits<CostType>::ZeroValue();
+    }
+
+  // Both searches run on the reduced costs w(u,v) - p(u) + p(v), which are
+  // nonnegative for a consistent potential p; clamping only absorbs
+  // roundoff.  A distance D(v) in reduced costs is d(v) + p(v) - p(source).
+  workspace.Distance[0][source] = 0;
+  workspace.Heap[0].push_back( HeapEntryType( 0, source ) );
+  workspace.Touched.push_back( source );
+  if( bidirectional )
+    {
+    workspace.Distance[1][target] = 0;
+    workspace.Heap[1].push_back( HeapEntryType( 0, target ) );
+    workspace.Touched.push_back( target );
+    }
+
+  double     best = infinity;
+  NodeIdType meeting = target;
+  for( ;; )
+    {
+    // drop stale heap entries
+    bool exhausted = false;
+    for( unsigned int direction = 0; direction < ( bidirectional ? 2u : 1u ); direction++ )
+      {
+      std::vector<HeapEntryType> & heap = workspace.Heap[direction];
+      while( !heap.empty() && ( workspace.Settled[direction][heap.front().second]
+                                || heap.front().first > workspace.Distance[direction][heap.front().second] ) )
+        {
+        std::pop_heap( heap.begin(), heap.end(), HeapCompareType() );
+        heap.pop_back();
+        }
+      exhausted = exhausted || heap.empty();
+      }
+    if( exhausted )
+      {
+      break;
+      }
+
+    unsigned int direction = 0;
+    if( bidirectional )
+      {
+      const double forwardTop = workspace.Heap[0].front().first;
+      const double backwardTop = workspace.Heap[1].front().first;
+      if( forwardTop + backwardTop >= best )
+        {
+        break;
+        }
+      direction = ( forwardTop <= backwardTop ) ? 0 : 1;
+      }
+
+    std::vector<HeapEntryType> & heap = workspace.Heap[direction];
+    const NodeIdType             u = heap.front().second;
+    const double                 distance = heap.front().first;
+    std::pop_heap( heap.begin(), heap.end(), HeapCompareType() );
+    heap.pop_back();
+    workspace.Settled[direction][u] = 1;
+    if( !bidirectional && u == target )
+      {
+      best = distance;
+      break;
+      }
+
+    const double        potential = this->Potential( u, source, target, bidirectional );
+    const SizeValueType end = this->m_RowOffsets[direction][u + 1];
+    for( SizeValueType e = this->m_RowOffsets[direction][u]; e < end; e++ )
+      {
+      const NodeIdType v = this->m_Neighbors[direction][e];
+      if( workspace.Settled[direction][v] )
+        {
+        continue;
+        }
+      // the backward search walks the edges in reverse, so the reduced cost
+      // of the same edge has the potential difference flipped
+      const double difference = this->Potential( v, source, target, bidirectional ) - potential;
+      const double reduced = std::max( static_cast<double>( this->m_Weights[direction][e] )
+                                       + ( direction == 0 ? difference : -difference ), 0.0 );
+      const double candidate = distance + reduced;
+      if( candidate < workspace.Distance[direction][v] )
+        {
+        if( workspace.Distance[0][v] == infinity && workspace.Distance[1][v] == infinity )
+          {
+          workspace.Touched.push_back( v );
+          }
+        workspace.Distance[direction][v] = candidate;
+        workspace.Parent[direction][v] = u;
+        heap.push_back( HeapEntryType( candidate, v ) );
+        std::push_heap( heap.begin(), heap.end(), HeapCompareType() );
+        if( bidirectional && workspace.Distance[1 - direction][v] < infinity
+            && candidate + workspace.Distance[1 - direction][v] < best )
+          {
+          best = candidate + workspace.Distance[1 - direction][v];
+          meeting = v;
+          }
+        }
+      }
+    }
+
+  if( best == infinity )
+    {
+    return this->GetInfinity();
+    }
+
+  if( path )
+    {
+    for( NodeIdType n = meeting; n != source; n = workspace.Parent[0][n] )
+      {
+      path->push_back( n );
+      }
+    path->push_back( source );
+    std::reverse( path->begin(), path->end() );
+    if( bidirectional )
+      {
+      for( NodeIdType n = meeting; n != target; )
+        {
+        n = workspace.Parent[1][n];
+        path->push_back( n );
+        }
+      }
+    }
+
+  // undo the potentials: the reduced cost of the whole path differs from
+  // its real cost by p(target) - p(source)
+  return static_cast<CostType>( best - this->Potential( target, source, target, bidirectional )
+                                + this->Potential( source, source, target, bidirectional ) );
+}
+
+template <class TCost, unsigned int NDimension>
+typename DijkstrasQueryEngine<TCost, NDimension>::CostType
+DijkstrasQueryEngine<TCost, NDimension>::FindPath( NodeIdType source, NodeIdType target, PathType * path )
+{
+  if( source >= this->m_NumberOfNodes || target >= this->m_NumberOfNodes )
+    {
+    itkExceptionMacro( "Query " << source << " -> " << target << " refers to a node outside the graph." );
+    }
+  return this->Search( source, target, this->m_Workspace, path );
+}
+
+template <class TCost, unsigned int NDimension>
+void DijkstrasQueryEngine<TCost, NDimension>::FindPaths( const std::vector<NodeIdType> & sources,
+                                                         const std::vector<NodeIdType> & targets,
+                                                         std::vector<CostType> & costs,
+                                                         std::vector<PathType> * paths )
+{
+  if( sources.size() != targets.size() )
+    {
+    itkExceptionMacro( "The query sources and targets differ in length." );
+    }
+  for( SizeValueType q = 0; q < sources.size(); q++ )
+    {
+    if( sources[q] >= this->m_NumberOfNodes || targets[q] >= this->m_NumberOfNodes )
+      {
+      itkExceptionMacro( "Query " << q << " refers to a node outside the graph." );
+      }
+    }
+
+  const SizeValueType numberOfQueries = sources.size();
+  costs.resize( numberOfQueries );
+  if( paths )
+    {
+    paths->resize( numberOfQueries );
+    }
+  if( numberOfQueries == 0 )
+    {
+    return;
+    }
+
+  const ThreadIdType numberOfThreads =
+    ::ants::GetNumberOfThreadsForRange( numberOfQueries, this->m_NumberOfThreads );
+  std::vector<SearchWorkspace> workspaces( numberOfThreads );
+
+  DijkstrasQueryFunctor<Self> functor;
+  functor.m_Engine = this;
+  functor.m_Sources = &sources;
+  functor.m_Targets = &targets;
+  functor.m_Costs = &costs;
+  functor.m_Paths = paths;
+  functor.m_Workspaces = &workspaces;
+  ::ants::ParallelizeRange( 0, numberOfQueries, functor, numberOfThreads );
+}
+
+template <class TCost, unsigned int NDimension>
+void DijkstrasQueryEngine<TCost, NDimension>::FindDistances( NodeIdType source, const std::vector<NodeIdType> & targets,
+                                                             std::vector<CostType> & costs )
+{
+  typedef std::pair<double, NodeIdType> HeapEntryType;
+  typedef std::greater<HeapEntryType>   HeapCompareType;
+
+  if( source >= this->m_NumberOfNodes )
+    {
+    itkExceptionMacro( "Source " << source << " is outside the graph." );
+    }
+
+  SearchWorkspace & workspace = this->m_Workspace;
+  const double      infinity = vnl_huge_val( double() );
+  this->InitializeWorkspace( workspace );
+
+  // the backward settled flags mark the targets still to be reached
+  SizeValueType remaining = 0;
+  for( SizeValueType i = 0; i < targets.size(); i++ )
+    {
+    if( targets[i] >= this->m_NumberOfNodes )
+      {
+      itkExceptionMacro( "Target " << targets[i] << " is outside the graph." );
+      }
+    if( !workspace.Settled[1][targets[i]] )
+      {
+      workspace.Settled[1][targets[i]] = 1;
+      remaining++;
+      }
+    }
+
+  std::vector<HeapEntryType> & heap = workspace.Heap[0];
+  workspace.Distance[0][source] = 0;
+  workspace.Touched.push_back( source );
+  heap.push_back( HeapEntryType( 0, source ) );
+  while( remaining > 0 && !heap.empty() )
+    {
+    const NodeIdType u = heap.front().second;
+    const double     distance = heap.front().first;
+    std::pop_heap( heap.begin(), heap.end(), HeapCompareType() );
+    heap.pop_back();
+    if( workspace.Settled[0][u] || distance > workspace.Distance[0][u] )
+      {
+      continue;
+      }
+    workspace.Settled[0][u] = 1;
+    if( workspace.Settled[1][u] )
+      {
+      remaining--;
+      }
+
+    const SizeValueType end = this->m_RowOffsets[0][u + 1];
+    for( SizeValueType e = this->m_RowOffsets[0][u]; e < end; e++ )
+      {
+      const NodeIdType v = this->m_Neighbors[0][e];
+      const double     candidate = distance + static_cast<double>( this->m_Weights[0][e] );
+      if( candidate < workspace.Distance[0][v] )
+        {
+        if( workspace.Distance[0][v] == infinity )
+          {
+          workspace.Touched.push_back( v );
+          }
+        workspace.Distance[0][v] = candidate;
+        heap.push_back( HeapEntryType( candidate, v ) );
+        std::push_heap( heap.begin(), heap.end(), HeapCompareType() );
+        }
+      }
+    }
+
+  costs.resize( targets.size() );
+  for( SizeValueType i = 0; i < targets.size(); i++ )
+    {
+    const double distance = workspace.Distance[0][targets[i]];
+    costs[i] = ( distance == infinity ) ? this->GetInfinity() : static_cast<CostType>( distance );
+    workspace.Settled[1][targets[i]] = 0;
+    }
+}
+
+template <class TCost, unsigned int NDimension>
+void DijkstrasQueryEngine<TCost, NDimension>::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "NumberOfNodes: " << this->m_NumberOfNodes << std::endl;
+  os << indent << "NumberOfEdges: " << this->m_Neighbors[0].size() << std::endl;
+  os << indent << "HeuristicScale: " << this->m_HeuristicScale << std::endl;
+  os << indent << "UseBidirectionalSearch: " << this->m_UseBidirectionalSearch << std::endl;
+  os << indent << "UseAStar: " << this->m_UseAStar << std::endl;
+  os << indent << "NumberOfThreads: " << this->m_NumberOfThreads << std::endl;
+}
 } // end namespace itk
 
 #endif
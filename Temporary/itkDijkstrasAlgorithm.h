@@ -52,6 +52,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "itkImageRegionIteratorWithIndex.h"
 #include "itkNeighborhoodIterator.h"
 #include "itkVector.h"
+#include "antsParallelizeRange.h"
 using namespace std;
 
 namespace itk
@@ -687,6 +688,180 @@ private:
   DijkstrasAlgorithm(const Self &); // purposely not implemented
   void operator=(const Self &);     // purposely not implemented
 };
+
+/**
+ * \class DijkstrasQueryEngine
+ * \brief Point-to-point shortest path queries over a fixed graph.
+ *
+ *  DijkstrasAlgorithm grows a single search from its sources over graph
+ *  nodes that are allocated as they are reached, and has to be reset
+ *  before every query.  This engine instead stores the graph once in
+ *  compressed sparse row (CSR) form -- one offset array, one neighbor array
+ *  and one weight array, plus the transposed graph for backward searches --
+ *  and answers any number of queries against it.
+ *
+ *  A query stops as soon as its target is settled.  By default it runs a
+ *  bidirectional search, and when the nodes have locations it guides both
+ *  directions with an A* heuristic: the Euclidean distance to the target
+ *  (or source) scaled by the smallest weight-to-length ratio of any edge,
+ *  which keeps the heuristic consistent for any nonnegative weights.  The
+ *  bidirectional A* uses the average of the two potentials, so both searches
+ *  run on the same nonnegative reduced edge costs and the usual
+ *  bidirectional stopping rule stays exact.
+ *
+ *  FindPaths answers a batch of queries in parallel, one search workspace
+ *  per thread; FindDistances answers one source against many targets with a
+ *  single search that ends once every target is settled.
+ *  Edge weights must be nonnegative.
+ */
+template <class TCost = double, unsigned int NDimension = 3>
+class DijkstrasQueryEngine : public itk::LightObject
+{
+public:
+  typedef DijkstrasQueryEngine     Self;
+  typedef LightObject              Superclass;
+  typedef SmartPointer<Self>       Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+  itkTypeMacro(DijkstrasQueryEngine, LightObject);
+  itkNewMacro(Self);
+
+  enum { Dimension = NDimension };
+  typedef TCost                                 CostType;
+  typedef unsigned int                          NodeIdType;
+  typedef itk::Vector<double, NDimension>       LocationType;
+  typedef std::vector<NodeIdType>               PathType;
+
+  /** Build the graph from a directed edge list; list both directions of
+   *  an undirected edge.  locations may be empty, which turns off A*. */
+  void SetGraph( unsigned int numberOfNodes, const std::vector<LocationType> & locations,
+                 const std::vector<NodeIdType> & edgeSources, const std::vector<NodeIdType> & edgeTargets,
+                 const std::vector<CostType> & edgeWeights );
+
+  /** Build the graph from GraphSearchNodes (e.g. the surface graphs of
+   *  ManifoldIntegrationAlgorithm), weighting each neighbor link by the
+   *  Euclidean distance between the node locations.  Node i of the engine
+   *  is nodes[i]; neighbors are found through GetIdentity(). */
+  template <class TGraphSearchNode>
+  void SetGraphFromSearchNodes( const std::vector<typename TGraphSearchNode::Pointer> & nodes );
+
+  unsigned int GetNumberOfNodes() const
+  {
+    return this->m_NumberOfNodes;
+  }
+
+  SizeValueType GetNumberOfEdges() const
+  {
+    return this->m_Neighbors[0].size();
+  }
+
+  /** cost reported for unreachable targets */
+  CostType GetInfinity() const
+  {
+    return vnl_huge_val( CostType() );
+  }
+
+  itkSetMacro( UseBidirectionalSearch, bool );
+  itkGetConstMacro( UseBidirectionalSearch, bool );
+  itkBooleanMacro( UseBidirectionalSearch );
+
+  itkSetMacro( UseAStar, bool );
+  itkGetConstMacro( UseAStar, bool );
+  itkBooleanMacro( UseAStar );
+
+  /** threads used by FindPaths; 0 uses the ITK global default */
+  itkSetMacro( NumberOfThreads, ThreadIdType );
+  itkGetConstMacro( NumberOfThreads, ThreadIdType );
+
+  /** Shortest path cost from source to target, and optionally the path
+   *  (source first, target last; empty if unreachable). */
+  CostType FindPath( NodeIdType source, NodeIdType target, PathType * path = ITK_NULLPTR );
+
+  /** Answer sources[i] -> targets[i] for all i in parallel. */
+  void FindPaths( const std::vector<NodeIdType> & sources, const std::vector<NodeIdType> & targets,
+                  std::vector<CostType> & costs, std::vector<PathType> * paths = ITK_NULLPTR );
+
+  /** Shortest path costs from one source to several targets. */
+  void FindDistances( NodeIdType source, const std::vector<NodeIdType> & targets, std::vector<CostType> & costs );
+
+  /** Per-thread search state, sized to the graph and reset lazily. */
+  struct SearchWorkspace
+    {
+    std::vector<double>        Distance[2];
+    std::vector<NodeIdType>    Parent[2];
+    std::vector<unsigned char> Settled[2];
+    std::vector<NodeIdType>    Touched;
+    std::vector<std::pair<double, NodeIdType> > Heap[2];
+    };
+
+  /** Runs one query in the given workspace; used by FindPath and FindPaths. */
+  CostType Search( NodeIdType source, NodeIdType target, SearchWorkspace & workspace, PathType * path ) const;
+
+protected:
+  DijkstrasQueryEngine();
+  ~DijkstrasQueryEngine()
+  {
+  }
+
+  void PrintSelf( std::ostream & os, Indent indent ) const ITK_OVERRIDE;
+
+private:
+  DijkstrasQueryEngine(const Self &); // purposely not implemented
+  void operator=(const Self &);       // purposely not implemented
+
+  void InitializeWorkspace( SearchWorkspace & workspace ) const;
+
+  void ResetWorkspace( SearchWorkspace & workspace ) const;
+
+  /** scaled Euclidean distance between two nodes, a lower bound on their
+   *  shortest path cost */
+  double Heuristic( NodeIdType a, NodeIdType b ) const;
+
+  /** A* potential of node v for a query; the bidirectional search uses the
+   *  average of the forward and backward heuristics */
+  double Potential( NodeIdType v, NodeIdType source, NodeIdType target, bool bidirectional ) const;
+
+  unsigned int m_NumberOfNodes;
+  /** CSR arrays of the graph ([0]) and of its transpose ([1]) */
+  std::vector<SizeValueType> m_RowOffsets[2];
+  std::vector<NodeIdType>    m_Neighbors[2];
+  std::vector<CostType>      m_Weights[2];
+  std::vector<LocationType>  m_Locations;
+  double                     m_HeuristicScale;
+
+  bool         m_UseBidirectionalSearch;
+  bool         m_UseAStar;
+  ThreadIdType m_NumberOfThreads;
+
+  SearchWorkspace m_Workspace;
+};
+
+/** ParallelizeRange callback of DijkstrasQueryEngine::FindPaths. */
+template <class TEngine>
+class DijkstrasQueryFunctor
+{
+public:
+  typedef typename TEngine::NodeIdType      NodeIdType;
+  typedef typename TEngine::CostType        CostType;
+  typedef typename TEngine::PathType        PathType;
+  typedef typename TEngine::SearchWorkspace SearchWorkspace;
+
+  const TEngine *                 m_Engine;
+  const std::vector<NodeIdType> * m_Sources;
+  const std::vector<NodeIdType> * m_Targets;
+  std::vector<CostType> *         m_Costs;
+  std::vector<PathType> *         m_Paths;
+  std::vector<SearchWorkspace> *  m_Workspaces;
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType threadId )
+  {
+    SearchWorkspace & workspace = ( *this->m_Workspaces )[threadId];
+    for( SizeValueType q = begin; q < end; q++ )
+      {
+      ( *this->m_Costs )[q] = this->m_Engine->Search( ( *this->m_Sources )[q], ( *this->m_Targets )[q], workspace,
+                                                      this->m_Paths ? &( *this->m_Paths )[q] : ITK_NULLPTR );
+      }
+  }
+};
 } // end namespace itk
 
 #ifndef ITK_MANUAL_INSTANTIATION
@@ -5,6 +5,8 @@
 // #include "itkVectorIndexSelectionCastImageFilter.h"
 
 #include "antsUtilities.h"
+#include "antsSymmetricEigenSystem3.h"
+#include "itkIntTypes.h"
 #include "itkSymmetricSecondRankTensor.h"
 #include "itkVector.h"
 #include "itkVersor.h"
@@ -161,8 +163,98 @@ unsigned int size(const itk::Vector<TFloat, NDim> &)
 }
 
 }
+/** Eigenvalues of a 3x3 tensor in increasing order, by the closed-form solver
+ *  of antsSymmetricEigenSystem3.h. */
 template <class TensorType>
-TensorType TensorLogAndExp( TensorType dtv, bool takelog, bool & success)
+void TensorEigenValues( const TensorType & dtv, double D[3] )
+{
+  const double tensor[6] = { dtv[0], dtv[1], dtv[2], dtv[3], dtv[4], dtv[5] };
+
+  ants::SymmetricEigenValues3( tensor, D );
+}
+
+/** Eigenvalues in increasing order, with V[i][k] the i-th component of the
+ *  eigenvector of D[k], as vnl_symmetric_eigensystem returns them. */
+template <class TensorType>
+void TensorEigenSystem( const TensorType & dtv, double D[3], double V[3][3] )
+{
+  const double tensor[6] = { dtv[0], dtv[1], dtv[2], dtv[3], dtv[4], dtv[5] };
+
+  ants::SymmetricEigenSystem3( tensor, D, V );
+}
+
+/** The same decomposition laid out like
+ *  SymmetricSecondRankTensor::ComputeEigenAnalysis, eigenvectors in rows. */
+template <class TensorType>
+void ComputeTensorEigenAnalysis( const TensorType & dtv,
+                                 typename TensorType::EigenValuesArrayType & eigenValues,
+                                 typename TensorType::EigenVectorsMatrixType & eigenVectors )
+{
+  double D[3];
+  double V[3][3];
+
+  TensorEigenSystem<TensorType>( dtv, D, V );
+  for( unsigned int k = 0; k < 3; k++ )
+    {
+    eigenValues[k] = D[k];
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      eigenVectors(k, i) = V[i][k];
+      }
+    }
+}
+
+/**
+ * Decomposes tensors[begin, end) a block at a time with
+ * ants::SymmetricEigenSystem3Batch and calls
+ *
+ *   visitor( offset, tensors[offset], D, V );
+ *
+ * for each of them, in order.  V is only filled when computeEigenVectors is
+ * set.  The tensor maps use this to run whole images through the batched
+ * solver while keeping the per-voxel logic of the functions below.
+ */
+template <class TensorType, class TVisitor>
+void VisitTensorEigenSystems( const TensorType *tensors, itk::SizeValueType begin, itk::SizeValueType end,
+                              bool computeEigenVectors, TVisitor & visitor )
+{
+  ants::SymmetricEigenSystem3Batch batch;
+  double                           D[3];
+  double                           V[3][3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+
+  for( itk::SizeValueType blockBegin = begin; blockBegin < end;
+       blockBegin += ants::SymmetricEigenSystem3Batch::BlockSize )
+    {
+    const unsigned int count = static_cast<unsigned int>(
+        std::min<itk::SizeValueType>( ants::SymmetricEigenSystem3Batch::BlockSize, end - blockBegin ) );
+    for( unsigned int i = 0; i < count; i++ )
+      {
+      batch.SetTensor( i, tensors[blockBegin + i] );
+      }
+    if( computeEigenVectors )
+      {
+      batch.ComputeEigenSystem( count );
+      }
+    else
+      {
+      batch.ComputeEigenValues( count );
+      }
+    for( unsigned int i = 0; i < count; i++ )
+      {
+      batch.GetEigenValues( i, D );
+      if( computeEigenVectors )
+        {
+        batch.GetEigenVectors( i, V );
+        }
+      visitor( blockBegin + i, tensors[blockBegin + i], D, V );
+      }
+    }
+}
+
+/** The early outs of TensorLogAndExp.  Returns false, with dtv set to what
+ *  TensorLogAndExp returns, when the tensor is not transformed. */
+template <class TensorType>
+bool IsLogAndExpTensor( TensorType & dtv, bool & success )
 {
   float eps = 1.e-12, mag = 0;
 
@@ -174,7 +266,7 @@ TensorType TensorLogAndExp( TensorType dtv, bool takelog, bool & success)
       {
       dtv.Fill(0); // dtv[0]=eps;   dtv[3]=eps;  dtv[5]=eps;
       success = false;
-      return dtv;
+      return false;
       }
     }
   mag = sqrt(mag);
@@ -198,36 +290,29 @@ TensorType TensorLogAndExp( TensorType dtv, bool takelog, bool & success)
     if( jj == 3 )
       {
       success = false;
-      return dtv;
+      return false;
       }
     }
 
   if( mag < eps )
     {
     success = false;
-    return dtv;
+    return false;
     }
-  // typedef vnl_matrix<double>        MatrixType;
-  typedef itk::VariableSizeMatrix<typename TensorType::ValueType> MatrixType;
+  return true;
+}
 
-  // MatrixType DT = Vector2Matrix<TensorType,MatrixType>(dtv);
-  MatrixType D;
-  MatrixType V;
-  EigenAnalysis<TensorType, MatrixType>(dtv, D, V);
-  double e1 = D(0, 0);
-  double e2 = D(1, 1);
-  double e3 = D(2, 2);
-  // float peigeps=1.e-12;
+/** The matrix log or exp of a tensor that passed IsLogAndExpTensor, given
+ *  its eigen decomposition. */
+template <class TensorType>
+TensorType TensorLogAndExp( TensorType dtv, bool takelog, bool & success, const double D[3], const double V[3][3] )
+{
+  double e1 = D[0];
+  double e2 = D[1];
+  double e3 = D[2];
 
-  if( fabs(e3) < eps )
-    {
-    // success = false;
-    // std::cout << "-4" << std::flush;
-    // return dtv;
-    }
+  double eigmat[3];
 
-  MatrixType eigmat(3, 3);
-  eigmat.Fill(0);
   if( takelog )
     {
     if( e1 < 0 )
@@ -238,33 +323,102 @@ TensorType TensorLogAndExp( TensorType dtv, bool takelog, bool & success)
       {
       e3 = e2;
       }
-    eigmat(0, 0) = log(fabs(e1) );
-    eigmat(1, 1) = log(fabs(e2) );
-    eigmat(2, 2) = log(fabs(e3) );
+    eigmat[0] = log(fabs(e1) );
+    eigmat[1] = log(fabs(e2) );
+    eigmat[2] = log(fabs(e3) );
     }
   else // take exp
     {
-    eigmat(0, 0) = exp(e1);
-    eigmat(1, 1) = exp(e2);
-    eigmat(2, 2) = exp(e3);
+    eigmat[0] = exp(e1);
+    eigmat[1] = exp(e2);
+    eigmat[2] = exp(e3);
     }
 
-  if( vnl_math_isnan(eigmat(0, 0) ) ||
-      vnl_math_isnan(eigmat(1, 1) ) ||
-      vnl_math_isnan(eigmat(2, 2) ) )
+  if( vnl_math_isnan(eigmat[0]) ||
+      vnl_math_isnan(eigmat[1]) ||
+      vnl_math_isnan(eigmat[2]) )
     {
     dtv.Fill(0);
     success = false;
     return dtv;
     }
 
-  typedef typename MatrixType::InternalMatrixType VnlMatrixType;
-  VnlMatrixType DTrec = V.GetVnlMatrix() * eigmat.GetVnlMatrix() * V.GetTranspose();
-  TensorType    dtv2 = Matrix2Vector<TensorType, VnlMatrixType>(DTrec);
+  // V * eigmat * V^T
+  unsigned int tensorIndex = 0;
+  for( unsigned int i = 0; i < 3; ++i )
+    {
+    for( unsigned int j = i; j < 3; ++j, ++tensorIndex )
+      {
+      dtv[tensorIndex] = V[i][0] * eigmat[0] * V[j][0]
+        + V[i][1] * eigmat[1] * V[j][1]
+        + V[i][2] * eigmat[2] * V[j][2];
+      }
+    }
+  return dtv;
+}
+
+template <class TensorType>
+TensorType TensorLogAndExp( TensorType dtv, bool takelog, bool & success)
+{
+  if( !IsLogAndExpTensor<TensorType>( dtv, success ) )
+    {
+    return dtv;
+    }
+
+  double D[3];
+  double V[3][3];
+  TensorEigenSystem<TensorType>( dtv, D, V );
 
-  return dtv2;
+  return TensorLogAndExp<TensorType>( dtv, takelog, success, D, V );
 }
 
+template <class TensorType>
+class TensorLogAndExpVisitor
+{
+public:
+  TensorType * m_Output;
+  bool         m_TakeLog;
+
+  void operator()( itk::SizeValueType offset, TensorType dtv, const double D[3], const double V[3][3] )
+  {
+    bool success = true;
+
+    if( IsLogAndExpTensor<TensorType>( dtv, success ) )
+      {
+      dtv = TensorLogAndExp<TensorType>( dtv, this->m_TakeLog, success, D, V );
+      }
+    this->m_Output[offset] = dtv;
+  }
+};
+
+/** TensorLogAndExp of input[begin, end) into output[begin, end), through the
+ *  batched eigensolver. */
+template <class TensorType>
+void TensorLogAndExpRange( const TensorType *input, TensorType *output,
+                           itk::SizeValueType begin, itk::SizeValueType end, bool takelog )
+{
+  TensorLogAndExpVisitor<TensorType> visitor;
+
+  visitor.m_Output = output;
+  visitor.m_TakeLog = takelog;
+  VisitTensorEigenSystems<TensorType>( input, begin, end, true, visitor );
+}
+
+/** ParallelizeRange functor for TensorLogAndExpRange over whole buffers. */
+template <class TensorType>
+class TensorLogAndExpFunctor
+{
+public:
+  const TensorType * m_Input;
+  TensorType *       m_Output;
+  bool               m_TakeLog;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    TensorLogAndExpRange<TensorType>( this->m_Input, this->m_Output, begin, end, this->m_TakeLog );
+  }
+};
+
 template <class TensorType>
 TensorType TensorLog( TensorType dtv, bool success = true )
 {
@@ -293,29 +447,19 @@ bool IsRealTensor( TensorType dtv )
 }
 
 template <class TensorType>
-float  GetTensorFA( TensorType dtv )
+float  GetTensorFA( TensorType dtv, const double D[3] )
 {
 
-  // Check for zero diffusion (probably background) and return zero FA 
+  // Check for zero diffusion (probably background) and return zero FA
   // if that's the case
-  if (dtv[0] + dtv[3] + dtv[5] == 0.0f) 
+  if (dtv[0] + dtv[3] + dtv[5] == 0.0f)
     {
       return 0.0f;
     }
 
-  typedef vnl_matrix<double> MatrixType;
-  MatrixType DT(3, 3);
-  DT.fill(0);
-  DT(0, 0) = dtv[0];
-  DT(1, 1) = dtv[3];
-  DT(2, 2) = dtv[5];
-  DT(1, 0) = DT(0, 1) = dtv[1];
-  DT(2, 0) = DT(0, 2) = dtv[2];
-  DT(2, 1) = DT(1, 2) = dtv[4];
-  vnl_symmetric_eigensystem<double> eig(DT);
-  double                            e1 = (eig.D(0, 0) );
-  double                            e2 = (eig.D(1, 1) );
-  double                            e3 = (eig.D(2, 2) );
+  double e1 = D[0];
+  double e2 = D[1];
+  double e3 = D[2];
   if( e1 < 0 )
     {
     e1 = e2;
@@ -333,21 +477,24 @@ float  GetTensorFA( TensorType dtv )
 }
 
 template <class TensorType>
-float  GetTensorFANumerator( TensorType dtv )
+float  GetTensorFA( TensorType dtv )
 {
-  typedef vnl_matrix<double> MatrixType;
-  MatrixType DT(3, 3);
-  DT.fill(0);
-  DT(0, 0) = dtv[0];
-  DT(1, 1) = dtv[3];
-  DT(2, 2) = dtv[5];
-  DT(1, 0) = DT(0, 1) = dtv[1];
-  DT(2, 0) = DT(0, 2) = dtv[2];
-  DT(2, 1) = DT(1, 2) = dtv[4];
-  vnl_symmetric_eigensystem<double> eig(DT);
-  double                            e1 = (eig.D(0, 0) );
-  double                            e2 = (eig.D(1, 1) );
-  double                            e3 = (eig.D(2, 2) );
+  if (dtv[0] + dtv[3] + dtv[5] == 0.0f)
+    {
+      return 0.0f;
+    }
+
+  double D[3];
+  TensorEigenValues<TensorType>( dtv, D );
+  return GetTensorFA<TensorType>( dtv, D );
+}
+
+template <class TensorType>
+float  GetTensorFANumerator( TensorType /* dtv */, const double D[3] )
+{
+  double e1 = D[0];
+  double e2 = D[1];
+  double e3 = D[2];
   if( e1 < 0 )
     {
     e1 = e2;
@@ -363,21 +510,19 @@ float  GetTensorFANumerator( TensorType dtv )
 }
 
 template <class TensorType>
-float  GetTensorFADenominator( TensorType dtv )
+float  GetTensorFANumerator( TensorType dtv )
 {
-  typedef vnl_matrix<double> MatrixType;
-  MatrixType DT(3, 3);
-  DT.fill(0);
-  DT(0, 0) = dtv[0];
-  DT(1, 1) = dtv[3];
-  DT(2, 2) = dtv[5];
-  DT(1, 0) = DT(0, 1) = dtv[1];
-  DT(2, 0) = DT(0, 2) = dtv[2];
-  DT(2, 1) = DT(1, 2) = dtv[4];
-  vnl_symmetric_eigensystem<double> eig(DT);
-  double                            e1 = (eig.D(0, 0) );
-  double                            e2 = (eig.D(1, 1) );
-  double                            e3 = (eig.D(2, 2) );
+  double D[3];
+  TensorEigenValues<TensorType>( dtv, D );
+  return GetTensorFANumerator<TensorType>( dtv, D );
+}
+
+template <class TensorType>
+float  GetTensorFADenominator( TensorType /* dtv */, const double D[3] )
+{
+  double e1 = D[0];
+  double e2 = D[1];
+  double e3 = D[2];
   if( e1 < 0 )
     {
     e1 = e2;
@@ -391,130 +536,89 @@ float  GetTensorFADenominator( TensorType dtv )
   return denom;
 }
 
+template <class TensorType>
+float  GetTensorFADenominator( TensorType dtv )
+{
+  double D[3];
+  TensorEigenValues<TensorType>( dtv, D );
+  return GetTensorFADenominator<TensorType>( dtv, D );
+}
+
 template <class TVectorType, class TTensorType>
 float  GetMetricTensorCost(  TVectorType dpath,  TTensorType dtv, unsigned int matrixpower)
 {
-  typedef vnl_matrix<double> MatrixType;
-  MatrixType DT(3, 3);
-  DT.fill(0);
-  DT(0, 0) = dtv[0];
-  DT(1, 1) = dtv[3];
-  DT(2, 2) = dtv[5];
-  DT(1, 0) = DT(0, 1) = dtv[1];
-  DT(2, 0) = DT(0, 2) = dtv[2];
-  DT(2, 1) = DT(1, 2) = dtv[4];
-
-  vnl_symmetric_eigensystem<double> eig(DT);
-  double                            e1 = (eig.D(0, 0) );
-  double                            e2 = (eig.D(1, 1) );
-  double                            e3 = (eig.D(2, 2) );
-  double                            etot = e1 + e2 + e3;
-  if( etot == 0 )
-    {
-    etot = 1;
-    }
+  double D[3];
+  double V[3][3];
 
-  MatrixType vec(3, 1);
-  vec(0, 0) = dpath[0];
-  vec(1, 0) = dpath[1];
-  vec(2, 0) = dpath[2];
-  MatrixType inv =  vnl_matrix_inverse<double>(DT);
-  for( unsigned int lo = 1; lo < matrixpower; lo++ )
+  TensorEigenSystem<TTensorType>( dtv, D, V );
+
+  // dpath^T DT^-(2^(matrixpower-1)) dpath, with the pseudo-inverse that
+  // vnl_matrix_inverse gives for zero eigenvalues
+  double cost = 0;
+  for( unsigned int k = 0; k < 3; k++ )
     {
-    inv = inv * inv;
+    if( D[k] == 0 )
+      {
+      continue;
+      }
+    double inv = 1.0 / D[k];
+    for( unsigned int lo = 1; lo < matrixpower; lo++ )
+      {
+      inv = inv * inv;
+      }
+    const double proj = V[0][k] * dpath[0] + V[1][k] * dpath[1] + V[2][k] * dpath[2];
+    cost += proj * proj * inv;
     }
 
-  MatrixType sol = vec.transpose() * inv * vec;
-  float      cost = sol(0, 0); // /etot;
-
-  return sqrt(cost);
+  return sqrt( static_cast<float>( cost ) );
 }
 
 template <class TVectorType, class TTensorType>
 TVectorType ChangeTensorByVector(  TVectorType dpath,  TTensorType dtv, float epsilon)
 {
-  typedef vnl_matrix<double> MatrixType;
-  MatrixType DT(3, 3);
-  DT.fill(0);
-  DT(0, 0) = dtv[0];
-  DT(1, 1) = dtv[3];
-  DT(2, 2) = dtv[5];
-  DT(1, 0) = DT(0, 1) = dtv[1];
-  DT(2, 0) = DT(0, 2) = dtv[2];
-  DT(2, 1) = DT(1, 2) = dtv[4];
-  vnl_symmetric_eigensystem<double> eig(DT);
-  double                            e3 = (eig.D(0, 0) );
-  double                            e2 = (eig.D(1, 1) );
-  double                            e1 = (eig.D(2, 2) );
-  double                            etot = e1 + e2 + e3;
-  if( etot == 0 )
-    {
-    etot = 1;
-    }
-
-  MatrixType vec(3, 1);
-  vec(0, 0) = dpath[0];
-  vec(1, 0) = dpath[1];
-  vec(2, 0) = dpath[2];
+  double D[3];
+  double V[3][3];
 
-  MatrixType evec1(3, 1); // biggest
-  evec1(0, 0) = eig.V(0, 2);
-  evec1(1, 0) = eig.V(1, 2);
-  evec1(2, 0) = eig.V(2, 2);
-  MatrixType evec2(3, 1); // middle
-  evec2(0, 0) = eig.V(0, 1);
-  evec2(1, 0) = eig.V(1, 1);
-  evec2(2, 0) = eig.V(2, 1);
-  MatrixType evec3(3, 1); // smallest
-  evec3(0, 0) = eig.V(0, 0);
-  evec3(1, 0) = eig.V(1, 0);
-  evec3(2, 0) = eig.V(2, 0);
+  TensorEigenSystem<TTensorType>( dtv, D, V );
 
-  float temp;
-  temp = (vec.transpose() * evec1)(0, 0);
-  temp = sqrt(temp * temp);
-  e1 *= ( 1.0 - epsilon * temp);
-  if( e1 < 1.e-11 )
+  // e[0] and V[.][2] are the biggest, e[2] and V[.][0] the smallest
+  double e[3] = { D[2], D[1], D[0] };
+  double DT[3][3] = { { 0, 0, 0 }, { 0, 0, 0 }, { 0, 0, 0 } };
+  for( unsigned int k = 0; k < 3; k++ )
     {
-    e1 = 1.e-11;
-    }
-
-  temp = (vec.transpose() * evec2)(0, 0);
-  temp = sqrt(temp * temp);
-  e2 *= ( 1.0 - epsilon * temp);
-  if( e2 < 1.e-11 )
-    {
-    e2 = 1.e-11;
-    }
+    const unsigned int column = 2 - k;
 
-  temp = (vec.transpose() * evec3)(0, 0);
-  temp = sqrt(temp * temp);
-  e3 *= ( 1.0 - epsilon * temp);
-  if( e3 < 1.e-11 )
-    {
-    e3 = 1.e-11;
+    float temp = dpath[0] * V[0][column] + dpath[1] * V[1][column] + dpath[2] * V[2][column];
+    temp = sqrt(temp * temp);
+    e[k] *= ( 1.0 - epsilon * temp);
+    if( e[k] < 1.e-11 )
+      {
+      e[k] = 1.e-11;
+      }
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      for( unsigned int j = 0; j < 3; j++ )
+        {
+        DT[i][j] += V[i][column] * V[j][column] * e[k];
+        }
+      }
     }
 
-  DT =  (evec3 * evec3.transpose() ) * e3 +   (evec2 * evec2.transpose() ) * e2  +  (evec1 * evec1.transpose() ) * e1;
-
   itk::Vector<float, 6> newtens;
-  newtens[0] = DT(0, 0);
-  newtens[3] = DT(1, 1);
-  newtens[5] = DT(2, 2);
-  newtens[1] = DT(0, 1);
-  newtens[2] = DT(0, 2);
-  newtens[4] = DT(2, 1);
+  newtens[0] = DT[0][0];
+  newtens[3] = DT[1][1];
+  newtens[5] = DT[2][2];
+  newtens[1] = DT[0][1];
+  newtens[2] = DT[0][2];
+  newtens[4] = DT[2][1];
 
   return newtens;
 }
 
+/** True when the eigenvalue maps of GetTensorADC are defined for dtv. */
 template <class TTensorType>
-float  GetTensorADC( TTensorType dtv,  unsigned int opt = 0)
+bool IsDecomposableTensor( TTensorType dtv )
 {
-  if( opt <= 1 )
-    {
-    return ( dtv[0] + dtv[3] + dtv[5] ) / 3.0;
-    }
   float eps = 1.e-9, mag = 0;
   for( unsigned int jj = 0; jj < 6; jj++ )
     {
@@ -522,36 +626,37 @@ float  GetTensorADC( TTensorType dtv,  unsigned int opt = 0)
     mag += ff * ff;
     if( vnl_math_isnan( ff ) || vnl_math_isinf(ff)   )
       {
-      return 0;
+      return false;
       }
     }
   mag = sqrt(mag);
 
   if(  dtv[1] == 0 && dtv[2] == 0 && dtv[4] == 0 )
     {
-    return 0;
+    return false;
     }
   if( mag < eps )
+    {
+    return false;
+    }
+  return true;
+}
+
+template <class TTensorType>
+float  GetTensorADC( TTensorType dtv,  unsigned int opt, const double D[3] )
+{
+  if( opt <= 1 )
+    {
+    return ( dtv[0] + dtv[3] + dtv[5] ) / 3.0;
+    }
+  if( !IsDecomposableTensor<TTensorType>( dtv ) )
     {
     return 0;
     }
 
-  itk::Vector<float, 6> dtv2;
-  typedef vnl_matrix<double> MatrixType;
-  MatrixType DT(3, 3);
-  DT.fill(0);
-  DT(0, 0) = dtv[0];
-  DT(1, 1) = dtv[3];
-  DT(2, 2) = dtv[5];
-  DT(1, 0) = DT(0, 1) = dtv[1];
-  DT(2, 0) = DT(0, 2) = dtv[2];
-  DT(2, 1) = DT(1, 2) = dtv[4];
-  //  if (takelog )std::cout << " TAKING LOG " << std::endl;  elsestd::cout << "TAKING EXP " << std::endl;
-  // std::cout << " dtv " << dtv << std::endl;
-  vnl_symmetric_eigensystem<double> eig(DT);
-  double                            e1 = (eig.D(0, 0) );
-  double                            e2 = (eig.D(1, 1) );
-  double                            e3 = (eig.D(2, 2) );
+  double e1 = D[0];
+  double e2 = D[1];
+  double e3 = D[2];
 
   /*
   opt  return
@@ -589,227 +694,145 @@ float  GetTensorADC( TTensorType dtv,  unsigned int opt = 0)
 }
 
 template <class TTensorType>
-itk::RGBPixel<unsigned char>   GetTensorRGB( TTensorType dtv )
+float  GetTensorADC( TTensorType dtv,  unsigned int opt = 0)
 {
-  typedef TTensorType TensorType;
-
-  itk::RGBPixel<unsigned char> zero;
-  zero.Fill(0);
-  float eps = 1.e-9, mag = 0;
-  for( unsigned int jj = 0; jj < 6; jj++ )
+  if( opt <= 1 )
     {
-    float ff = dtv[jj];
-    mag += ff * ff;
-    if( vnl_math_isnan( ff ) || vnl_math_isinf(ff)   )
-      {
-      return zero;
-      }
+    return ( dtv[0] + dtv[3] + dtv[5] ) / 3.0;
     }
-  mag = sqrt(mag);
-
-  itk::RGBPixel<unsigned char> rgb;
-
-  if(  dtv[1] == 0 && dtv[2] == 0 && dtv[4] == 0 )
+  if( !IsDecomposableTensor<TTensorType>( dtv ) )
     {
-    return zero;
+    return 0;
     }
-  if( mag < eps )
+
+  double D[3];
+  TensorEigenValues<TTensorType>( dtv, D );
+  return GetTensorADC<TTensorType>( dtv, opt, D );
+}
+
+template <class TTensorType>
+itk::RGBPixel<unsigned char>   GetTensorRGB( TTensorType dtv, const double D[3], const double V[3][3] )
+{
+  typedef TTensorType TensorType;
+
+  itk::RGBPixel<unsigned char> zero;
+  zero.Fill(0);
+  if( !IsDecomposableTensor<TensorType>( dtv ) )
     {
     return zero;
     }
 
-  typedef itk::VariableSizeMatrix<typename TTensorType::ValueType> EigenMatrixType;
-  EigenMatrixType evals(3, 3);
-  EigenMatrixType evecs(3, 3);
+  itk::RGBPixel<unsigned char> rgb;
 
-  EigenAnalysis<TensorType, EigenMatrixType>(dtv, evals, evecs);
-  float fa = GetTensorFA<TensorType>(dtv);
+  float fa = GetTensorFA<TensorType>(dtv, D);
 
-  rgb[0] = (unsigned char)(std::fabs(evecs(0, 2) ) * fa * 255);
-  rgb[1] = (unsigned char)(std::fabs(evecs(1, 2) ) * fa * 255);
-  rgb[2] = (unsigned char)(std::fabs(evecs(2, 2) ) * fa * 255);
+  rgb[0] = (unsigned char)(std::fabs(V[0][2]) * fa * 255);
+  rgb[1] = (unsigned char)(std::fabs(V[1][2]) * fa * 255);
+  rgb[2] = (unsigned char)(std::fabs(V[2][2]) * fa * 255);
 
   return rgb;
 }
 
 template <class TTensorType>
-itk::RGBPixel<float>   GetTensorPrincipalEigenvector( TTensorType dtv )
+itk::RGBPixel<unsigned char>   GetTensorRGB( TTensorType dtv )
 {
-  itk::RGBPixel<float> zero;
-
+  itk::RGBPixel<unsigned char> zero;
   zero.Fill(0);
-  float eps = 1.e-9, mag = 0;
-  for( unsigned int jj = 0; jj < 6; jj++ )
-    {
-    float ff = dtv[jj];
-    mag += ff * ff;
-    if( vnl_math_isnan( ff ) || vnl_math_isinf(ff)   )
-      {
-      return zero;
-      }
-    }
-  mag = sqrt(mag);
-
-  if(  dtv[1] == 0 && dtv[2] == 0 && dtv[4] == 0 )
+  if( !IsDecomposableTensor<TTensorType>( dtv ) )
     {
     return zero;
     }
-  if( mag < eps )
-    {
-    return zero;
-    }
-
-  itk::Vector<float, 6> dtv2;
-  typedef vnl_matrix<double> MatrixType;
-  MatrixType DT(3, 3);
-  DT.fill(0);
-  DT(0, 0) = dtv[0];
-  DT(1, 1) = dtv[3];
-  DT(2, 2) = dtv[5];
-  DT(1, 0) = DT(0, 1) = dtv[1];
-  DT(2, 0) = DT(0, 2) = dtv[2];
-  DT(2, 1) = DT(1, 2) = dtv[4];
-  //  if (takelog )std::cout << " TAKING LOG " << std::endl;  elsestd::cout << "TAKING EXP " << std::endl;
-  // std::cout << " dtv " << dtv << std::endl;
-  vnl_symmetric_eigensystem<double> eig(DT);
 
-  itk::RGBPixel<float> rgb;
+  double D[3];
+  double V[3][3];
+  TensorEigenSystem<TTensorType>( dtv, D, V );
+  return GetTensorRGB<TTensorType>( dtv, D, V );
+}
 
-  float xx = dtv[0];
-  float xy = dtv[1];
-  float xz = dtv[2];
-  float yy = dtv[3];
-  float yz = dtv[4];
-  float zz = dtv[5];
-  float isp = ( xx * xx + yy * yy + zz * zz + 2.0 * (xy * xy + xz * xz + yz * yz) );
+template <class TTensorType>
+itk::RGBPixel<float>   GetTensorPrincipalEigenvector( TTensorType dtv )
+{
+  itk::RGBPixel<float> zero;
 
-  float fa = 0.0;
-  if( isp > 0.0 )
+  zero.Fill(0);
+  if( !IsDecomposableTensor<TTensorType>( dtv ) )
     {
-    float trace = dtv[0];
-    trace += dtv[3];
-    trace += dtv[5];
-    float anisotropy = 3.0 * isp - trace * trace;
-    fa = ( std::sqrt(anisotropy / ( 2.0 * isp ) ) );
+    return zero;
     }
 
-  // rgb[0]=eig.V(2,0)*fa*255;//+eig.V(1,0)*e2;
-  // rgb[1]=eig.V(2,1)*fa*255;//+eig.V(1,1)*e2;
-  //  rgb[2]=eig.V(2,2)*fa*255;//+eig.V(1,2)*e2;
+  double D[3];
+  double V[3][3];
+  TensorEigenSystem<TTensorType>( dtv, D, V );
 
   // biggest evec
-  rgb[0] = eig.V(0, 2); // +eig.V(1,0)*e2;
-  rgb[1] = eig.V(1, 2); // +eig.V(1,1)*e2;
-  rgb[2] = eig.V(2, 2); // +eig.V(1,2)*e2;
-
-  return rgb;
-  mag = rgb[0] * rgb[0] + rgb[1] * rgb[1] + rgb[2] * rgb[2];
-
-  mag = sqrt(mag);
-  rgb[0] = rgb[0] / mag;
-  rgb[1] = rgb[1] / mag;
-  rgb[2] = rgb[2] / mag;
+  itk::RGBPixel<float> rgb;
+  rgb[0] = V[0][2];
+  rgb[1] = V[1][2];
+  rgb[2] = V[2][2];
 
   return rgb;
 }
 
 template <class TTensorType>
-itk::Vector<float>   GetTensorPrincipalEigenvector( TTensorType dtv, unsigned int whichvec)
+itk::Vector<float>   GetTensorPrincipalEigenvector( TTensorType dtv, unsigned int whichvec, const double V[3][3] )
 {
   itk::Vector<float, 3> zero;
 
   zero.Fill(0);
-  float eps = 1.e-9, mag = 0;
-  for( unsigned int jj = 0; jj < 6; jj++ )
-    {
-    float ff = dtv[jj];
-    mag += ff * ff;
-    if( vnl_math_isnan( ff ) || vnl_math_isinf(ff)   )
-      {
-      return zero;
-      }
-    }
-  mag = sqrt(mag);
-
-  if(  dtv[1] == 0 && dtv[2] == 0 && dtv[4] == 0 )
-    {
-    return zero;
-    }
-  if( mag < eps )
+  if( !IsDecomposableTensor<TTensorType>( dtv ) )
     {
     return zero;
     }
 
-  itk::Vector<float, 6> dtv2;
-  typedef vnl_matrix<double> MatrixType;
-  MatrixType DT(3, 3);
-  DT.fill(0);
-  DT(0, 0) = dtv[0];
-  DT(1, 1) = dtv[3];
-  DT(2, 2) = dtv[5];
-  DT(1, 0) = DT(0, 1) = dtv[1];
-  DT(2, 0) = DT(0, 2) = dtv[2];
-  DT(2, 1) = DT(1, 2) = dtv[4];
-  //  if (takelog )std::cout << " TAKING LOG " << std::endl;  else std::cout << "TAKING EXP " << std::endl;
-  // std::cout << " dtv " << dtv << std::endl;
-  vnl_symmetric_eigensystem<double> eig(DT);
-
   itk::Vector<float, 3> rgb;
+  rgb[0] = V[0][whichvec];
+  rgb[1] = V[1][whichvec];
+  rgb[2] = V[2][whichvec];
+
+  return rgb;
+}
 
-  float xx = dtv[0];
-  float xy = dtv[1];
-  float xz = dtv[2];
-  float yy = dtv[3];
-  float yz = dtv[4];
-  float zz = dtv[5];
-  float isp = ( xx * xx + yy * yy + zz * zz + 2.0 * (xy * xy + xz * xz + yz * yz) );
+template <class TTensorType>
+itk::Vector<float>   GetTensorPrincipalEigenvector( TTensorType dtv, unsigned int whichvec)
+{
+  itk::Vector<float, 3> zero;
 
-  if( isp > 0.0 )
+  zero.Fill(0);
+  if( !IsDecomposableTensor<TTensorType>( dtv ) )
     {
-    float trace = dtv[0];
-    trace += dtv[3];
-    trace += dtv[5];
+    return zero;
     }
 
-  rgb[0] = eig.V(0, whichvec); // +eig.V(1,0)*e2;
-  rgb[1] = eig.V(1, whichvec); // +eig.V(1,1)*e2;
-  rgb[2] = eig.V(2, whichvec); // +eig.V(1,2)*e2;
-
-  return rgb;
+  double D[3];
+  double V[3][3];
+  TensorEigenSystem<TTensorType>( dtv, D, V );
+  return GetTensorPrincipalEigenvector<TTensorType>( dtv, whichvec, V );
 }
 
 template <class TTensorType>
 static float GetMetricTensorCost(  itk::Vector<float, 3> dpath,  TTensorType dtv )
 {
-  typedef vnl_matrix<double> MatrixType;
-  MatrixType DT(3, 3);
-  DT.fill(0);
-  DT(0, 0) = dtv[0];
-  DT(1, 1) = dtv[3];
-  DT(2, 2) = dtv[5];
-  DT(1, 0) = DT(0, 1) = dtv[1];
-  DT(2, 0) = DT(0, 2) = dtv[2];
-  DT(2, 1) = DT(1, 2) = dtv[4];
-  vnl_symmetric_eigensystem<double> eig(DT);
-  double                            e1 = (eig.D(0, 0) );
-  double                            e2 = (eig.D(1, 1) );
-  double                            e3 = (eig.D(2, 2) );
-  double                            etot = e1 + e2 + e3;
+  double D[3];
+  double V[3][3];
+
+  TensorEigenSystem<TTensorType>( dtv, D, V );
+  double etot = D[0] + D[1] + D[2];
   if( etot == 0 )
     {
     etot = 1;
     }
 
-  MatrixType vec(3, 1);
-  vec(0, 0) = dpath[0];
-  vec(1, 0) = dpath[1];
-  vec(2, 0) = dpath[2];
-  MatrixType inv =  vnl_matrix_inverse<double>(DT);
-
-  MatrixType sol = vec.transpose() * inv * vec;
-  float      cost = sol(0, 0) / etot;
+  double cost = 0;
+  for( unsigned int k = 0; k < 3; k++ )
+    {
+    if( D[k] != 0 )
+      {
+      const double proj = V[0][k] * dpath[0] + V[1][k] * dpath[1] + V[2][k] * dpath[2];
+      cost += proj * proj / D[k];
+      }
+    }
 
-  return cost;
+  return cost / etot;
 }
 
 template <class TensorType, class VersorTensorType, class MatrixType>
@@ -0,0 +1,411 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __antsSymmetricEigenSystem3_h
+#define __antsSymmetricEigenSystem3_h
+
+#include <algorithm>
+#include <cmath>
+
+namespace ants
+{
+/**
+ * Closed-form eigen decomposition of 3x3 symmetric matrices, the diffusion
+ * tensor case that the tensor maps used to hand to vnl_symmetric_eigensystem
+ * one voxel at a time.
+ *
+ * The tensor is given by its six unique components in the ANTs order
+ * { xx, xy, xz, yy, yz, zz }.  As with vnl, the eigenvalues come back in
+ * increasing order and column k of the eigenvector matrix, V[i][k], is the
+ * unit eigenvector of eigenvalue k.  Eigenvalues come from the trigonometric
+ * solution of the characteristic cubic and eigenvectors from cross products
+ * of the rows of A - lambda I.  Both lose accuracy as two eigenvalues merge,
+ * so a matrix whose eigenvalue gaps fall below
+ * SymmetricEigenSystem3Tolerance of its spectral radius is decomposed again
+ * with cyclic Jacobi rotations.  The sign of each eigenvector is arbitrary,
+ * as it is with vnl.
+ */
+const double SymmetricEigenSystem3Tolerance = 1.e-5;
+
+/** Trigonometric eigenvalues of one tensor, in increasing order.  Returns
+ *  false when two eigenvalues are too close for the closed form to be
+ *  trusted.  There are no branches, so loops over this inline. */
+inline bool SymmetricEigenValues3( double a00, double a01, double a02,
+                                   double a11, double a12, double a22,
+                                   double & e0, double & e1, double & e2 )
+{
+  const double q = ( a00 + a11 + a22 ) / 3.0;
+  const double b00 = a00 - q;
+  const double b11 = a11 - q;
+  const double b22 = a22 - q;
+  const double offDiagonal = a01 * a01 + a02 * a02 + a12 * a12;
+  const double p = std::sqrt( ( b00 * b00 + b11 * b11 + b22 * b22 + 2.0 * offDiagonal ) / 6.0 );
+  const double inverseP = ( p > 0.0 ) ? 1.0 / p : 0.0;
+
+  // r = det( ( A - qI ) / p ) / 2 = cos( 3 phi )
+  const double c00 = b00 * inverseP;
+  const double c11 = b11 * inverseP;
+  const double c22 = b22 * inverseP;
+  const double c01 = a01 * inverseP;
+  const double c02 = a02 * inverseP;
+  const double c12 = a12 * inverseP;
+  double       r = 0.5 * ( c00 * ( c11 * c22 - c12 * c12 )
+                           - c01 * ( c01 * c22 - c12 * c02 )
+                           + c02 * ( c01 * c12 - c11 * c02 ) );
+  r = std::min( std::max( r, -1.0 ), 1.0 );
+
+  const double phi = std::acos( r ) / 3.0;
+  const double twoThirdsPi = 2.0943951023931954923;
+  e2 = q + 2.0 * p * std::cos( phi );
+  e0 = q + 2.0 * p * std::cos( phi + twoThirdsPi );
+  e1 = 3.0 * q - e0 - e2;
+
+  const double scale = std::max( std::fabs( e0 ), std::fabs( e2 ) );
+  const double tolerance = SymmetricEigenSystem3Tolerance * scale;
+  return ( e1 - e0 ) > tolerance && ( e2 - e1 ) > tolerance;
+}
+
+/** Unit eigenvector of a well separated eigenvalue: the longest cross product
+ *  of two rows of A - lambda I. */
+inline void SymmetricEigenVector3( double a00, double a01, double a02,
+                                   double a11, double a12, double a22,
+                                   double lambda, double & x, double & y, double & z )
+{
+  const double r00 = a00 - lambda;
+  const double r11 = a11 - lambda;
+  const double r22 = a22 - lambda;
+
+  // rows r0 = ( r00, a01, a02 ), r1 = ( a01, r11, a12 ), r2 = ( a02, a12, r22 )
+  const double x01 = a01 * a12 - a02 * r11;
+  const double y01 = a02 * a01 - r00 * a12;
+  const double z01 = r00 * r11 - a01 * a01;
+  const double x02 = a01 * r22 - a02 * a12;
+  const double y02 = a02 * a02 - r00 * r22;
+  const double z02 = r00 * a12 - a01 * a02;
+  const double x12 = r11 * r22 - a12 * a12;
+  const double y12 = a12 * a02 - a01 * r22;
+  const double z12 = a01 * a12 - r11 * a02;
+
+  const double n01 = x01 * x01 + y01 * y01 + z01 * z01;
+  const double n02 = x02 * x02 + y02 * y02 + z02 * z02;
+  const double n12 = x12 * x12 + y12 * y12 + z12 * z12;
+
+  const bool   use01 = ( n01 >= n02 ) && ( n01 >= n12 );
+  const bool   use02 = !use01 && ( n02 >= n12 );
+  const double norm = use01 ? n01 : ( use02 ? n02 : n12 );
+  const double inverseNorm = ( norm > 0.0 ) ? 1.0 / std::sqrt( norm ) : 0.0;
+
+  x = ( use01 ? x01 : ( use02 ? x02 : x12 ) ) * inverseNorm;
+  y = ( use01 ? y01 : ( use02 ? y02 : y12 ) ) * inverseNorm;
+  z = ( use01 ? z01 : ( use02 ? z02 : z12 ) ) * inverseNorm;
+}
+
+/** Closed-form eigenvectors for eigenvalues from SymmetricEigenValues3 that
+ *  passed the separation test.  The middle eigenvector is the cross product
+ *  of the outer two, after the smallest is orthogonalized against the
+ *  largest. */
+inline void SymmetricEigenVectors3( double a00, double a01, double a02,
+                                    double a11, double a12, double a22,
+                                    double e0, double e2, double V[3][3] )
+{
+  double x2, y2, z2;
+  SymmetricEigenVector3( a00, a01, a02, a11, a12, a22, e2, x2, y2, z2 );
+
+  double x0, y0, z0;
+  SymmetricEigenVector3( a00, a01, a02, a11, a12, a22, e0, x0, y0, z0 );
+
+  const double projection = x0 * x2 + y0 * y2 + z0 * z2;
+  x0 -= projection * x2;
+  y0 -= projection * y2;
+  z0 -= projection * z2;
+  const double norm = x0 * x0 + y0 * y0 + z0 * z0;
+  const double inverseNorm = ( norm > 0.0 ) ? 1.0 / std::sqrt( norm ) : 0.0;
+  x0 *= inverseNorm;
+  y0 *= inverseNorm;
+  z0 *= inverseNorm;
+
+  V[0][0] = x0;
+  V[1][0] = y0;
+  V[2][0] = z0;
+  V[0][1] = y2 * z0 - z2 * y0;
+  V[1][1] = z2 * x0 - x2 * z0;
+  V[2][1] = x2 * y0 - y2 * x0;
+  V[0][2] = x2;
+  V[1][2] = y2;
+  V[2][2] = z2;
+}
+
+/** Cyclic Jacobi decomposition, the fallback for (nearly) repeated
+ *  eigenvalues.  Eigenvalues are sorted in increasing order. */
+inline void JacobiSymmetricEigenSystem3( const double tensor[6], double D[3], double V[3][3] )
+{
+  double A[3][3];
+
+  A[0][0] = tensor[0];
+  A[0][1] = A[1][0] = tensor[1];
+  A[0][2] = A[2][0] = tensor[2];
+  A[1][1] = tensor[3];
+  A[1][2] = A[2][1] = tensor[4];
+  A[2][2] = tensor[5];
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    for( unsigned int j = 0; j < 3; j++ )
+      {
+      V[i][j] = ( i == j ) ? 1.0 : 0.0;
+      }
+    }
+
+  const unsigned int pairs[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+  for( unsigned int sweep = 0; sweep < 50; sweep++ )
+    {
+    const double offDiagonal = A[0][1] * A[0][1] + A[0][2] * A[0][2] + A[1][2] * A[1][2];
+    const double diagonal = A[0][0] * A[0][0] + A[1][1] * A[1][1] + A[2][2] * A[2][2];
+    if( !( offDiagonal > 1.e-36 * diagonal ) || !( offDiagonal <= diagonal + offDiagonal ) )
+      {
+      // converged, or not finite
+      break;
+      }
+    for( unsigned int n = 0; n < 3; n++ )
+      {
+      const unsigned int p = pairs[n][0];
+      const unsigned int q = pairs[n][1];
+      if( A[p][q] == 0.0 )
+        {
+        continue;
+        }
+      const double theta = ( A[q][q] - A[p][p] ) / ( 2.0 * A[p][q] );
+      const double t = ( theta >= 0.0 ? 1.0 : -1.0 ) / ( std::fabs( theta ) + std::sqrt( theta * theta + 1.0 ) );
+      const double c = 1.0 / std::sqrt( t * t + 1.0 );
+      const double s = t * c;
+      for( unsigned int k = 0; k < 3; k++ )
+        {
+        const double akp = A[k][p];
+        const double akq = A[k][q];
+        A[k][p] = c * akp - s * akq;
+        A[k][q] = s * akp + c * akq;
+        }
+      for( unsigned int k = 0; k < 3; k++ )
+        {
+        const double apk = A[p][k];
+        const double aqk = A[q][k];
+        A[p][k] = c * apk - s * aqk;
+        A[q][k] = s * apk + c * aqk;
+        }
+      for( unsigned int k = 0; k < 3; k++ )
+        {
+        const double vkp = V[k][p];
+        const double vkq = V[k][q];
+        V[k][p] = c * vkp - s * vkq;
+        V[k][q] = s * vkp + c * vkq;
+        }
+      }
+    }
+
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    D[i] = A[i][i];
+    }
+  for( unsigned int i = 0; i < 2; i++ )
+    {
+    unsigned int smallest = i;
+    for( unsigned int j = i + 1; j < 3; j++ )
+      {
+      if( D[j] < D[smallest] )
+        {
+        smallest = j;
+        }
+      }
+    if( smallest != i )
+      {
+      std::swap( D[i], D[smallest] );
+      for( unsigned int k = 0; k < 3; k++ )
+        {
+        std::swap( V[k][i], V[k][smallest] );
+        }
+      }
+    }
+}
+
+/** Eigenvalues of one tensor, in increasing order. */
+inline void SymmetricEigenValues3( const double tensor[6], double D[3] )
+{
+  if( !SymmetricEigenValues3( tensor[0], tensor[1], tensor[2], tensor[3], tensor[4], tensor[5],
+                              D[0], D[1], D[2] ) )
+    {
+    double V[3][3];
+    JacobiSymmetricEigenSystem3( tensor, D, V );
+    }
+}
+
+/** Eigenvalues and eigenvectors of one tensor. */
+inline void SymmetricEigenSystem3( const double tensor[6], double D[3], double V[3][3] )
+{
+  if( SymmetricEigenValues3( tensor[0], tensor[1], tensor[2], tensor[3], tensor[4], tensor[5],
+                             D[0], D[1], D[2] ) )
+    {
+    SymmetricEigenVectors3( tensor[0], tensor[1], tensor[2], tensor[3], tensor[4], tensor[5],
+                            D[0], D[2], V );
+    }
+  else
+    {
+    JacobiSymmetricEigenSystem3( tensor, D, V );
+    }
+}
+
+/**
+ * Decomposes a run of up to BlockSize tensors at once.  The components are
+ * kept in structure-of-arrays form, m_Tensor[component][voxel], so the
+ * closed-form pass is a straight, branch-free loop over voxels that the
+ * compiler can vectorize.  The few tensors with nearly repeated eigenvalues
+ * are flagged during that pass and redone with Jacobi afterwards.
+ *
+ * A block is about 36 kB, so give each thread its own.
+ */
+class SymmetricEigenSystem3Batch
+{
+public:
+  enum { BlockSize = 256 };
+
+  double        m_Tensor[6][BlockSize];
+  double        m_EigenValues[3][BlockSize];
+  double        m_EigenVectors[3][3][BlockSize];
+  unsigned char m_Separated[BlockSize];
+
+  template <class TTensor>
+  void SetTensor( unsigned int i, const TTensor & dtv )
+  {
+    for( unsigned int c = 0; c < 6; c++ )
+      {
+      this->m_Tensor[c][i] = dtv[c];
+      }
+  }
+
+  void ComputeEigenValues( unsigned int count )
+  {
+    this->ComputeClosedFormEigenValues( count );
+    for( unsigned int i = 0; i < count; i++ )
+      {
+      if( !this->m_Separated[i] )
+        {
+        double tensor[6];
+        double D[3];
+        double V[3][3];
+        this->GetTensor( i, tensor );
+        JacobiSymmetricEigenSystem3( tensor, D, V );
+        this->SetEigenValues( i, D );
+        }
+      }
+  }
+
+  void ComputeEigenSystem( unsigned int count )
+  {
+    this->ComputeClosedFormEigenValues( count );
+
+    const double *a00 = this->m_Tensor[0];
+    const double *a01 = this->m_Tensor[1];
+    const double *a02 = this->m_Tensor[2];
+    const double *a11 = this->m_Tensor[3];
+    const double *a12 = this->m_Tensor[4];
+    const double *a22 = this->m_Tensor[5];
+    for( unsigned int i = 0; i < count; i++ )
+      {
+      double V[3][3];
+      SymmetricEigenVectors3( a00[i], a01[i], a02[i], a11[i], a12[i], a22[i],
+                              this->m_EigenValues[0][i], this->m_EigenValues[2][i], V );
+      for( unsigned int r = 0; r < 3; r++ )
+        {
+        for( unsigned int c = 0; c < 3; c++ )
+          {
+          this->m_EigenVectors[r][c][i] = V[r][c];
+          }
+        }
+      }
+    for( unsigned int i = 0; i < count; i++ )
+      {
+      if( !this->m_Separated[i] )
+        {
+        double tensor[6];
+        double D[3];
+        double V[3][3];
+        this->GetTensor( i, tensor );
+        JacobiSymmetricEigenSystem3( tensor, D, V );
+        this->SetEigenValues( i, D );
+        for( unsigned int r = 0; r < 3; r++ )
+          {
+          for( unsigned int c = 0; c < 3; c++ )
+            {
+            this->m_EigenVectors[r][c][i] = V[r][c];
+            }
+          }
+        }
+      }
+  }
+
+  void GetEigenValues( unsigned int i, double D[3] ) const
+  {
+    for( unsigned int k = 0; k < 3; k++ )
+      {
+      D[k] = this->m_EigenValues[k][i];
+      }
+  }
+
+  void GetEigenVectors( unsigned int i, double V[3][3] ) const
+  {
+    for( unsigned int r = 0; r < 3; r++ )
+      {
+      for( unsigned int c = 0; c < 3; c++ )
+        {
+        V[r][c] = this->m_EigenVectors[r][c][i];
+        }
+      }
+  }
+
+private:
+  void ComputeClosedFormEigenValues( unsigned int count )
+  {
+    const double *a00 = this->m_Tensor[0];
+    const double *a01 = this->m_Tensor[1];
+    const double *a02 = this->m_Tensor[2];
+    const double *a11 = this->m_Tensor[3];
+    const double *a12 = this->m_Tensor[4];
+    const double *a22 = this->m_Tensor[5];
+    double *      e0 = this->m_EigenValues[0];
+    double *      e1 = this->m_EigenValues[1];
+    double *      e2 = this->m_EigenValues[2];
+    for( unsigned int i = 0; i < count; i++ )
+      {
+      this->m_Separated[i] = SymmetricEigenValues3( a00[i], a01[i], a02[i], a11[i], a12[i], a22[i],
+                                                    e0[i], e1[i], e2[i] );
+      }
+  }
+
+  void GetTensor( unsigned int i, double tensor[6] ) const
+  {
+    for( unsigned int c = 0; c < 6; c++ )
+      {
+      tensor[c] = this->m_Tensor[c][i];
+      }
+  }
+
+  void SetEigenValues( unsigned int i, const double D[3] )
+  {
+    for( unsigned int k = 0; k < 3; k++ )
+      {
+      this->m_EigenValues[k][i] = D[k];
+      }
+  }
+};
+} // end namespace ants
+
+#endif
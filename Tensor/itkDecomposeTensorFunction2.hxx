@@ -15,6 +15,7 @@
 #define _itkDecomposeTensorFunction2_hxx
 
 #include "itkDecomposeTensorFunction2.h"
+#include "antsSymmetricEigenSystem3.h"
 
 #include "vnl/algo/vnl_cholesky.h"
 #include "vnl/algo/vnl_qr.h"
@@ -84,6 +85,25 @@ DecomposeTensorFunction2<TInput, TRealType, TOutput>
   V.SetSize( RowDimensions, RowDimensions );
 
   D.Fill( 0.0 );
+
+  if( RowDimensions == 3 && ColumnDimensions == 3 )
+    {
+    // diffusion tensors take the closed-form solver
+    const double tensor[6] = { M[0][0], M[0][1], M[0][2], M[1][1], M[1][2], M[2][2] };
+    double       eigenValues[3];
+    double       eigenVectors[3][3];
+    ants::SymmetricEigenSystem3( tensor, eigenValues, eigenVectors );
+    for( unsigned int j = 0; j < 3; j++ )
+      {
+      for( unsigned int i = 0; i < 3; i++ )
+        {
+        V[i][j] = eigenVectors[i][j];
+        }
+      D[j][j] = eigenValues[j];
+      }
+    return;
+    }
+
   vnl_symmetric_eigensystem<RealType> eig( M.GetVnlMatrix() );
   for( unsigned int j = 0; j < ColumnDimensions; j++ )
     {
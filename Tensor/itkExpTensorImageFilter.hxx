@@ -25,6 +25,7 @@
 #include "vnl/algo/vnl_symmetric_eigensystem.h"
 #include "itkExpTensorImageFilter.h"
 #include "TensorFunctions.h"
+#include "antsParallelizeRange.h"
 
 namespace itk
 {
@@ -42,19 +43,16 @@ ExpTensorImageFilter<TInputImage, TOutputImage>
   InputImagePointer  input = this->GetInput();
   OutputImagePointer output = this->GetOutput();
 
-  ImageRegionConstIterator<InputImageType> inputIt( input, input->GetLargestPossibleRegion() );
-
   output->SetRegions( input->GetLargestPossibleRegion() );
   output->Allocate();
 
-  ImageRegionIterator<OutputImageType> outputIt( output, output->GetLargestPossibleRegion() );
-  for( inputIt.GoToBegin(), outputIt.GoToBegin();
-       !inputIt.IsAtEnd() && !outputIt.IsAtEnd(); ++inputIt, ++outputIt )
-    {
-    bool           success; // TODO -- actually check the result?
-    InputPixelType result = TensorLogAndExp<InputPixelType>(inputIt.Value(), false, success);
-    outputIt.Set( result );
-    }
+  // the tensors go through the batched eigensolver a block at a time
+  TensorLogAndExpFunctor<InputPixelType> functor;
+  functor.m_Input = input->GetBufferPointer();
+  functor.m_Output = output->GetBufferPointer();
+  functor.m_TakeLog = false;
+  ants::ParallelizeRange( 0, input->GetLargestPossibleRegion().GetNumberOfPixels(), functor,
+                          this->GetNumberOfThreads() );
 }
 
 /**
@@ -25,6 +25,7 @@
 #include "vnl/algo/vnl_symmetric_eigensystem.h"
 #include "itkLogTensorImageFilter.h"
 #include "TensorFunctions.h"
+#include "antsParallelizeRange.h"
 
 namespace itk
 {
@@ -42,19 +43,16 @@ LogTensorImageFilter<TInputImage, TOutputImage>
   InputImagePointer  input = this->GetInput();
   OutputImagePointer output = this->GetOutput();
 
-  ImageRegionConstIterator<InputImageType> inputIt( input, input->GetLargestPossibleRegion() );
-
   output->SetRegions( input->GetLargestPossibleRegion() );
   output->Allocate();
 
-  ImageRegionIteratorWithIndex<OutputImageType> outputIt( output, output->GetLargestPossibleRegion() );
-  for( inputIt.GoToBegin(), outputIt.GoToBegin();
-       !inputIt.IsAtEnd() && !outputIt.IsAtEnd();
-       ++inputIt, ++outputIt )
-    {
-    InputPixelType result = TensorLog<InputPixelType>(inputIt.Value() );
-    outputIt.Set( result );
-    }
+  // the tensors go through the batched eigensolver a block at a time
+  TensorLogAndExpFunctor<InputPixelType> functor;
+  functor.m_Input = input->GetBufferPointer();
+  functor.m_Output = output->GetBufferPointer();
+  functor.m_TakeLog = true;
+  ants::ParallelizeRange( 0, input->GetLargestPossibleRegion().GetNumberOfPixels(), functor,
+                          this->GetNumberOfThreads() );
 }
 
 /**
@@ -1,4 +1,19 @@
 #include "ReadWriteData.h"
+#include "antsParallelizeRange.h"
+#include "itkSimpleFastMutexLock.h"
+#include "itk_zlib.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#if defined( _WIN32 )
+#include <process.h>
+#define ANTS_GETPID _getpid
+#else
+#include <unistd.h>
+#define ANTS_GETPID getpid
+#endif
 
 bool ANTSFileExists(const std::string & strFilename)
 {
@@ -25,3 +40,246 @@ bool ANTSFileExists(const std::string & strFilename)
     }
   return blnReturn;
 }
+
+namespace
+{
+itk::SimpleFastMutexLock ioMutex;
+
+// Blocks are compressed independently, so the ratio is within a fraction
+// of a percent of a single stream once they are this large.
+const size_t gzipBlockSize = 1 << 22;
+
+bool CompressGzipMember( const unsigned char *input, size_t length, int level,
+                         std::vector<unsigned char> & member )
+{
+  z_stream stream;
+
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+  // windowBits 15 + 16 asks zlib for a gzip header and trailer
+  if( deflateInit2( &stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY ) != Z_OK )
+    {
+    return false;
+    }
+  member.resize( deflateBound( &stream, static_cast<uLong>( length ) ) + 32 );
+  stream.next_in = const_cast<Bytef *>( input );
+  stream.avail_in = static_cast<uInt>( length );
+  stream.next_out = &member[0];
+  stream.avail_out = static_cast<uInt>( member.size() );
+
+  const int status = deflate( &stream, Z_FINISH );
+  member.resize( stream.total_out );
+  deflateEnd( &stream );
+  return status == Z_STREAM_END;
+}
+
+class GzipMemberFunctor
+{
+public:
+  const unsigned char *                     m_Input;
+  size_t                                    m_InputSize;
+  int                                       m_Level;
+  std::vector<std::vector<unsigned char> > *m_Members;
+  std::vector<char> *                       m_Compressed;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    for( itk::SizeValueType b = begin; b < end; b++ )
+      {
+      const size_t offset = b * gzipBlockSize;
+      const size_t length = std::min( gzipBlockSize, this->m_InputSize - offset );
+      ( *this->m_Compressed )[b] = CompressGzipMember( this->m_Input + offset, length, this->m_Level,
+                                                       ( *this->m_Members )[b] );
+      }
+  }
+};
+
+int GetGzipCompressionLevel()
+{
+  const char *level = getenv( "ANTS_GZIP_LEVEL" );
+
+  if( level == ITK_NULLPTR || *level == '\0' )
+    {
+    return 6;
+    }
+  return std::min( std::max( atoi( level ), 0 ), 9 );
+}
+
+struct IOStatistics
+{
+  unsigned long m_Files[2];
+  double        m_Bytes[2];
+  double        m_Seconds[2];
+
+  IOStatistics()
+  {
+    for( unsigned int i = 0; i < 2; i++ )
+      {
+      this->m_Files[i] = 0;
+      this->m_Bytes[i] = 0;
+      this->m_Seconds[i] = 0;
+      }
+  }
+
+  ~IOStatistics()
+  {
+    if( getenv( "ANTS_IO_STATISTICS" ) != ITK_NULLPTR && ( this->m_Files[0] + this->m_Files[1] ) > 0 )
+      {
+      ANTSPrintIOStatistics( std::cout );
+      }
+  }
+};
+
+IOStatistics ioStatistics;
+}
+
+bool ANTSUseParallelGzip(const std::string & filename)
+{
+  const std::string extension( ".nii.gz" );
+
+  if( filename.length() <= extension.length() ||
+      filename.compare( filename.length() - extension.length(), extension.length(), extension ) != 0 )
+    {
+    return false;
+    }
+  const char *option = getenv( "ANTS_PARALLEL_GZIP" );
+  if( option != ITK_NULLPTR && std::string( option ) == "0" )
+    {
+    return false;
+    }
+  return itk::MultiThreader::GetGlobalDefaultNumberOfThreads() > 1;
+}
+
+std::string ANTSParallelGzipTemporaryFile(const std::string & filename)
+{
+  static unsigned long count = 0;
+
+  ioMutex.Lock();
+  const unsigned long id = count++;
+  ioMutex.Unlock();
+
+  // foo.nii.gz -> foo.<pid>-<id>.nii, next to the output
+  std::ostringstream name;
+  name << filename.substr( 0, filename.length() - 7 ) << "." << ANTS_GETPID() << "-" << id << ".nii";
+  return name.str();
+}
+
+bool ANTSParallelGzipFile(const std::string & source, const std::string & target)
+{
+  std::ifstream input( source.c_str(), std::ios::in | std::ios::binary );
+
+  if( !input )
+    {
+    remove( source.c_str() );
+    return false;
+    }
+
+  // a gzip file may hold any number of members back to back.  The source is
+  // read, compressed and appended one batch of blocks at a time, one block
+  // per thread, so that memory stays bounded for any image size.  The
+  // members go to a file next to the target, which is renamed at the end so
+  // that a failed write cannot leave a truncated target behind.
+  input.seekg( 0, std::ios::end );
+  const size_t sourceSize = static_cast<size_t>( input.tellg() );
+  input.seekg( 0, std::ios::beg );
+
+  const size_t blocksPerBatch =
+    std::max<size_t>( 1, itk::MultiThreader::GetGlobalDefaultNumberOfThreads() );
+  std::vector<unsigned char>               data( std::max<size_t>( 1, std::min( sourceSize,
+                                                                                blocksPerBatch * gzipBlockSize ) ) );
+  std::vector<std::vector<unsigned char> > members( blocksPerBatch );
+  std::vector<char>                        compressed( blocksPerBatch, 0 );
+
+  const std::string partial = ANTSParallelGzipTemporaryFile( target ) + ".gz";
+  std::ofstream     output( partial.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+
+  GzipMemberFunctor functor;
+  functor.m_Input = &data[0];
+  functor.m_Level = GetGzipCompressionLevel();
+  functor.m_Members = &members;
+  functor.m_Compressed = &compressed;
+
+  bool ok = !output.fail() && !input.fail();
+  bool first = true;
+  while( ok )
+    {
+    input.read( reinterpret_cast<char *>( &data[0] ), data.size() );
+    const size_t length = static_cast<size_t>( input.gcount() );
+    if( input.bad() )
+      {
+      ok = false;
+      break;
+      }
+    // an empty source still needs one (empty) member
+    if( length == 0 && !first )
+      {
+      break;
+      }
+    first = false;
+
+    const size_t numberOfBlocks = std::max<size_t>( 1, ( length + gzipBlockSize - 1 ) / gzipBlockSize );
+    functor.m_InputSize = length;
+    std::fill( compressed.begin(), compressed.end(), 0 );
+    ants::ParallelizeRange( 0, numberOfBlocks, functor );
+    for( size_t b = 0; b < numberOfBlocks && ok; b++ )
+      {
+      ok = compressed[b] != 0;
+      if( ok && !members[b].empty() )
+        {
+        output.write( reinterpret_cast<const char *>( &members[b][0] ), members[b].size() );
+        ok = !output.fail();
+        }
+      }
+    if( length < data.size() )
+      {
+      break;
+      }
+    }
+  input.close();
+  remove( source.c_str() );
+  output.close();
+  if( !ok || output.fail() )
+    {
+    remove( partial.c_str() );
+    return false;
+    }
+#if defined( _WIN32 )
+  // rename does not replace an existing file on Windows
+  remove( target.c_str() );
+#endif
+  if( rename( partial.c_str(), target.c_str() ) != 0 )
+    {
+    remove( partial.c_str() );
+    return false;
+    }
+  return true;
+}
+
+void ANTSRecordIO(const std::string & filename, bool writing, double seconds)
+{
+  struct stat fileInfo;
+  double      bytes = 0;
+
+  if( stat( filename.c_str(), &fileInfo ) == 0 )
+    {
+    bytes = static_cast<double>( fileInfo.st_size );
+    }
+
+  ioMutex.Lock();
+  ioStatistics.m_Files[writing] += 1;
+  ioStatistics.m_Bytes[writing] += bytes;
+  ioStatistics.m_Seconds[writing] += seconds;
+  ioMutex.Unlock();
+}
+
+void ANTSPrintIOStatistics(std::ostream & os)
+{
+  const double megabyte = 1024.0 * 1024.0;
+
+  ioMutex.Lock();
+  os << "I/O: read " << ioStatistics.m_Files[0] << " files, " << ioStatistics.m_Bytes[0] / megabyte
+     << " MB in " << ioStatistics.m_Seconds[0] << " s; wrote " << ioStatistics.m_Files[1] << " files, "
+     << ioStatistics.m_Bytes[1] / megabyte << " MB in " << ioStatistics.m_Seconds[1] << " s" << std::endl;
+  ioMutex.Unlock();
+}
@@ -24,10 +24,238 @@
 #include "itkLogTensorImageFilter.h"
 #include "itkExpTensorImageFilter.h"
 #include "itkCastImageFilter.h"
+#include "itkTimeProbe.h"
+#include "antsParallelizeRange.h"
+#include "antsReadCache.h"
 #include <sys/stat.h>
 
 extern bool ANTSFileExists(const std::string & strFilename);
 
+// Parallel gzip for NIfTI output.  WriteImage and WriteTensorImage write a
+// .nii.gz file uncompressed to a temporary .nii first, then compress it in
+// independent blocks on all threads into a standard multi-member gzip file
+// that any gzip or NIfTI reader accepts.  Set ANTS_PARALLEL_GZIP=0 to use the
+// single-threaded ITK compression instead, and ANTS_GZIP_LEVEL=0..9 to
+// choose the compression level (default 6, as zlib).
+extern bool ANTSUseParallelGzip(const std::string & filename);
+
+extern std::string ANTSParallelGzipTemporaryFile(const std::string & filename);
+
+// Compresses source into target and removes source.  The compressed data
+// go to a temporary file next to target that is then renamed over it, so if
+// anything fails this returns false and target is left as it was (except on
+// Windows, where the old target is removed before the rename).
+extern bool ANTSParallelGzipFile(const std::string & source, const std::string & target);
+
+// I/O instrumentation.  Every image and point set read and every image write
+// is timed; with ANTS_IO_STATISTICS set, the number of files, bytes on disk
+// and seconds spent reading and writing are printed when the tool exits.
+extern void ANTSRecordIO(const std::string & filename, bool writing, double seconds);
+
+extern void ANTSPrintIOStatistics(std::ostream & os);
+
+class ANTSIOTimer
+{
+public:
+  ANTSIOTimer(const char *file, bool writing) : m_File( file ), m_Writing( writing )
+  {
+    this->m_Probe.Start();
+  }
+
+  ~ANTSIOTimer()
+  {
+    this->m_Probe.Stop();
+    ANTSRecordIO( this->m_File, this->m_Writing, this->m_Probe.GetTotal() );
+  }
+
+private:
+  std::string    m_File;
+  bool           m_Writing;
+  itk::TimeProbe m_Probe;
+};
+
+// Runs an ImageFileWriter whose input is set, compressing .nii.gz output
+// with ANTSParallelGzipFile when enabled.
+template <class TWriter>
+void ANTSUpdateCompressedImageFileWriter(TWriter * writer, const char *file)
+{
+  ANTSIOTimer timer( file, true );
+
+  // drop cached reads of file before writing, so that a failed write leaves
+  // none behind, and again after, in case another thread read the file
+  // while it was written
+  ::ants::RemoveFromReadCache( file );
+  if( ANTSUseParallelGzip( file ) )
+    {
+    const std::string uncompressed = ANTSParallelGzipTemporaryFile( file );
+    writer->SetFileName( uncompressed );
+    writer->SetUseCompression( false );
+    try
+      {
+      writer->Update();
+      }
+    catch( ... )
+      {
+      remove( uncompressed.c_str() );
+      throw;
+      }
+    writer->SetFileName( file );
+    if( ANTSParallelGzipFile( uncompressed, file ) )
+      {
+      ::ants::RemoveFromReadCache( file );
+      return;
+      }
+    }
+  writer->SetUseCompression( true );
+  writer->Update();
+  ::ants::RemoveFromReadCache( file );
+}
+
+// In-memory handoff.  A file name of the form "0x..." is the address, as
+// printed with "%p", of an itk::SmartPointer owned by the caller.  This lets
+// the ants:: library functions be chained in one process without touching
+// the disk.
+//
+// ReadImage shares the image held by that pointer when its type is the
+// requested one: no pixel is copied, the caller and the target reference the
+// same object, and the image lives until both have released it.  A function
+// that modifies its input in place therefore modifies the caller's image.  A
+// scalar image of the same dimension but another pixel type is converted on
+// all threads into a new image that the caller does not see.
+//
+// WriteImage stores a reference to the image in the caller's pointer, which
+// must be an itk::SmartPointer of the written image type.  The image, and the
+// filter that produced it if it was not disconnected, outlive the call.
+inline bool ANTSIsImagePointer(const char *file)
+{
+  return file[0] == '0' && file[1] == 'x';
+}
+
+inline void * ANTSImagePointerAddress(const char *file)
+{
+  void *ptr = ITK_NULLPTR;
+
+  sscanf( file, "%p", &ptr );
+  return ptr;
+}
+
+template <class TPixel>
+struct ANTSIsScalarPixel
+{
+  enum { Value = 0 };
+};
+
+#define ANTS_SCALAR_PIXEL( type )      \
+  template <>                          \
+  struct ANTSIsScalarPixel<type>       \
+  {                                    \
+    enum { Value = 1 };                \
+  }
+ANTS_SCALAR_PIXEL( char );
+ANTS_SCALAR_PIXEL( signed char );
+ANTS_SCALAR_PIXEL( unsigned char );
+ANTS_SCALAR_PIXEL( short );
+ANTS_SCALAR_PIXEL( unsigned short );
+ANTS_SCALAR_PIXEL( int );
+ANTS_SCALAR_PIXEL( unsigned int );
+ANTS_SCALAR_PIXEL( long );
+ANTS_SCALAR_PIXEL( unsigned long );
+ANTS_SCALAR_PIXEL( float );
+ANTS_SCALAR_PIXEL( double );
+#undef ANTS_SCALAR_PIXEL
+
+template <class TInputImage, class TOutputImage>
+class ANTSConvertImageBufferFunctor
+{
+public:
+  typedef typename TOutputImage::PixelType OutputPixelType;
+
+  const typename TInputImage::PixelType *m_Input;
+  OutputPixelType *                      m_Output;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    for( itk::SizeValueType i = begin; i < end; i++ )
+      {
+      this->m_Output[i] = static_cast<OutputPixelType>( this->m_Input[i] );
+      }
+  }
+};
+
+// Converts object into a new image if it is a TInputImage.
+template <class TInputImage, class TOutputImage>
+bool ANTSConvertImage(const itk::DataObject * object, itk::SmartPointer<TOutputImage> & target)
+{
+  const TInputImage *input = dynamic_cast<const TInputImage *>( object );
+
+  if( input == ITK_NULLPTR )
+    {
+    return false;
+    }
+  typename TOutputImage::Pointer output = AllocImage<TOutputImage>( input );
+
+  ANTSConvertImageBufferFunctor<TInputImage, TOutputImage> functor;
+  functor.m_Input = input->GetBufferPointer();
+  functor.m_Output = output->GetBufferPointer();
+  ::ants::ParallelizeRange( 0, input->GetBufferedRegion().GetNumberOfPixels(), functor );
+  target = output;
+  return true;
+}
+
+// Only scalar images are converted; any other type must match exactly.
+template <class TImageType, bool IsScalar>
+struct ANTSImagePointerConverter
+{
+  static bool Convert(const itk::DataObject *, itk::SmartPointer<TImageType> &)
+  {
+    return false;
+  }
+};
+
+template <class TImageType>
+struct ANTSImagePointerConverter<TImageType, true>
+{
+  static bool Convert(const itk::DataObject * object, itk::SmartPointer<TImageType> & target)
+  {
+    enum { ImageDimension = TImageType::ImageDimension };
+    return ANTSConvertImage<itk::Image<float, ImageDimension>, TImageType>( object, target )
+           || ANTSConvertImage<itk::Image<double, ImageDimension>, TImageType>( object, target )
+           || ANTSConvertImage<itk::Image<unsigned char, ImageDimension>, TImageType>( object, target )
+           || ANTSConvertImage<itk::Image<char, ImageDimension>, TImageType>( object, target )
+           || ANTSConvertImage<itk::Image<short, ImageDimension>, TImageType>( object, target )
+           || ANTSConvertImage<itk::Image<unsigned short, ImageDimension>, TImageType>( object, target )
+           || ANTSConvertImage<itk::Image<int, ImageDimension>, TImageType>( object, target )
+           || ANTSConvertImage<itk::Image<unsigned int, ImageDimension>, TImageType>( object, target )
+           || ANTSConvertImage<itk::Image<long, ImageDimension>, TImageType>( object, target )
+           || ANTSConvertImage<itk::Image<unsigned long, ImageDimension>, TImageType>( object, target );
+  }
+};
+
+// Reads the image behind a "0x..." file name into target, sharing it when
+// the types match.  Returns false, with target null, if the pointer is null
+// or holds an image that cannot be converted.
+template <class TImageType>
+bool ANTSReadImagePointer(itk::SmartPointer<TImageType> & target, const char *file)
+{
+  // Only the object pointer is read; itk::SmartPointer holds nothing else,
+  // and the real type of the object is checked below.
+  const itk::SmartPointer<itk::DataObject> *slot =
+    static_cast<const itk::SmartPointer<itk::DataObject> *>( ANTSImagePointerAddress( file ) );
+  itk::DataObject *object = slot == ITK_NULLPTR ? ITK_NULLPTR : slot->GetPointer();
+
+  target = dynamic_cast<TImageType *>( object );
+  if( target.IsNull() && ( object == ITK_NULLPTR ||
+                           !ANTSImagePointerConverter<TImageType,
+                                                      ANTSIsScalarPixel<typename TImageType::PixelType>::Value != 0>
+                           ::Convert( object, target ) ) )
+    {
+    std::cerr << " in-memory image " << file << " is null or of an unsupported type . " << std::endl;
+    target = ITK_NULLPTR;
+    return false;
+    }
+  return true;
+}
+
 // Nifti stores DTI values in lower tri format but itk uses upper tri
 // currently, nifti io does nothing to deal with this. if this changes
 // the function below should be modified/eliminated.
@@ -146,7 +374,7 @@ void NiftiDTICheck(itk::SmartPointer<TImageType> & target, const char *file, boo
 template <class TImageType>
 void ReadTensorImage(itk::SmartPointer<TImageType> & target, const char *file, bool takelog = true)
 {
-  if( !ANTSFileExists(std::string(file) ) )
+  if( !ANTSIsImagePointer( file ) && !ANTSFileExists(std::string(file) ) )
     {
     std::cerr << " file " << std::string(file) << " does not exist . " << std::endl;
     return;
@@ -157,11 +385,12 @@ void ReadTensorImage(itk::SmartPointer<TImageType> & target, const char *file, b
 
   typedef itk::LogTensorImageFilter<ImageType, ImageType> LogFilterType;
   typename FileSourceType::Pointer reffilter = ITK_NULLPTR;
-  if( file[0] == '0' && file[1] == 'x' )
+  if( ANTSIsImagePointer( file ) )
     {
-    void* ptr;
-    sscanf(file, "%p", (void **)&ptr);
-    target = *( static_cast<typename TImageType::Pointer *>( ptr ) );
+    if( !ANTSReadImagePointer( target, file ) )
+      {
+      return;
+      }
     }
   else
     {
@@ -171,6 +400,7 @@ void ReadTensorImage(itk::SmartPointer<TImageType> & target, const char *file, b
     reffilter->SetFileName( file );
     try
       {
+      ANTSIOTimer timer( file, false );
       reffilter->Update();
       }
     catch( itk::ExceptionObject & e )
@@ -189,7 +419,7 @@ void ReadTensorImage(itk::SmartPointer<TImageType> & target, const char *file, b
   if( takelog )
     {
     typename LogFilterType::Pointer logFilter = LogFilterType::New();
-    logFilter->SetInput( reffilter->GetOutput() );
+    logFilter->SetInput( target );
     try
       {
       logFilter->Update();
@@ -218,22 +448,10 @@ bool ReadImage(itk::SmartPointer<TImageType> & target, const char *file)
     return false;
     }
 
-  std::string comparetype1 = std::string( "0x" );
-  std::string comparetype2 = std::string( file );
-  comparetype2 = comparetype2.substr( 0, 2 );
   // Read the image files begin
-  if(  comparetype1 == comparetype2  )
-    {
-    typedef TImageType RImageType;
-    void* ptr;
-    sscanf(file, "%p", (void **)&ptr);
-    typename RImageType::Pointer Rimage = *( static_cast<typename RImageType::Pointer *>( ptr ) );
-    /** more needs to be done here to cast the pointer to an image type --- this is a work-around */
-    typedef itk::CastImageFilter<RImageType, TImageType> CastFilterType;
-    typename CastFilterType::Pointer caster = CastFilterType::New();
-    caster->SetInput( Rimage );
-    caster->UpdateLargestPossibleRegion();
-    target = caster->GetOutput();
+  if( ANTSIsImagePointer( file ) )
+    {
+    return ANTSReadImagePointer( target, file );
     }
   else
     {
@@ -245,10 +463,18 @@ bool ReadImage(itk::SmartPointer<TImageType> & target, const char *file)
     typedef TImageType                      ImageType;
     typedef itk::ImageFileReader<ImageType> FileSourceType;
 
+    const std::string cacheKey = ::ants::GetReadCacheKey( file, typeid( ImageType ) );
+    target = ::ants::FindImageInReadCache<ImageType>( cacheKey );
+    if( target.IsNotNull() )
+      {
+      return true;
+      }
+
     typename FileSourceType::Pointer reffilter = FileSourceType::New();
     reffilter->SetFileName( file );
     try
       {
+      ANTSIOTimer timer( file, false );
       reffilter->Update();
       }
     catch( itk::ExceptionObject & e )
@@ -259,6 +485,7 @@ bool ReadImage(itk::SmartPointer<TImageType> & target, const char *file)
       std::exception();
       return false;
       }
+    ::ants::AddImageToReadCache<ImageType>( cacheKey, reffilter->GetOutput() );
 
     // typename ImageType::DirectionType dir;
     // dir.SetIdentity();
@@ -276,10 +503,18 @@ typename ImageType::Pointer ReadImage(char* fn )
   // Read the image files begin
   typedef itk::ImageFileReader<ImageType> FileSourceType;
 
+  const std::string           cacheKey = ::ants::GetReadCacheKey( fn, typeid( ImageType ) );
+  typename ImageType::Pointer cached = ::ants::FindImageInReadCache<ImageType>( cacheKey );
+  if( cached.IsNotNull() )
+    {
+    return cached;
+    }
+
   typename FileSourceType::Pointer reffilter = FileSourceType::New();
   reffilter->SetFileName( fn );
   try
     {
+    ANTSIOTimer timer( fn, false );
     reffilter->Update();
     }
   catch( itk::ExceptionObject & e )
@@ -288,6 +523,7 @@ typename ImageType::Pointer ReadImage(char* fn )
     std::cerr << e << std::endl;
     return NULL;
     }
+  ::ants::AddImageToReadCache<ImageType>( cacheKey, reffilter->GetOutput() );
 
   //typename ImageType::DirectionType dir;
   //dir.SetIdentity();
@@ -311,6 +547,7 @@ typename ImageType::Pointer ReadTensorImage(char* fn, bool takelog = true )
   reffilter->SetFileName( fn );
   try
     {
+    ANTSIOTimer timer( fn, false );
     reffilter->Update();
     }
   catch( itk::ExceptionObject & e )
@@ -360,6 +597,7 @@ bool ReadLabeledPointSet( itk::SmartPointer<TPointSet> & target, const char *fil
   reffilter->SetRandomPercentage( samplingPercentage );
   try
     {
+    ANTSIOTimer timer( file, false );
     reffilter->Update();
     }
   catch( itk::ExceptionObject & e )
@@ -451,6 +689,7 @@ typename TPointSet::Pointer ReadLabeledPointSet( char* fn )
   reffilter->SetFileName( fn );
   try
     {
+    ANTSIOTimer timer( fn, false );
     reffilter->Update();
     }
   catch( itk::ExceptionObject & e )
@@ -503,11 +742,9 @@ bool WriteImage(const itk::SmartPointer<TImageType> image, const char *file)
   // if (writer->GetImageIO->GetNumberOfComponents() == 6)
   // NiftiDTICheck<TImageType>(image,file);
 
-  if( file[0] == '0' && file[1] == 'x' )
+  if( ANTSIsImagePointer( file ) )
     {
-    void* ptr;
-    sscanf(file, "%p", (void **)&ptr);
-    *( static_cast<typename TImageType::Pointer *>( ptr ) ) = image;
+    *( static_cast<typename TImageType::Pointer *>( ANTSImagePointerAddress( file ) ) ) = image;
     }
   else
     {
@@ -520,8 +757,7 @@ bool WriteImage(const itk::SmartPointer<TImageType> image, const char *file)
       std::exception();
       }
     writer->SetInput(image);
-    writer->SetUseCompression( true );
-    writer->Update();
+    ANTSUpdateCompressedImageFileWriter( writer.GetPointer(), file );
     }
   return true;
 }
@@ -548,17 +784,14 @@ void WriteTensorImage(itk::SmartPointer<TImageType> image, const char *file, boo
   // convert from upper tri to lower tri
   NiftiDTICheck<TImageType>(writeImage, file, true); // BA May 30 2009 -- remove b/c ITK fixed NIFTI reader
 
-  if( file[0] == '0' && file[1] == 'x' )
+  if( ANTSIsImagePointer( file ) )
     {
-    void* ptr;
-    sscanf(file, "%p", (void **)&ptr);
-    *( static_cast<typename TImageType::Pointer *>( ptr ) ) = writeImage;
+    *( static_cast<typename TImageType::Pointer *>( ANTSImagePointerAddress( file ) ) ) = writeImage;
     }
   else
     {
     writer->SetInput(writeImage);
-    writer->SetUseCompression( true );
-    writer->Update();
+    ANTSUpdateCompressedImageFileWriter( writer.GetPointer(), file );
     }
 }
 
@@ -0,0 +1,157 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __antsImageSetSlab_h
+#define __antsImageSetSlab_h
+
+#include "itkImageFileReader.h"
+#include "itkImageIOFactory.h"
+#include "itkImageRegionConstIterator.h"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace ants
+{
+/**
+ * Helpers for tools that reduce a set of same-sized images voxel by voxel.
+ * Instead of holding every image, the tools walk the images in slabs along
+ * the slowest axis and only ever read the current slab of each file through
+ * the reader's requested region, so memory is bounded by the slab budget
+ * rather than by the number of subjects.
+ */
+
+/** True if every image in filenames can be read one slab at a time.  Image
+ *  IOs that cannot stream read the whole file for every slab, and so do
+ *  gzipped files, which can only be decompressed from the start; for those
+ *  the tools read the set as a single slab instead. */
+inline bool ImageSetCanStreamRead( const std::vector<std::string> & filenames )
+{
+  for( unsigned long j = 0; j < filenames.size(); j++ )
+    {
+    const std::string & filename = filenames[j];
+    if( filename.size() >= 3 && filename.compare( filename.size() - 3, 3, ".gz" ) == 0 )
+      {
+      return false;
+      }
+    itk::ImageIOBase::Pointer io =
+      itk::ImageIOFactory::CreateImageIO( filename.c_str(), itk::ImageIOFactory::ReadMode );
+    if( io.IsNull() || !io->CanStreamRead() )
+      {
+      return false;
+      }
+    }
+  return true;
+}
+
+/** Number of slices along the last axis such that one slab of nimages
+ *  float images fits in budgetInBytes (at least one slice).  Only use it
+ *  for image sets that ImageSetCanStreamRead. */
+template <class TRegion>
+unsigned long GetImageSetSlabThickness( const TRegion & fullRegion, unsigned long nimages,
+                                        unsigned long budgetInBytes = 512ul * 1024ul * 1024ul )
+{
+  const unsigned int slabAxis = TRegion::ImageDimension - 1;
+  unsigned long      sliceVoxels = 1;
+
+  for( unsigned int i = 0; i < slabAxis; i++ )
+    {
+    sliceVoxels *= fullRegion.GetSize()[i];
+    }
+  const unsigned long bytesPerSlice = std::max( sliceVoxels * nimages * sizeof( float ), 1ul );
+  unsigned long       thickness = std::max( budgetInBytes / bytesPerSlice, 1ul );
+  return std::min( thickness, static_cast<unsigned long>( fullRegion.GetSize()[slabAxis] ) );
+}
+
+/** The slab of fullRegion starting first slices into the last axis. */
+template <class TRegion>
+TRegion GetImageSetSlab( const TRegion & fullRegion, unsigned long first, unsigned long thickness )
+{
+  const unsigned int  slabAxis = TRegion::ImageDimension - 1;
+  const unsigned long nslices = fullRegion.GetSize()[slabAxis];
+  TRegion             slab = fullRegion;
+
+  slab.SetIndex( slabAxis, fullRegion.GetIndex()[slabAxis] + first );
+  slab.SetSize( slabAxis, std::min( thickness, nslices - first ) );
+  return slab;
+}
+
+/** Read the slab of every image in filenames into data.  With voxelMajor,
+ *  data[ v * filenames.size() + j ] is voxel v of image j, which keeps the
+ *  values of one voxel contiguous; otherwise data[ j * nvoxels + v ], which
+ *  keeps whole image rows contiguous.  data is usually float; label images
+ *  can be read into an integer vector with an integer TImage.  Returns false
+ *  if an image cannot be read or does not match fullRegion. */
+template <class TImage, class TValue>
+bool ReadImageSetSlab( const std::vector<std::string> & filenames, const typename TImage::RegionType & slab,
+                       const typename TImage::RegionType & fullRegion, std::vector<TValue> & data,
+                       bool voxelMajor = true )
+{
+  typedef itk::ImageFileReader<TImage>          ReaderType;
+  typedef itk::ImageRegionConstIterator<TImage> ConstIteratorType;
+
+  const unsigned long nimages = filenames.size();
+  const unsigned long nvoxels = slab.GetNumberOfPixels();
+  data.resize( nvoxels * nimages );
+  for( unsigned long j = 0; j < nimages; j++ )
+    {
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName( filenames[j].c_str() );
+    try
+      {
+      reader->UpdateOutputInformation();
+      if( reader->GetOutput()->GetLargestPossibleRegion() != fullRegion )
+        {
+        std::cout << filenames[j] << " does not match the size of " << filenames[0] << std::endl;
+        return false;
+        }
+      reader->GetOutput()->SetRequestedRegion( slab );
+      reader->Update();
+      }
+    catch( itk::ExceptionObject & e )
+      {
+      std::cerr << "Exception caught during image set reading " << std::endl;
+      std::cerr << e << " file " << filenames[j] << std::endl;
+      return false;
+      }
+
+    const unsigned long stride = voxelMajor ? nimages : 1;
+    TValue *            out = voxelMajor ? &data[j] : &data[j * nvoxels];
+    ConstIteratorType   It( reader->GetOutput(), slab );
+    for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+      {
+      *out = static_cast<TValue>( It.Get() );
+      out += stride;
+      }
+    }
+  return true;
+}
+
+/** Index of the v-th voxel of slab in buffer order. */
+template <class TRegion>
+typename TRegion::IndexType GetImageSetSlabIndex( const TRegion & slab, unsigned long v )
+{
+  typename TRegion::IndexType ind = slab.GetIndex();
+  for( unsigned int d = 0; d < TRegion::ImageDimension; d++ )
+    {
+    const unsigned long extent = slab.GetSize()[d];
+    ind[d] += static_cast<typename TRegion::IndexValueType>( v % extent );
+    v /= extent;
+    }
+  return ind;
+}
+} // namespace ants
+
+#endif
@@ -0,0 +1,665 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __antsLabelFusion_h
+#define __antsLabelFusion_h
+
+#include "antsParallelizeRange.h"
+#include "itkNumericTraits.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace ants
+{
+/**
+ * Multi-atlas label fusion for ImageMath MajorityVoting, CorrelationVoting
+ * and STAPLE.
+ *
+ * AtlasLabelStack packs the label images of a set of atlases voxel-major,
+ * so the votes for one voxel are contiguous, and replaces every label by
+ * its rank among the distinct labels of the stack.  Votes can then be
+ * tallied in a dense per-thread array indexed by that compact id, however
+ * large or sparse the label values are.  A stack can hold whole images or
+ * one slab of them (see antsImageSetSlab.h), which bounds the memory of
+ * majority voting for large atlas sets.
+ *
+ * LocalCorrelationCalculator gives the correlation weights of
+ * CorrelationVoting from running box sums, so each weight costs a constant
+ * amount of work whatever the neighborhood radius.
+ */
+
+template <class TLabel>
+class AtlasLabelStack;
+
+template <class TLabel>
+class AtlasVoteFunctor
+{
+public:
+  typedef typename AtlasLabelStack<TLabel>::LabelIdType LabelIdType;
+
+  const AtlasLabelStack<TLabel> *   m_Stack;
+  const float *                     m_Weights;
+  std::vector<std::vector<float> > *m_Votes;
+  TLabel *                          m_Output;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    const itk::SizeValueType    natlases = this->m_Stack->GetNumberOfAtlases();
+    const itk::SizeValueType    nvoxels = this->m_Stack->GetNumberOfVoxels();
+    const std::vector<TLabel> & labels = this->m_Stack->GetLabels();
+    std::vector<float> &        votes = ( *this->m_Votes )[threadId];
+
+    for( itk::SizeValueType v = begin; v < end; v++ )
+      {
+      const LabelIdType *ids = this->m_Stack->GetVoxelLabelIds( v );
+
+      // ties go to the label that first reached the winning count, as in
+      // the serial loops over the atlases
+      float       maxVotes = 0;
+      LabelIdType winner = 0;
+      bool        found = false;
+      for( itk::SizeValueType a = 0; a < natlases; a++ )
+        {
+        votes[ids[a]] += 1;
+        if( votes[ids[a]] > maxVotes )
+          {
+          maxVotes = votes[ids[a]];
+          winner = ids[a];
+          found = true;
+          }
+        }
+
+      // a weighted vote only where the atlases disagree
+      if( this->m_Weights && maxVotes < static_cast<float>( natlases ) )
+        {
+        for( itk::SizeValueType a = 0; a < natlases; a++ )
+          {
+          votes[ids[a]] = 0;
+          }
+        maxVotes = 0;
+        found = false;
+        for( itk::SizeValueType a = 0; a < natlases; a++ )
+          {
+          votes[ids[a]] += this->m_Weights[a * nvoxels + v];
+          if( votes[ids[a]] > maxVotes )
+            {
+            maxVotes = votes[ids[a]];
+            winner = ids[a];
+            found = true;
+            }
+          }
+        }
+
+      for( itk::SizeValueType a = 0; a < natlases; a++ )
+        {
+        votes[ids[a]] = 0;
+        }
+      this->m_Output[v] = found ? labels[winner] : itk::NumericTraits<TLabel>::ZeroValue();
+      }
+  }
+};
+
+template <class TLabel>
+class AtlasSTAPLEFunctor
+{
+public:
+  typedef typename AtlasLabelStack<TLabel>::LabelIdType LabelIdType;
+
+  const AtlasLabelStack<TLabel> *        m_Stack;
+  LabelIdType                            m_Label;
+  const std::vector<itk::SizeValueType> *m_Voxels;
+  std::vector<double> *                  m_Weights;
+  const std::vector<double> *            m_Sensitivity;
+  const std::vector<double> *            m_Specificity;
+  double                                 m_Prior;
+  bool                                   m_UpdateWeights;
+
+  /** per thread: sensitivity and specificity numerators, then the sums of
+   *  W and of 1 - W */
+  std::vector<std::vector<double> > *m_SensitivitySums;
+  std::vector<std::vector<double> > *m_SpecificitySums;
+  std::vector<double> *              m_WeightSums;
+  std::vector<double> *              m_ComplementSums;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    const itk::SizeValueType natlases = this->m_Stack->GetNumberOfAtlases();
+    std::vector<double> &    weights = *this->m_Weights;
+    std::vector<double> &    sensitivitySums = ( *this->m_SensitivitySums )[threadId];
+    std::vector<double> &    specificitySums = ( *this->m_SpecificitySums )[threadId];
+    double                   weightSum = 0;
+    double                   complementSum = 0;
+
+    for( itk::SizeValueType k = begin; k < end; k++ )
+      {
+      const LabelIdType *ids = this->m_Stack->GetVoxelLabelIds( ( *this->m_Voxels )[k] );
+      if( this->m_UpdateWeights )
+        {
+        double alpha = 1.0;
+        double beta = 1.0;
+        for( itk::SizeValueType a = 0; a < natlases; a++ )
+          {
+          if( ids[a] == this->m_Label )
+            {
+            alpha *= ( *this->m_Sensitivity )[a];
+            beta *= 1.0 - ( *this->m_Specificity )[a];
+            }
+          else
+            {
+            alpha *= 1.0 - ( *this->m_Sensitivity )[a];
+            beta *= ( *this->m_Specificity )[a];
+            }
+          }
+        const double denominator = this->m_Prior * alpha + ( 1.0 - this->m_Prior ) * beta;
+        weights[k] = ( denominator > 0 ) ? this->m_Prior * alpha / denominator : 0.0;
+        }
+
+      const double w = weights[k];
+      weightSum += w;
+      complementSum += 1.0 - w;
+      for( itk::SizeValueType a = 0; a < natlases; a++ )
+        {
+        if( ids[a] == this->m_Label )
+          {
+          sensitivitySums[a] += w;
+          }
+        else
+          {
+          specificitySums[a] += 1.0 - w;
+          }
+        }
+      }
+    ( *this->m_WeightSums )[threadId] = weightSum;
+    ( *this->m_ComplementSums )[threadId] = complementSum;
+  }
+};
+
+template <class TLabel>
+class AtlasLabelStack
+{
+public:
+  typedef TLabel       LabelType;
+  typedef unsigned int LabelIdType;
+
+  AtlasLabelStack() :
+    m_NumberOfAtlases( 0 ),
+    m_NumberOfVoxels( 0 )
+  {
+  }
+
+  /** labels[ v * numberOfAtlases + a ] is the label atlas a gives voxel v,
+   *  the layout ReadImageSetSlab produces with voxelMajor. */
+  void SetLabels( const std::vector<TLabel> & labels, itk::SizeValueType numberOfAtlases )
+  {
+    this->m_NumberOfAtlases = numberOfAtlases;
+    this->m_NumberOfVoxels = ( numberOfAtlases > 0 ) ? labels.size() / numberOfAtlases : 0;
+
+    this->m_LabelVoxels.clear();
+    this->m_Labels.clear();
+    this->m_Stack.resize( labels.size() );
+    if( labels.empty() )
+      {
+      return;
+      }
+
+    // there are few distinct labels and runs of equal labels are common, so
+    // the sorted label list is grown by insertion, remembering the last
+    // lookup, rather than by sorting a copy of the whole stack
+    TLabel lastLabel = labels[0];
+    this->m_Labels.push_back( lastLabel );
+    for( itk::SizeValueType i = 1; i < labels.size(); i++ )
+      {
+      if( labels[i] != lastLabel )
+        {
+        lastLabel = labels[i];
+        typename std::vector<TLabel>::iterator it =
+          std::lower_bound( this->m_Labels.begin(), this->m_Labels.end(), lastLabel );
+        if( it == this->m_Labels.end() || *it != lastLabel )
+          {
+          this->m_Labels.insert( it, lastLabel );
+          }
+        }
+      }
+
+    LabelIdType lastId = 0;
+    for( itk::SizeValueType i = 0; i < labels.size(); i++ )
+      {
+      if( this->m_Labels[lastId] != labels[i] )
+        {
+        lastId = static_cast<LabelIdType>( std::lower_bound( this->m_Labels.begin(), this->m_Labels.end(),
+                                                             labels[i] ) - this->m_Labels.begin() );
+        }
+      this->m_Stack[i] = lastId;
+      }
+  }
+
+  itk::SizeValueType GetNumberOfAtlases() const
+  {
+    return this->m_NumberOfAtlases;
+  }
+
+  itk::SizeValueType GetNumberOfVoxels() const
+  {
+    return this->m_NumberOfVoxels;
+  }
+
+  /** the distinct labels of the stack in increasing order; a compact label
+   *  id is an index into this list */
+  const std::vector<TLabel> & GetLabels() const
+  {
+    return this->m_Labels;
+  }
+
+  /** compact id of label, or false if no atlas uses it */
+  bool GetLabelId( TLabel label, LabelIdType & id ) const
+  {
+    typename std::vector<TLabel>::const_iterator it =
+      std::lower_bound( this->m_Labels.begin(), this->m_Labels.end(), label );
+    if( it == this->m_Labels.end() || *it != label )
+      {
+      return false;
+      }
+    id = static_cast<LabelIdType>( it - this->m_Labels.begin() );
+    return true;
+  }
+
+  /** the compact label ids of all atlases at voxel v */
+  const LabelIdType * GetVoxelLabelIds( itk::SizeValueType v ) const
+  {
+    return &this->m_Stack[v * this->m_NumberOfAtlases];
+  }
+
+  /** Majority vote at every voxel; ties go to the label that reached the
+   *  winning count first in atlas order. */
+  void MajorityVote( std::vector<TLabel> & output, itk::ThreadIdType numberOfThreads = 0 ) const
+  {
+    this->Vote( ITK_NULLPTR, output, numberOfThreads );
+  }
+
+  /** Vote weighted by weights[ a * nvoxels + v ] wherever the atlases
+   *  disagree; unanimous voxels keep their label. */
+  void WeightedVote( const float * weights, std::vector<TLabel> & output, itk::ThreadIdType numberOfThreads = 0 ) const
+  {
+    this->Vote( weights, output, numberOfThreads );
+  }
+
+  /** The voxels at which at least one atlas votes for label id. */
+  const std::vector<itk::SizeValueType> & GetLabelVoxels( LabelIdType id )
+  {
+    if( this->m_LabelVoxels.empty() )
+      {
+      this->m_LabelVoxels.resize( this->m_Labels.size() );
+      std::vector<itk::SizeValueType> lastVoxel( this->m_Labels.size(), this->m_NumberOfVoxels );
+      for( itk::SizeValueType v = 0; v < this->m_NumberOfVoxels; v++ )
+        {
+        const LabelIdType *ids = this->GetVoxelLabelIds( v );
+        for( itk::SizeValueType a = 0; a < this->m_NumberOfAtlases; a++ )
+          {
+          if( lastVoxel[ids[a]] != v )
+            {
+            lastVoxel[ids[a]] = v;
+            this->m_LabelVoxels[ids[a]].push_back( v );
+            }
+          }
+        }
+      }
+    return this->m_LabelVoxels[id];
+  }
+
+  /**
+   * STAPLE (Warfield et al., IEEE TMI 2004) estimate of the probability of
+   * label id at every voxel, with the same initialization and updates as
+   * itk::STAPLEImageFilter: W starts at the fraction of atlases voting for
+   * the label, the prior is the mean of that times confidenceWeight, and each
+   * iteration re-estimates sensitivity and specificity from W and then W
+   * from them.  Voxels where no atlas votes for the label all share one
+   * value of W and are handled together, so an iteration only visits the
+   * voxels of the label.  Iterations stop once no sensitivity or
+   * specificity changes by more than tolerance.
+   */
+  void STAPLE( LabelIdType id, double confidenceWeight, std::vector<float> & probability,
+               double tolerance = 1e-10, unsigned int maximumIterations = 1000,
+               itk::ThreadIdType numberOfThreads = 0 )
+  {
+    const std::vector<itk::SizeValueType> & voxels = this->GetLabelVoxels( id );
+    const itk::SizeValueType                natlases = this->m_NumberOfAtlases;
+    const itk::SizeValueType                nlabel = voxels.size();
+    const double                            nbackground = static_cast<double>( this->m_NumberOfVoxels - nlabel );
+
+    probability.assign( this->m_NumberOfVoxels, 0.0f );
+    if( nlabel == 0 )
+      {
+      return;
+      }
+
+    std::vector<double> weights( nlabel );
+    double              prior = 0;
+    for( itk::SizeValueType k = 0; k < nlabel; k++ )
+      {
+      const LabelIdType *ids = this->GetVoxelLabelIds( voxels[k] );
+      unsigned int       count = 0;
+      for( itk::SizeValueType a = 0; a < natlases; a++ )
+        {
+        count += ( ids[a] == id );
+        }
+      weights[k] = static_cast<double>( count ) / static_cast<double>( natlases );
+      prior += weights[k];
+      }
+    prior = prior / static_cast<double>( this->m_NumberOfVoxels ) * confidenceWeight;
+
+    const itk::ThreadIdType           nthreads = GetNumberOfThreadsForRange( nlabel, numberOfThreads );
+    std::vector<double>               sensitivity( natlases, 0 );
+    std::vector<double>               specificity( natlases, 0 );
+    std::vector<std::vector<double> > sensitivitySums( nthreads );
+    std::vector<std::vector<double> > specificitySums( nthreads );
+    std::vector<double>               weightSums( nthreads, 0 );
+    std::vector<double>               complementSums( nthreads, 0 );
+
+    AtlasSTAPLEFunctor<TLabel> functor;
+    functor.m_Stack = this;
+    functor.m_Label = id;
+    functor.m_Voxels = &voxels;
+    functor.m_Weights = &weights;
+    functor.m_Sensitivity = &sensitivity;
+    functor.m_Specificity = &specificity;
+    functor.m_Prior = prior;
+    functor.m_UpdateWeights = false;
+    functor.m_SensitivitySums = &sensitivitySums;
+    functor.m_SpecificitySums = &specificitySums;
+    functor.m_WeightSums = &weightSums;
+    functor.m_ComplementSums = &complementSums;
+
+    double backgroundWeight = 0;
+    for( unsigned int iteration = 0; iteration < maximumIterations; iteration++ )
+      {
+      for( itk::ThreadIdType t = 0; t < nthreads; t++ )
+        {
+        sensitivitySums[t].assign( natlases, 0 );
+        specificitySums[t].assign( natlases, 0 );
+        weightSums[t] = 0;
+        complementSums[t] = 0;
+        }
+      ParallelizeRange( 0, nlabel, functor, nthreads );
+      functor.m_UpdateWeights = true;
+
+      // sensitivity and specificity from the current W
+      double weightSum = nbackground * backgroundWeight;
+      double complementSum = nbackground * ( 1.0 - backgroundWeight );
+      for( itk::ThreadIdType t = 0; t < nthreads; t++ )
+        {
+        weightSum += weightSums[t];
+        complementSum += complementSums[t];
+        }
+      double change = 0;
+      for( itk::SizeValueType a = 0; a < natlases; a++ )
+        {
+        double sensitivityNumerator = 0;
+        double specificityNumerator = nbackground * ( 1.0 - backgroundWeight );
+        for( itk::ThreadIdType t = 0; t < nthreads; t++ )
+          {
+          sensitivityNumerator += sensitivitySums[t][a];
+          specificityNumerator += specificitySums[t][a];
+          }
+        const double p = ( weightSum > 0 ) ? sensitivityNumerator / weightSum : 0.0;
+        const double q = ( complementSum > 0 ) ? specificityNumerator / complementSum : 0.0;
+        change = std::max( change, std::max( std::fabs( p - sensitivity[a] ), std::fabs( q - specificity[a] ) ) );
+        sensitivity[a] = p;
+        specificity[a] = q;
+        }
+
+      // W of the voxels no atlas labels; the others are updated by the
+      // next pass of the functor
+      double alpha = 1.0;
+      double beta = 1.0;
+      for( itk::SizeValueType a = 0; a < natlases; a++ )
+        {
+        alpha *= 1.0 - sensitivity[a];
+        beta *= specificity[a];
+        }
+      const double denominator = prior * alpha + ( 1.0 - prior ) * beta;
+      backgroundWeight = ( denominator > 0 ) ? prior * alpha / denominator : 0.0;
+
+      if( iteration > 0 && change <= tolerance )
+        {
+        break;
+        }
+      }
+    // the last pass updated the weights from the final estimates
+    functor.m_UpdateWeights = true;
+    ParallelizeRange( 0, nlabel, functor, nthreads );
+
+    std::fill( probability.begin(), probability.end(), static_cast<float>( backgroundWeight ) );
+    for( itk::SizeValueType k = 0; k < nlabel; k++ )
+      {
+      probability[voxels[k]] = static_cast<float>( weights[k] );
+      }
+  }
+
+private:
+  void Vote( const float * weights, std::vector<TLabel> & output, itk::ThreadIdType numberOfThreads ) const
+  {
+    output.resize( this->m_NumberOfVoxels );
+    if( this->m_NumberOfVoxels == 0 || this->m_NumberOfAtlases == 0 )
+      {
+      std::fill( output.begin(), output.end(), itk::NumericTraits<TLabel>::ZeroValue() );
+      return;
+      }
+
+    const itk::ThreadIdType          nthreads = GetNumberOfThreadsForRange( this->m_NumberOfVoxels, numberOfThreads );
+    std::vector<std::vector<float> > votes( nthreads, std::vector<float>( this->m_Labels.size(), 0.0f ) );
+
+    AtlasVoteFunctor<TLabel> functor;
+    functor.m_Stack = this;
+    functor.m_Weights = weights;
+    functor.m_Votes = &votes;
+    functor.m_Output = &output[0];
+    ParallelizeRange( 0, this->m_NumberOfVoxels, functor, nthreads );
+  }
+
+  itk::SizeValueType                            m_NumberOfAtlases;
+  itk::SizeValueType                            m_NumberOfVoxels;
+  std::vector<TLabel>                           m_Labels;
+  std::vector<LabelIdType>                      m_Stack;
+  std::vector<std::vector<itk::SizeValueType> > m_LabelVoxels;
+};
+
+class BoxSumFunctor
+{
+public:
+  double *                          m_Buffer;
+  itk::SizeValueType                m_Length;
+  itk::SizeValueType                m_Stride;
+  long                              m_Radius;
+  std::vector<std::vector<double> > m_Prefix;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    std::vector<double> & prefix = this->m_Prefix[threadId];
+    const long            length = static_cast<long>( this->m_Length );
+
+    prefix.resize( this->m_Length + 1 );
+    for( itk::SizeValueType line = begin; line < end; line++ )
+      {
+      const itk::SizeValueType inner = line % this->m_Stride;
+      const itk::SizeValueType outer = line / this->m_Stride;
+      double *                 values = this->m_Buffer + outer * this->m_Stride * this->m_Length + inner;
+
+      prefix[0] = 0;
+      for( long x = 0; x < length; x++ )
+        {
+        prefix[x + 1] = prefix[x] + values[x * this->m_Stride];
+        }
+      for( long x = 0; x < length; x++ )
+        {
+        const long lo = std::max( x - this->m_Radius, 0L );
+        const long hi = std::min( x + this->m_Radius, length - 1 );
+        values[x * this->m_Stride] = prefix[hi + 1] - prefix[lo];
+        }
+      }
+  }
+};
+
+/** Replace every value of buffer (an image of the given size, first axis
+ *  fastest) by its sum over the box of the given radius around it, clipped
+ *  at the image border, with one running-sum pass per axis. */
+template <unsigned int VDimension>
+void ComputeBoxSums( std::vector<double> & buffer, const itk::Size<VDimension> & size, unsigned int radius,
+                     itk::ThreadIdType numberOfThreads = 0 )
+{
+  itk::SizeValueType stride = 1;
+
+  for( unsigned int d = 0; d < VDimension; d++ )
+    {
+    const itk::SizeValueType numberOfLines = buffer.size() / size[d];
+    BoxSumFunctor            functor;
+    functor.m_Buffer = buffer.empty() ? ITK_NULLPTR : &buffer[0];
+    functor.m_Length = size[d];
+    functor.m_Stride = stride;
+    functor.m_Radius = radius;
+    functor.m_Prefix.resize( GetNumberOfThreadsForRange( numberOfLines, numberOfThreads ) );
+    ParallelizeRange( 0, numberOfLines, functor, numberOfThreads );
+    stride *= size[d];
+    }
+}
+
+template <class TImage>
+class LocalCorrelationFunctor
+{
+public:
+  itk::Size<TImage::ImageDimension> m_Size;
+  long                              m_Radius;
+  const double *                    m_TargetSum;
+  const double *                    m_TargetSquaresSum;
+  const double *                    m_ImageSum;
+  const double *                    m_ImageSquaresSum;
+  const double *                    m_ProductSum;
+  float *                           m_Weights;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    for( itk::SizeValueType v = begin; v < end; v++ )
+      {
+      // number of voxels of the clipped box
+      itk::SizeValueType rest = v;
+      double             count = 1;
+      for( unsigned int d = 0; d < TImage::ImageDimension; d++ )
+        {
+        const long length = static_cast<long>( this->m_Size[d] );
+        const long x = static_cast<long>( rest % this->m_Size[d] );
+        rest /= this->m_Size[d];
+        count *= std::min( x + this->m_Radius, length - 1 ) - std::max( x - this->m_Radius, 0L ) + 1;
+        }
+
+      const double covariance = this->m_ProductSum[v] - this->m_TargetSum[v] * this->m_ImageSum[v] / count;
+      const double targetVariance = this->m_TargetSquaresSum[v] - this->m_TargetSum[v] * this->m_TargetSum[v] / count;
+      const double imageVariance = this->m_ImageSquaresSum[v] - this->m_ImageSum[v] * this->m_ImageSum[v] / count;
+      const double denominator = targetVariance * imageVariance;
+      this->m_Weights[v] = ( denominator > 0 ) ? std::fabs( covariance / std::sqrt( denominator ) ) : 0.0f;
+      }
+  }
+};
+
+/** Absolute Pearson correlation between a target image and other images
+ *  of the same size over the box of the given radius around each voxel
+ *  (clipped at the border), from box sums of the values, their squares
+ *  and their products.  The sums of the target are kept between images. */
+template <class TImage>
+class LocalCorrelationCalculator
+{
+public:
+  typedef typename TImage::SizeType SizeType;
+
+  LocalCorrelationCalculator() :
+    m_Radius( 1 ),
+    m_NumberOfThreads( 0 ),
+    m_Target( ITK_NULLPTR )
+  {
+  }
+
+  /** set before SetTarget */
+  void SetRadius( unsigned int radius )
+  {
+    this->m_Radius = radius;
+  }
+
+  void SetNumberOfThreads( itk::ThreadIdType numberOfThreads )
+  {
+    this->m_NumberOfThreads = numberOfThreads;
+  }
+
+  void SetTarget( const TImage * target )
+  {
+    this->m_Target = target->GetBufferPointer();
+    this->m_Size = target->GetBufferedRegion().GetSize();
+
+    const itk::SizeValueType nvoxels = target->GetBufferedRegion().GetNumberOfPixels();
+    this->m_TargetSum.resize( nvoxels );
+    this->m_TargetSquaresSum.resize( nvoxels );
+    for( itk::SizeValueType v = 0; v < nvoxels; v++ )
+      {
+      const double value = this->m_Target[v];
+      this->m_TargetSum[v] = value;
+      this->m_TargetSquaresSum[v] = value * value;
+      }
+    ComputeBoxSums( this->m_TargetSum, this->m_Size, this->m_Radius, this->m_NumberOfThreads );
+    ComputeBoxSums( this->m_TargetSquaresSum, this->m_Size, this->m_Radius, this->m_NumberOfThreads );
+  }
+
+  /** weights[ v ] for every voxel v of image, which must match the target */
+  void ComputeWeights( const TImage * image, float * weights )
+  {
+    const itk::SizeValueType              nvoxels = this->m_TargetSum.size();
+    const typename TImage::PixelType *    values = image->GetBufferPointer();
+
+    this->m_ImageSum.resize( nvoxels );
+    this->m_ImageSquaresSum.resize( nvoxels );
+    this->m_ProductSum.resize( nvoxels );
+    for( itk::SizeValueType v = 0; v < nvoxels; v++ )
+      {
+      const double value = values[v];
+      this->m_ImageSum[v] = value;
+      this->m_ImageSquaresSum[v] = value * value;
+      this->m_ProductSum[v] = value * this->m_Target[v];
+      }
+    ComputeBoxSums( this->m_ImageSum, this->m_Size, this->m_Radius, this->m_NumberOfThreads );
+    ComputeBoxSums( this->m_ImageSquaresSum, this->m_Size, this->m_Radius, this->m_NumberOfThreads );
+    ComputeBoxSums( this->m_ProductSum, this->m_Size, this->m_Radius, this->m_NumberOfThreads );
+
+    LocalCorrelationFunctor<TImage> functor;
+    functor.m_Size = this->m_Size;
+    functor.m_Radius = this->m_Radius;
+    functor.m_TargetSum = &this->m_TargetSum[0];
+    functor.m_TargetSquaresSum = &this->m_TargetSquaresSum[0];
+    functor.m_ImageSum = &this->m_ImageSum[0];
+    functor.m_ImageSquaresSum = &this->m_ImageSquaresSum[0];
+    functor.m_ProductSum = &this->m_ProductSum[0];
+    functor.m_Weights = weights;
+    ParallelizeRange( 0, nvoxels, functor, this->m_NumberOfThreads );
+  }
+
+private:
+  unsigned int                       m_Radius;
+  itk::ThreadIdType                  m_NumberOfThreads;
+  const typename TImage::PixelType * m_Target;
+  SizeType                           m_Size;
+  std::vector<double>                m_TargetSum;
+  std::vector<double>                m_TargetSquaresSum;
+  std::vector<double>                m_ImageSum;
+  std::vector<double>                m_ImageSquaresSum;
+  std::vector<double>                m_ProductSum;
+};
+} // namespace ants
+
+#endif
@@ -0,0 +1,347 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __antsLabelStatistics_h
+#define __antsLabelStatistics_h
+
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkContinuousIndex.h"
+#include "antsImageSetSlab.h"
+#include "antsParallelizeRange.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <vector>
+
+namespace ants
+{
+/** Per-label summary gathered by LabelStatisticsCalculator.  Count,
+ *  centroid and bounding box cover every voxel carrying the label; the value
+ *  moments and histogram only cover the voxels that contributed a value
+ *  (ValueCount of them). */
+template <unsigned int VDimension>
+struct LabelStatistics
+{
+  typedef itk::Index<VDimension> IndexType;
+
+  LabelStatistics() :
+    Count( 0 ), ValueCount( 0 ), Sum( 0 ), SumOfSquares( 0 ),
+    Minimum( std::numeric_limits<double>::max() ), Maximum( -std::numeric_limits<double>::max() )
+  {
+    for( unsigned int d = 0; d < VDimension; d++ )
+      {
+      IndexSum[d] = 0;
+      BoundingBoxMinimum[d] = itk::NumericTraits<itk::IndexValueType>::max();
+      BoundingBoxMaximum[d] = itk::NumericTraits<itk::IndexValueType>::NonpositiveMin();
+      }
+  }
+
+  void Merge( const LabelStatistics & other )
+  {
+    Count += other.Count;
+    ValueCount += other.ValueCount;
+    Sum += other.Sum;
+    SumOfSquares += other.SumOfSquares;
+    Minimum = std::min( Minimum, other.Minimum );
+    Maximum = std::max( Maximum, other.Maximum );
+    for( unsigned int d = 0; d < VDimension; d++ )
+      {
+      IndexSum[d] += other.IndexSum[d];
+      BoundingBoxMinimum[d] = std::min( BoundingBoxMinimum[d], other.BoundingBoxMinimum[d] );
+      BoundingBoxMaximum[d] = std::max( BoundingBoxMaximum[d], other.BoundingBoxMaximum[d] );
+      }
+    if( Histogram.size() < other.Histogram.size() )
+      {
+      Histogram.resize( other.Histogram.size(), 0 );
+      }
+    for( unsigned int b = 0; b < other.Histogram.size(); b++ )
+      {
+      Histogram[b] += other.Histogram[b];
+      }
+  }
+
+  double GetMean() const
+  {
+    return ValueCount > 0 ? Sum / static_cast<double>( ValueCount ) : 0.0;
+  }
+
+  /** unbiased sample variance of the contributed values */
+  double GetVariance() const
+  {
+    if( ValueCount < 2 )
+      {
+      return 0.0;
+      }
+    const double n = static_cast<double>( ValueCount );
+    return std::max( ( SumOfSquares - Sum * Sum / n ) / ( n - 1.0 ), 0.0 );
+  }
+
+  /** mean voxel index; see LabelStatisticsCalculator::GetCentroid for the
+   *  physical point */
+  itk::ContinuousIndex<double, VDimension> GetIndexCentroid() const
+  {
+    itk::ContinuousIndex<double, VDimension> centroid;
+    for( unsigned int d = 0; d < VDimension; d++ )
+      {
+      centroid[d] = Count > 0 ? IndexSum[d] / static_cast<double>( Count ) : 0.0;
+      }
+    return centroid;
+  }
+
+  unsigned long              Count;
+  unsigned long              ValueCount;
+  double                     Sum;
+  double                     SumOfSquares;
+  double                     Minimum;
+  double                     Maximum;
+  double                     IndexSum[VDimension];
+  IndexType                  BoundingBoxMinimum;
+  IndexType                  BoundingBoxMaximum;
+  std::vector<unsigned long> Histogram;
+};
+
+/**
+ * Accumulates LabelStatistics for every nonzero label of a label image in
+ * one threaded pass, instead of rescanning the image once per label.  The
+ * image is split into slabs along its last axis, each thread fills its own
+ * label -> statistics map and the maps are merged in thread order at the end.
+ *
+ * An optional value image supplies the values.  When it shares the label
+ * image grid it is read voxel for voxel; otherwise it is linearly
+ * interpolated at the physical point of each label voxel and voxels that
+ * fall outside it contribute no value.
+ */
+template <class TLabelImage, class TValueImage = TLabelImage>
+class LabelStatisticsCalculator
+{
+public:
+  itkStaticConstMacro( ImageDimension, unsigned int, TLabelImage::ImageDimension );
+
+  typedef typename TLabelImage::PixelType                          LabelType;
+  typedef LabelStatistics<TLabelImage::ImageDimension>             StatisticsType;
+  typedef std::map<LabelType, StatisticsType>                      StatisticsMapType;
+  typedef typename TLabelImage::RegionType                         RegionType;
+  typedef typename TLabelImage::PointType                          PointType;
+  typedef itk::LinearInterpolateImageFunction<TValueImage, double> InterpolatorType;
+
+  LabelStatisticsCalculator() :
+    m_LabelImage( ITK_NULLPTR ), m_ValueImage( ITK_NULLPTR ), m_IgnoreZeroValues( false ),
+    m_NumberOfHistogramBins( 0 ), m_HistogramMinimum( 0 ), m_HistogramMaximum( 1 ),
+    m_NumberOfThreads( 0 ), m_ValueImageOnLabelGrid( false )
+  {
+  }
+
+  void SetLabelImage( const TLabelImage * image )
+  {
+    this->m_LabelImage = image;
+  }
+
+  void SetValueImage( const TValueImage * image )
+  {
+    this->m_ValueImage = image;
+  }
+
+  /** Skip values whose magnitude is below 1e-9, as ROIStatistics always did. */
+  void SetIgnoreZeroValues( bool ignore )
+  {
+    this->m_IgnoreZeroValues = ignore;
+  }
+
+  /** Per-label value histograms over [minimum, maximum]; values outside are
+   *  clamped into the end bins.  Zero bins (the default) turns them off. */
+  void SetHistogramParameters( unsigned int numberOfBins, double minimum, double maximum )
+  {
+    this->m_NumberOfHistogramBins = numberOfBins;
+    this->m_HistogramMinimum = minimum;
+    this->m_HistogramMaximum = maximum;
+  }
+
+  /** 0 uses the ITK global default. */
+  void SetNumberOfThreads( itk::ThreadIdType n )
+  {
+    this->m_NumberOfThreads = n;
+  }
+
+  void Compute()
+  {
+    const RegionType  region = this->m_LabelImage->GetLargestPossibleRegion();
+    const unsigned long nslices = region.GetSize()[ImageDimension - 1];
+
+    this->m_Statistics.clear();
+    this->m_ValueImageOnLabelGrid = false;
+    this->m_Interpolator = ITK_NULLPTR;
+    if( this->m_ValueImage )
+      {
+      this->m_ValueImageOnLabelGrid =
+        this->m_ValueImage->GetLargestPossibleRegion() == region &&
+        this->m_ValueImage->GetSpacing() == this->m_LabelImage->GetSpacing() &&
+        this->m_ValueImage->GetOrigin() == this->m_LabelImage->GetOrigin() &&
+        this->m_ValueImage->GetDirection() == this->m_LabelImage->GetDirection();
+      if( !this->m_ValueImageOnLabelGrid )
+        {
+        this->m_Interpolator = InterpolatorType::New();
+        this->m_Interpolator->SetInputImage( this->m_ValueImage );
+        }
+      }
+
+    const itk::ThreadIdType nthreads = GetNumberOfThreadsForRange( nslices, this->m_NumberOfThreads );
+    this->m_ThreadStatistics.assign( nthreads, StatisticsMapType() );
+    ParallelizeRange( 0, nslices, *this, nthreads );
+    for( itk::ThreadIdType t = 0; t < nthreads; t++ )
+      {
+      const StatisticsMapType & partial = this->m_ThreadStatistics[t];
+      for( typename StatisticsMapType::const_iterator it = partial.begin(); it != partial.end(); ++it )
+        {
+        this->m_Statistics[it->first].Merge( it->second );
+        }
+      }
+    this->m_ThreadStatistics.clear();
+    this->m_Interpolator = ITK_NULLPTR;
+  }
+
+  /** Statistics of all nonzero labels, in ascending label order. */
+  const StatisticsMapType & GetStatistics() const
+  {
+    return this->m_Statistics;
+  }
+
+  std::vector<LabelType> GetLabels() const
+  {
+    std::vector<LabelType> labels;
+    for( typename StatisticsMapType::const_iterator it = this->m_Statistics.begin();
+         it != this->m_Statistics.end(); ++it )
+      {
+      labels.push_back( it->first );
+      }
+    return labels;
+  }
+
+  bool HasLabel( LabelType label ) const
+  {
+    return this->m_Statistics.find( label ) != this->m_Statistics.end();
+  }
+
+  /** Physical centre of mass of the label's voxels. */
+  PointType GetCentroid( const StatisticsType & stats ) const
+  {
+    PointType point;
+    this->m_LabelImage->TransformContinuousIndexToPhysicalPoint( stats.GetIndexCentroid(), point );
+    return point;
+  }
+
+  /** ParallelizeRange callback over slices [begin, end) of the last axis. */
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType threadId )
+  {
+    typedef itk::ImageRegionConstIteratorWithIndex<TLabelImage> LabelIteratorType;
+    typedef itk::ImageRegionConstIterator<TValueImage>          ValueIteratorType;
+
+    const RegionType    slab = GetImageSetSlab( this->m_LabelImage->GetLargestPossibleRegion(), begin, end - begin );
+    StatisticsMapType & partial = this->m_ThreadStatistics[threadId];
+    const bool          histogram = this->m_NumberOfHistogramBins > 0;
+    const double        binScale = histogram ? this->m_NumberOfHistogramBins
+      / std::max( this->m_HistogramMaximum - this->m_HistogramMinimum, 1.e-12 ) : 0.0;
+
+    LabelIteratorType lIt( this->m_LabelImage, slab );
+    ValueIteratorType vIt;
+    if( this->m_ValueImageOnLabelGrid )
+      {
+      vIt = ValueIteratorType( this->m_ValueImage, slab );
+      vIt.GoToBegin();
+      }
+
+    /** labels come in runs, so remember the last one instead of searching
+     *  the map at every voxel */
+    StatisticsType * current = ITK_NULLPTR;
+    LabelType        currentLabel = itk::NumericTraits<LabelType>::ZeroValue();
+    for( lIt.GoToBegin(); !lIt.IsAtEnd(); ++lIt )
+      {
+      const LabelType label = lIt.Get();
+      double          value = 0;
+      bool            hasValue = false;
+      if( this->m_ValueImageOnLabelGrid )
+        {
+        value = static_cast<double>( vIt.Get() );
+        hasValue = true;
+        ++vIt;
+        }
+      if( label == itk::NumericTraits<LabelType>::ZeroValue() )
+        {
+        continue;
+        }
+      if( current == ITK_NULLPTR || label != currentLabel )
+        {
+        current = &partial[label];
+        currentLabel = label;
+        if( histogram && current->Histogram.empty() )
+          {
+          current->Histogram.assign( this->m_NumberOfHistogramBins, 0 );
+          }
+        }
+
+      const typename TLabelImage::IndexType index = lIt.GetIndex();
+      current->Count++;
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        current->IndexSum[d] += index[d];
+        current->BoundingBoxMinimum[d] = std::min( current->BoundingBoxMinimum[d], index[d] );
+        current->BoundingBoxMaximum[d] = std::max( current->BoundingBoxMaximum[d], index[d] );
+        }
+
+      if( this->m_Interpolator.IsNotNull() )
+        {
+        PointType point;
+        this->m_LabelImage->TransformIndexToPhysicalPoint( index, point );
+        if( this->m_Interpolator->IsInsideBuffer( point ) )
+          {
+          value = this->m_Interpolator->Evaluate( point );
+          hasValue = true;
+          }
+        }
+      if( !hasValue || ( this->m_IgnoreZeroValues && std::fabs( value ) <= 1.e-9 ) )
+        {
+        continue;
+        }
+      current->ValueCount++;
+      current->Sum += value;
+      current->SumOfSquares += value * value;
+      current->Minimum = std::min( current->Minimum, value );
+      current->Maximum = std::max( current->Maximum, value );
+      if( histogram )
+        {
+        const double bin = std::floor( ( value - this->m_HistogramMinimum ) * binScale );
+        const long   b = static_cast<long>( std::min( std::max( bin, 0.0 ),
+                                                      static_cast<double>( this->m_NumberOfHistogramBins - 1 ) ) );
+        current->Histogram[b]++;
+        }
+      }
+  }
+
+private:
+  const TLabelImage *                     m_LabelImage;
+  const TValueImage *                     m_ValueImage;
+  bool                                    m_IgnoreZeroValues;
+  unsigned int                            m_NumberOfHistogramBins;
+  double                                  m_HistogramMinimum;
+  double                                  m_HistogramMaximum;
+  itk::ThreadIdType                       m_NumberOfThreads;
+  bool                                    m_ValueImageOnLabelGrid;
+  typename InterpolatorType::Pointer      m_Interpolator;
+  std::vector<StatisticsMapType>          m_ThreadStatistics;
+  StatisticsMapType                       m_Statistics;
+};
+} // namespace ants
+
+#endif
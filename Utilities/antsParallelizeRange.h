@@ -0,0 +1,113 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __antsParallelizeRange_h
+#define __antsParallelizeRange_h
+
+#include "itkMultiThreader.h"
+#include "itkIntTypes.h"
+
+namespace ants
+{
+/**
+ * Split the half-open range [begin, end) into contiguous chunks and hand one
+ * chunk to each thread of an itk::MultiThreader.  The functor is called as
+ *
+ *   functor( chunkBegin, chunkEnd, threadId );
+ *
+ * and must only touch state owned by its chunk or by its threadId.  This is
+ * the same SingleMethodExecute pattern the ITK filters use, packaged for the
+ * non-filter loops in the command line tools.
+ */
+template <class TFunctor>
+struct ParallelizeRangeStruct
+{
+  TFunctor *           Functor;
+  itk::SizeValueType   Begin;
+  itk::SizeValueType   End;
+};
+
+template <class TFunctor>
+ITK_THREAD_RETURN_TYPE ParallelizeRangeCallback( void *arg )
+{
+  typedef itk::MultiThreader::ThreadInfoStruct ThreadInfoType;
+  ThreadInfoType *                   info = static_cast<ThreadInfoType *>( arg );
+  const itk::ThreadIdType            threadId = info->ThreadID;
+  const itk::ThreadIdType            threadCount = info->NumberOfThreads;
+  ParallelizeRangeStruct<TFunctor> * str = static_cast<ParallelizeRangeStruct<TFunctor> *>( info->UserData );
+
+  const itk::SizeValueType total = str->End - str->Begin;
+  const itk::SizeValueType chunk = ( total + threadCount - 1 ) / threadCount;
+  const itk::SizeValueType chunkBegin = str->Begin + chunk * threadId;
+  itk::SizeValueType       chunkEnd = chunkBegin + chunk;
+  if( chunkEnd > str->End )
+    {
+    chunkEnd = str->End;
+    }
+  if( chunkBegin < chunkEnd )
+    {
+    ( *str->Functor )( chunkBegin, chunkEnd, threadId );
+    }
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+/** Returns the number of threads that were used, so that callers can size
+ *  their per-thread accumulators before the call with GetNumberOfThreadsForRange. */
+inline itk::ThreadIdType GetNumberOfThreadsForRange( itk::SizeValueType rangeLength,
+                                                     itk::ThreadIdType numberOfThreads = 0 )
+{
+  if( numberOfThreads == 0 )
+    {
+    numberOfThreads = itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+    }
+  if( rangeLength < numberOfThreads )
+    {
+    numberOfThreads = static_cast<itk::ThreadIdType>( rangeLength );
+    }
+  if( numberOfThreads < 1 )
+    {
+    numberOfThreads = 1;
+    }
+  return numberOfThreads;
+}
+
+template <class TFunctor>
+itk::ThreadIdType ParallelizeRange( itk::SizeValueType begin, itk::SizeValueType end, TFunctor & functor,
+                                    itk::ThreadIdType numberOfThreads = 0 )
+{
+  if( end <= begin )
+    {
+    return 0;
+    }
+  numberOfThreads = GetNumberOfThreadsForRange( end - begin, numberOfThreads );
+  if( numberOfThreads == 1 )
+    {
+    functor( begin, end, 0 );
+    return 1;
+    }
+
+  ParallelizeRangeStruct<TFunctor> str;
+  str.Functor = &functor;
+  str.Begin = begin;
+  str.End = end;
+
+  itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+  threader->SetNumberOfThreads( numberOfThreads );
+  threader->SetSingleMethod( ParallelizeRangeCallback<TFunctor>, &str );
+  threader->SingleMethodExecute();
+  return numberOfThreads;
+}
+} // namespace ants
+
+#endif
@@ -0,0 +1,187 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "antsReadCache.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include <list>
+#include <map>
+#include <sstream>
+#include <sys/stat.h>
+
+namespace ants
+{
+namespace
+{
+struct ReadCacheEntry
+{
+  std::string          m_Key;
+  itk::Object::Pointer m_Object;
+  itk::SizeValueType   m_Bytes;
+};
+
+typedef std::list<ReadCacheEntry>                          ReadCacheListType;
+typedef std::map<std::string, ReadCacheListType::iterator> ReadCacheMapType;
+
+// most recently used entry first
+struct ReadCache
+{
+  itk::SimpleFastMutexLock m_Mutex;
+  ReadCacheListType        m_Entries;
+  ReadCacheMapType         m_Index;
+  itk::SizeValueType       m_Capacity;
+  itk::SizeValueType       m_Bytes;
+  itk::SizeValueType       m_Hits;
+  itk::SizeValueType       m_Misses;
+  itk::SizeValueType       m_Evictions;
+
+  ReadCache() : m_Capacity( 0 ), m_Bytes( 0 ), m_Hits( 0 ), m_Misses( 0 ), m_Evictions( 0 )
+  {
+  }
+
+  // call with m_Mutex locked
+  void Evict( itk::SizeValueType capacity )
+  {
+    while( this->m_Bytes > capacity && !this->m_Entries.empty() )
+      {
+      this->m_Bytes -= this->m_Entries.back().m_Bytes;
+      this->m_Index.erase( this->m_Entries.back().m_Key );
+      this->m_Entries.pop_back();
+      this->m_Evictions++;
+      }
+  }
+};
+
+ReadCache readCache;
+}
+
+void SetReadCacheCapacity( itk::SizeValueType bytes )
+{
+  readCache.m_Mutex.Lock();
+  readCache.m_Capacity = bytes;
+  readCache.Evict( bytes );
+  readCache.m_Mutex.Unlock();
+}
+
+itk::SizeValueType GetReadCacheCapacity()
+{
+  readCache.m_Mutex.Lock();
+  const itk::SizeValueType capacity = readCache.m_Capacity;
+  readCache.m_Mutex.Unlock();
+  return capacity;
+}
+
+std::string GetReadCacheKey( const std::string & filename, const std::type_info & type )
+{
+  struct stat fileInfo;
+
+  if( !IsReadCacheEnabled() || stat( filename.c_str(), &fileInfo ) != 0 )
+    {
+    return std::string();
+    }
+#if defined( __APPLE__ )
+  const long nanoseconds = fileInfo.st_mtimespec.tv_nsec;
+#elif defined( _WIN32 )
+  const long nanoseconds = 0;
+#else
+  const long nanoseconds = fileInfo.st_mtim.tv_nsec;
+#endif
+  // a file rewritten in place changes its modification time, to the
+  // nanosecond where the file system keeps it; one renamed over the old
+  // name is a new inode
+  std::ostringstream key;
+  key << filename << '\n' << fileInfo.st_dev << ':' << fileInfo.st_ino << '\n' << fileInfo.st_mtime << '.'
+      << nanoseconds << '\n' << fileInfo.st_size << '\n' << type.name();
+  return key.str();
+}
+
+void RemoveFromReadCache( const std::string & filename )
+{
+  const std::string prefix = filename + '\n';
+
+  readCache.m_Mutex.Lock();
+  ReadCacheListType::iterator it = readCache.m_Entries.begin();
+  while( it != readCache.m_Entries.end() )
+    {
+    if( it->m_Key.compare( 0, prefix.length(), prefix ) == 0 )
+      {
+      readCache.m_Bytes -= it->m_Bytes;
+      readCache.m_Index.erase( it->m_Key );
+      it = readCache.m_Entries.erase( it );
+      }
+    else
+      {
+      ++it;
+      }
+    }
+  readCache.m_Mutex.Unlock();
+}
+
+itk::Object::Pointer FindInReadCache( const std::string & key )
+{
+  itk::Object::Pointer object;
+
+  readCache.m_Mutex.Lock();
+  ReadCacheMapType::iterator it = readCache.m_Index.find( key );
+  if( it != readCache.m_Index.end() )
+    {
+    readCache.m_Entries.splice( readCache.m_Entries.begin(), readCache.m_Entries, it->second );
+    object = it->second->m_Object;
+    readCache.m_Hits++;
+    }
+  else
+    {
+    readCache.m_Misses++;
+    }
+  readCache.m_Mutex.Unlock();
+  return object;
+}
+
+void AddToReadCache( const std::string & key, itk::Object * object, itk::SizeValueType bytes )
+{
+  readCache.m_Mutex.Lock();
+  if( bytes <= readCache.m_Capacity && readCache.m_Index.find( key ) == readCache.m_Index.end() )
+    {
+    ReadCacheEntry entry;
+    entry.m_Key = key;
+    entry.m_Object = object;
+    entry.m_Bytes = bytes;
+    readCache.m_Entries.push_front( entry );
+    readCache.m_Index[key] = readCache.m_Entries.begin();
+    readCache.m_Bytes += bytes;
+    readCache.Evict( readCache.m_Capacity );
+    }
+  readCache.m_Mutex.Unlock();
+}
+
+void ClearReadCache()
+{
+  readCache.m_Mutex.Lock();
+  readCache.m_Entries.clear();
+  readCache.m_Index.clear();
+  readCache.m_Bytes = 0;
+  readCache.m_Mutex.Unlock();
+}
+
+void PrintReadCacheStatistics( std::ostream & os )
+{
+  const double megabyte = 1024.0 * 1024.0;
+
+  readCache.m_Mutex.Lock();
+  os << "Read cache: " << readCache.m_Entries.size() << " entries, " << readCache.m_Bytes / megabyte << " of "
+     << readCache.m_Capacity / megabyte << " MB; " << readCache.m_Hits << " hits, " << readCache.m_Misses
+     << " misses, " << readCache.m_Evictions << " evictions" << std::endl;
+  readCache.m_Mutex.Unlock();
+}
+} // namespace ants
@@ -0,0 +1,118 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __antsReadCache_h
+#define __antsReadCache_h
+
+#include "itkObject.h"
+#include "itkIntTypes.h"
+#include "itkImageDuplicator.h"
+
+#include <iostream>
+#include <string>
+#include <typeinfo>
+
+namespace ants
+{
+/**
+ * Process-wide cache of decoded images and transforms, for long-lived
+ * processes such as antsServer that run many tools on the same inputs.
+ *
+ * ReadImage and itk::ants::ReadTransform look an input up by file name,
+ * inode, modification time, size and requested type before decoding it, and
+ * store what they decoded afterwards.  WriteImage, WriteTensorImage and
+ * itk::ants::WriteTransform drop the entries of the file they write.  The
+ * cache holds its own reference to every entry and hands out copies, so a
+ * tool that modifies its input in place never changes what the next tool
+ * reads.  Entries are evicted least
+ * recently used first once their total size exceeds the capacity; an entry
+ * that is still referenced elsewhere is freed when its last holder releases
+ * it.
+ *
+ * The capacity is 0, i.e. the cache is disabled, unless a program sets it.
+ */
+void SetReadCacheCapacity( itk::SizeValueType bytes );
+
+itk::SizeValueType GetReadCacheCapacity();
+
+inline bool IsReadCacheEnabled()
+{
+  return GetReadCacheCapacity() > 0;
+}
+
+/** Key for filename read as type; empty if the cache is disabled or the file
+ *  cannot be stat'ed, in which case the file is not cached. */
+std::string GetReadCacheKey( const std::string & filename, const std::type_info & type );
+
+/** The cached object, or a null pointer.  The caller must copy it before
+ *  handing it out. */
+itk::Object::Pointer FindInReadCache( const std::string & key );
+
+void AddToReadCache( const std::string & key, itk::Object * object, itk::SizeValueType bytes );
+
+/** Drops every entry read from filename; called by the writers. */
+void RemoveFromReadCache( const std::string & filename );
+
+void ClearReadCache();
+
+void PrintReadCacheStatistics( std::ostream & os );
+
+template <class TImage>
+typename TImage::Pointer DuplicateImage( const TImage * image )
+{
+  typedef itk::ImageDuplicator<TImage> DuplicatorType;
+  typename DuplicatorType::Pointer duplicator = DuplicatorType::New();
+  duplicator->SetInputImage( image );
+  duplicator->Update();
+  return duplicator->GetModifiableOutput();
+}
+
+template <class TImage>
+itk::SizeValueType GetImageBufferSize( const TImage * image )
+{
+  return static_cast<itk::SizeValueType>( image->GetPixelContainer()->Size() )
+         * sizeof( typename TImage::InternalPixelType );
+}
+
+/** A copy of the image read from filename if it is cached, else null. */
+template <class TImage>
+typename TImage::Pointer FindImageInReadCache( const std::string & key )
+{
+  if( key.empty() )
+    {
+    return ITK_NULLPTR;
+    }
+  itk::Object::Pointer object = FindInReadCache( key );
+  const TImage *       image = dynamic_cast<const TImage *>( object.GetPointer() );
+  if( image == ITK_NULLPTR )
+    {
+    return ITK_NULLPTR;
+    }
+  return DuplicateImage<TImage>( image );
+}
+
+/** Caches a copy of image, which the caller keeps using. */
+template <class TImage>
+void AddImageToReadCache( const std::string & key, const TImage * image )
+{
+  if( key.empty() || image == ITK_NULLPTR )
+    {
+    return;
+    }
+  typename TImage::Pointer copy = DuplicateImage<TImage>( image );
+  AddToReadCache( key, copy.GetPointer(), GetImageBufferSize<TImage>( image ) );
+}
+} // namespace ants
+
+#endif
@@ -118,12 +118,12 @@ public:
     this->m_PercentVarianceForPseudoInverse = p;
   }
 
-  MatrixType PseudoInverse( MatrixType p_in,  bool take_sqrt = false )
+  MatrixType PseudoInverse( const MatrixType & p_in,  bool take_sqrt = false )
   {
     return this->VNLPseudoInverse(  p_in,  take_sqrt );
   }
 
-  MatrixType VNLPseudoInverse( MatrixType,  bool take_sqrt = false );
+  MatrixType VNLPseudoInverse( const MatrixType &,  bool take_sqrt = false );
 
   void ZeroProduct( VectorType& v1, VectorType& v2 )
   {
@@ -197,18 +197,38 @@ public:
       }
   }
 
-  MatrixType OrthogonalizeMatrix(MatrixType M, VectorType V )
+  MatrixType OrthogonalizeMatrix( const MatrixType & M, const VectorType & V )
   {
-    for( unsigned int j = 0; j < M.cols(); j++ )
+    MatrixType ortho( M );
+    this->OrthogonalizeMatrixInPlace( ortho, V );
+    return ortho;
+  }
+
+  /** Remove the projection onto V from every column of M without allocating
+   *  per-column temporaries. */
+  void OrthogonalizeMatrixInPlace( MatrixType & M, const VectorType & V )
+  {
+    double vnorm = inner_product( V, V );
+    if ( vnorm < this->m_Epsilon ) vnorm = 1;
+    const unsigned int nrows = M.rows();
+    const unsigned int ncols = M.cols();
+    std::vector<double> ratio( ncols, 0 );
+    for( unsigned int i = 0; i < nrows; i++ )
       {
-      VectorType Mvec = M.get_column(j);
-      double     vnorm = inner_product(V, V);
-      if ( vnorm < this->m_Epsilon ) vnorm = 1;
-      double     ratio = inner_product(Mvec, V) / vnorm;
-      VectorType ortho = Mvec - V * ratio;
-      M.set_column(j, ortho);
+      const RealType * row = M[i];
+      for( unsigned int j = 0; j < ncols; j++ )
+        {
+        ratio[j] += row[j] * V(i);
+        }
+      }
+    for( unsigned int i = 0; i < nrows; i++ )
+      {
+      RealType * row = M[i];
+      for( unsigned int j = 0; j < ncols; j++ )
+        {
+        row[j] -= V(i) * ratio[j] / vnorm;
+        }
       }
-    return M;
   }
 
   MatrixType RankifyMatrixColumns(MatrixType M )
@@ -286,27 +306,27 @@ public:
       matrix.rows(), matrix.cols() ); this->m_OriginalMatrixR.update(matrix); this->m_MatrixR.update(matrix);
   }
 
-  MatrixType GetMatrixP()
+  const MatrixType & GetMatrixP() const
   {
     return this->m_MatrixP;
   }
 
-  MatrixType GetMatrixQ()
+  const MatrixType & GetMatrixQ() const
   {
     return this->m_MatrixQ;
   }
 
-  MatrixType GetMatrixR()
+  const MatrixType & GetMatrixR() const
   {
     return this->m_MatrixR;
   }
 
-  MatrixType GetMatrixU()
+  const MatrixType & GetMatrixU() const
   {
     return this->m_MatrixU;
   }
 
-  MatrixType GetOriginalMatrixP()
+  const MatrixType & GetOriginalMatrixP() const
   {
     return this->m_OriginalMatrixP;
   }
@@ -321,12 +341,12 @@ public:
     return this->m_lambda = lambda;
   }
 
-  MatrixType GetOriginalMatrixQ()
+  const MatrixType & GetOriginalMatrixQ() const
   {
     return this->m_OriginalMatrixQ;
   }
 
-  MatrixType GetOriginalMatrixR()
+  const MatrixType & GetOriginalMatrixR() const
   {
     return this->m_OriginalMatrixR;
   }
@@ -422,66 +442,82 @@ public:
     return this->loc_Array;
   }
 
-  MatrixType NormalizeMatrix(MatrixType p, bool makepositive = true );
+  MatrixType NormalizeMatrix( const MatrixType & p, bool makepositive = true )
+  {
+    MatrixType np( p );
+    this->NormalizeMatrixInPlace( np, makepositive );
+    return np;
+  }
+
+  void NormalizeMatrixInPlace( MatrixType & p, bool makepositive = true );
 
   /** needed for partial scca */
-  MatrixType CovarianceMatrix(MatrixType p, RealType regularization = 1.e-2 )
+  MatrixType CovarianceMatrix( const MatrixType & p, RealType regularization = 1.e-2 )
   {
-    if( p.rows() < p.columns() )
-      {
-      MatrixType invcov = p * p.transpose();
-      invcov.set_identity();
-      invcov = invcov * regularization + p * p.transpose();
-      return invcov;
-      }
-    else
-      {
-      MatrixType invcov = p.transpose() * p;
-      invcov.set_identity();
-      invcov = invcov * regularization + p.transpose() * p;
-      return invcov;
-      }
+    MatrixType cov;
+    this->CovarianceMatrix( p, cov, regularization );
+    return cov;
   }
 
-  MatrixType WhitenMatrix(MatrixType p, RealType regularization = 1.e-2 )
+  /** Compute p p^T (or p^T p, whichever is smaller) plus a ridge into cov,
+   *  reusing the storage of cov when it already has the right size. */
+  void CovarianceMatrix( const MatrixType & p, MatrixType & cov, RealType regularization = 1.e-2 );
+
+  MatrixType WhitenMatrix( const MatrixType & p, RealType regularization = 1.e-2 )
   {
-    double reg = 1.e-9;
+    MatrixType wp( p );
+    this->WhitenMatrixInPlace( wp, regularization );
+    return wp;
+  }
 
-    if( p.rows() < p.cols() )
-      {
-      reg = regularization;
-      }
-    MatrixType cov = this->CovarianceMatrix(p, reg);
+  void WhitenMatrixInPlace( MatrixType & p, RealType regularization = 1.e-2 );
+
+  MatrixType WhitenMatrixByAnotherMatrix( const MatrixType & p, const MatrixType & op, RealType regularization = 1.e-2)
+  {
+    MatrixType cov;
+    this->CovarianceMatrix( op, cov, regularization );
     MatrixType invcov = this->PseudoInverse( cov, true );
-    bool       debug = false;
-    if( ( ! this->m_Silent )  &&  ( debug ) )
-      {
-      std::cout << " cov " << std::endl;   std::cout << cov << std::endl;
-      std::cout << " invcov " << std::endl;   std::cout << invcov << std::endl;
-      std::cout << " id? " << std::endl;   std::cout << cov * invcov << std::endl;
-      }
+    MatrixType wp;
     if( p.rows() < p.columns() )
       {
-      return invcov * p;
+      this->MultiplyMatrices( invcov, p, wp );
       }
     else
       {
-      return p * invcov;
+      this->MultiplyMatrices( p, invcov, wp );
       }
+    return wp;
   }
 
-  MatrixType WhitenMatrixByAnotherMatrix(MatrixType p, MatrixType op, RealType regularization = 1.e-2)
+  /** out = A * B in i-k-j order so that both operands and the result are
+   *  walked along rows; out is only reallocated when its size changes. */
+  void MultiplyMatrices( const MatrixType & A, const MatrixType & B, MatrixType & out ) const
   {
-    MatrixType invcov = this->CovarianceMatrix(op, regularization);
-
-    invcov = this->PseudoInverse( invcov, true );
-    if( p.rows() < p.columns() )
+    const unsigned int nrows = A.rows();
+    const unsigned int ninner = A.cols();
+    const unsigned int ncols = B.cols();
+    if( out.rows() != nrows || out.cols() != ncols )
       {
-      return invcov * p;
+      out.set_size( nrows, ncols );
       }
-    else
+    out.fill( 0 );
+    for( unsigned int i = 0; i < nrows; i++ )
       {
-      return p * invcov;
+      const RealType * arow = A[i];
+      RealType *       orow = out[i];
+      for( unsigned int k = 0; k < ninner; k++ )
+        {
+        const RealType a = arow[k];
+        if( a == 0 )
+          {
+          continue;
+          }
+        const RealType * brow = B[k];
+        for( unsigned int j = 0; j < ncols; j++ )
+          {
+          orow[j] += a * brow[j];
+          }
+        }
       }
   }
 
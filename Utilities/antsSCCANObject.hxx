@@ -795,19 +795,28 @@ antsSCCANObject<TInputImage, TRealType>
 }
 
 template <class TInputImage, class TRealType>
-typename antsSCCANObject<TInputImage, TRealType>::MatrixType
+void
 antsSCCANObject<TInputImage, TRealType>
-::NormalizeMatrix( typename antsSCCANObject<TInputImage, TRealType>::MatrixType p, bool makepositive )
+::NormalizeMatrixInPlace( typename antsSCCANObject<TInputImage, TRealType>::MatrixType & p, bool makepositive )
 {
-  return(p);
-  MatrixType np( p.rows(), p.columns() );
-
-  for( unsigned long i = 0; i < p.columns(); i++ )
+  return;
+  const unsigned long nrows = p.rows();
+  const unsigned long ncols = p.columns();
+  for( unsigned long i = 0; i < ncols; i++ )
     {
-    VectorType wpcol = p.get_column(i);
-    VectorType wpcol2 = wpcol - wpcol.mean();
-    double     sd = wpcol2.squared_magnitude();
-    sd = sqrt( sd / (p.rows() - 1) );
+    double mean = 0;
+    for( unsigned long r = 0; r < nrows; r++ )
+      {
+      mean += p( r, i );
+      }
+    mean /= static_cast<double>( nrows );
+    double sd = 0;
+    for( unsigned long r = 0; r < nrows; r++ )
+      {
+      const double d = p( r, i ) - mean;
+      sd += d * d;
+      }
+    sd = sqrt( sd / (nrows - 1) );
     if( sd <= 0.0 && i == static_cast<unsigned long>(0) )
       {
       if ( ! this->m_Silent )  std::cout << " row " << i << " has zero variance --- exiting " << std::endl;
@@ -816,31 +825,133 @@ antsSCCANObject<TInputImage, TRealType>
     if( sd <= 0 && i > 0 )
       {
       if ( ! this->m_Silent )  std::cout << " row " << i << " has zero variance --- copying the previous row " << std::endl;
-      if ( ! this->m_Silent )  std::cout << " the row is " << wpcol << std::endl;
-      np.set_column(i, np.get_column(i - 1) );
+      if ( ! this->m_Silent )  std::cout << " the row is " << p.get_column( i ) << std::endl;
+      for( unsigned long r = 0; r < nrows; r++ )
+        {
+        p( r, i ) = p( r, i - 1 );
+        }
       }
     else
       {
-      wpcol = wpcol2 / sd;
-      np.set_column(i, wpcol);
+      for( unsigned long r = 0; r < nrows; r++ )
+        {
+        p( r, i ) = ( p( r, i ) - mean ) / sd;
+        }
       }
     }
   /** cast to a non-negative space */
   if( makepositive )
     {
-    np = np - np.min_value();
+    p -= p.min_value();
+    }
+}
+
+template <class TInputImage, class TRealType>
+void
+antsSCCANObject<TInputImage, TRealType>
+::CovarianceMatrix( const typename antsSCCANObject<TInputImage, TRealType>::MatrixType & p,
+  typename antsSCCANObject<TInputImage, TRealType>::MatrixType & cov, TRealType regularization )
+{
+  const unsigned int nrows = p.rows();
+  const unsigned int ncols = p.cols();
+  /** the covariance is symmetric, so only the upper triangle is accumulated */
+  if( nrows < ncols )
+    {
+    if( cov.rows() != nrows || cov.cols() != nrows )
+      {
+      cov.set_size( nrows, nrows );
+      }
+    for( unsigned int i = 0; i < nrows; i++ )
+      {
+      const RealType * rowi = p[i];
+      for( unsigned int j = i; j < nrows; j++ )
+        {
+        const RealType * rowj = p[j];
+        RealType         sum = 0;
+        for( unsigned int k = 0; k < ncols; k++ )
+          {
+          sum += rowi[k] * rowj[k];
+          }
+        cov( i, j ) = sum;
+        cov( j, i ) = sum;
+        }
+      }
+    }
+  else
+    {
+    if( cov.rows() != ncols || cov.cols() != ncols )
+      {
+      cov.set_size( ncols, ncols );
+      }
+    cov.fill( 0 );
+    for( unsigned int k = 0; k < nrows; k++ )
+      {
+      const RealType * rowk = p[k];
+      for( unsigned int i = 0; i < ncols; i++ )
+        {
+        const RealType a = rowk[i];
+        RealType *     covi = cov[i];
+        for( unsigned int j = i; j < ncols; j++ )
+          {
+          covi[j] += a * rowk[j];
+          }
+        }
+      }
+    for( unsigned int i = 0; i < ncols; i++ )
+      {
+      for( unsigned int j = i + 1; j < ncols; j++ )
+        {
+        cov( j, i ) = cov( i, j );
+        }
+      }
+    }
+  for( unsigned int i = 0; i < cov.rows(); i++ )
+    {
+    cov( i, i ) += regularization;
+    }
+}
+
+template <class TInputImage, class TRealType>
+void
+antsSCCANObject<TInputImage, TRealType>
+::WhitenMatrixInPlace( typename antsSCCANObject<TInputImage, TRealType>::MatrixType & p, TRealType regularization )
+{
+  double reg = 1.e-9;
+
+  if( p.rows() < p.cols() )
+    {
+    reg = regularization;
     }
-  return np;
+  MatrixType cov;
+  this->CovarianceMatrix( p, cov, reg );
+  MatrixType invcov = this->PseudoInverse( cov, true );
+  bool       debug = false;
+  if( ( ! this->m_Silent )  &&  ( debug ) )
+    {
+    std::cout << " cov " << std::endl;   std::cout << cov << std::endl;
+    std::cout << " invcov " << std::endl;   std::cout << invcov << std::endl;
+    std::cout << " id? " << std::endl;   std::cout << cov * invcov << std::endl;
+    }
+  MatrixType wp;
+  if( p.rows() < p.columns() )
+    {
+    this->MultiplyMatrices( invcov, p, wp );
+    }
+  else
+    {
+    this->MultiplyMatrices( p, invcov, wp );
+    }
+  p.swap( wp );
 }
 
 template <class TInputImage, class TRealType>
 typename antsSCCANObject<TInputImage, TRealType>::MatrixType
 antsSCCANObject<TInputImage, TRealType>
-::VNLPseudoInverse( typename antsSCCANObject<TInputImage, TRealType>::MatrixType rin, bool take_sqrt )
+::VNLPseudoInverse( const typename antsSCCANObject<TInputImage, TRealType>::MatrixType & rin, bool take_sqrt )
 {
-  double       pinvTolerance = this->m_PinvTolerance;
-  MatrixType   dd = rin;
-  unsigned int ss = dd.rows();
+  double            pinvTolerance = this->m_PinvTolerance;
+  const MatrixType & dd = rin;
+  unsigned int      ss = dd.rows();
 
   if( dd.rows() > dd.columns() )
     {
@@ -1225,7 +1336,8 @@ void antsSCCANObject<TInputImage, TRealType>
 
   if( this->m_OriginalMatrixQ.size() > 0 )
     {
-    omatQ = this->NormalizeMatrix(this->m_OriginalMatrixQ);
+    omatQ = this->m_OriginalMatrixQ;
+    this->NormalizeMatrixInPlace( omatQ );
     }
   else
     {
@@ -1287,8 +1399,10 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   if ( ! this->m_Silent )  std::cout << " ed sparse cca " << std::endl;
   unsigned int nsubj = this->m_MatrixP.rows();
 
-  this->m_MatrixP = this->NormalizeMatrix(this->m_OriginalMatrixP);
-  this->m_MatrixQ = this->NormalizeMatrix(this->m_OriginalMatrixQ);
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
+  this->m_MatrixQ = this->m_OriginalMatrixQ;
+  this->NormalizeMatrixInPlace( this->m_MatrixQ );
 
   RealType tau = 0.01;
   if( this->m_Debug )
@@ -1405,9 +1519,12 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   /*
   if ( ! this->m_Silent )  std::cout <<" ed sparse partial cca " << std::endl;
   unsigned int nsubj=this->m_MatrixP.rows();
-  this->m_MatrixP=this->NormalizeMatrix(this->m_OriginalMatrixP);
-  this->m_MatrixQ=this->NormalizeMatrix(this->m_OriginalMatrixQ);
-  this->m_MatrixR=this->NormalizeMatrix(this->m_OriginalMatrixR);
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
+  this->m_MatrixQ = this->m_OriginalMatrixQ;
+  this->NormalizeMatrixInPlace( this->m_MatrixQ );
+  this->m_MatrixR = this->m_OriginalMatrixR;
+  this->NormalizeMatrixInPlace( this->m_MatrixR );
 
   RealType tau=0.01;
   if (this->m_Debug) if ( ! this->m_Silent )  std::cout << " inv view mats " << std::endl;
@@ -1622,7 +1739,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   this->m_CanonicalCorrelations.fill(0);
   if ( ! this->m_Silent )  std::cout << " arnoldi sparse svd : cg " << std::endl;
   std::vector<RealType> vexlist;
-  this->m_MatrixP = this->NormalizeMatrix(this->m_OriginalMatrixP);
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
   this->m_MatrixQ = this->m_MatrixP;
   if( this->m_OriginalMatrixR.size() > 0 )
     {
@@ -1869,7 +1987,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   if ( ! this->m_Silent )  std::cout << " sparse recon prior " << this->m_MinClusterSizeP << std::endl;
   MatrixType matrixB( this->m_OriginalMatrixP.rows(), n_vecs );
   matrixB.fill( 0 );
-  this->m_MatrixP = this->NormalizeMatrix( this->m_OriginalMatrixP );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
   this->m_VariatesP.set_size( this->m_MatrixP.cols(), n_vecs );
   this->m_VariatesP.fill( 0 );
   VectorType icept( this->m_MatrixP.rows(), 0 );
@@ -2149,7 +2268,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
                    <<  this->m_KeepPositiveP << " covering " << this->m_Covering << " smooth " << this->m_Smoother << std::endl;
   MatrixType matrixB( this->m_OriginalMatrixP.rows(), n_vecs );
   matrixB.fill( 0 );
-  this->m_MatrixP = this->NormalizeMatrix( this->m_OriginalMatrixP  );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
   VectorType icept( this->m_MatrixP.rows(), 0 );
   if ( this->m_FractionNonZeroP < 1.e-11 )
     { // estimate sparseness from PCA
@@ -2411,7 +2531,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   if ( ! this->m_Silent )  std::cout << " sparse recon " << this->m_MinClusterSizeP << " useL1 " << this->m_UseL1  << std::endl;
   MatrixType matrixB( this->m_OriginalMatrixP.rows(), n_vecs );
   matrixB.fill( 0 );
-  this->m_MatrixP = this->NormalizeMatrix( this->m_OriginalMatrixP );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
   MatrixType        cov = this->m_MatrixP * this->m_MatrixP.transpose();
   vnl_svd<RealType> eig( cov, 1.e-6 );
   this->m_VariatesP.set_size( this->m_MatrixP.cols(), n_vecs );
@@ -2515,7 +2636,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   std::vector<RealType> vexlist;
 
   vexlist.push_back( 0 );
-  this->m_MatrixP = this->NormalizeMatrix( this->m_OriginalMatrixP );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
   this->m_MatrixQ = this->m_MatrixP;
   if( this->m_OriginalMatrixR.size() > 0 )
     {
@@ -2759,7 +2881,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   this->m_CanonicalCorrelations.fill(0);
   if ( ! this->m_Silent )  std::cout << " arnoldi sparse svd " << std::endl;
   std::vector<RealType> vexlist;
-  this->m_MatrixP = this->NormalizeMatrix(this->m_OriginalMatrixP);
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
   this->m_MatrixQ = this->m_MatrixP;
   if( this->m_OriginalMatrixR.size() > 0 )
     {
@@ -3528,8 +3651,10 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   if ( ! this->m_Silent )  std::cout << " ridge cca : taup " << taup << " tauq " << tauq << std::endl;
 
   this->m_CanonicalCorrelations.set_size( n_vecs );
-  this->m_MatrixP = this->NormalizeMatrix( this->m_OriginalMatrixP, false );
-  this->m_MatrixQ = this->NormalizeMatrix( this->m_OriginalMatrixQ, false );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP, false );
+  this->m_MatrixQ = this->m_OriginalMatrixQ;
+  this->NormalizeMatrixInPlace( this->m_MatrixQ, false );
 
   this->m_VariatesP.set_size( this->m_MatrixP.cols(), n_vecs );
   this->m_VariatesQ.set_size( this->m_MatrixQ.cols(), n_vecs );
@@ -3685,7 +3810,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   if ( ! this->m_Silent )  std::cout << " conjugate gradient sparse-pca approx to pca " << std::endl;
   std::vector<RealType> vexlist;
 
-  this->m_MatrixP = this->NormalizeMatrix(this->m_OriginalMatrixP);
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
   this->m_MatrixQ = this->m_MatrixP;
   if( this->m_OriginalMatrixR.size() > 0 )
     {
@@ -3865,8 +3991,10 @@ TRealType antsSCCANObject<TInputImage, TRealType>
 
   if ( ! this->m_Silent )  std::cout << " Cross-validation - LASSO " << std::endl;
 
-  this->m_MatrixP = this->NormalizeMatrix( this->m_OriginalMatrixP );
-  this->m_MatrixR = this->NormalizeMatrix( this->m_OriginalMatrixR );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
+  this->m_MatrixR = this->m_OriginalMatrixR;
+  this->NormalizeMatrixInPlace( this->m_MatrixR );
   if( this->m_OriginalMatrixR.size() <=  0 )
     {
     if ( ! this->m_Silent )  std::cout << " You need to define a reference matrix " << std::endl;
@@ -3984,8 +4112,10 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   if ( ! this->m_Silent )  std::cout << " Pathwise LASSO : penalty = " << gamma << " veclimit = " << n_vecs << std::endl;
 
   this->m_CanonicalCorrelations.set_size( 1 );
-  this->m_MatrixP = this->NormalizeMatrix( this->m_OriginalMatrixP );
-  this->m_MatrixR = this->NormalizeMatrix( this->m_OriginalMatrixR );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
+  this->m_MatrixR = this->m_OriginalMatrixR;
+  this->NormalizeMatrixInPlace( this->m_MatrixR );
   if( this->m_OriginalMatrixR.size() <=  0 )
     {
     if ( ! this->m_Silent )  std::cout << " You need to define a reference matrix " << std::endl;
@@ -4333,8 +4463,10 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   if ( ! this->m_Silent )  std::cout << " network decomposition using nlcg & normal equations " << std::endl;
 
   this->m_CanonicalCorrelations.set_size( this->m_OriginalMatrixP.rows() );
-  this->m_MatrixP = this->NormalizeMatrix( this->m_OriginalMatrixP );
-  this->m_MatrixR = this->NormalizeMatrix( this->m_OriginalMatrixR );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
+  this->m_MatrixR = this->m_OriginalMatrixR;
+  this->NormalizeMatrixInPlace( this->m_MatrixR );
   this->m_MatrixR = this->m_OriginalMatrixR;
   if( this->m_OriginalMatrixR.size() <=  0 )
     {
@@ -4431,7 +4563,7 @@ TRealType antsSCCANObject<TInputImage, TRealType>
     unsigned int colind = extra_cols;
     RealType     minerr1;
     bool         addcol = false;
-    matrixP = this->NormalizeMatrix( matrixP );
+    this->NormalizeMatrixInPlace( matrixP );
     while(  colind < this->m_VariatesP.cols()  )
       {
       VectorType b =  original_b;  this->m_OriginalB = original_b;
@@ -4493,7 +4625,7 @@ TRealType antsSCCANObject<TInputImage, TRealType>
       RealType fiterr = ( original_b - soln ).one_norm() / original_b.size();
       avgfiterr += ( fiterr * ( 1.0 / ( RealType ) foldnum ) );
       /** Testing */
-      p_leave_out = this->NormalizeMatrix( p_leave_out );
+      this->NormalizeMatrixInPlace( p_leave_out );
       A = p_leave_out * this->m_VariatesP.extract( matrixP.cols(), colind, 0, 0);
       if( addcol )
         {
@@ -4701,7 +4833,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   this->m_CanonicalCorrelations.fill(0);
   if ( ! this->m_Silent )  std::cout << " basic svd " << std::endl;
   std::vector<RealType> vexlist;
-  this->m_MatrixP = this->NormalizeMatrix(this->m_OriginalMatrixP);
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
   this->m_MatrixQ = this->m_MatrixP;
   if( this->m_OriginalMatrixR.size() > 0 )
     {
@@ -4790,7 +4923,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   this->m_CanonicalCorrelations.fill(0);
   if ( ! this->m_Silent )  std::cout << " arnoldi sparse svd : cg " << std::endl;
   std::vector<RealType> vexlist;
-  this->m_MatrixP = this->NormalizeMatrix(this->m_OriginalMatrixP);
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP );
   this->m_MatrixQ = this->m_MatrixP;
   if( this->m_OriginalMatrixR.size() > 0 )
     {
@@ -5059,12 +5193,12 @@ bool antsSCCANObject<TInputImage, TRealType>
       {
       VectorType temp = this->m_MatrixP * this->m_VariatesP.get_column( k-1 );
       this->SparsifyOther( temp );
-      if ( k < (this->m_MatrixP.columns()-1) ) this->m_MatrixP = this->OrthogonalizeMatrix( this->m_MatrixP, temp );
+      if ( k < (this->m_MatrixP.columns()-1) ) this->OrthogonalizeMatrixInPlace( this->m_MatrixP, temp );
       temp = this->m_MatrixQ * this->m_VariatesQ.get_column( k-1 );
       this->SparsifyOther( temp );
-      if ( n_vecs < this->m_MatrixQ.columns() ) this->m_MatrixQ = this->OrthogonalizeMatrix( this->m_MatrixQ, temp );
-      this->m_MatrixP = this->NormalizeMatrix( this->m_MatrixP, false );
-      this->m_MatrixQ = this->NormalizeMatrix( this->m_MatrixQ, false );
+      if ( n_vecs < this->m_MatrixQ.columns() ) this->OrthogonalizeMatrixInPlace( this->m_MatrixQ, temp );
+      this->NormalizeMatrixInPlace( this->m_MatrixP, false );
+      this->NormalizeMatrixInPlace( this->m_MatrixQ, false );
       }
     VectorType ptemp = this->m_VariatesP.get_column(k);
     VectorType qtemp = this->m_VariatesQ.get_column(k);
@@ -5273,10 +5407,10 @@ TRealType antsSCCANObject<TInputImage, TRealType>
       {
       VectorType temp = this->m_MatrixP * this->m_VariatesP.get_column( kk-1 );
       this->SparsifyOther( temp );
-      if ( n_vecs < this->m_MatrixP.columns() ) this->m_MatrixP = this->OrthogonalizeMatrix( this->m_MatrixP, temp );
+      if ( n_vecs < this->m_MatrixP.columns() ) this->OrthogonalizeMatrixInPlace( this->m_MatrixP, temp );
       temp = this->m_MatrixQ * this->m_VariatesQ.get_column( kk-1 );
       this->SparsifyOther( temp );
-      if ( n_vecs < this->m_MatrixQ.columns() ) this->m_MatrixQ = this->OrthogonalizeMatrix( this->m_MatrixQ, temp );
+      if ( n_vecs < this->m_MatrixQ.columns() ) this->OrthogonalizeMatrixInPlace( this->m_MatrixQ, temp );
       }
     VectorType qvec = ( this->m_MatrixP * ipvec );
     this->SparsifyOther( qvec );
@@ -5409,9 +5543,12 @@ TRealType antsSCCANObject<TInputImage, TRealType>
     if ( ! this->m_Silent )  std::cout << " arnoldi sparse partial cca : L1?" << this->m_UseL1 << " GradStep " << this->m_GradStep
 		   <<  "  p+ " << this->GetKeepPositiveP() << " q+ " << this->GetKeepPositiveQ() << " covering " << this->m_Covering << std::endl;
     }
-  this->m_MatrixP =  this->NormalizeMatrix( this->m_OriginalMatrixP, false );
-  this->m_MatrixQ =  this->NormalizeMatrix( this->m_OriginalMatrixQ, false );
-  this->m_MatrixR =  this->NormalizeMatrix( this->m_OriginalMatrixR, false );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP, false );
+  this->m_MatrixQ = this->m_OriginalMatrixQ;
+  this->NormalizeMatrixInPlace( this->m_MatrixQ, false );
+  this->m_MatrixR = this->m_OriginalMatrixR;
+  this->NormalizeMatrixInPlace( this->m_MatrixR, false );
 
   if( this->m_OriginalMatrixR.size() > 0 )
     {
@@ -5523,8 +5660,8 @@ TRealType antsSCCANObject<TInputImage, TRealType>
     {
     this->m_GradStepP = gradstepsp[ k ];
     this->m_GradStepQ = gradstepsq[ k ];
-    if ( k == 0 ) this->m_MatrixP =  this->NormalizeMatrix( this->m_OriginalMatrixP, false );
-    if ( k == 0 ) this->m_MatrixQ =  this->NormalizeMatrix( this->m_OriginalMatrixQ, false );
+    if ( k == 0 ) { this->m_MatrixP = this->m_OriginalMatrixP; this->NormalizeMatrixInPlace( this->m_MatrixP, false ); }
+    if ( k == 0 ) { this->m_MatrixQ = this->m_OriginalMatrixQ; this->NormalizeMatrixInPlace( this->m_MatrixQ, false ); }
     loop=0;
     this->m_GradStep = basegradstep;
     while( ( ( loop < innerloop ) ) ) // && ( energyincreases )  ) )
@@ -5656,9 +5793,12 @@ TRealType antsSCCANObject<TInputImage, TRealType>
   this->m_CanonicalCorrelations.fill(0);
   if ( ! this->m_Silent )  std::cout << " iht cca " << std::endl;
   if ( ! this->m_Silent )  std::cout << "  pos-p " << this->GetKeepPositiveP() << " pos-q " << this->GetKeepPositiveQ() << std::endl;
-  this->m_MatrixP = this->NormalizeMatrix( this->m_OriginalMatrixP, false );
-  this->m_MatrixQ = this->NormalizeMatrix( this->m_OriginalMatrixQ, false );
-  this->m_MatrixR = this->NormalizeMatrix( this->m_OriginalMatrixR, false );
+  this->m_MatrixP = this->m_OriginalMatrixP;
+  this->NormalizeMatrixInPlace( this->m_MatrixP, false );
+  this->m_MatrixQ = this->m_OriginalMatrixQ;
+  this->NormalizeMatrixInPlace( this->m_MatrixQ, false );
+  this->m_MatrixR = this->m_OriginalMatrixR;
+  this->NormalizeMatrixInPlace( this->m_MatrixR, false );
 
   if( this->m_OriginalMatrixR.size() > 0 )
     {
@@ -5770,7 +5910,8 @@ void antsSCCANObject<TInputImage, TRealType>
     }
   if( this->m_OriginalMatrixR.size() > 0 || nvecs > 0  )
     {
-    this->m_MatrixP = this->NormalizeMatrix(this->m_OriginalMatrixP);
+    this->m_MatrixP = this->m_OriginalMatrixP;
+    this->NormalizeMatrixInPlace( this->m_MatrixP );
     if( this->m_VariatesP.size() > 0 )
       {
       this->m_MatrixRp.set_size(this->m_MatrixP.rows(), this->m_OriginalMatrixR.cols() + nvecs);
@@ -5790,7 +5931,8 @@ void antsSCCANObject<TInputImage, TRealType>
       }
     else
       {
-      this->m_MatrixRp = this->NormalizeMatrix(this->m_OriginalMatrixR);
+      this->m_MatrixRp = this->m_OriginalMatrixR;
+      this->NormalizeMatrixInPlace( this->m_MatrixRp );
       }
     this->m_MatrixRp = ProjectionMatrix(this->m_MatrixRp);
     if( this->m_Debug && this->m_VariatesP.cols() > 1 )
@@ -5806,7 +5948,8 @@ void antsSCCANObject<TInputImage, TRealType>
                             (this->m_MatrixP * this->m_VariatesP).get_column(1) ) << std::endl;
       }
 
-    this->m_MatrixQ = this->NormalizeMatrix(this->m_OriginalMatrixQ);
+    this->m_MatrixQ = this->m_OriginalMatrixQ;
+    this->NormalizeMatrixInPlace( this->m_MatrixQ );
     if( this->m_VariatesQ.size() > 0 )
       {
       this->m_MatrixRq.set_size(this->m_MatrixQ.rows(), this->m_OriginalMatrixR.cols() + nvecs);
@@ -5826,14 +5969,17 @@ void antsSCCANObject<TInputImage, TRealType>
       }
     else
       {
-      this->m_MatrixRq = this->NormalizeMatrix(this->m_OriginalMatrixR);
+      this->m_MatrixRq = this->m_OriginalMatrixR;
+      this->NormalizeMatrixInPlace( this->m_MatrixRq );
       }
     this->m_MatrixRq = ProjectionMatrix(this->m_MatrixRq);
     }
   else
     {
-    this->m_MatrixP = this->NormalizeMatrix(this->m_OriginalMatrixP);
-    this->m_MatrixQ = this->NormalizeMatrix(this->m_OriginalMatrixQ);
+    this->m_MatrixP = this->m_OriginalMatrixP;
+    this->NormalizeMatrixInPlace( this->m_MatrixP );
+    this->m_MatrixQ = this->m_OriginalMatrixQ;
+    this->NormalizeMatrixInPlace( this->m_MatrixQ );
     //     this->m_MatrixP=this->WhitenMatrix(this->m_MatrixP);
     //     this->m_MatrixQ=this->WhitenMatrix(this->m_MatrixQ);
     }
@@ -6193,21 +6339,22 @@ TRealType antsSCCANObject<TInputImage, TRealType>
       {
       if ( ! this->m_Silent )  std::cout << " norm P " << std::endl;
       }
-    this->m_MatrixP = this->NormalizeMatrix(this->m_MatrixP);
+    this->NormalizeMatrixInPlace( this->m_MatrixP );
     if( this->m_Debug )
       {
       if ( ! this->m_Silent )  std::cout << " norm Q " << std::endl;
       }
-    this->m_MatrixQ = this->NormalizeMatrix(this->m_MatrixQ);
+    this->NormalizeMatrixInPlace( this->m_MatrixQ );
     if( this->m_OriginalMatrixR.size() > 0 )
       {
-      this->m_MatrixR = this->NormalizeMatrix(this->m_OriginalMatrixR);
-      this->m_MatrixR = this->WhitenMatrix(this->m_MatrixR);
+      this->m_MatrixR = this->m_OriginalMatrixR;
+      this->NormalizeMatrixInPlace( this->m_MatrixR );
+      this->WhitenMatrixInPlace( this->m_MatrixR );
       this->m_MatrixRRt = this->m_MatrixR * this->m_MatrixR.transpose();
       this->UpdatePandQbyR();
       }
-    this->m_MatrixP = this->WhitenMatrix(this->m_MatrixP);
-    this->m_MatrixQ = this->WhitenMatrix(this->m_MatrixQ);
+    this->WhitenMatrixInPlace( this->m_MatrixP );
+    this->WhitenMatrixInPlace( this->m_MatrixQ );
     this->m_AlreadyWhitened = true;
     }
   for( unsigned int outer_it = 0; outer_it < 2; outer_it++ )
@@ -6258,12 +6405,12 @@ antsSCCANObject<TInputImage, TRealType>
   this->m_WeightsR = this->InitializeV(this->m_MatrixR);
   if( !this->m_AlreadyWhitened )
     {
-    this->m_MatrixP = this->NormalizeMatrix(this->m_MatrixP);
-    this->m_MatrixP = this->WhitenMatrix(this->m_MatrixP);
-    this->m_MatrixQ = this->NormalizeMatrix(this->m_MatrixQ);
-    this->m_MatrixQ = this->WhitenMatrix(this->m_MatrixQ);
-    this->m_MatrixR = this->NormalizeMatrix(this->m_MatrixR);
-    this->m_MatrixR = this->WhitenMatrix(this->m_MatrixR);
+    this->NormalizeMatrixInPlace( this->m_MatrixP );
+    this->WhitenMatrixInPlace( this->m_MatrixP );
+    this->NormalizeMatrixInPlace( this->m_MatrixQ );
+    this->WhitenMatrixInPlace( this->m_MatrixQ );
+    this->NormalizeMatrixInPlace( this->m_MatrixR );
+    this->WhitenMatrixInPlace( this->m_MatrixR );
     this->m_AlreadyWhitened = true;
     }
   RealType      truecorr = 0;
@@ -6545,8 +6692,9 @@ antsSCCANObject<TInputImage, TRealType>
           pp.set_column(colcount,this->m_MatrixP*this->m_VariatesP.get_column(kk));
       colcount++;
         }
-        temp=this->NormalizeMatrix(pp);
-        temp=this->WhitenMatrix(temp);
+        temp = pp;
+        this->NormalizeMatrixInPlace( temp );
+        this->WhitenMatrixInPlace( temp );
         temp=temp*temp.transpose();
         this->m_MatrixP=(this->m_MatrixP-temp*this->m_MatrixP);
 
@@ -6559,8 +6707,9 @@ antsSCCANObject<TInputImage, TRealType>
           qq.set_column(colcount,this->m_MatrixQ*this->m_VariatesQ.get_column(kk));
       colcount++;
         }
-        temp=this->NormalizeMatrix(qq);
-        temp=this->WhitenMatrix(temp);
+        temp = qq;
+        this->NormalizeMatrixInPlace( temp );
+        this->WhitenMatrixInPlace( temp );
         temp=temp*temp.transpose();
         this->m_MatrixQ=(this->m_MatrixQ-temp*this->m_MatrixQ);
       }
@@ -6616,16 +6765,16 @@ antsSCCANObject<TInputImage, TRealType>
 //      if ( its == 0 && which_e_vec > 0  ) {
 //        this->WhitenDataSetForRunSCCANMultiple();
         q_evecs_factor=this->m_MatrixQ*this->m_VariatesQ.get_n_columns(0,which_e_vec);
-        q_evecs_factor=this->NormalizeMatrix( q_evecs_factor );
-        q_evecs_factor=this->WhitenMatrix(q_evecs_factor);
+        this->NormalizeMatrixInPlace( q_evecs_factor );
+        this->WhitenMatrixInPlace( q_evecs_factor );
         q_evecs_factor=q_evecs_factor*q_evecs_factor.transpose();
  //       MatrixType temp=this->m_MatrixP-q_evecs_factor*this->m_MatrixP;
  //       temp=this->InverseCovarianceMatrix(temp,&this->m_MatrixP);
  //       this->m_MatrixP=temp;
 
         p_evecs_factor=this->m_MatrixP*this->m_VariatesP.get_n_columns(0,which_e_vec);
-        p_evecs_factor=this->NormalizeMatrix( p_evecs_factor );
-        p_evecs_factor=this->WhitenMatrix(p_evecs_factor);
+        this->NormalizeMatrixInPlace( p_evecs_factor );
+        this->WhitenMatrixInPlace( p_evecs_factor );
         p_evecs_factor=p_evecs_factor*p_evecs_factor.transpose();
 //        temp=this->m_MatrixQ-p_evecs_factor*this->m_MatrixQ;
 //        temp=this->InverseCovarianceMatrix(temp,&this->m_MatrixQ);
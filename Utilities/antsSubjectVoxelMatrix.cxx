@@ -0,0 +1,248 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#include "antsSubjectVoxelMatrix.h"
+#include "itksys/SystemTools.hxx"
+
+#include <cstring>
+#include <fstream>
+
+#if !defined( _WIN32 )
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define ANTS_SUBJECT_VOXEL_MATRIX_USE_MMAP
+#endif
+
+namespace itk
+{
+namespace ants
+{
+namespace
+{
+const char     SubjectVoxelMatrixMagic[8] = { 'A', 'N', 'T', 'S', 'S', 'V', 'M', '\0' };
+const uint32_t SubjectVoxelMatrixVersion = 1;
+const uint64_t SubjectVoxelMatrixAlignment = 4096;
+
+uint64_t AlignSubjectVoxelMatrixPosition( uint64_t position )
+{
+  return ( ( position + SubjectVoxelMatrixAlignment - 1 ) / SubjectVoxelMatrixAlignment )
+         * SubjectVoxelMatrixAlignment;
+}
+}
+
+SubjectVoxelMatrix
+::SubjectVoxelMatrix() :
+  m_Mapping( ITK_NULLPTR ),
+  m_MappingLength( 0 ),
+  m_Writable( false ),
+  m_VoxelOffsets( ITK_NULLPTR ),
+  m_Data( ITK_NULLPTR )
+{
+  std::memset( &this->m_Header, 0, sizeof( HeaderType ) );
+}
+
+SubjectVoxelMatrix
+::~SubjectVoxelMatrix()
+{
+  this->Close();
+}
+
+bool
+SubjectVoxelMatrix
+::IsSubjectVoxelMatrixFileName( const std::string & filename )
+{
+  const std::string ext = itksys::SystemTools::GetFilenameLastExtension( filename );
+  return ext == ".antsmat";
+}
+
+bool
+SubjectVoxelMatrix
+::MapFile( const std::string & filename, bool forWriting, uint64_t length )
+{
+#if defined( ANTS_SUBJECT_VOXEL_MATRIX_USE_MMAP )
+  int fd = open( filename.c_str(), forWriting ? ( O_RDWR | O_CREAT | O_TRUNC ) : O_RDONLY, 0644 );
+  if( fd < 0 )
+    {
+    return false;
+    }
+  if( forWriting )
+    {
+    if( ftruncate( fd, static_cast<off_t>( length ) ) != 0 )
+      {
+      close( fd );
+      return false;
+      }
+    }
+  else
+    {
+    struct stat st;
+    if( fstat( fd, &st ) != 0 )
+      {
+      close( fd );
+      return false;
+      }
+    length = static_cast<uint64_t>( st.st_size );
+    }
+  if( length < sizeof( HeaderType ) )
+    {
+    close( fd );
+    return false;
+    }
+  /** readers get a private copy-on-write mapping so that a vnl_matrix_ref on
+   *  the data can be handed to code that modifies its input */
+  void *mapping = mmap( ITK_NULLPTR, static_cast<size_t>( length ), PROT_READ | PROT_WRITE,
+                        forWriting ? MAP_SHARED : MAP_PRIVATE, fd, 0 );
+  close( fd );
+  if( mapping == MAP_FAILED )
+    {
+    return false;
+    }
+  this->m_Mapping = static_cast<char *>( mapping );
+#else
+  if( forWriting )
+    {
+    this->m_Buffer.assign( static_cast<size_t>( length ), 0 );
+    }
+  else
+    {
+    std::ifstream in( filename.c_str(), std::ios::in | std::ios::binary );
+    if( !in.is_open() )
+      {
+      return false;
+      }
+    in.seekg( 0, std::ios::end );
+    length = static_cast<uint64_t>( in.tellg() );
+    if( length < sizeof( HeaderType ) )
+      {
+      return false;
+      }
+    in.seekg( 0, std::ios::beg );
+    this->m_Buffer.resize( static_cast<size_t>( length ) );
+    in.read( &this->m_Buffer[0], static_cast<std::streamsize>( length ) );
+    }
+  this->m_Mapping = &this->m_Buffer[0];
+#endif
+  this->m_MappingLength = length;
+  this->m_Writable = forWriting;
+  this->m_FileName = filename;
+  return true;
+}
+
+bool
+SubjectVoxelMatrix
+::Open( const std::string & filename )
+{
+  this->Close();
+  if( !this->MapFile( filename, false, 0 ) )
+    {
+    itkWarningMacro( "Could not map " << filename );
+    return false;
+    }
+  std::memcpy( &this->m_Header, this->m_Mapping, sizeof( HeaderType ) );
+
+  const uint64_t dataLength = this->m_Header.NumberOfSubjects * this->m_Header.NumberOfVoxels * sizeof( ValueType );
+  if( std::memcmp( this->m_Header.Magic, SubjectVoxelMatrixMagic, sizeof( SubjectVoxelMatrixMagic ) ) != 0 ||
+      this->m_Header.Version != SubjectVoxelMatrixVersion ||
+      this->m_Header.DataPosition + dataLength > this->m_MappingLength ||
+      this->m_Header.VoxelOffsetsPosition + this->m_Header.NumberOfVoxels * sizeof( uint64_t ) >
+      this->m_Header.DataPosition )
+    {
+    itkWarningMacro( << filename << " is not a valid subject x voxel matrix file" );
+    this->Close();
+    return false;
+    }
+  this->m_VoxelOffsets = reinterpret_cast<uint64_t *>( this->m_Mapping + this->m_Header.VoxelOffsetsPosition );
+  this->m_Data = reinterpret_cast<ValueType *>( this->m_Mapping + this->m_Header.DataPosition );
+  return true;
+}
+
+bool
+SubjectVoxelMatrix
+::Create( const std::string & filename, const HeaderType & header, const std::vector<uint64_t> & voxelOffsets )
+{
+  this->Close();
+  if( voxelOffsets.size() != header.NumberOfVoxels )
+    {
+    itkWarningMacro( "Expected " << header.NumberOfVoxels << " voxel offsets but got " << voxelOffsets.size() );
+    return false;
+    }
+
+  this->m_Header = header;
+  std::memcpy( this->m_Header.Magic, SubjectVoxelMatrixMagic, sizeof( SubjectVoxelMatrixMagic ) );
+  this->m_Header.Version = SubjectVoxelMatrixVersion;
+  this->m_Header.VoxelOffsetsPosition = sizeof( HeaderType );
+  this->m_Header.DataPosition =
+    AlignSubjectVoxelMatrixPosition( this->m_Header.VoxelOffsetsPosition
+                                     + this->m_Header.NumberOfVoxels * sizeof( uint64_t ) );
+  const uint64_t length = this->m_Header.DataPosition
+    + this->m_Header.NumberOfSubjects * this->m_Header.NumberOfVoxels * sizeof( ValueType );
+
+  if( !this->MapFile( filename, true, length ) )
+    {
+    itkWarningMacro( "Could not create " << filename );
+    return false;
+    }
+  std::memcpy( this->m_Mapping, &this->m_Header, sizeof( HeaderType ) );
+  this->m_VoxelOffsets = reinterpret_cast<uint64_t *>( this->m_Mapping + this->m_Header.VoxelOffsetsPosition );
+  if( !voxelOffsets.empty() )
+    {
+    std::memcpy( this->m_VoxelOffsets, &voxelOffsets[0], voxelOffsets.size() * sizeof( uint64_t ) );
+    }
+  this->m_Data = reinterpret_cast<ValueType *>( this->m_Mapping + this->m_Header.DataPosition );
+  return true;
+}
+
+void
+SubjectVoxelMatrix
+::Close()
+{
+  if( this->m_Mapping == ITK_NULLPTR )
+    {
+    return;
+    }
+#if defined( ANTS_SUBJECT_VOXEL_MATRIX_USE_MMAP )
+  if( this->m_Writable )
+    {
+    msync( this->m_Mapping, static_cast<size_t>( this->m_MappingLength ), MS_SYNC );
+    }
+  munmap( this->m_Mapping, static_cast<size_t>( this->m_MappingLength ) );
+#else
+  if( this->m_Writable )
+    {
+    std::ofstream out( this->m_FileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc );
+    out.write( &this->m_Buffer[0], static_cast<std::streamsize>( this->m_MappingLength ) );
+    }
+  std::vector<char>().swap( this->m_Buffer );
+#endif
+  this->m_Mapping = ITK_NULLPTR;
+  this->m_MappingLength = 0;
+  this->m_VoxelOffsets = ITK_NULLPTR;
+  this->m_Data = ITK_NULLPTR;
+  this->m_Writable = false;
+}
+
+void
+SubjectVoxelMatrix
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "FileName: " << this->m_FileName << std::endl;
+  os << indent << "NumberOfSubjects: " << this->m_Header.NumberOfSubjects << std::endl;
+  os << indent << "NumberOfVoxels: " << this->m_Header.NumberOfVoxels << std::endl;
+  os << indent << "ImageDimension: " << this->m_Header.ImageDimension << std::endl;
+}
+} // namespace ants
+} // namespace itk
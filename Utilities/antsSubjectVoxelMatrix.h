@@ -0,0 +1,338 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __antsSubjectVoxelMatrix_h
+#define __antsSubjectVoxelMatrix_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkIntTypes.h"
+#include "itkImageFileReader.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkSimpleFastMutexLock.h"
+#include "antsParallelizeRange.h"
+#include <vnl/vnl_matrix.h>
+#include <vnl/vnl_matrix_ref.h>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+namespace ants
+{
+/** On-disk header of a subject x voxel matrix (.antsmat).
+ *
+ *  The file holds, in order: this header, the buffer offsets (uint64) of the
+ *  NumberOfVoxels mask voxels inside the mask image, and the float32 matrix
+ *  stored one subject per row.  The matrix block starts on a page boundary so
+ *  that it can be mapped straight into memory. */
+struct SubjectVoxelMatrixHeader
+{
+  char     Magic[8];
+  uint32_t Version;
+  uint32_t ImageDimension;
+  uint64_t NumberOfSubjects;
+  uint64_t NumberOfVoxels;
+  uint64_t Size[4];
+  double   Spacing[4];
+  double   Origin[4];
+  double   Direction[16];
+  uint64_t VoxelOffsetsPosition;
+  uint64_t DataPosition;
+};
+
+/** \class SubjectVoxelMatrix
+ * \brief Memory-mapped, binary subject x voxel matrix with the mask geometry in its header.
+ *
+ * Building the matrix from an image list reads the subjects in parallel and
+ * writes them straight into the mapped file.  Readers map the file instead of
+ * parsing CSV text or an .mha matrix image, and can wrap the mapping in a
+ * vnl_matrix_ref without copying.  The mapping is private to the process, so
+ * writes through the reference never reach the file.
+ */
+class SubjectVoxelMatrix : public Object
+{
+public:
+  typedef SubjectVoxelMatrix       Self;
+  typedef Object                   Superclass;
+  typedef SmartPointer<Self>       Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  itkNewMacro( Self );
+
+  itkTypeMacro( SubjectVoxelMatrix, Object );
+
+  typedef float                            ValueType;
+  typedef SubjectVoxelMatrixHeader         HeaderType;
+  typedef vnl_matrix_ref<ValueType>        MatrixReferenceType;
+
+  /** True when the file name carries the .antsmat extension. */
+  static bool IsSubjectVoxelMatrixFileName( const std::string & filename );
+
+  /** Map an existing file.  Returns false if it is missing or malformed. */
+  bool Open( const std::string & filename );
+
+  /** Create (or truncate) a file large enough for the given header and map it
+   *  for writing.  The voxel offsets must hold header.NumberOfVoxels entries. */
+  bool Create( const std::string & filename, const HeaderType & header,
+               const std::vector<uint64_t> & voxelOffsets );
+
+  /** Flush and unmap. */
+  void Close();
+
+  bool IsOpen() const
+  {
+    return this->m_Data != ITK_NULLPTR;
+  }
+
+  const HeaderType & GetHeader() const
+  {
+    return this->m_Header;
+  }
+
+  SizeValueType GetNumberOfSubjects() const
+  {
+    return static_cast<SizeValueType>( this->m_Header.NumberOfSubjects );
+  }
+
+  SizeValueType GetNumberOfVoxels() const
+  {
+    return static_cast<SizeValueType>( this->m_Header.NumberOfVoxels );
+  }
+
+  const uint64_t * GetVoxelOffsets() const
+  {
+    return this->m_VoxelOffsets;
+  }
+
+  const ValueType * GetSubjectRow( SizeValueType subject ) const
+  {
+    return this->m_Data + subject * this->m_Header.NumberOfVoxels;
+  }
+
+  ValueType * GetSubjectRow( SizeValueType subject )
+  {
+    return this->m_Data + subject * this->m_Header.NumberOfVoxels;
+  }
+
+  /** Subjects x voxels view of the mapped data (no copy). */
+  MatrixReferenceType GetMatrixReference()
+  {
+    return MatrixReferenceType( this->GetNumberOfSubjects(), this->GetNumberOfVoxels(), this->m_Data );
+  }
+
+  /** Convert into a caller-owned matrix of another precision. */
+  template <class TValue>
+  void CopyToMatrix( vnl_matrix<TValue> & matrix ) const
+  {
+    const SizeValueType rows = this->GetNumberOfSubjects();
+    const SizeValueType cols = this->GetNumberOfVoxels();
+    if( matrix.rows() != rows || matrix.cols() != cols )
+      {
+      matrix.set_size( rows, cols );
+      }
+    for( SizeValueType i = 0; i < rows; i++ )
+      {
+      const ValueType * row = this->GetSubjectRow( i );
+      TValue *          out = matrix[i];
+      for( SizeValueType j = 0; j < cols; j++ )
+        {
+        out[j] = static_cast<TValue>( row[j] );
+        }
+      }
+  }
+
+protected:
+  SubjectVoxelMatrix();
+  ~SubjectVoxelMatrix();
+
+  void PrintSelf( std::ostream & os, Indent indent ) const ITK_OVERRIDE;
+
+private:
+  SubjectVoxelMatrix( const Self & ); // purposely not implemented
+  void operator=( const Self & );     // purposely not implemented
+
+  bool MapFile( const std::string & filename, bool forWriting, uint64_t length );
+
+  HeaderType   m_Header;
+  std::string  m_FileName;
+  char *       m_Mapping;
+  uint64_t     m_MappingLength;
+  bool         m_Writable;
+  uint64_t *   m_VoxelOffsets;
+  ValueType *  m_Data;
+  /** used instead of a mapping on platforms without mmap */
+  std::vector<char> m_Buffer;
+};
+
+/** Fill the geometry part of a header from an image. */
+template <class TImage>
+void InitializeSubjectVoxelMatrixHeader( const TImage * image, SubjectVoxelMatrixHeader & header )
+{
+  const unsigned int dimension = TImage::ImageDimension;
+
+  for( unsigned int d = 0; d < 4; d++ )
+    {
+    header.Size[d] = 1;
+    header.Spacing[d] = 1;
+    header.Origin[d] = 0;
+    for( unsigned int e = 0; e < 4; e++ )
+      {
+      header.Direction[d * 4 + e] = ( d == e ) ? 1 : 0;
+      }
+    }
+  header.ImageDimension = dimension;
+  for( unsigned int d = 0; d < dimension && d < 4; d++ )
+    {
+    header.Size[d] = image->GetLargestPossibleRegion().GetSize()[d];
+    header.Spacing[d] = image->GetSpacing()[d];
+    header.Origin[d] = image->GetOrigin()[d];
+    for( unsigned int e = 0; e < dimension && e < 4; e++ )
+      {
+      header.Direction[d * 4 + e] = image->GetDirection()[d][e];
+      }
+    }
+}
+
+/** True if mask selects the voxels of matrix: the same image size and the
+ *  same buffer offsets (mask >= 0.5, in buffer order). */
+template <class TImage>
+bool SubjectVoxelMatrixMatchesMask( const SubjectVoxelMatrix * matrix, const TImage * mask )
+{
+  const SubjectVoxelMatrixHeader & header = matrix->GetHeader();
+
+  if( header.ImageDimension != TImage::ImageDimension )
+    {
+    return false;
+    }
+  for( unsigned int d = 0; d < TImage::ImageDimension && d < 4; d++ )
+    {
+    if( header.Size[d] != mask->GetLargestPossibleRegion().GetSize()[d] )
+      {
+      return false;
+      }
+    }
+
+  const uint64_t * offsets = matrix->GetVoxelOffsets();
+  SizeValueType    v = 0;
+  ImageRegionConstIteratorWithIndex<TImage> mIter( mask, mask->GetLargestPossibleRegion() );
+  for( mIter.GoToBegin(); !mIter.IsAtEnd(); ++mIter )
+    {
+    if( mIter.Get() >= 0.5 )
+      {
+      if( v >= matrix->GetNumberOfVoxels()
+          || offsets[v] != static_cast<uint64_t>( mask->ComputeOffset( mIter.GetIndex() ) ) )
+        {
+        return false;
+        }
+      v++;
+      }
+    }
+  return v == matrix->GetNumberOfVoxels();
+}
+
+/** Reads one subject image per row straight into the mapped matrix. */
+template <class TImage>
+class SubjectVoxelMatrixRowReader
+{
+public:
+  typedef typename TImage::IndexType IndexType;
+
+  SubjectVoxelMatrixRowReader( SubjectVoxelMatrix * matrix, const std::vector<std::string> & filenames,
+                               const std::vector<IndexType> & indices ) :
+    m_Matrix( matrix ), m_FileNames( filenames ), m_Indices( indices ), m_Failed( false )
+  {
+  }
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType )
+  {
+    typedef ImageFileReader<TImage> ReaderType;
+    for( SizeValueType subject = begin; subject < end; subject++ )
+      {
+      typename ReaderType::Pointer reader = ReaderType::New();
+      reader->SetFileName( this->m_FileNames[subject] );
+      try
+        {
+        reader->Update();
+        }
+      catch( ExceptionObject & e )
+        {
+        this->m_Mutex.Lock();
+        std::cerr << "Exception caught reading " << this->m_FileNames[subject] << std::endl << e << std::endl;
+        this->m_Failed = true;
+        this->m_Mutex.Unlock();
+        continue;
+        }
+      const TImage *              image = reader->GetOutput();
+      SubjectVoxelMatrix::ValueType * row = this->m_Matrix->GetSubjectRow( subject );
+      for( SizeValueType v = 0; v < this->m_Indices.size(); v++ )
+        {
+        row[v] = static_cast<SubjectVoxelMatrix::ValueType>( image->GetPixel( this->m_Indices[v] ) );
+        }
+      }
+  }
+
+  bool GetFailed() const
+  {
+    return this->m_Failed;
+  }
+
+private:
+  SubjectVoxelMatrix *             m_Matrix;
+  const std::vector<std::string> & m_FileNames;
+  const std::vector<IndexType> &   m_Indices;
+  bool                             m_Failed;
+  SimpleFastMutexLock              m_Mutex;
+};
+
+/** Build a .antsmat file from a list of subject images and a mask (voxels
+ *  with mask >= 0.5 are kept, in image buffer order).  Subjects are read in
+ *  parallel; numberOfThreads = 0 uses the ITK global default. */
+template <class TImage>
+bool ConvertImageListToSubjectVoxelMatrix( const std::vector<std::string> & filenames, const TImage * mask,
+                                           const std::string & outname, ThreadIdType numberOfThreads = 0 )
+{
+  typedef typename TImage::IndexType IndexType;
+
+  std::vector<IndexType> indices;
+  std::vector<uint64_t>  offsets;
+  ImageRegionConstIteratorWithIndex<TImage> mIter( mask, mask->GetLargestPossibleRegion() );
+  for( mIter.GoToBegin(); !mIter.IsAtEnd(); ++mIter )
+    {
+    if( mIter.Get() >= 0.5 )
+      {
+      indices.push_back( mIter.GetIndex() );
+      offsets.push_back( static_cast<uint64_t>( mask->ComputeOffset( mIter.GetIndex() ) ) );
+      }
+    }
+
+  SubjectVoxelMatrixHeader header;
+  InitializeSubjectVoxelMatrixHeader<TImage>( mask, header );
+  header.NumberOfSubjects = filenames.size();
+  header.NumberOfVoxels = indices.size();
+
+  SubjectVoxelMatrix::Pointer matrix = SubjectVoxelMatrix::New();
+  if( !matrix->Create( outname, header, offsets ) )
+    {
+    return false;
+    }
+  SubjectVoxelMatrixRowReader<TImage> rowReader( matrix, filenames, indices );
+  ::ants::ParallelizeRange( 0, filenames.size(), rowReader, numberOfThreads );
+  matrix->Close();
+  return !rowReader.GetFailed();
+}
+} // namespace ants
+} // namespace itk
+
+#endif
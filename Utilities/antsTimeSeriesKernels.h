@@ -0,0 +1,344 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __antsTimeSeriesKernels_h
+#define __antsTimeSeriesKernels_h
+
+#include "antsParallelizeRange.h"
+#include "vnl/vnl_math.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace ants
+{
+/**
+ * Threaded kernels for the ImageMath time series operations.
+ *
+ * A time series image keeps time on its slowest axis, so its buffer is a
+ * time-major matrix: buffer[ t * nvoxels + v ].  Rather than gathering one
+ * voxel's time course at a time with GetPixel, the kernels below stream
+ * whole volumes and keep per-voxel accumulators, each thread owning a block
+ * of voxels (or of time points), so every pass reads memory contiguously.
+ * The matrix form used by TimeSeriesRegionCorr is already voxel-major,
+ * rows[ v * ntimes + t ], and region means and correlations work on its rows.
+ *
+ * Each output element is summed by one thread in the same order as the
+ * serial loops they replace, so results do not depend on the thread count.
+ */
+
+template <class TPixel>
+class TimeSeriesMomentsFunctor
+{
+public:
+  const TPixel *        m_Buffer;
+  itk::SizeValueType    m_NumberOfVoxels;
+  itk::SizeValueType    m_NumberOfTimePoints;
+  std::vector<double> * m_Means;
+  std::vector<double> * m_StandardDeviations;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    std::vector<double> & means = *this->m_Means;
+    const double          ntimes = static_cast<double>( this->m_NumberOfTimePoints );
+
+    for( itk::SizeValueType v = begin; v < end; v++ )
+      {
+      means[v] = 0;
+      }
+    for( itk::SizeValueType t = 0; t < this->m_NumberOfTimePoints; t++ )
+      {
+      const TPixel *volume = this->m_Buffer + t * this->m_NumberOfVoxels;
+      for( itk::SizeValueType v = begin; v < end; v++ )
+        {
+        means[v] += volume[v];
+        }
+      }
+    for( itk::SizeValueType v = begin; v < end; v++ )
+      {
+      means[v] /= ntimes;
+      }
+    if( !this->m_StandardDeviations )
+      {
+      return;
+      }
+
+    std::vector<double> & deviations = *this->m_StandardDeviations;
+    for( itk::SizeValueType v = begin; v < end; v++ )
+      {
+      deviations[v] = 0;
+      }
+    for( itk::SizeValueType t = 0; t < this->m_NumberOfTimePoints; t++ )
+      {
+      const TPixel *volume = this->m_Buffer + t * this->m_NumberOfVoxels;
+      for( itk::SizeValueType v = begin; v < end; v++ )
+        {
+        const double d = volume[v] - means[v];
+        deviations[v] += d * d;
+        }
+      }
+    for( itk::SizeValueType v = begin; v < end; v++ )
+      {
+      deviations[v] = std::sqrt( deviations[v] / ntimes );
+      }
+  }
+};
+
+/** Mean and (if standardDeviations is not null) population standard
+ *  deviation over time of every voxel of a time-major buffer. */
+template <class TPixel>
+void ComputeTimeSeriesMoments( const TPixel * buffer, itk::SizeValueType numberOfVoxels,
+                               itk::SizeValueType numberOfTimePoints, std::vector<double> & means,
+                               std::vector<double> * standardDeviations = ITK_NULLPTR,
+                               itk::ThreadIdType numberOfThreads = 0 )
+{
+  means.resize( numberOfVoxels );
+  if( standardDeviations )
+    {
+    standardDeviations->resize( numberOfVoxels );
+    }
+  if( numberOfTimePoints == 0 )
+    {
+    return;
+    }
+
+  TimeSeriesMomentsFunctor<TPixel> functor;
+  functor.m_Buffer = buffer;
+  functor.m_NumberOfVoxels = numberOfVoxels;
+  functor.m_NumberOfTimePoints = numberOfTimePoints;
+  functor.m_Means = &means;
+  functor.m_StandardDeviations = standardDeviations;
+  ParallelizeRange( 0, numberOfVoxels, functor, numberOfThreads );
+}
+
+template <class TPixel>
+class TimeSeriesLeverageFunctor
+{
+public:
+  const TPixel *              m_Buffer;
+  itk::SizeValueType          m_NumberOfVoxels;
+  itk::SizeValueType          m_NumberOfTimePoints;
+  const std::vector<double> * m_Means;
+  std::vector<double> *       m_Leverage;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    const std::vector<double> & means = *this->m_Means;
+    const double                ntimes = static_cast<double>( this->m_NumberOfTimePoints );
+
+    for( itk::SizeValueType t = begin; t < end; t++ )
+      {
+      const TPixel *volume = this->m_Buffer + t * this->m_NumberOfVoxels;
+      double        leverage = 0;
+      for( itk::SizeValueType v = 0; v < this->m_NumberOfVoxels; v++ )
+        {
+        leverage += std::fabs( means[v] - volume[v] ) / ntimes;
+        }
+      ( *this->m_Leverage )[t] = leverage;
+      }
+  }
+};
+
+/** Leverage of every time point: the mean absolute difference of its volume
+ *  from the voxelwise temporal means, divided by the number of time points. */
+template <class TPixel>
+void ComputeTimeSeriesLeverage( const TPixel * buffer, itk::SizeValueType numberOfVoxels,
+                                itk::SizeValueType numberOfTimePoints, const std::vector<double> & means,
+                                std::vector<double> & leverage, itk::ThreadIdType numberOfThreads = 0 )
+{
+  leverage.assign( numberOfTimePoints, 0 );
+
+  TimeSeriesLeverageFunctor<TPixel> functor;
+  functor.m_Buffer = buffer;
+  functor.m_NumberOfVoxels = numberOfVoxels;
+  functor.m_NumberOfTimePoints = numberOfTimePoints;
+  functor.m_Means = &means;
+  functor.m_Leverage = &leverage;
+  ParallelizeRange( 0, numberOfTimePoints, functor, numberOfThreads );
+}
+
+template <class TPixel, class TLabel>
+class RegionTimeSeriesMeansFunctor
+{
+public:
+  const TPixel *               m_Rows;
+  const TLabel *               m_Labels;
+  itk::SizeValueType           m_NumberOfVoxels;
+  itk::SizeValueType           m_NumberOfTimePoints;
+  itk::SizeValueType           m_NumberOfLabels;
+  const std::vector<double> *  m_Counts;
+  std::vector<double> *        m_Means;
+
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    const itk::SizeValueType ntimes = this->m_NumberOfTimePoints;
+    std::vector<double> &    means = *this->m_Means;
+
+    for( itk::SizeValueType v = 0; v < this->m_NumberOfVoxels; v++ )
+      {
+      const TLabel label = this->m_Labels[v];
+      if( label < 1 || static_cast<itk::SizeValueType>( label ) > this->m_NumberOfLabels )
+        {
+        continue;
+        }
+      const TPixel *row = this->m_Rows + v * ntimes;
+      double *      mean = &means[( static_cast<itk::SizeValueType>( label ) - 1 ) * ntimes];
+      for( itk::SizeValueType t = begin; t < end; t++ )
+        {
+        mean[t] += row[t];
+        }
+      }
+    for( itk::SizeValueType l = 0; l < this->m_NumberOfLabels; l++ )
+      {
+      for( itk::SizeValueType t = begin; t < end; t++ )
+        {
+        means[l * ntimes + t] /= ( *this->m_Counts )[l];
+        }
+      }
+  }
+};
+
+/** Average time course of labels 1..numberOfLabels of a voxel-major matrix
+ *  (rows[ v * ntimes + t ], labels[ v ]) in a single pass over the voxels,
+ *  threaded over blocks of time points.  means[ ( l - 1 ) * ntimes + t ] and
+ *  counts[ l - 1 ] receive the mean and voxel count of label l. */
+template <class TPixel, class TLabel>
+void ComputeRegionTimeSeriesMeans( const TPixel * rows, const TLabel * labels, itk::SizeValueType numberOfVoxels,
+                                   itk::SizeValueType numberOfTimePoints, itk::SizeValueType numberOfLabels,
+                                   std::vector<double> & means, std::vector<double> & counts,
+                                   itk::ThreadIdType numberOfThreads = 0 )
+{
+  counts.assign( numberOfLabels, 0 );
+  for( itk::SizeValueType v = 0; v < numberOfVoxels; v++ )
+    {
+    if( labels[v] >= 1 && static_cast<itk::SizeValueType>( labels[v] ) <= numberOfLabels )
+      {
+      counts[static_cast<itk::SizeValueType>( labels[v] ) - 1]++;
+      }
+    }
+  means.assign( numberOfLabels * numberOfTimePoints, 0 );
+
+  RegionTimeSeriesMeansFunctor<TPixel, TLabel> functor;
+  functor.m_Rows = rows;
+  functor.m_Labels = labels;
+  functor.m_NumberOfVoxels = numberOfVoxels;
+  functor.m_NumberOfTimePoints = numberOfTimePoints;
+  functor.m_NumberOfLabels = numberOfLabels;
+  functor.m_Counts = &counts;
+  functor.m_Means = &means;
+  ParallelizeRange( 0, numberOfTimePoints, functor, numberOfThreads );
+}
+
+class RowCorrelationFunctor
+{
+public:
+  const double *                      m_Rows;
+  itk::SizeValueType                  m_NumberOfRows;
+  itk::SizeValueType                  m_NumberOfColumns;
+  const std::vector<unsigned char> *  m_UseRow;
+  std::vector<double> *               m_Correlations;
+
+  /** Pairs row q with row n - 1 - q, so every chunk of the range gets about
+   *  the same share of the upper triangle. */
+  void operator()( itk::SizeValueType begin, itk::SizeValueType end, itk::ThreadIdType )
+  {
+    for( itk::SizeValueType q = begin; q < end; q++ )
+      {
+      this->CorrelateRow( q );
+      if( this->m_NumberOfRows - 1 - q != q )
+        {
+        this->CorrelateRow( this->m_NumberOfRows - 1 - q );
+        }
+      }
+  }
+
+  void CorrelateRow( itk::SizeValueType i )
+  {
+    if( !( *this->m_UseRow )[i] )
+      {
+      return;
+      }
+    const itk::SizeValueType n = this->m_NumberOfRows;
+    const double *           x = this->m_Rows + i * this->m_NumberOfColumns;
+    std::vector<double> &    correlations = *this->m_Correlations;
+    for( itk::SizeValueType j = i + 1; j < n; j++ )
+      {
+      if( !( *this->m_UseRow )[j] )
+        {
+        continue;
+        }
+      const double *y = this->m_Rows + j * this->m_NumberOfColumns;
+      double        corr = 0;
+      for( itk::SizeValueType t = 0; t < this->m_NumberOfColumns; t++ )
+        {
+        corr += x[t] * y[t];
+        }
+      if( !vnl_math_isfinite( corr ) )
+        {
+        corr = 0;
+        }
+      correlations[i * n + j] = corr;
+      correlations[j * n + i] = corr;
+      }
+  }
+};
+
+/** Pearson correlation of every pair of used rows of the row-major
+ *  nrows x ncols matrix rows, computed as the product of the matrix with
+ *  its transpose after centring each used row and scaling it to unit norm
+ *  (rows is modified in place).  Rows without variance correlate 0 with
+ *  everything.  Only the off-diagonal entries between used rows of the
+ *  nrows x nrows correlations are written; the caller initializes the rest. */
+inline void ComputeRowCorrelations( std::vector<double> & rows, itk::SizeValueType numberOfRows,
+                                    itk::SizeValueType numberOfColumns, const std::vector<unsigned char> & useRow,
+                                    std::vector<double> & correlations, itk::ThreadIdType numberOfThreads = 0 )
+{
+  correlations.resize( numberOfRows * numberOfRows );
+  for( itk::SizeValueType i = 0; i < numberOfRows; i++ )
+    {
+    if( !useRow[i] )
+      {
+      continue;
+      }
+    double *row = &rows[i * numberOfColumns];
+    double  mean = 0;
+    for( itk::SizeValueType t = 0; t < numberOfColumns; t++ )
+      {
+      mean += row[t];
+      }
+    mean /= static_cast<double>( numberOfColumns );
+    double sumOfSquares = 0;
+    for( itk::SizeValueType t = 0; t < numberOfColumns; t++ )
+      {
+      row[t] -= mean;
+      sumOfSquares += row[t] * row[t];
+      }
+    const double scale = ( sumOfSquares > 0 ) ? 1.0 / std::sqrt( sumOfSquares ) : 0.0;
+    for( itk::SizeValueType t = 0; t < numberOfColumns; t++ )
+      {
+      row[t] *= scale;
+      }
+    }
+
+  RowCorrelationFunctor functor;
+  functor.m_Rows = rows.empty() ? ITK_NULLPTR : &rows[0];
+  functor.m_NumberOfRows = numberOfRows;
+  functor.m_NumberOfColumns = numberOfColumns;
+  functor.m_UseRow = &useRow;
+  functor.m_Correlations = &correlations;
+  ParallelizeRange( 0, ( numberOfRows + 1 ) / 2, functor, numberOfThreads );
+}
+} // namespace ants
+
+#endif
@@ -18,6 +18,8 @@
 
 #include "itkVector.h"
 
+#include <vector>
+
 namespace itk
 {
 /** \class DiReCTImageFilter
@@ -240,6 +242,25 @@ public:
   itkGetConstMacro( UseBSplineSmoothing, bool  );
   itkBooleanMacro( UseBSplineSmoothing );
 
+  /**
+   * Set/Get the option to restrict the computation to the bounding region of
+   * the gray and white matters, padded by BoundingRegionPadding voxels.  All
+   * fields and intermediate images (and hence the warping, gradient and
+   * composition work) are then only as large as that region instead of the
+   * full field of view.  Voxels outside the region get a thickness of zero.
+   * Default = false.
+   */
+  itkSetMacro( RestrictToBoundingRegion, bool  );
+  itkGetConstMacro( RestrictToBoundingRegion, bool  );
+  itkBooleanMacro( RestrictToBoundingRegion );
+
+  /**
+   * Set/Get the padding (in voxels) around the gray and white matters used
+   * when restricting to the bounding region.  Default = 10.
+   */
+  itkSetMacro( BoundingRegionPadding, unsigned int  );
+  itkGetConstMacro( BoundingRegionPadding, unsigned int );
+
   /**
    * Get the number of elapsed iterations.  This is a helper function for
    * reporting observations.
@@ -283,6 +304,25 @@ private:
    */
   InputImagePointer ExtractRegionalContours( const InputImageType *, LabelType );
 
+  /**
+   * Private function for finding the padded bounding region of the gray and
+   * white matters.
+   */
+  RegionType ComputeBoundingRegion( const InputImageType * ) const;
+
+  /**
+   * Private function for cropping an image to a region (keeping its index).
+   */
+  template <class TImage>
+  typename TImage::Pointer CropImage( const TImage *, const RegionType & );
+
+  /**
+   * Private function for putting a cropped image back into the full field of
+   * view.  Voxels outside the cropped region are taken from the reference
+   * image or set to zero.
+   */
+  RealImagePointer UncropImage( const RealImageType *, const RealImageType *, bool );
+
   /**
    * Private function for making thickness image.
    */
@@ -293,6 +333,13 @@ private:
    */
   RealImagePointer WarpImage( const RealImageType *, const DisplacementFieldType * );
 
+  /**
+   * Private function for warping several images with one evaluation of the
+   * displacement field per voxel.
+   */
+  std::vector<RealImagePointer> WarpImages( const std::vector<const RealImageType *> &,
+                                            const DisplacementFieldType * );
+
   /**
    * Private function for inverting the deformation field.
    */
@@ -336,6 +383,8 @@ private:
 
   bool m_UseBSplineSmoothing;
 
+  bool         m_RestrictToBoundingRegion;
+  unsigned int m_BoundingRegionPadding;
 };
 } // end namespace itk
 
@@ -25,8 +25,10 @@
 #include "itkComposeDisplacementFieldsImageFilter.h"
 #include "itkDiscreteGaussianImageFilter.h"
 #include "itkDisplacementFieldToBSplineImageFilter.h"
+#include "itkExtractImageFilter.h"
 #include "itkGaussianOperator.h"
 #include "itkGradientRecursiveGaussianImageFilter.h"
+#include "itkImageAlgorithm.h"
 #include "itkVectorMagnitudeImageFilter.h"
 #include "itkImageDuplicator.h"
 #include "itkImageRegionIterator.h"
@@ -34,6 +36,7 @@
 #include "itkImportImageFilter.h"
 #include "itkInvertDisplacementFieldImageFilter.h"
 #include "itkIterationReporter.h"
+#include "itkLinearInterpolateImageFunction.h"
 #include "itkMaximumImageFilter.h"
 #include "itkMultiplyByConstantImageFilter.h"
 #include "itkStatisticsImageFilter.h"
@@ -43,9 +46,387 @@
 #include "itkWindowConvergenceMonitoringFunction.h"
 
 #include "ReadWriteData.h"
+#include "antsParallelizeRange.h"
 
 namespace itk
 {
+namespace DiReCTFunctor
+{
+/**
+ * The per-voxel loops of DiReCTImageFilter, written as functors over ranges
+ * of buffer offsets for ::ants::ParallelizeRange.  The images and fields
+ * involved all share one buffered region, so a buffer offset addresses the
+ * same voxel in each of them.  Each functor only writes the voxels of its
+ * own range; reductions are kept per thread.
+ */
+
+/** Warps several scalar images that share the grid of the displacement field
+ *  with a single field lookup and index transform per voxel.  Per image this
+ *  does exactly what WarpImageFilter does with its default linear
+ *  interpolator and an edge padding value of zero. */
+template <class TFilter>
+class FusedWarpFunctor
+{
+public:
+  typedef typename TFilter::RealImageType                 RealImageType;
+  typedef typename TFilter::RealType                      RealType;
+  typedef typename TFilter::DisplacementFieldType         DisplacementFieldType;
+  typedef typename TFilter::VectorType                    VectorType;
+  typedef typename DisplacementFieldType::IndexType       IndexType;
+  typedef typename DisplacementFieldType::PointType       PointType;
+  typedef LinearInterpolateImageFunction<RealImageType, double> InterpolatorType;
+  typedef typename InterpolatorType::Pointer              InterpolatorPointer;
+  typedef typename InterpolatorType::ContinuousIndexType  ContinuousIndexType;
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType )
+  {
+    const VectorType *    field = this->m_DisplacementField->GetBufferPointer();
+    const RealImageType * reference = this->m_Interpolators[0]->GetInputImage();
+    const unsigned int    numberOfImages = this->m_Interpolators.size();
+
+    for( SizeValueType i = begin; i < end; i++ )
+      {
+      const IndexType index = this->m_DisplacementField->ComputeIndex( static_cast<OffsetValueType>( i ) );
+
+      PointType point;
+      reference->TransformIndexToPhysicalPoint( index, point );
+      const VectorType & displacement = field[i];
+      for( unsigned int j = 0; j < TFilter::ImageDimension; j++ )
+        {
+        point[j] += displacement[j];
+        }
+      ContinuousIndexType cindex;
+      reference->TransformPhysicalPointToContinuousIndex( point, cindex );
+      for( unsigned int n = 0; n < numberOfImages; n++ )
+        {
+        if( this->m_Interpolators[n]->IsInsideBuffer( cindex ) )
+          {
+          this->m_Outputs[n][i] = static_cast<RealType>( this->m_Interpolators[n]->EvaluateAtContinuousIndex( cindex ) );
+          }
+        else
+          {
+          this->m_Outputs[n][i] = 0;
+          }
+        }
+      }
+  }
+
+  const DisplacementFieldType *    m_DisplacementField;
+  std::vector<InterpolatorPointer> m_Interpolators;
+  std::vector<RealType *>          m_Outputs;
+};
+
+/** Normalizes the gradient and computes the speed image and the per-voxel
+ *  energy terms in the gray matter. */
+template <class TFilter>
+class SpeedFunctor
+{
+public:
+  typedef typename TFilter::InputPixelType InputPixelType;
+  typedef typename TFilter::RealType       RealType;
+  typedef typename TFilter::VectorType     VectorType;
+
+  SpeedFunctor( ThreadIdType numberOfThreads ) :
+    m_NumberOfGrayMatterVoxels( numberOfThreads, 0 )
+  {
+  }
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType threadId )
+  {
+    const VectorType zeroVector( 0.0 );
+    SizeValueType    count = 0;
+
+    for( SizeValueType i = begin; i < end; i++ )
+      {
+      if( this->m_Segmentation[i] == this->m_GrayMatterPixel )
+        {
+        RealType norm = ( this->m_Gradient[i] ).GetNorm();
+        if( norm > 1e-3 && !vnl_math_isnan( norm ) && !vnl_math_isinf( norm ) )
+          {
+          this->m_Gradient[i] = this->m_Gradient[i] / norm;
+          }
+        else
+          {
+          this->m_Gradient[i] = zeroVector;
+          }
+        RealType delta = ( this->m_WarpedWhiteMatterProbability[i] - this->m_GrayMatterProbability[i] );
+        this->m_Energy[i] = vnl_math_abs( delta );
+        count++;
+        RealType speedValue = -1.0 * delta * this->m_GrayMatterProbability[i] * this->m_GradientStep;
+        if( vnl_math_isnan( speedValue ) || vnl_math_isinf( speedValue ) )
+          {
+          speedValue = 0.0;
+          }
+        this->m_Speed[i] = speedValue;
+        }
+      else
+        {
+        this->m_Speed[i] = 0.0;
+        this->m_Energy[i] = 0.0;
+        }
+      }
+    this->m_NumberOfGrayMatterVoxels[threadId] += count;
+  }
+
+  RealType GetNumberOfGrayMatterVoxels() const
+  {
+    SizeValueType count = 0;
+    for( unsigned int n = 0; n < this->m_NumberOfGrayMatterVoxels.size(); n++ )
+      {
+      count += this->m_NumberOfGrayMatterVoxels[n];
+      }
+    return static_cast<RealType>( count );
+  }
+
+  const InputPixelType * m_Segmentation;
+  const RealType *       m_GrayMatterProbability;
+  const RealType *       m_WarpedWhiteMatterProbability;
+  VectorType *           m_Gradient;
+  RealType *             m_Speed;
+  RealType *             m_Energy;
+  InputPixelType         m_GrayMatterPixel;
+  RealType               m_GradientStep;
+
+private:
+  std::vector<SizeValueType> m_NumberOfGrayMatterVoxels;
+};
+
+/** Accumulates the forward incremental field and the hit, total and
+ *  thickness images. */
+template <class TFilter>
+class ObjectiveFunctor
+{
+public:
+  typedef typename TFilter::InputPixelType InputPixelType;
+  typedef typename TFilter::RealType       RealType;
+  typedef typename TFilter::VectorType     VectorType;
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType )
+  {
+    for( SizeValueType i = begin; i < end; i++ )
+      {
+      const InputPixelType segmentationValue = this->m_Segmentation[i];
+
+      this->m_ForwardIncrementalField[i] = this->m_ForwardIncrementalField[i]
+        + this->m_Gradient[i] * this->m_Speed[i];
+      if( segmentationValue == this->m_GrayMatterPixel || segmentationValue == this->m_WhiteMatterPixel )
+        {
+        if( this->m_IsFirstIntegrationPoint )
+          {
+          InputPixelType whiteMatterContoursValue = static_cast<InputPixelType>( this->m_WhiteMatterContours[i] );
+          this->m_Hit[i] = whiteMatterContoursValue;
+
+          VectorType vector = this->m_IntegratedField[i];
+          RealType   weightedNorm = vector.GetNorm() * whiteMatterContoursValue;
+
+          this->m_Thickness[i] = weightedNorm;
+          this->m_Total[i] = weightedNorm;
+          }
+        else if( segmentationValue == this->m_GrayMatterPixel )
+          {
+          this->m_Hit[i] = this->m_Hit[i] + this->m_WarpedWhiteMatterContours[i];
+          this->m_Total[i] = this->m_Total[i] + this->m_WarpedThickness[i];
+          }
+        }
+      }
+  }
+
+  const InputPixelType * m_Segmentation;
+  VectorType *           m_ForwardIncrementalField;
+  const VectorType *     m_Gradient;
+  const RealType *       m_Speed;
+  const RealType *       m_WhiteMatterContours;
+  const VectorType *     m_IntegratedField;
+  RealType *             m_Hit;
+  RealType *             m_Thickness;
+  RealType *             m_Total;
+  const RealType *       m_WarpedWhiteMatterContours;
+  const RealType *       m_WarpedThickness;
+  InputPixelType         m_GrayMatterPixel;
+  InputPixelType         m_WhiteMatterPixel;
+  bool                   m_IsFirstIntegrationPoint;
+};
+
+/** Zeroes the fields outside the gray matter and the contours and copies the
+ *  velocity into the inverse incremental field. */
+template <class TFilter>
+class RestrictFieldsFunctor
+{
+public:
+  typedef typename TFilter::InputPixelType InputPixelType;
+  typedef typename TFilter::LabelType      LabelType;
+  typedef typename TFilter::RealType       RealType;
+  typedef typename TFilter::VectorType     VectorType;
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType )
+  {
+    const VectorType zeroVector( 0.0 );
+
+    for( SizeValueType i = begin; i < end; i++ )
+      {
+      InputPixelType segmentationValue = this->m_Segmentation[i];
+      InputPixelType whiteMatterContoursValue = static_cast<InputPixelType>( this->m_WhiteMatterContours[i] );
+      InputPixelType matterContoursValue = this->m_MatterContours[i];
+
+      if( segmentationValue == 0 ||
+        ( whiteMatterContoursValue == 0 && matterContoursValue == 0 && segmentationValue != this->m_GrayMatterLabel ) )
+        {
+        this->m_InverseField[i] = zeroVector;
+        this->m_VelocityField[i] = zeroVector;
+        this->m_IntegratedField[i] = zeroVector;
+        }
+
+      this->m_InverseIncrementalField[i] = this->m_VelocityField[i];
+      }
+  }
+
+  const InputPixelType * m_Segmentation;
+  const InputPixelType * m_MatterContours;
+  const RealType *       m_WhiteMatterContours;
+  VectorType *           m_VelocityField;
+  VectorType *           m_InverseIncrementalField;
+  VectorType *           m_InverseField;
+  VectorType *           m_IntegratedField;
+  LabelType              m_GrayMatterLabel;
+};
+
+/** Adds the forward incremental field to the velocity field, estimates the
+ *  thickness and applies the thickness prior. */
+template <class TFilter>
+class VelocityUpdateFunctor
+{
+public:
+  typedef typename TFilter::InputImageType InputImageType;
+  typedef typename TFilter::InputPixelType InputPixelType;
+  typedef typename TFilter::RealImageType  RealImageType;
+  typedef typename TFilter::RealType       RealType;
+  typedef typename TFilter::VectorType     VectorType;
+
+  VelocityUpdateFunctor( ThreadIdType numberOfThreads ) :
+    m_PriorEnergy( numberOfThreads, 0 ),
+    m_PriorEnergyCount( numberOfThreads, 0 )
+  {
+  }
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType threadId )
+  {
+    const InputPixelType * segmentation = this->m_SegmentationImage->GetBufferPointer();
+    RealType               priorEnergy = 0;
+    unsigned long          priorEnergyCount = 0;
+
+    for( SizeValueType i = begin; i < end; i++ )
+      {
+      this->m_VelocityField[i] = this->m_VelocityField[i] + this->m_ForwardIncrementalField[i];
+      if( segmentation[i] == this->m_GrayMatterPixel )
+        {
+        RealType thicknessValue = 0.0;
+        if( this->m_SmoothHit[i] > 0.001 )
+          {
+          thicknessValue = this->m_SmoothTotal[i] / this->m_SmoothHit[i];
+          if( thicknessValue < 0.0 )
+            {
+            thicknessValue = 0.0;
+            }
+          if( ! this->m_ThicknessPriorImage && ( thicknessValue > this->m_ThicknessPriorEstimate ) )
+            {
+            RealType fraction = this->m_ThicknessPriorEstimate / thicknessValue;
+            this->m_VelocityField[i] = this->m_VelocityField[i] * vnl_math_sqr( fraction );
+            }
+          else if( this->m_ThicknessPriorImage )
+            {
+            typename RealImageType::IndexType index =
+              this->m_SegmentationImage->ComputeIndex( static_cast<OffsetValueType>( i ) );
+            RealType thicknessPrior = this->m_ThicknessPriorImage->GetPixel( index );
+            if( ( thicknessPrior > NumericTraits<RealType>::ZeroValue() ) &&
+                ( thicknessValue > thicknessPrior ) )
+              {
+              priorEnergy += vnl_math_abs( thicknessPrior - thicknessValue );
+              priorEnergyCount++;
+
+              RealType fraction = thicknessPrior / thicknessValue;
+              this->m_VelocityField[i] = this->m_VelocityField[i] * vnl_math_sqr( fraction );
+              }
+            }
+          }
+        this->m_CorticalThickness[i] = thicknessValue;
+        }
+      }
+    this->m_PriorEnergy[threadId] += priorEnergy;
+    this->m_PriorEnergyCount[threadId] += priorEnergyCount;
+  }
+
+  RealType GetPriorEnergy() const
+  {
+    RealType priorEnergy = 0;
+    for( unsigned int n = 0; n < this->m_PriorEnergy.size(); n++ )
+      {
+      priorEnergy += this->m_PriorEnergy[n];
+      }
+    return priorEnergy;
+  }
+
+  unsigned long GetPriorEnergyCount() const
+  {
+    unsigned long priorEnergyCount = 0;
+    for( unsigned int n = 0; n < this->m_PriorEnergyCount.size(); n++ )
+      {
+      priorEnergyCount += this->m_PriorEnergyCount[n];
+      }
+    return priorEnergyCount;
+  }
+
+  const InputImageType * m_SegmentationImage;
+  const RealImageType *  m_ThicknessPriorImage;
+  VectorType *           m_VelocityField;
+  const VectorType *     m_ForwardIncrementalField;
+  const RealType *       m_SmoothHit;
+  const RealType *       m_SmoothTotal;
+  RealType *             m_CorticalThickness;
+  InputPixelType         m_GrayMatterPixel;
+  RealType               m_ThicknessPriorEstimate;
+
+private:
+  std::vector<RealType>      m_PriorEnergy;
+  std::vector<unsigned long> m_PriorEnergyCount;
+};
+
+/** Estimates the thickness from the (smoothed) hit and total images. */
+template <class TFilter>
+class ThicknessFunctor
+{
+public:
+  typedef typename TFilter::InputPixelType InputPixelType;
+  typedef typename TFilter::RealType       RealType;
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType )
+  {
+    for( SizeValueType i = begin; i < end; i++ )
+      {
+      if( this->m_Segmentation[i] == this->m_GrayMatterPixel )
+        {
+        RealType thicknessValue = 0.0;
+        if( this->m_SmoothHit[i] > 0.001 )
+          {
+          thicknessValue = this->m_SmoothTotal[i] / this->m_SmoothHit[i];
+          if( thicknessValue < 0.0 )
+            {
+            thicknessValue = 0.0;
+            }
+          }
+        this->m_CorticalThickness[i] = thicknessValue;
+        }
+      }
+  }
+
+  const InputPixelType * m_Segmentation;
+  const RealType *       m_SmoothHit;
+  const RealType *       m_SmoothTotal;
+  RealType *             m_CorticalThickness;
+  InputPixelType         m_GrayMatterPixel;
+};
+
+} // end namespace DiReCTFunctor
+
 template <class TInputImage, class TOutputImage>
 DiReCTImageFilter<TInputImage, TOutputImage>
 ::DiReCTImageFilter() :
@@ -63,7 +444,9 @@ DiReCTImageFilter<TInputImage, TOutputImage>
   m_CurrentEnergy( NumericTraits<RealType>::max() ),
   m_ConvergenceThreshold( 0.001 ),
   m_ConvergenceWindowSize( 10 ),
-  m_UseBSplineSmoothing( false )
+  m_UseBSplineSmoothing( false ),
+  m_RestrictToBoundingRegion( false ),
+  m_BoundingRegionPadding( 10 )
 {
   this->m_ThicknessPriorImage = ITK_NULLPTR;
   this->SetNumberOfRequiredInputs( 3 );
@@ -141,6 +524,26 @@ DiReCTImageFilter<TInputImage, TOutputImage>
   whiteMatterProbabilityImage->Update();
   whiteMatterProbabilityImage->DisconnectPipeline();
 
+  // Optionally crop everything to the padded bounding region of the gray and
+  // white matters.  The crops keep their index so that lookups in the full
+  // size thickness prior image remain valid.
+
+  const RegionType fullRegion = segmentationImage->GetBufferedRegion();
+  RealImagePointer fullWhiteMatterProbabilityImage = whiteMatterProbabilityImage;
+  if( this->m_RestrictToBoundingRegion )
+    {
+    const RegionType boundingRegion = this->ComputeBoundingRegion( segmentationImage );
+    if( boundingRegion != fullRegion )
+      {
+      itkDebugMacro( "Restricting to the bounding region " << boundingRegion );
+      segmentationImage = this->template CropImage<InputImageType>( segmentationImage, boundingRegion );
+      grayMatterProbabilityImage =
+        this->template CropImage<RealImageType>( grayMatterProbabilityImage, boundingRegion );
+      whiteMatterProbabilityImage =
+        this->template CropImage<RealImageType>( whiteMatterProbabilityImage, boundingRegion );
+      }
+    }
+
   // Extract the gray and white matter segmentations and combine to form the
   // gm/wm region.  Dilate the latter region by 1 voxel.
 
@@ -223,41 +626,14 @@ DiReCTImageFilter<TInputImage, TOutputImage>
   velocityField->Allocate();
   velocityField->FillBuffer( zeroVector );
 
-  // Instantiate most of the iterators all in one place
-
-  ImageRegionIterator<RealImageType> ItCorticalThicknessImage(
-    corticalThicknessImage,
-    corticalThicknessImage->GetRequestedRegion() );
-  ImageRegionConstIterator<RealImageType> ItGrayMatterProbabilityMap(
-    grayMatterProbabilityImage,
-    grayMatterProbabilityImage->GetRequestedRegion() );
-  ImageRegionIterator<RealImageType> ItHitImage(
-    hitImage,
-    hitImage->GetRequestedRegion() );
-  ImageRegionIterator<DisplacementFieldType> ItForwardIncrementalField(
-    forwardIncrementalField,
-    forwardIncrementalField->GetRequestedRegion() );
-  ImageRegionConstIterator<InputImageType> ItMatterContours(
-    matterContours,
-    matterContours->GetRequestedRegion() );
-  ImageRegionIterator<DisplacementFieldType> ItInverseIncrementalField(
-    inverseIncrementalField,
-    inverseIncrementalField->GetRequestedRegion() );
-  ImageRegionConstIteratorWithIndex<InputImageType> ItSegmentationImage(
-    segmentationImage,
-    segmentationImage->GetRequestedRegion() );
-  ImageRegionIterator<RealImageType> ItSpeedImage(
-    speedImage,
-    speedImage->GetRequestedRegion() );
-  ImageRegionIterator<RealImageType> ItThicknessImage(
-    thicknessImage,
-    thicknessImage->GetRequestedRegion() );
-  ImageRegionIterator<RealImageType> ItTotalImage(
-    totalImage,
-    totalImage->GetRequestedRegion() );
-  ImageRegionConstIterator<RealImageType> ItWhiteMatterContours(
-    whiteMatterContours,
-    whiteMatterContours->GetRequestedRegion() );
+  // All of the images and fields above, and the ones produced during the
+  // integration, share the buffered region of the segmentation image so the
+  // voxel loops below work directly on the buffers, split over threads.
+
+  const SizeValueType numberOfVoxels = segmentationImage->GetBufferedRegion().GetNumberOfPixels();
+  const ThreadIdType  numberOfThreads = ::ants::GetNumberOfThreadsForRange( numberOfVoxels,
+                                                                            this->GetNumberOfThreads() );
+  std::vector<RealType> energyBuffer( numberOfVoxels );
 
   // Monitor the convergence
   typedef Function::WindowConvergenceMonitoringFunction<double> ConvergenceMonitoringType;
@@ -288,10 +664,6 @@ DiReCTImageFilter<TInputImage, TOutputImage>
     hitImage->FillBuffer( 0.0 );
     totalImage->FillBuffer( 0.0 );
 
-    ImageRegionIterator<DisplacementFieldType> ItVelocityField(
-      velocityField,
-      velocityField->GetRequestedRegion() );
-
     unsigned int integrationPoint = 0;
     while( integrationPoint++ < this->m_NumberOfIntegrationPoints )
       {
@@ -304,9 +676,19 @@ DiReCTImageFilter<TInputImage, TOutputImage>
       inverseField->Update();
       inverseField->DisconnectPipeline();
 
-      RealImagePointer warpedWhiteMatterProbabilityImage = this->WarpImage( whiteMatterProbabilityImage, inverseField );
-      RealImagePointer warpedWhiteMatterContours = this->WarpImage( whiteMatterContours, inverseField );
-      RealImagePointer warpedThicknessImage = this->WarpImage( thicknessImage, inverseField );
+      // Warp the three images with a single evaluation of the inverse field
+      // per voxel.
+
+      std::vector<const RealImageType *> imagesToWarp;
+      imagesToWarp.push_back( whiteMatterProbabilityImage );
+      imagesToWarp.push_back( whiteMatterContours );
+      imagesToWarp.push_back( thicknessImage );
+
+      std::vector<RealImagePointer> warpedImages = this->WarpImages( imagesToWarp, inverseField );
+
+      RealImagePointer warpedWhiteMatterProbabilityImage = warpedImages[0];
+      RealImagePointer warpedWhiteMatterContours = warpedImages[1];
+      RealImagePointer warpedThicknessImage = warpedImages[2];
 
       typedef GradientRecursiveGaussianImageFilter<RealImageType, DisplacementFieldType>
         GradientImageFilterType;
@@ -318,153 +700,59 @@ DiReCTImageFilter<TInputImage, TOutputImage>
 
       DisplacementFieldPointer gradientImage = gradientFilter->GetOutput();
 
-      // Instantiate the iterators all in one place
-
-      ImageRegionIterator<DisplacementFieldType> ItGradientImage(
-        gradientImage,
-        gradientImage->GetRequestedRegion() );
-      ImageRegionIterator<RealImageType> ItWarpedWhiteMatterProbabilityMap(
-        warpedWhiteMatterProbabilityImage,
-        warpedWhiteMatterProbabilityImage->GetRequestedRegion() );
-      ImageRegionIterator<RealImageType> ItWarpedWhiteMatterContours(
-        warpedWhiteMatterContours,
-        warpedWhiteMatterContours->GetRequestedRegion() );
-      ImageRegionIterator<DisplacementFieldType> ItInverseField(
-        inverseField,
-        inverseField->GetRequestedRegion() );
-      ImageRegionIterator<DisplacementFieldType> ItIntegratedField(
-        integratedField,
-        integratedField->GetRequestedRegion() );
-
-      // Generate speed image
-
-      speedImage->FillBuffer( 0.0 );
-
-      ItGradientImage.GoToBegin();
-      ItGrayMatterProbabilityMap.GoToBegin();
-      ItSegmentationImage.GoToBegin();
-      ItSpeedImage.GoToBegin();
-      ItWarpedWhiteMatterProbabilityMap.GoToBegin();
-
-      const typename InputImageType::PixelType grayMatterPixel =
-        static_cast<typename InputImageType::PixelType>( this->m_GrayMatterLabel ),
-      whiteMatterPixel =
-        static_cast<typename InputImageType::PixelType>( this->m_WhiteMatterLabel );
-      while( !ItSegmentationImage.IsAtEnd() )
+      // Generate speed image.  The energy terms are stored per voxel and summed
+      // in raster order afterwards so that the energy, and hence the
+      // convergence, does not depend on the number of threads.
+
+      typedef DiReCTFunctor::SpeedFunctor<Self> SpeedFunctorType;
+      SpeedFunctorType speedFunctor( numberOfThreads );
+      speedFunctor.m_Segmentation = segmentationImage->GetBufferPointer();
+      speedFunctor.m_GrayMatterProbability = grayMatterProbabilityImage->GetBufferPointer();
+      speedFunctor.m_WarpedWhiteMatterProbability = warpedWhiteMatterProbabilityImage->GetBufferPointer();
+      speedFunctor.m_Gradient = gradientImage->GetBufferPointer();
+      speedFunctor.m_Speed = speedImage->GetBufferPointer();
+      speedFunctor.m_Energy = &energyBuffer[0];
+      speedFunctor.m_GrayMatterPixel = static_cast<InputPixelType>( this->m_GrayMatterLabel );
+      speedFunctor.m_GradientStep = this->m_CurrentGradientStep;
+      ::ants::ParallelizeRange( 0, numberOfVoxels, speedFunctor, numberOfThreads );
+
+      for( SizeValueType i = 0; i < numberOfVoxels; i++ )
         {
-        if( ItSegmentationImage.Get() == grayMatterPixel )
-          {
-          RealType norm = ( ItGradientImage.Get() ).GetNorm();
-          if( norm > 1e-3 && !vnl_math_isnan( norm ) && !vnl_math_isinf( norm ) )
-            {
-            ItGradientImage.Set( ItGradientImage.Get() / norm );
-            }
-          else
-            {
-            ItGradientImage.Set( zeroVector );
-            }
-          RealType delta = ( ItWarpedWhiteMatterProbabilityMap.Get() - ItGrayMatterProbabilityMap.Get() );
-          currentEnergy += vnl_math_abs( delta );
-          numberOfGrayMatterVoxels++;
-          RealType speedValue = -1.0 * delta * ItGrayMatterProbabilityMap.Get() * this->m_CurrentGradientStep;
-          if( vnl_math_isnan( speedValue ) || vnl_math_isinf( speedValue ) )
-            {
-            speedValue = 0.0;
-            }
-          ItSpeedImage.Set( speedValue );
-          }
-        else
-          {
-          ItSpeedImage.Set( 0.0 );
-          }
-
-        ++ItGradientImage;
-        ++ItGrayMatterProbabilityMap;
-        ++ItSegmentationImage;
-        ++ItSpeedImage;
-        ++ItWarpedWhiteMatterProbabilityMap;
+        currentEnergy += energyBuffer[i];
         }
+      numberOfGrayMatterVoxels += speedFunctor.GetNumberOfGrayMatterVoxels();
 
       // Calculate objective function value
 
-      ItForwardIncrementalField.GoToBegin();
-      ItGradientImage.GoToBegin();
-      ItSegmentationImage.GoToBegin();
-      ItSpeedImage.GoToBegin();
-      ItWhiteMatterContours.GoToBegin();
-
-      while( !ItSegmentationImage.IsAtEnd() )
-        {
-        typename InputImageType::IndexType index =
-          ItSegmentationImage.GetIndex();
-        typename InputImageType::PixelType segmentationValue =
-          ItSegmentationImage.Get();
-
-        ItForwardIncrementalField.Set( ItForwardIncrementalField.Get()
-                                       + ItGradientImage.Get() * ItSpeedImage.Get() );
-        if( segmentationValue == grayMatterPixel || segmentationValue == whiteMatterPixel )
-          {
-          if( integrationPoint == 1 )
-            {
-            typename InputImageType::PixelType whiteMatterContoursValue =
-              static_cast<typename InputImageType::PixelType>( ItWhiteMatterContours.Get() );
-            hitImage->SetPixel( index, whiteMatterContoursValue );
-
-            VectorType vector = integratedField->GetPixel( index );
-            RealType   weightedNorm = vector.GetNorm() * whiteMatterContoursValue;
-
-            thicknessImage->SetPixel( index, weightedNorm );
-            totalImage->SetPixel( index, weightedNorm );
-            }
-          else if( segmentationValue == grayMatterPixel )
-            {
-            hitImage->SetPixel( index, hitImage->GetPixel( index )
-                                + warpedWhiteMatterContours->GetPixel( index ) );
-            totalImage->SetPixel( index, totalImage->GetPixel( index )
-                                  + warpedThicknessImage->GetPixel( index ) );
-            }
-          }
-
-        ++ItForwardIncrementalField;
-        ++ItGradientImage;
-        ++ItSegmentationImage;
-        ++ItSpeedImage;
-        ++ItWhiteMatterContours;
-        }
-
-      ItSegmentationImage.GoToBegin();
-      ItMatterContours.GoToBegin();
-      ItWhiteMatterContours.GoToBegin();
-      ItVelocityField.GoToBegin();
-      ItInverseIncrementalField.GoToBegin();
-      ItIntegratedField.GoToBegin();
-      ItInverseField.GoToBegin();
-      while( !ItSegmentationImage.IsAtEnd() )
-        {
-        typename InputImageType::PixelType segmentationValue =
-          ItSegmentationImage.Get();
-        typename InputImageType::PixelType whiteMatterContoursValue =
-          static_cast<typename InputImageType::PixelType>( ItWhiteMatterContours.Get() );
-        typename InputImageType::PixelType matterContoursValue = ItMatterContours.Get();
-
-        if( segmentationValue == 0 ||
-          ( whiteMatterContoursValue == 0 && matterContoursValue == 0 && segmentationValue != this->m_GrayMatterLabel ) )
-          {
-          ItInverseField.Set( zeroVector );
-          ItVelocityField.Set( zeroVector );
-          ItIntegratedField.Set( zeroVector );
-          }
-
-        ItInverseIncrementalField.Set( ItVelocityField.Get() );
-
-        ++ItSegmentationImage;
-        ++ItMatterContours;
-        ++ItWhiteMatterContours;
-        ++ItVelocityField;
-        ++ItInverseIncrementalField;
-        ++ItInverseField;
-        ++ItIntegratedField;
-        }
+      typedef DiReCTFunctor::ObjectiveFunctor<Self> ObjectiveFunctorType;
+      ObjectiveFunctorType objectiveFunctor;
+      objectiveFunctor.m_Segmentation = segmentationImage->GetBufferPointer();
+      objectiveFunctor.m_ForwardIncrementalField = forwardIncrementalField->GetBufferPointer();
+      objectiveFunctor.m_Gradient = gradientImage->GetBufferPointer();
+      objectiveFunctor.m_Speed = speedImage->GetBufferPointer();
+      objectiveFunctor.m_WhiteMatterContours = whiteMatterContours->GetBufferPointer();
+      objectiveFunctor.m_IntegratedField = integratedField->GetBufferPointer();
+      objectiveFunctor.m_Hit = hitImage->GetBufferPointer();
+      objectiveFunctor.m_Thickness = thicknessImage->GetBufferPointer();
+      objectiveFunctor.m_Total = totalImage->GetBufferPointer();
+      objectiveFunctor.m_WarpedWhiteMatterContours = warpedWhiteMatterContours->GetBufferPointer();
+      objectiveFunctor.m_WarpedThickness = warpedThicknessImage->GetBufferPointer();
+      objectiveFunctor.m_GrayMatterPixel = static_cast<InputPixelType>( this->m_GrayMatterLabel );
+      objectiveFunctor.m_WhiteMatterPixel = static_cast<InputPixelType>( this->m_WhiteMatterLabel );
+      objectiveFunctor.m_IsFirstIntegrationPoint = ( integrationPoint == 1 );
+      ::ants::ParallelizeRange( 0, numberOfVoxels, objectiveFunctor, numberOfThreads );
+
+      typedef DiReCTFunctor::RestrictFieldsFunctor<Self> RestrictFieldsFunctorType;
+      RestrictFieldsFunctorType restrictFieldsFunctor;
+      restrictFieldsFunctor.m_Segmentation = segmentationImage->GetBufferPointer();
+      restrictFieldsFunctor.m_MatterContours = matterContours->GetBufferPointer();
+      restrictFieldsFunctor.m_WhiteMatterContours = whiteMatterContours->GetBufferPointer();
+      restrictFieldsFunctor.m_VelocityField = velocityField->GetBufferPointer();
+      restrictFieldsFunctor.m_InverseIncrementalField = inverseIncrementalField->GetBufferPointer();
+      restrictFieldsFunctor.m_InverseField = inverseField->GetBufferPointer();
+      restrictFieldsFunctor.m_IntegratedField = integratedField->GetBufferPointer();
+      restrictFieldsFunctor.m_GrayMatterLabel = this->m_GrayMatterLabel;
+      ::ants::ParallelizeRange( 0, numberOfVoxels, restrictFieldsFunctor, numberOfThreads );
 
       if( integrationPoint == 1 )
         {
@@ -543,63 +831,21 @@ DiReCTImageFilter<TInputImage, TOutputImage>
       smoothTotalImage = totalImage;
       }
 
-    ImageRegionConstIterator<RealImageType> ItSmoothHitImage( smoothHitImage,
-      smoothHitImage->GetRequestedRegion() );
-    ImageRegionConstIterator<RealImageType> ItSmoothTotalImage( smoothTotalImage,
-      smoothTotalImage->GetRequestedRegion() );
-
-    ItCorticalThicknessImage.GoToBegin();
-    ItForwardIncrementalField.GoToBegin();
-    ItSegmentationImage.GoToBegin();
-    ItSmoothHitImage.GoToBegin();
-    ItSmoothTotalImage.GoToBegin();
-    ItVelocityField.GoToBegin();
-
-    while( !ItSegmentationImage.IsAtEnd() )
-      {
-      ItVelocityField.Set( ItVelocityField.Get() + ItForwardIncrementalField.Get() );
-      const typename InputImageType::PixelType grayMatterPixel =
-        static_cast<typename InputImageType::PixelType>( this->m_GrayMatterLabel );
-      if(  ItSegmentationImage.Get() == grayMatterPixel )
-        {
-        RealType thicknessValue = 0.0;
-        if( ItSmoothHitImage.Get() > 0.001 )
-          {
-          thicknessValue = ItSmoothTotalImage.Get() / ItSmoothHitImage.Get();
-          if( thicknessValue < 0.0 )
-            {
-            thicknessValue = 0.0;
-            }
-          if( ! this->m_ThicknessPriorImage && ( thicknessValue > this->m_ThicknessPriorEstimate ) )
-            {
-            RealType fraction = this->m_ThicknessPriorEstimate / thicknessValue;
-            ItVelocityField.Set( ItVelocityField.Get() * vnl_math_sqr( fraction ) );
-            }
-          else if( this->m_ThicknessPriorImage )
-            {
-            typename RealImageType::IndexType index = ItSegmentationImage.GetIndex();
-            RealType thicknessPrior = this->m_ThicknessPriorImage->GetPixel( index );
-            if( ( thicknessPrior > NumericTraits<RealType>::ZeroValue() ) &&
-                ( thicknessValue > thicknessPrior ) )
-              {
-              priorEnergy += vnl_math_abs( thicknessPrior - thicknessValue );
-              priorEnergyCount++;
-
-              RealType fraction = thicknessPrior / thicknessValue;
-              ItVelocityField.Set( ItVelocityField.Get() * vnl_math_sqr( fraction ) );
-              }
-            }
-          }
-        ItCorticalThicknessImage.Set( thicknessValue );
-        }
-
-      ++ItCorticalThicknessImage;
-      ++ItForwardIncrementalField;
-      ++ItSmoothHitImage;
-      ++ItSegmentationImage;
-      ++ItSmoothTotalImage;
-      ++ItVelocityField;
-      }
+    typedef DiReCTFunctor::VelocityUpdateFunctor<Self> VelocityUpdateFunctorType;
+    VelocityUpdateFunctorType velocityUpdateFunctor( numberOfThreads );
+    velocityUpdateFunctor.m_SegmentationImage = segmentationImage;
+    velocityUpdateFunctor.m_ThicknessPriorImage = this->m_ThicknessPriorImage;
+    velocityUpdateFunctor.m_VelocityField = velocityField->GetBufferPointer();
+    velocityUpdateFunctor.m_ForwardIncrementalField = forwardIncrementalField->GetBufferPointer();
+    velocityUpdateFunctor.m_SmoothHit = smoothHitImage->GetBufferPointer();
+    velocityUpdateFunctor.m_SmoothTotal = smoothTotalImage->GetBufferPointer();
+    velocityUpdateFunctor.m_CorticalThickness = corticalThicknessImage->GetBufferPointer();
+    velocityUpdateFunctor.m_GrayMatterPixel = static_cast<InputPixelType>( this->m_GrayMatterLabel );
+    velocityUpdateFunctor.m_ThicknessPriorEstimate = this->m_ThicknessPriorEstimate;
+    ::ants::ParallelizeRange( 0, numberOfVoxels, velocityUpdateFunctor, numberOfThreads );
+
+    priorEnergy += velocityUpdateFunctor.GetPriorEnergy();
+    priorEnergyCount += velocityUpdateFunctor.GetPriorEnergyCount();
 
     if( this->m_UseBSplineSmoothing )
       {
@@ -635,7 +881,14 @@ DiReCTImageFilter<TInputImage, TOutputImage>
 
   // Replace the identity direction with the original direction in the outputs
 
-  RealImagePointer warpedWhiteMatterProbabilityImage = this->WarpImage( whiteMatterProbabilityImage, inverseField );
+  std::vector<const RealImageType *> imagesToWarp( 1, whiteMatterProbabilityImage.GetPointer() );
+  RealImagePointer warpedWhiteMatterProbabilityImage = this->WarpImages( imagesToWarp, inverseField )[0];
+  if( segmentationImage->GetBufferedRegion() != fullRegion )
+    {
+    corticalThicknessImage = this->UncropImage( corticalThicknessImage, fullWhiteMatterProbabilityImage, false );
+    warpedWhiteMatterProbabilityImage =
+      this->UncropImage( warpedWhiteMatterProbabilityImage, fullWhiteMatterProbabilityImage, true );
+    }
   warpedWhiteMatterProbabilityImage->SetDirection( this->GetSegmentationImage()->GetDirection() );
   corticalThicknessImage->SetDirection( this->GetSegmentationImage()->GetDirection() );
 
@@ -692,68 +945,188 @@ DiReCTImageFilter<TInputImage, TOutputImage>
 }
 
 
+template <class TInputImage, class TOutputImage>
+typename DiReCTImageFilter<TInputImage, TOutputImage>::RegionType
+DiReCTImageFilter<TInputImage, TOutputImage>
+::ComputeBoundingRegion( const InputImageType *segmentationImage ) const
+{
+  const RegionType fullRegion = segmentationImage->GetBufferedRegion();
+
+  IndexType minIndex;
+  IndexType maxIndex;
+  bool      isEmpty = true;
+
+  const InputPixelType grayMatterPixel = static_cast<InputPixelType>( this->m_GrayMatterLabel );
+  const InputPixelType whiteMatterPixel = static_cast<InputPixelType>( this->m_WhiteMatterLabel );
+
+  ImageRegionConstIteratorWithIndex<InputImageType> It( segmentationImage, fullRegion );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    if( It.Get() != grayMatterPixel && It.Get() != whiteMatterPixel )
+      {
+      continue;
+      }
+    const IndexType index = It.GetIndex();
+    if( isEmpty )
+      {
+      minIndex = index;
+      maxIndex = index;
+      isEmpty = false;
+      continue;
+      }
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      minIndex[d] = vnl_math_min( minIndex[d], index[d] );
+      maxIndex[d] = vnl_math_max( maxIndex[d], index[d] );
+      }
+    }
+  if( isEmpty )
+    {
+    return fullRegion;
+    }
+
+  const IndexValueType padding = static_cast<IndexValueType>( this->m_BoundingRegionPadding );
+
+  RegionType boundingRegion;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    const IndexValueType lower = fullRegion.GetIndex()[d];
+    const IndexValueType upper = lower + static_cast<IndexValueType>( fullRegion.GetSize()[d] ) - 1;
+    const IndexValueType first = vnl_math_max( minIndex[d] - padding, lower );
+    const IndexValueType last = vnl_math_min( maxIndex[d] + padding, upper );
+
+    boundingRegion.SetIndex( d, first );
+    boundingRegion.SetSize( d, static_cast<SizeValueType>( last - first + 1 ) );
+    }
+  return boundingRegion;
+}
+
+template <class TInputImage, class TOutputImage>
+template <class TImage>
+typename TImage::Pointer
+DiReCTImageFilter<TInputImage, TOutputImage>
+::CropImage( const TImage *inputImage, const RegionType & region )
+{
+  typedef ExtractImageFilter<TImage, TImage> ExtracterType;
+  typename ExtracterType::Pointer extracter = ExtracterType::New();
+  extracter->SetInput( inputImage );
+  extracter->SetExtractionRegion( region );
+  extracter->SetDirectionCollapseToSubmatrix();
+
+  typename TImage::Pointer croppedImage = extracter->GetOutput();
+  croppedImage->Update();
+  croppedImage->DisconnectPipeline();
+
+  return croppedImage;
+}
+
+template <class TInputImage, class TOutputImage>
+typename DiReCTImageFilter<TInputImage, TOutputImage>::RealImagePointer
+DiReCTImageFilter<TInputImage, TOutputImage>
+::UncropImage( const RealImageType *croppedImage, const RealImageType *referenceImage, bool copyReference )
+{
+  RealImagePointer outputImage = RealImageType::New();
+  outputImage->CopyInformation( referenceImage );
+  outputImage->SetRegions( referenceImage->GetBufferedRegion() );
+  outputImage->Allocate();
+  if( copyReference )
+    {
+    ImageAlgorithm::Copy( referenceImage, outputImage.GetPointer(), referenceImage->GetBufferedRegion(),
+                          referenceImage->GetBufferedRegion() );
+    }
+  else
+    {
+    outputImage->FillBuffer( 0.0 );
+    }
+  ImageAlgorithm::Copy( croppedImage, outputImage.GetPointer(), croppedImage->GetBufferedRegion(),
+                        croppedImage->GetBufferedRegion() );
+
+  return outputImage;
+}
+
 template <class TInputImage, class TOutputImage>
 void
 DiReCTImageFilter<TInputImage, TOutputImage>
 ::MakeThicknessImage( RealImagePointer hitImage, RealImagePointer totalImage,
   InputImagePointer segmentationImage, RealImagePointer corticalThicknessImage )
 {
-		RealImagePointer smoothHitImage;
-		RealImagePointer smoothTotalImage;
-		if( this->m_SmoothingVariance > 0.0 )
-				{
-				smoothHitImage = this->SmoothImage( hitImage, this->m_SmoothingVariance );
-				smoothTotalImage = this->SmoothImage( totalImage, this->m_SmoothingVariance );
-				}
-		else
-				{
-				smoothHitImage = hitImage;
-				smoothTotalImage = totalImage;
-				}
-
-  ImageRegionIterator<RealImageType> ItCorticalThicknessImage(
-    corticalThicknessImage,
-    corticalThicknessImage->GetRequestedRegion() );
-  ImageRegionConstIteratorWithIndex<InputImageType> ItSegmentationImage(
-    segmentationImage,
-    segmentationImage->GetRequestedRegion() );
-
-		ImageRegionConstIterator<RealImageType> ItSmoothHitImage( smoothHitImage,
-				smoothHitImage->GetRequestedRegion() );
-		ImageRegionConstIterator<RealImageType> ItSmoothTotalImage( smoothTotalImage,
-				smoothTotalImage->GetRequestedRegion() );
-
-		ItCorticalThicknessImage.GoToBegin();
-		ItSegmentationImage.GoToBegin();
-		ItSmoothHitImage.GoToBegin();
-		ItSmoothTotalImage.GoToBegin();
-
-		RealType meanThickness = 0;
-		unsigned long count = 0;
-		while( !ItSegmentationImage.IsAtEnd() )
-				{
-				const typename InputImageType::PixelType grayMatterPixel =
-						static_cast<typename InputImageType::PixelType>( this->m_GrayMatterLabel );
-				if(  ItSegmentationImage.Get() == grayMatterPixel )
-						{
-						RealType thicknessValue = 0.0;
-						if( ItSmoothHitImage.Get() > 0.001 )
-								{
-								thicknessValue = ItSmoothTotalImage.Get() / ItSmoothHitImage.Get();
-       	meanThickness += thicknessValue;
-	       count++;
-								if( thicknessValue < 0.0 )
-										{
-										thicknessValue = 0.0;
-										}
-								}
-						ItCorticalThicknessImage.Set( thicknessValue );
-						}
-				++ItCorticalThicknessImage;
-				++ItSmoothHitImage;
-				++ItSegmentationImage;
-				++ItSmoothTotalImage;
-				}
+  RealImagePointer smoothHitImage;
+  RealImagePointer smoothTotalImage;
+  if( this->m_SmoothingVariance > 0.0 )
+    {
+    smoothHitImage = this->SmoothImage( hitImage, this->m_SmoothingVariance );
+    smoothTotalImage = this->SmoothImage( totalImage, this->m_SmoothingVariance );
+    }
+  else
+    {
+    smoothHitImage = hitImage;
+    smoothTotalImage = totalImage;
+    }
+
+  typedef DiReCTFunctor::ThicknessFunctor<Self> ThicknessFunctorType;
+  ThicknessFunctorType thicknessFunctor;
+  thicknessFunctor.m_Segmentation = segmentationImage->GetBufferPointer();
+  thicknessFunctor.m_SmoothHit = smoothHitImage->GetBufferPointer();
+  thicknessFunctor.m_SmoothTotal = smoothTotalImage->GetBufferPointer();
+  thicknessFunctor.m_CorticalThickness = corticalThicknessImage->GetBufferPointer();
+  thicknessFunctor.m_GrayMatterPixel = static_cast<InputPixelType>( this->m_GrayMatterLabel );
+  ::ants::ParallelizeRange( 0, segmentationImage->GetBufferedRegion().GetNumberOfPixels(), thicknessFunctor,
+                            this->GetNumberOfThreads() );
+}
+
+template <class TInputImage, class TOutputImage>
+std::vector<typename DiReCTImageFilter<TInputImage, TOutputImage>::RealImagePointer>
+DiReCTImageFilter<TInputImage, TOutputImage>
+::WarpImages( const std::vector<const RealImageType *> & inputImages,
+              const DisplacementFieldType *displacementField )
+{
+  std::vector<RealImagePointer> warpedImages;
+
+  // The fused path needs the images to share the grid of the field; anything
+  // else goes through WarpImageFilter one image at a time.
+  bool sameInformation = true;
+  for( unsigned int n = 0; n < inputImages.size(); n++ )
+    {
+    const RealImageType *inputImage = inputImages[n];
+    if( inputImage->GetBufferedRegion() != displacementField->GetBufferedRegion() ||
+        inputImage->GetBufferedRegion() != displacementField->GetLargestPossibleRegion() ||
+        inputImage->GetSpacing() != displacementField->GetSpacing() ||
+        inputImage->GetOrigin() != displacementField->GetOrigin() ||
+        inputImage->GetDirection() != displacementField->GetDirection() )
+      {
+      sameInformation = false;
+      }
+    }
+  if( !sameInformation )
+    {
+    for( unsigned int n = 0; n < inputImages.size(); n++ )
+      {
+      warpedImages.push_back( this->WarpImage( inputImages[n], displacementField ) );
+      }
+    return warpedImages;
+    }
+
+  typedef DiReCTFunctor::FusedWarpFunctor<Self> FusedWarpFunctorType;
+  FusedWarpFunctorType warpFunctor;
+  warpFunctor.m_DisplacementField = displacementField;
+  for( unsigned int n = 0; n < inputImages.size(); n++ )
+    {
+    RealImagePointer warpedImage = RealImageType::New();
+    warpedImage->CopyInformation( inputImages[n] );
+    warpedImage->SetRegions( displacementField->GetLargestPossibleRegion() );
+    warpedImage->Allocate();
+    warpedImages.push_back( warpedImage );
+
+    typename FusedWarpFunctorType::InterpolatorPointer interpolator =
+      FusedWarpFunctorType::InterpolatorType::New();
+    interpolator->SetInputImage( inputImages[n] );
+    warpFunctor.m_Interpolators.push_back( interpolator );
+    warpFunctor.m_Outputs.push_back( warpedImage->GetBufferPointer() );
+    }
+  ::ants::ParallelizeRange( 0, displacementField->GetBufferedRegion().GetNumberOfPixels(), warpFunctor,
+                            this->GetNumberOfThreads() );
+
+  return warpedImages;
 }
 
 template <class TInputImage, class TOutputImage>
@@ -960,6 +1333,13 @@ DiReCTImageFilter<TInputImage, TOutputImage>
                    << this->m_ConvergenceThreshold << std::endl;
   os << indent << "Convergence window size = "
                    << this->m_ConvergenceWindowSize << std::endl;
+  os << indent << "Restrict to bounding region = "
+                   << this->m_RestrictToBoundingRegion << std::endl;
+  if( this->m_RestrictToBoundingRegion )
+    {
+    os << indent << "Bounding region padding = "
+                   << this->m_BoundingRegionPadding << std::endl;
+    }
 }
 } // end namespace itk
 
@@ -20,12 +20,27 @@
 
 #include "itksys/hash_map.hxx"
 
+#include <utility>
+#include <vector>
+
 namespace itk
 {
 /** \class LabelOverlapMeasuresImageFilter
  * \brief Computes overlap measures between the set same set of labels of
  * pixels of two images.  Background is assumed to be 0.
  *
+ * Integer labels that span a moderate range are counted in flat arrays
+ * indexed by label, one per thread; other labels fall back to a hash map.
+ *
+ * With ComputeSurfaceDistances on, the boundary voxels of every label are
+ * collected in the same threaded pass (a voxel is on the boundary if one of
+ * its face neighbors, or the image edge, carries another label) and the
+ * Hausdorff and mean surface distances between the source and target
+ * boundaries of every label are computed in physical units.  Each label
+ * needs a distance map only over the bounding box of its own boundaries, so
+ * the cost grows with the size of the labels rather than with the number of
+ * labels times the size of the image.
+ *
  * \sa LabelOverlapMeasuresImageFilter
  *
  * \ingroup MultiThreaded
@@ -75,6 +90,10 @@ public:
       m_Intersection = 0;
       m_SourceComplement = 0;
       m_TargetComplement = 0;
+      m_SourceBoundary = 0;
+      m_TargetBoundary = 0;
+      m_SurfaceDistanceSum = 0.0;
+      m_HausdorffDistance = 0.0;
     }
 
     // added for completeness
@@ -86,6 +105,11 @@ public:
       m_Intersection = l.m_Intersection;
       m_SourceComplement = l.m_SourceComplement;
       m_TargetComplement = l.m_TargetComplement;
+      m_SourceBoundary = l.m_SourceBoundary;
+      m_TargetBoundary = l.m_TargetBoundary;
+      m_SurfaceDistanceSum = l.m_SurfaceDistanceSum;
+      m_HausdorffDistance = l.m_HausdorffDistance;
+      return *this;
     }
 
     unsigned long m_Source;
@@ -94,6 +118,12 @@ public:
     unsigned long m_Intersection;
     unsigned long m_SourceComplement;
     unsigned long m_TargetComplement;
+    // filled in only when surface distances are computed; the distance sum
+    // runs over the boundary voxels of both images
+    unsigned long m_SourceBoundary;
+    unsigned long m_TargetBoundary;
+    double        m_SurfaceDistanceSum;
+    double        m_HausdorffDistance;
   };
 
   /** Type of the map used to store data per label */
@@ -105,6 +135,15 @@ public:
   itkStaticConstMacro( ImageDimension, unsigned int,
                        TLabelImage::ImageDimension );
 
+  /** Boundary voxels as (label, buffer offset) pairs */
+  typedef std::pair<LabelType, OffsetValueType> BoundaryVoxelType;
+  typedef std::vector<BoundaryVoxelType>        BoundaryVoxelListType;
+
+  /** Compute the Hausdorff and mean surface distances.  Default off. */
+  itkSetMacro( ComputeSurfaceDistances, bool );
+  itkGetConstMacro( ComputeSurfaceDistances, bool );
+  itkBooleanMacro( ComputeSurfaceDistances );
+
   /** Set the source image. */
   void SetSourceImage( const LabelImageType * image )
   {
@@ -158,6 +197,20 @@ public:
   RealType GetVolumeSimilarity( LabelType );
   RealType GetFalseNegativeError( LabelType );
   RealType GetFalsePositiveError( LabelType );
+
+  /** surface distances, in physical units.  A label present in only one of
+   * the images has an infinite distance, as do the measures over all labels
+   * then.  Over all labels, the Hausdorff distance is the largest one of the
+   * labels and the mean is taken over the boundary voxels of all labels.
+   * With no boundary voxels, i.e. no labels besides the background, both
+   * are 0, as for two identical surfaces. */
+  RealType GetHausdorffDistance();
+
+  RealType GetMeanSurfaceDistance();
+
+  RealType GetHausdorffDistance( LabelType );
+  RealType GetMeanSurfaceDistance( LabelType );
+
   /** alternative names */
   RealType GetJaccardCoefficient()
   {
@@ -216,9 +269,28 @@ private:
   LabelOverlapMeasuresImageFilter( const Self & ); // purposely not implemented
   void operator=( const Self & );                  // purposely not implemented
 
+  /** Collects the boundary voxels of the nonzero labels of image. */
+  void FindBoundaryVoxels( const LabelImageType *, const RegionType &, BoundaryVoxelListType & ) const;
+
+  void ComputeLabelSurfaceDistances();
+
+  /** Warns and returns false if the surface distances were not computed. */
+  bool CheckSurfaceDistances() const;
+
   std::vector<MapType> m_LabelSetMeasuresPerThread;
   MapType              m_LabelSetMeasures;
 
+  // flat per thread accumulators: source, target and intersection counts of
+  // label m_MinimumLabel + i at 3 * i, 3 * i + 1 and 3 * i + 2
+  bool                                     m_UseFlatAccumulators;
+  LabelType                                m_MinimumLabel;
+  SizeValueType                            m_NumberOfFlatLabels;
+  std::vector<std::vector<SizeValueType> > m_FlatCountsPerThread;
+
+  bool                               m_ComputeSurfaceDistances;
+  std::vector<BoundaryVoxelListType> m_SourceBoundaryPerThread;
+  std::vector<BoundaryVoxelListType> m_TargetBoundaryPerThread;
+
   SimpleFastMutexLock m_Mutex;
 }; // end of class
 } // end namespace itk
@@ -17,10 +17,202 @@
 #include "itkLabelOverlapMeasuresImageFilter.h"
 
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkProgressReporter.h"
+#include "itkSignedMaurerDistanceMapImageFilter.h"
+#include "antsParallelizeRange.h"
+
+#include <algorithm>
+#include <limits>
 
 namespace itk
 {
+namespace LabelOverlapFunctor
+{
+/** Smallest and largest label of the source and target buffers, per thread,
+ *  for ::ants::ParallelizeRange over buffer offsets. */
+template <class TLabel>
+class LabelRangeFunctor
+{
+public:
+  LabelRangeFunctor( ThreadIdType numberOfThreads ) :
+    m_Source( ITK_NULLPTR ),
+    m_Target( ITK_NULLPTR ),
+    m_Minimum( numberOfThreads, NumericTraits<TLabel>::max() ),
+    m_Maximum( numberOfThreads, NumericTraits<TLabel>::NonpositiveMin() )
+  {
+  }
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType threadId )
+  {
+    TLabel minimum = this->m_Minimum[threadId];
+    TLabel maximum = this->m_Maximum[threadId];
+
+    for( SizeValueType i = begin; i < end; i++ )
+      {
+      minimum = std::min( minimum, std::min( this->m_Source[i], this->m_Target[i] ) );
+      maximum = std::max( maximum, std::max( this->m_Source[i], this->m_Target[i] ) );
+      }
+    this->m_Minimum[threadId] = minimum;
+    this->m_Maximum[threadId] = maximum;
+  }
+
+  const TLabel *      m_Source;
+  const TLabel *      m_Target;
+  std::vector<TLabel> m_Minimum;
+  std::vector<TLabel> m_Maximum;
+};
+
+/** Surface distances of a range of labels, given the boundary voxels of
+ *  both images sorted by label.  Label g has the source boundary voxels
+ *  [m_SourceBegin[g], m_SourceEnd[g]) and likewise for the target.  Each
+ *  directed distance is read from a distance map of the other boundary
+ *  computed over the bounding box of both boundaries of the label only. */
+template <class TLabelImage>
+class SurfaceDistanceFunctor
+{
+public:
+  itkStaticConstMacro( ImageDimension, unsigned int, TLabelImage::ImageDimension );
+
+  typedef typename TLabelImage::PixelType                   LabelType;
+  typedef typename TLabelImage::RegionType                  RegionType;
+  typedef typename TLabelImage::IndexType                   IndexType;
+  typedef std::pair<LabelType, OffsetValueType>             BoundaryVoxelType;
+  typedef Image<unsigned char, TLabelImage::ImageDimension> MaskImageType;
+  typedef Image<float, TLabelImage::ImageDimension>         DistanceImageType;
+
+  SurfaceDistanceFunctor() :
+    m_Image( ITK_NULLPTR ),
+    m_Source( ITK_NULLPTR ),
+    m_Target( ITK_NULLPTR ),
+    m_NumberOfFilterThreads( 1 )
+  {
+  }
+
+  void operator()( SizeValueType begin, SizeValueType end, ThreadIdType )
+  {
+    for( SizeValueType g = begin; g < end; g++ )
+      {
+      const BoundaryVoxelType * sourceBegin = this->m_Source + this->m_SourceBegin[g];
+      const BoundaryVoxelType * sourceEnd = this->m_Source + this->m_SourceEnd[g];
+      const BoundaryVoxelType * targetBegin = this->m_Target + this->m_TargetBegin[g];
+      const BoundaryVoxelType * targetEnd = this->m_Target + this->m_TargetEnd[g];
+      if( sourceBegin == sourceEnd || targetBegin == targetEnd )
+        {
+        this->m_DistanceSum[g] = std::numeric_limits<double>::infinity();
+        this->m_HausdorffDistance[g] = std::numeric_limits<double>::infinity();
+        continue;
+        }
+
+      IndexType lower = this->m_Image->ComputeIndex( sourceBegin->second );
+      IndexType upper = lower;
+      this->ExpandBoundingBox( sourceBegin, sourceEnd, lower, upper );
+      this->ExpandBoundingBox( targetBegin, targetEnd, lower, upper );
+      RegionType box;
+      box.SetIndex( lower );
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        box.SetSize( d, static_cast<SizeValueType>( upper[d] - lower[d] + 1 ) );
+        }
+
+      double sum = 0.0;
+      double maximum = 0.0;
+      this->DirectedDistances( sourceBegin, sourceEnd, targetBegin, targetEnd, box, sum, maximum );
+      this->DirectedDistances( targetBegin, targetEnd, sourceBegin, sourceEnd, box, sum, maximum );
+      this->m_DistanceSum[g] = sum;
+      this->m_HausdorffDistance[g] = maximum;
+      }
+  }
+
+  const TLabelImage *        m_Image;
+  const BoundaryVoxelType *  m_Source;
+  const BoundaryVoxelType *  m_Target;
+  std::vector<SizeValueType> m_SourceBegin;
+  std::vector<SizeValueType> m_SourceEnd;
+  std::vector<SizeValueType> m_TargetBegin;
+  std::vector<SizeValueType> m_TargetEnd;
+  std::vector<double>        m_DistanceSum;
+  std::vector<double>        m_HausdorffDistance;
+  ThreadIdType               m_NumberOfFilterThreads;
+
+private:
+  void ExpandBoundingBox( const BoundaryVoxelType *begin, const BoundaryVoxelType *end,
+                          IndexType & lower, IndexType & upper ) const
+  {
+    for( const BoundaryVoxelType *it = begin; it != end; ++it )
+      {
+      const IndexType index = this->m_Image->ComputeIndex( it->second );
+      for( unsigned int d = 0; d < ImageDimension; d++ )
+        {
+        lower[d] = std::min( lower[d], index[d] );
+        upper[d] = std::max( upper[d], index[d] );
+        }
+      }
+  }
+
+  /** Index relative to the start of box of the voxel at a buffer offset. */
+  IndexType BoxIndex( OffsetValueType offset, const RegionType & box ) const
+  {
+    IndexType index = this->m_Image->ComputeIndex( offset );
+
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      index[d] -= box.GetIndex()[d];
+      }
+    return index;
+  }
+
+  /** Adds the distances from the voxels [from, fromEnd) to the nearest
+   *  voxel of [to, toEnd) to sum and maximum. */
+  void DirectedDistances( const BoundaryVoxelType *from, const BoundaryVoxelType *fromEnd,
+                          const BoundaryVoxelType *to, const BoundaryVoxelType *toEnd,
+                          const RegionType & box, double & sum, double & maximum ) const
+  {
+    if( static_cast<SizeValueType>( toEnd - to ) == box.GetNumberOfPixels() )
+      {
+      // every voxel of the box is a voxel of to
+      return;
+      }
+
+    // the box as an image of its own, starting at index 0
+    typename TLabelImage::PointType origin;
+    this->m_Image->TransformIndexToPhysicalPoint( box.GetIndex(), origin );
+    RegionType region;
+    region.SetSize( box.GetSize() );
+
+    typename MaskImageType::Pointer mask = MaskImageType::New();
+    mask->CopyInformation( this->m_Image );
+    mask->SetOrigin( origin );
+    mask->SetRegions( region );
+    mask->Allocate();
+    mask->FillBuffer( 0 );
+    for( const BoundaryVoxelType *it = to; it != toEnd; ++it )
+      {
+      mask->SetPixel( this->BoxIndex( it->second, box ), 1 );
+      }
+
+    typedef SignedMaurerDistanceMapImageFilter<MaskImageType, DistanceImageType> DistancerType;
+    typename DistancerType::Pointer distancer = DistancerType::New();
+    distancer->SetInput( mask );
+    distancer->SetBackgroundValue( 0 );
+    distancer->SetInsideIsPositive( false );
+    distancer->SetSquaredDistance( false );
+    distancer->SetUseImageSpacing( true );
+    distancer->SetNumberOfThreads( this->m_NumberOfFilterThreads );
+    distancer->Update();
+
+    const DistanceImageType *distance = distancer->GetOutput();
+    for( const BoundaryVoxelType *it = from; it != fromEnd; ++it )
+      {
+      // voxels of to are inside the map and have distance 0
+      const double d = std::max( 0.0, static_cast<double>( distance->GetPixel( this->BoxIndex( it->second, box ) ) ) );
+      sum += d;
+      maximum = std::max( maximum, d );
+      }
+  }
+};
+} // end namespace LabelOverlapFunctor
+
 #if defined(__GNUC__) && (__GNUC__ <= 2) // NOTE: This class needs a mutex for gnu 2.95
 /** Used for mutex locking */
 #define LOCK_HASHMAP this->m_Mutex.Lock()
@@ -36,6 +228,11 @@ LabelOverlapMeasuresImageFilter<TLabelImage>
 {
   // this filter requires two input images
   this->SetNumberOfRequiredInputs( 2 );
+
+  this->m_UseFlatAccumulators = false;
+  this->m_MinimumLabel = NumericTraits<LabelType>::ZeroValue();
+  this->m_NumberOfFlatLabels = 0;
+  this->m_ComputeSurfaceDistances = false;
 }
 
 template <class TLabelImage>
@@ -90,12 +287,68 @@ LabelOverlapMeasuresImageFilter<TLabelImage>
 {
   int numberOfThreads = this->GetNumberOfThreads();
 
+  const LabelImageType *source = this->GetSourceImage();
+  const LabelImageType *target = this->GetTargetImage();
+  if( source->GetBufferedRegion() != target->GetBufferedRegion() )
+    {
+    itkExceptionMacro( << "The source and target images must have the same size." );
+    }
+
+  // Integer labels within a moderate range are counted in flat arrays, at
+  // 3 * 8 bytes per label and thread, instead of a hash map per voxel.
+  const double maximumNumberOfFlatLabels = 1 << 18;
+  this->m_UseFlatAccumulators = false;
+  const SizeValueType numberOfPixels = source->GetBufferedRegion().GetNumberOfPixels();
+  if( NumericTraits<LabelType>::is_integer && numberOfPixels > 0 )
+    {
+    typedef LabelOverlapFunctor::LabelRangeFunctor<LabelType> RangeFunctorType;
+    RangeFunctorType rangeFunctor( ::ants::GetNumberOfThreadsForRange( numberOfPixels, numberOfThreads ) );
+    rangeFunctor.m_Source = source->GetBufferPointer();
+    rangeFunctor.m_Target = target->GetBufferPointer();
+    ::ants::ParallelizeRange( 0, numberOfPixels, rangeFunctor, numberOfThreads );
+
+    LabelType minimum = rangeFunctor.m_Minimum[0];
+    LabelType maximum = rangeFunctor.m_Maximum[0];
+    for( unsigned int n = 1; n < rangeFunctor.m_Minimum.size(); n++ )
+      {
+      minimum = std::min( minimum, rangeFunctor.m_Minimum[n] );
+      maximum = std::max( maximum, rangeFunctor.m_Maximum[n] );
+      }
+    if( static_cast<double>( maximum ) - static_cast<double>( minimum ) < maximumNumberOfFlatLabels )
+      {
+      this->m_UseFlatAccumulators = true;
+      this->m_MinimumLabel = minimum;
+      this->m_NumberOfFlatLabels = static_cast<SizeValueType>( maximum ) - static_cast<SizeValueType>( minimum ) + 1;
+      }
+    }
+
   // Resize the thread temporaries
-  this->m_LabelSetMeasuresPerThread.resize( numberOfThreads );
-  // Initialize the temporaries
-  for( int n = 0; n < numberOfThreads; n++ )
+  if( this->m_UseFlatAccumulators )
+    {
+    this->m_LabelSetMeasuresPerThread.clear();
+    this->m_FlatCountsPerThread.resize( numberOfThreads );
+    for( int n = 0; n < numberOfThreads; n++ )
+      {
+      this->m_FlatCountsPerThread[n].assign( 3 * this->m_NumberOfFlatLabels, 0 );
+      }
+    }
+  else
+    {
+    this->m_FlatCountsPerThread.clear();
+    this->m_LabelSetMeasuresPerThread.resize( numberOfThreads );
+    // Initialize the temporaries
+    for( int n = 0; n < numberOfThreads; n++ )
+      {
+      this->m_LabelSetMeasuresPerThread[n].clear();
+      }
+    }
+
+  this->m_SourceBoundaryPerThread.clear();
+  this->m_TargetBoundaryPerThread.clear();
+  if( this->m_ComputeSurfaceDistances )
     {
-    this->m_LabelSetMeasuresPerThread[n].clear();
+    this->m_SourceBoundaryPerThread.resize( numberOfThreads );
+    this->m_TargetBoundaryPerThread.resize( numberOfThreads );
     }
 
   // Initialize the final map
@@ -107,8 +360,46 @@ void
 LabelOverlapMeasuresImageFilter<TLabelImage>
 ::AfterThreadedGenerateData()
 {
+  typedef typename MapType::value_type MapValueType;
+
+  if( this->m_UseFlatAccumulators )
+    {
+    std::vector<SizeValueType> counts( 3 * this->m_NumberOfFlatLabels, 0 );
+    for( unsigned int n = 0; n < this->m_FlatCountsPerThread.size(); n++ )
+      {
+      for( SizeValueType i = 0; i < counts.size(); i++ )
+        {
+        counts[i] += this->m_FlatCountsPerThread[n][i];
+        }
+      }
+    this->m_FlatCountsPerThread.clear();
+
+    // the other measures follow from the source, target and intersection
+    for( SizeValueType i = 0; i < this->m_NumberOfFlatLabels; i++ )
+      {
+      const SizeValueType sourceCount = counts[3 * i];
+      const SizeValueType targetCount = counts[3 * i + 1];
+      const SizeValueType intersection = counts[3 * i + 2];
+      if( sourceCount == 0 && targetCount == 0 )
+        {
+        continue;
+        }
+      LabelSetMeasures measures;
+      measures.m_Source = sourceCount;
+      measures.m_Target = targetCount;
+      measures.m_Intersection = intersection;
+      measures.m_Union = sourceCount + targetCount - intersection;
+      measures.m_SourceComplement = sourceCount - intersection;
+      measures.m_TargetComplement = targetCount - intersection;
+
+      const LabelType label =
+        static_cast<LabelType>( static_cast<SizeValueType>( this->m_MinimumLabel ) + i );
+      this->m_LabelSetMeasures.insert( MapValueType( label, measures ) );
+      }
+    }
+
   // Run through the map for each thread and accumulate the set measures.
-  for( unsigned int n = 0; n < this->GetNumberOfThreads(); n++ )
+  for( unsigned int n = 0; n < this->m_LabelSetMeasuresPerThread.size(); n++ )
     {
     // iterate over the map for this thread
     for( MapConstIterator threadIt = this->m_LabelSetMeasuresPerThread[n].begin();
@@ -120,7 +411,6 @@ LabelOverlapMeasuresImageFilter<TLabelImage>
       if( mapIt == this->m_LabelSetMeasures.end() )
         {
         // create a new entry
-        typedef typename MapType::value_type MapValueType;
         mapIt = this->m_LabelSetMeasures.insert( MapValueType(
                                                    (*threadIt).first, LabelSetMeasures() ) ).first;
         }
@@ -137,6 +427,11 @@ LabelOverlapMeasuresImageFilter<TLabelImage>
         (*threadIt).second.m_TargetComplement;
       } // end of thread map iterator loop
     }   // end of thread loop
+
+  if( this->m_ComputeSurfaceDistances )
+    {
+    this->ComputeLabelSurfaceDistances();
+    }
 }
 
 template <class TLabelImage>
@@ -153,6 +448,34 @@ LabelOverlapMeasuresImageFilter<TLabelImage>
   // support progress methods/callbacks
   ProgressReporter progress( this, threadId,
                              2 * outputRegionForThread.GetNumberOfPixels() );
+
+  if( this->m_ComputeSurfaceDistances )
+    {
+    this->FindBoundaryVoxels( this->GetSourceImage(), outputRegionForThread,
+                              this->m_SourceBoundaryPerThread[threadId] );
+    this->FindBoundaryVoxels( this->GetTargetImage(), outputRegionForThread,
+                              this->m_TargetBoundaryPerThread[threadId] );
+    }
+
+  if( this->m_UseFlatAccumulators )
+    {
+    SizeValueType *     counts = &( this->m_FlatCountsPerThread[threadId][0] );
+    const SizeValueType minimumLabel = static_cast<SizeValueType>( this->m_MinimumLabel );
+    for( ItS.GoToBegin(), ItT.GoToBegin(); !ItS.IsAtEnd(); ++ItS, ++ItT )
+      {
+      const SizeValueType s = 3 * ( static_cast<SizeValueType>( ItS.Get() ) - minimumLabel );
+      const SizeValueType t = 3 * ( static_cast<SizeValueType>( ItT.Get() ) - minimumLabel );
+      counts[s]++;
+      counts[t + 1]++;
+      if( s == t )
+        {
+        counts[s + 2]++;
+        }
+      progress.CompletedPixel();
+      }
+    return;
+    }
+
   for( ItS.GoToBegin(), ItT.GoToBegin(); !ItS.IsAtEnd(); ++ItS, ++ItT )
     {
     LabelType sourceLabel = ItS.Get();
@@ -205,6 +528,126 @@ LabelOverlapMeasuresImageFilter<TLabelImage>
     }
 }
 
+template <class TLabelImage>
+void
+LabelOverlapMeasuresImageFilter<TLabelImage>
+::FindBoundaryVoxels( const LabelImageType *image, const RegionType & region,
+                      BoundaryVoxelListType & boundary ) const
+{
+  const LabelType *       buffer = image->GetBufferPointer();
+  const OffsetValueType * offsetTable = image->GetOffsetTable();
+  const IndexType         start = image->GetBufferedRegion().GetIndex();
+  const SizeType          size = image->GetBufferedRegion().GetSize();
+
+  ImageRegionConstIteratorWithIndex<LabelImageType> It( image, region );
+  for( It.GoToBegin(); !It.IsAtEnd(); ++It )
+    {
+    const LabelType label = It.Get();
+    if( label == NumericTraits<LabelType>::ZeroValue() )
+      {
+      continue;
+      }
+    const IndexType       index = It.GetIndex();
+    const OffsetValueType offset = image->ComputeOffset( index );
+
+    // the image edge counts as background
+    bool isBoundary = false;
+    for( unsigned int d = 0; d < ImageDimension && !isBoundary; d++ )
+      {
+      isBoundary = index[d] == start[d]
+        || index[d] == start[d] + static_cast<IndexValueType>( size[d] ) - 1
+        || buffer[offset - offsetTable[d]] != label
+        || buffer[offset + offsetTable[d]] != label;
+      }
+    if( isBoundary )
+      {
+      boundary.push_back( BoundaryVoxelType( label, offset ) );
+      }
+    }
+}
+
+template <class TLabelImage>
+void
+LabelOverlapMeasuresImageFilter<TLabelImage>
+::ComputeLabelSurfaceDistances()
+{
+  BoundaryVoxelListType source;
+  BoundaryVoxelListType target;
+
+  for( unsigned int n = 0; n < this->m_SourceBoundaryPerThread.size(); n++ )
+    {
+    source.insert( source.end(), this->m_SourceBoundaryPerThread[n].begin(),
+                   this->m_SourceBoundaryPerThread[n].end() );
+    target.insert( target.end(), this->m_TargetBoundaryPerThread[n].begin(),
+                   this->m_TargetBoundaryPerThread[n].end() );
+    }
+  this->m_SourceBoundaryPerThread.clear();
+  this->m_TargetBoundaryPerThread.clear();
+  std::sort( source.begin(), source.end() );
+  std::sort( target.begin(), target.end() );
+
+  typedef LabelOverlapFunctor::SurfaceDistanceFunctor<LabelImageType> FunctorType;
+  FunctorType functor;
+  functor.m_Image = this->GetSourceImage();
+  functor.m_Source = source.empty() ? ITK_NULLPTR : &source[0];
+  functor.m_Target = target.empty() ? ITK_NULLPTR : &target[0];
+
+  std::vector<MapIterator> labels;
+  for( MapIterator mapIt = this->m_LabelSetMeasures.begin();
+       mapIt != this->m_LabelSetMeasures.end(); ++mapIt )
+    {
+    const LabelType label = (*mapIt).first;
+    if( label == NumericTraits<LabelType>::ZeroValue() )
+      {
+      continue;
+      }
+    const BoundaryVoxelType first( label, NumericTraits<OffsetValueType>::NonpositiveMin() );
+    const BoundaryVoxelType last( label, NumericTraits<OffsetValueType>::max() );
+    functor.m_SourceBegin.push_back( std::lower_bound( source.begin(), source.end(), first ) - source.begin() );
+    functor.m_SourceEnd.push_back( std::upper_bound( source.begin(), source.end(), last ) - source.begin() );
+    functor.m_TargetBegin.push_back( std::lower_bound( target.begin(), target.end(), first ) - target.begin() );
+    functor.m_TargetEnd.push_back( std::upper_bound( target.begin(), target.end(), last ) - target.begin() );
+    labels.push_back( mapIt );
+    }
+  functor.m_DistanceSum.resize( labels.size() );
+  functor.m_HausdorffDistance.resize( labels.size() );
+
+  // many labels are spread over the threads one distance map at a time,
+  // while a few labels use all threads for every distance map
+  const ThreadIdType numberOfThreads = this->GetNumberOfThreads();
+  if( labels.size() >= numberOfThreads )
+    {
+    ::ants::ParallelizeRange( 0, labels.size(), functor, numberOfThreads );
+    }
+  else
+    {
+    functor.m_NumberOfFilterThreads = numberOfThreads;
+    functor( 0, labels.size(), 0 );
+    }
+
+  for( unsigned int g = 0; g < labels.size(); g++ )
+    {
+    LabelSetMeasures & measures = (*labels[g]).second;
+    measures.m_SourceBoundary = functor.m_SourceEnd[g] - functor.m_SourceBegin[g];
+    measures.m_TargetBoundary = functor.m_TargetEnd[g] - functor.m_TargetBegin[g];
+    measures.m_SurfaceDistanceSum = functor.m_DistanceSum[g];
+    measures.m_HausdorffDistance = functor.m_HausdorffDistance[g];
+    }
+}
+
+template <class TLabelImage>
+bool
+LabelOverlapMeasuresImageFilter<TLabelImage>
+::CheckSurfaceDistances() const
+{
+  if( !this->m_ComputeSurfaceDistances )
+    {
+    itkWarningMacro( "Surface distances are only computed with ComputeSurfaceDistances on." );
+    return false;
+    }
+  return true;
+}
+
 /**
  *  measures
  */
@@ -432,12 +875,113 @@ LabelOverlapMeasuresImageFilter<TLabelImage>
   return value;
 }
 
+template <class TLabelImage>
+typename LabelOverlapMeasuresImageFilter<TLabelImage>::RealType
+LabelOverlapMeasuresImageFilter<TLabelImage>
+::GetHausdorffDistance()
+{
+  if( !this->CheckSurfaceDistances() )
+    {
+    return 0.0;
+    }
+
+  RealType value = 0.0;
+  for( MapIterator mapIt = this->m_LabelSetMeasures.begin();
+       mapIt != this->m_LabelSetMeasures.end(); ++mapIt )
+    {
+    // Do not include the background in the final value.
+    if( (*mapIt).first == NumericTraits<LabelType>::ZeroValue() )
+      {
+      continue;
+      }
+    value = std::max( value, static_cast<RealType>( (*mapIt).second.m_HausdorffDistance ) );
+    }
+  return value;
+}
+
+template <class TLabelImage>
+typename LabelOverlapMeasuresImageFilter<TLabelImage>::RealType
+LabelOverlapMeasuresImageFilter<TLabelImage>
+::GetHausdorffDistance( LabelType label )
+{
+  if( !this->CheckSurfaceDistances() )
+    {
+    return 0.0;
+    }
+
+  MapIterator mapIt = this->m_LabelSetMeasures.find( label );
+  if( mapIt == this->m_LabelSetMeasures.end() )
+    {
+    itkWarningMacro( "Label " << label << " not found." );
+    return 0.0;
+    }
+  return static_cast<RealType>( (*mapIt).second.m_HausdorffDistance );
+}
+
+template <class TLabelImage>
+typename LabelOverlapMeasuresImageFilter<TLabelImage>::RealType
+LabelOverlapMeasuresImageFilter<TLabelImage>
+::GetMeanSurfaceDistance()
+{
+  if( !this->CheckSurfaceDistances() )
+    {
+    return 0.0;
+    }
+
+  RealType numerator = 0.0;
+  RealType denominator = 0.0;
+  for( MapIterator mapIt = this->m_LabelSetMeasures.begin();
+       mapIt != this->m_LabelSetMeasures.end(); ++mapIt )
+    {
+    // Do not include the background in the final value.
+    if( (*mapIt).first == NumericTraits<LabelType>::ZeroValue() )
+      {
+      continue;
+      }
+    numerator += static_cast<RealType>( (*mapIt).second.m_SurfaceDistanceSum );
+    denominator += static_cast<RealType>( (*mapIt).second.m_SourceBoundary
+                                          + (*mapIt).second.m_TargetBoundary );
+    }
+  // no boundary voxels means no labels besides the background
+  if( denominator == 0.0 )
+    {
+    return 0.0;
+    }
+  return numerator / denominator;
+}
+
+template <class TLabelImage>
+typename LabelOverlapMeasuresImageFilter<TLabelImage>::RealType
+LabelOverlapMeasuresImageFilter<TLabelImage>
+::GetMeanSurfaceDistance( LabelType label )
+{
+  if( !this->CheckSurfaceDistances() )
+    {
+    return 0.0;
+    }
+
+  MapIterator mapIt = this->m_LabelSetMeasures.find( label );
+  if( mapIt == this->m_LabelSetMeasures.end() )
+    {
+    itkWarningMacro( "Label " << label << " not found." );
+    return 0.0;
+    }
+  const RealType boundary =
+    static_cast<RealType>( (*mapIt).second.m_SourceBoundary + (*mapIt).second.m_TargetBoundary );
+  if( boundary == 0.0 )
+    {
+    return 0.0;
+    }
+  return static_cast<RealType>( (*mapIt).second.m_SurfaceDistanceSum ) / boundary;
+}
+
 template <class TLabelImage>
 void
 LabelOverlapMeasuresImageFilter<TLabelImage>
 ::PrintSelf( std::ostream& os, Indent indent ) const
 {
   Superclass::PrintSelf( os, indent );
+  os << indent << "ComputeSurfaceDistances: " << this->m_ComputeSurfaceDistances << std::endl;
 }
 } // end namespace itk
 #endif
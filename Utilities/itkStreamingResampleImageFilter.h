@@ -0,0 +1,119 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkStreamingResampleImageFilter_h
+#define __itkStreamingResampleImageFilter_h
+
+#include "itkResampleImageFilter.h"
+
+namespace itk
+{
+/** \class StreamingResampleImageFilter
+ * \brief ResampleImageFilter that requests only the part of its input that
+ * the requested output region maps to.
+ *
+ * ResampleImageFilter always requests the whole input, so a streamed
+ * writer downstream bounds the memory of the output but not of the input.
+ * This filter maps a lattice of output voxels of every requested region
+ * through the transform and requests the bounding box of the result, padded
+ * by the interpolation radius.  For a linear transform the corners of the
+ * region are mapped, which is exact; for any other transform the lattice has
+ * SamplingStep voxels between samples and the box is padded accordingly,
+ * which assumes the transform is smooth at that scale.
+ *
+ * The interpolator is given the streamed part of the input as a complete
+ * image, so that interpolators that prefilter their input, such as the
+ * B-spline interpolator, do not pull the whole input through the pipeline.
+ * Near the edge of a piece they see the edge of that piece, not of the
+ * image, which changes B-spline results by a small amount within a few
+ * voxels of piece boundaries.
+ *
+ * With an ImageFileReader as input and an ImageFileWriter with several
+ * stream divisions as output, peak memory is bounded by the size of one
+ * output piece and its input bounding box, provided both file formats can
+ * be streamed.
+ *
+ * \ingroup GeometricTransform
+ */
+template <class TInputImage, class TOutputImage, class TInterpolatorPrecisionType = double,
+          class TTransformPrecisionType = TInterpolatorPrecisionType>
+class StreamingResampleImageFilter :
+  public ResampleImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType, TTransformPrecisionType>
+{
+public:
+  /** Standard class typedefs. */
+  typedef StreamingResampleImageFilter Self;
+  typedef ResampleImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType,
+                              TTransformPrecisionType> Superclass;
+  typedef SmartPointer<Self>       Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro( Self );
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro( StreamingResampleImageFilter, ResampleImageFilter );
+
+  itkStaticConstMacro( ImageDimension, unsigned int, TOutputImage::ImageDimension );
+
+  typedef TInputImage                           InputImageType;
+  typedef TOutputImage                          OutputImageType;
+  typedef typename InputImageType::RegionType   InputImageRegionType;
+  typedef typename OutputImageType::RegionType  OutputImageRegionType;
+  typedef typename Superclass::TransformType    TransformType;
+  typedef typename Superclass::InterpolatorType InterpolatorType;
+  typedef typename Superclass::ExtrapolatorType ExtrapolatorType;
+
+  /** Number of input voxels added on every side of the mapped bounding
+   *  box.  It must cover the support of the interpolator.  Default 4. */
+  itkSetMacro( InterpolationRadius, unsigned int );
+  itkGetConstMacro( InterpolationRadius, unsigned int );
+
+  /** Output voxels between the samples mapped for a nonlinear transform.
+   *  Default 4. */
+  itkSetClampMacro( SamplingStep, unsigned int, 1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( SamplingStep, unsigned int );
+
+  /** The input region that outputRegion maps to, clipped to the input. */
+  InputImageRegionType ComputeInputRegion( const OutputImageRegionType & outputRegion ) const;
+
+protected:
+  StreamingResampleImageFilter();
+  ~StreamingResampleImageFilter()
+  {
+  }
+
+  void PrintSelf( std::ostream & os, Indent indent ) const ITK_OVERRIDE;
+
+  void GenerateInputRequestedRegion() ITK_OVERRIDE;
+
+  void BeforeThreadedGenerateData() ITK_OVERRIDE;
+
+  void AfterThreadedGenerateData() ITK_OVERRIDE;
+
+private:
+  StreamingResampleImageFilter( const Self & ); // purposely not implemented
+  void operator=( const Self & );               // purposely not implemented
+
+  unsigned int                     m_InterpolationRadius;
+  unsigned int                     m_SamplingStep;
+  typename InputImageType::Pointer m_InputPiece;
+};
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkStreamingResampleImageFilter.hxx"
+#endif
+
+#endif
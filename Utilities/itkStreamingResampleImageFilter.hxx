@@ -0,0 +1,194 @@
+/*=========================================================================
+
+  Program:   Advanced Normalization Tools
+
+  Copyright (c) ConsortiumOfANTS. All rights reserved.
+  See accompanying COPYING.txt or
+  https://github.com/stnava/ANTs/blob/master/ANTSCopyright.txt
+  for details.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#ifndef __itkStreamingResampleImageFilter_hxx
+#define __itkStreamingResampleImageFilter_hxx
+
+#include "itkStreamingResampleImageFilter.h"
+#include "itkMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace itk
+{
+template <class TInputImage, class TOutputImage, class TInterpolatorPrecisionType, class TTransformPrecisionType>
+StreamingResampleImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType, TTransformPrecisionType>
+::StreamingResampleImageFilter() :
+  m_InterpolationRadius( 4 ),
+  m_SamplingStep( 4 ),
+  m_InputPiece( ITK_NULLPTR )
+{
+}
+
+template <class TInputImage, class TOutputImage, class TInterpolatorPrecisionType, class TTransformPrecisionType>
+typename StreamingResampleImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType,
+                                      TTransformPrecisionType>::InputImageRegionType
+StreamingResampleImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType, TTransformPrecisionType>
+::ComputeInputRegion( const OutputImageRegionType & outputRegion ) const
+{
+  const InputImageType * input = this->GetInput();
+  const TransformType *  transform = this->GetTransform();
+  const InputImageRegionType largestRegion = input->GetLargestPossibleRegion();
+
+  // the output geometry, without touching the output image
+  typename OutputImageType::Pointer outputGeometry = OutputImageType::New();
+  outputGeometry->SetOrigin( this->GetOutputOrigin() );
+  outputGeometry->SetSpacing( this->GetOutputSpacing() );
+  outputGeometry->SetDirection( this->GetOutputDirection() );
+
+  // lattice of output indices; the last index of every dimension is always
+  // visited, and a linear transform only needs the corners
+  const bool linear = transform->IsLinear();
+  unsigned int step[ImageDimension];
+  double       scale = 1.0;
+  for( unsigned int d = 0; d < ImageDimension; d++ )
+    {
+    const SizeValueType size = outputRegion.GetSize()[d];
+    step[d] = linear ? static_cast<unsigned int>( std::max<SizeValueType>( size - 1, 1 ) ) : this->m_SamplingStep;
+    for( unsigned int e = 0; e < InputImageType::ImageDimension; e++ )
+      {
+      scale = std::max( scale, this->GetOutputSpacing()[d] / input->GetSpacing()[e] );
+      }
+    }
+
+  double lower[InputImageType::ImageDimension];
+  double upper[InputImageType::ImageDimension];
+  for( unsigned int d = 0; d < InputImageType::ImageDimension; d++ )
+    {
+    lower[d] = NumericTraits<double>::max();
+    upper[d] = NumericTraits<double>::NonpositiveMin();
+    }
+
+  typename OutputImageType::IndexType index = outputRegion.GetIndex();
+  bool                                done = outputRegion.GetNumberOfPixels() == 0;
+  while( !done )
+    {
+    typename OutputImageType::PointType outputPoint;
+    outputGeometry->TransformIndexToPhysicalPoint( index, outputPoint );
+    const typename TransformType::OutputPointType inputPoint = transform->TransformPoint( outputPoint );
+    ContinuousIndex<double, InputImageType::ImageDimension> inputIndex;
+    input->TransformPhysicalPointToContinuousIndex( inputPoint, inputIndex );
+    for( unsigned int d = 0; d < InputImageType::ImageDimension; d++ )
+      {
+      if( vnl_math_isfinite( inputIndex[d] ) )
+        {
+        lower[d] = std::min( lower[d], inputIndex[d] );
+        upper[d] = std::max( upper[d], inputIndex[d] );
+        }
+      }
+
+    // next lattice index, clamping to the last index before wrapping
+    done = true;
+    for( unsigned int d = 0; d < ImageDimension; d++ )
+      {
+      const IndexValueType last = outputRegion.GetIndex()[d]
+        + static_cast<IndexValueType>( outputRegion.GetSize()[d] ) - 1;
+      if( index[d] < last )
+        {
+        index[d] = std::min<IndexValueType>( index[d] + step[d], last );
+        done = false;
+        break;
+        }
+      index[d] = outputRegion.GetIndex()[d];
+      }
+    }
+
+  // between lattice samples a smooth transform moves by about step voxels
+  // of the output, i.e. step * scale voxels of the input
+  const double margin = this->m_InterpolationRadius + ( linear ? 1.0 : this->m_SamplingStep * scale );
+
+  InputImageRegionType inputRegion;
+  for( unsigned int d = 0; d < InputImageType::ImageDimension; d++ )
+    {
+    if( lower[d] > upper[d] )
+      {
+      inputRegion = InputImageRegionType();
+      break;
+      }
+    const IndexValueType begin = Math::Floor<IndexValueType>( lower[d] - margin );
+    const IndexValueType end = Math::Ceil<IndexValueType>( upper[d] + margin );
+    inputRegion.SetIndex( d, begin );
+    inputRegion.SetSize( d, static_cast<SizeValueType>( end - begin + 1 ) );
+    }
+  if( inputRegion.GetNumberOfPixels() == 0 || !inputRegion.Crop( largestRegion ) )
+    {
+    // the piece maps outside of the input: one voxel keeps the pipeline
+    // valid, and every output voxel gets the default value
+    inputRegion.SetIndex( largestRegion.GetIndex() );
+    typename InputImageRegionType::SizeType size;
+    size.Fill( 1 );
+    inputRegion.SetSize( size );
+    }
+  return inputRegion;
+}
+
+template <class TInputImage, class TOutputImage, class TInterpolatorPrecisionType, class TTransformPrecisionType>
+void
+StreamingResampleImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType, TTransformPrecisionType>
+::GenerateInputRequestedRegion()
+{
+  // the superclass would request the whole input
+  InputImageType * input = const_cast<InputImageType *>( this->GetInput() );
+
+  if( input == ITK_NULLPTR || this->GetTransform() == ITK_NULLPTR )
+    {
+    return;
+    }
+  input->SetRequestedRegion( this->ComputeInputRegion( this->GetOutput()->GetRequestedRegion() ) );
+}
+
+template <class TInputImage, class TOutputImage, class TInterpolatorPrecisionType, class TTransformPrecisionType>
+void
+StreamingResampleImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType, TTransformPrecisionType>
+::BeforeThreadedGenerateData()
+{
+  // the buffered piece of the input, presented as a complete image that
+  // shares the input's pixels
+  const typename InputImageType::ConstPointer input = this->GetInput();
+  this->m_InputPiece = InputImageType::New();
+  this->m_InputPiece->CopyInformation( input );
+  this->m_InputPiece->SetRegions( input->GetBufferedRegion() );
+  this->m_InputPiece->SetPixelContainer( const_cast<InputImageType *>( input.GetPointer() )->GetPixelContainer() );
+
+  // The superclass checks the interpolator, sets up the default pixel value
+  // and connects its input to the interpolator and extrapolator.  It is
+  // given the piece for that call, because the B-spline interpolator would
+  // pull the whole input through the pipeline to prefilter it.
+  this->SetInput( this->m_InputPiece );
+  Superclass::BeforeThreadedGenerateData();
+  this->SetInput( input );
+}
+
+template <class TInputImage, class TOutputImage, class TInterpolatorPrecisionType, class TTransformPrecisionType>
+void
+StreamingResampleImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType, TTransformPrecisionType>
+::AfterThreadedGenerateData()
+{
+  Superclass::AfterThreadedGenerateData();
+  this->m_InputPiece = ITK_NULLPTR;
+}
+
+template <class TInputImage, class TOutputImage, class TInterpolatorPrecisionType, class TTransformPrecisionType>
+void
+StreamingResampleImageFilter<TInputImage, TOutputImage, TInterpolatorPrecisionType, TTransformPrecisionType>
+::PrintSelf( std::ostream & os, Indent indent ) const
+{
+  Superclass::PrintSelf( os, indent );
+  os << indent << "InterpolationRadius: " << this->m_InterpolationRadius << std::endl;
+  os << indent << "SamplingStep: " << this->m_SamplingStep << std::endl;
+}
+} // end namespace itk
+
+#endif
@@ -9,11 +9,32 @@
 #include "itkTransformFileWriter.h"
 
 #include "itkCompositeTransform.h"
+#include "antsReadCache.h"
 
 namespace itk
 {
 namespace ants
 {
+/** Approximate memory held by a transform, for the read cache. */
+template <class T, unsigned VImageDimension>
+SizeValueType
+GetTransformSize(const itk::Transform<T, VImageDimension, VImageDimension> * transform)
+{
+  typedef typename itk::CompositeTransform<T, VImageDimension> CompositeTransformType;
+
+  const CompositeTransformType *composite = dynamic_cast<const CompositeTransformType *>( transform );
+  if( composite != ITK_NULLPTR )
+    {
+    SizeValueType size = 0;
+    for( SizeValueType n = 0; n < composite->GetNumberOfTransforms(); n++ )
+      {
+      size += GetTransformSize<T, VImageDimension>( composite->GetNthTransform( n ).GetPointer() );
+      }
+    return size;
+    }
+  return ( transform->GetNumberOfParameters() + transform->GetFixedParameters().Size() ) * sizeof( T );
+}
+
 template <class T, unsigned VImageDimension>
 typename itk::Transform<T, VImageDimension, VImageDimension>::Pointer
 ReadTransform(const std::string & filename,
@@ -28,6 +49,20 @@ ReadTransform(const std::string & filename,
     return ITK_NULLPTR;
     }
 
+  typedef typename itk::Transform<T, VImageDimension, VImageDimension> TransformType;
+
+  // a cached transform is cloned, so callers may still modify what they get
+  const std::string cacheKey = ::ants::GetReadCacheKey( filename, typeid( TransformType ) );
+  if( !cacheKey.empty() )
+    {
+    itk::Object::Pointer cached = ::ants::FindInReadCache( cacheKey );
+    const TransformType *cachedTransform = dynamic_cast<const TransformType *>( cached.GetPointer() );
+    if( cachedTransform != ITK_NULLPTR )
+      {
+      return cachedTransform->Clone().GetPointer();
+      }
+    }
+
   bool hasTransformBeenRead = false;
 
   typedef typename itk::DisplacementFieldTransform<T, VImageDimension>      DisplacementFieldTransformType;
@@ -60,7 +95,6 @@ ReadTransform(const std::string & filename,
       }
     }
 
-  typedef typename itk::Transform<T, VImageDimension, VImageDimension> TransformType;
   typename TransformType::Pointer transform;
   if( hasTransformBeenRead )
     {
@@ -124,6 +158,11 @@ ReadTransform(const std::string & filename,
        transform = static_cast<TransformType *>( listOfTransforms->front().GetPointer() );
        }
     }
+  if( !cacheKey.empty() && transform.IsNotNull() )
+    {
+    typename TransformType::Pointer copy = transform->Clone();
+    ::ants::AddToReadCache( cacheKey, copy.GetPointer(), GetTransformSize<T, VImageDimension>( transform.GetPointer() ) );
+    }
   return transform;
 }
 
@@ -142,6 +181,8 @@ WriteTransform(typename itk::Transform<T, VImageDimension, VImageDimension>::Poi
     dynamic_cast<DisplacementFieldTransformType *>(xfrm.GetPointer() );
 
   // if it's a displacement field transform or output file indicates it should be a transform
+  // see ANTSUpdateCompressedImageFileWriter
+  ::ants::RemoveFromReadCache( filename );
   try
     {
     if(  dispXfrm != ITK_NULLPTR 
@@ -217,6 +258,7 @@ WriteTransform(typename itk::Transform<T, VImageDimension, VImageDimension>::Poi
     std::cerr << err << std::endl;
     return EXIT_FAILURE;
     }
+  ::ants::RemoveFromReadCache( filename );
   return EXIT_SUCCESS;
 }
 
@@ -231,6 +273,8 @@ WriteInverseTransform(typename itk::DisplacementFieldTransform<T, VImageDimensio
   typedef itk::TransformFileWriterTemplate<T>                               TransformWriterType;
   
   typename DisplacementFieldType::Pointer inverseDispField = xfrm->GetModifiableInverseDisplacementField();
+  // see ANTSUpdateCompressedImageFileWriter
+  ::ants::RemoveFromReadCache( filename );
   try
     {
       if(    filename.find(".xfm" ) == std::string::npos
@@ -261,6 +305,7 @@ WriteInverseTransform(typename itk::DisplacementFieldTransform<T, VImageDimensio
     std::cerr << err << std::endl;
     return EXIT_FAILURE;
     }
+  ::ants::RemoveFromReadCache( filename );
   return EXIT_SUCCESS;
 }
 